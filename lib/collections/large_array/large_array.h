@@ -0,0 +1,346 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include <lib/collections/vector/vector.h>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace NCollections {
+
+/**
+ * Как просить у ядра большие страницы:
+ * Disabled — обычная куча, Advise — анонимный mmap + madvise(MADV_HUGEPAGE) (прозрачные huge pages),
+ * Explicit — сначала MAP_HUGETLB из заранее выделенного пула, при неудаче — как Advise.
+ */
+enum class EHugePages {
+    Disabled,
+    Advise,
+    Explicit
+};
+
+/**
+ * Выделение больших блоков памяти под huge pages (2 МиБ)
+ *
+ * Блоки меньше MIN_HUGE_ALLOCATION берутся из кучи: выравнивание до 2 МиБ на них
+ * не окупается. Большие блоки округляются до границы huge page и мапятся анонимно;
+ * память приходит обнулённой. На системах без mmap всё уходит в кучу.
+ */
+class TLargeAllocator {
+public:
+    static constexpr size_t HUGE_PAGE_SIZE = size_t(2) << 20;
+    static constexpr size_t MIN_HUGE_ALLOCATION = HUGE_PAGE_SIZE;
+    static constexpr size_t PAGE_SIZE = 4096;
+
+    struct TBlock {
+        void* Data = nullptr;
+        size_t Bytes = 0;
+        bool Mapped = false;
+        bool Huge = false;
+    };
+
+    static EHugePages& DefaultMode() {
+        static EHugePages mode = EHugePages::Advise;
+        return mode;
+    }
+
+    static TBlock Allocate(size_t bytes, EHugePages mode) {
+        TBlock block;
+        if (bytes == 0) return block;
+#if defined(__linux__)
+        if (mode != EHugePages::Disabled && bytes >= MIN_HUGE_ALLOCATION) {
+            size_t rounded = (bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+#if defined(MAP_HUGETLB)
+            if (mode == EHugePages::Explicit) {
+                void* data = mmap(nullptr, rounded, PROT_READ | PROT_WRITE,
+                                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+                if (data != MAP_FAILED) {
+                    block.Data = data;
+                    block.Bytes = rounded;
+                    block.Mapped = true;
+                    block.Huge = true;
+                    return block;
+                }
+            }
+#endif
+            void* data = mmap(nullptr, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (data != MAP_FAILED) {
+                block.Data = data;
+                block.Bytes = rounded;
+                block.Mapped = true;
+#if defined(MADV_HUGEPAGE)
+                block.Huge = madvise(data, rounded, MADV_HUGEPAGE) == 0;
+#endif
+                return block;
+            }
+        }
+#else
+        (void)mode;
+#endif
+        block.Data = ::operator new(bytes);
+        block.Bytes = bytes;
+        std::memset(block.Data, 0, bytes);
+        return block;
+    }
+
+    static void Deallocate(const TBlock& block) {
+        if (!block.Data) return;
+#if defined(__linux__)
+        if (block.Mapped) {
+            munmap(block.Data, block.Bytes);
+            return;
+        }
+#endif
+        ::operator delete(block.Data);
+    }
+};
+
+/**
+ * Плоский массив тривиальных значений поверх TLargeAllocator
+ *
+ * Для больших плоских массивов индекса (длины документов, битовые карты, аккумуляторы скоров):
+ * случайный доступ к ним упирается в TLB, а huge page закрывает 2 МиБ одной записью.
+ * Новые элементы обнуляются. Рост — удвоением с копированием через memcpy.
+ */
+template <typename T>
+class TLargeArray {
+    static_assert(std::is_trivially_copyable<T>::value, "TLargeArray holds trivially copyable values only");
+
+public:
+    using value_type = T;
+    using size_type = size_t;
+    using iterator = T*;
+    using const_iterator = const T*;
+
+    TLargeArray() : Size_(0), Capacity_(0), Mode_(TLargeAllocator::DefaultMode()) {}
+
+    explicit TLargeArray(size_type count, EHugePages mode = TLargeAllocator::DefaultMode())
+        : Size_(0), Capacity_(0), Mode_(mode)
+    {
+        Resize(count);
+    }
+
+    TLargeArray(const TLargeArray& other) : Size_(0), Capacity_(0), Mode_(other.Mode_) {
+        Reserve(other.Size_);
+        if (other.Size_ > 0) {
+            std::memcpy(Data(), other.Data(), other.Size_ * sizeof(T));
+        }
+        Size_ = other.Size_;
+    }
+
+    TLargeArray(TLargeArray&& other) noexcept
+        : Block_(other.Block_), Size_(other.Size_), Capacity_(other.Capacity_), Mode_(other.Mode_)
+    {
+        other.Block_ = TLargeAllocator::TBlock();
+        other.Size_ = 0;
+        other.Capacity_ = 0;
+    }
+
+    TLargeArray& operator=(const TLargeArray& other) {
+        if (this != &other) {
+            TLargeArray copy(other);
+            Swap(copy);
+        }
+        return *this;
+    }
+
+    TLargeArray& operator=(TLargeArray&& other) noexcept {
+        if (this != &other) {
+            TLargeAllocator::Deallocate(Block_);
+            Block_ = other.Block_;
+            Size_ = other.Size_;
+            Capacity_ = other.Capacity_;
+            Mode_ = other.Mode_;
+            other.Block_ = TLargeAllocator::TBlock();
+            other.Size_ = 0;
+            other.Capacity_ = 0;
+        }
+        return *this;
+    }
+
+    ~TLargeArray() {
+        TLargeAllocator::Deallocate(Block_);
+    }
+
+    T& operator[](size_type pos) { return Data()[pos]; }
+    const T& operator[](size_type pos) const { return Data()[pos]; }
+    T& Back() { return Data()[Size_ - 1]; }
+    const T& Back() const { return Data()[Size_ - 1]; }
+
+    T* Data() noexcept { return static_cast<T*>(Block_.Data); }
+    const T* Data() const noexcept { return static_cast<const T*>(Block_.Data); }
+
+    iterator begin() noexcept { return Data(); }
+    const_iterator begin() const noexcept { return Data(); }
+    iterator end() noexcept { return Data() + Size_; }
+    const_iterator end() const noexcept { return Data() + Size_; }
+
+    bool Empty() const noexcept { return Size_ == 0; }
+    size_type Size() const noexcept { return Size_; }
+    size_type Capacity() const noexcept { return Capacity_; }
+    size_type SizeBytes() const noexcept { return Size_ * sizeof(T); }
+
+    /**
+     * true, если блок отдан через mmap и ядро приняло запрос на huge pages.
+     */
+    bool IsHugePageBacked() const noexcept { return Block_.Huge; }
+
+    void Reserve(size_type capacity) {
+        if (capacity <= Capacity_) return;
+        TLargeAllocator::TBlock block = TLargeAllocator::Allocate(capacity * sizeof(T), Mode_);
+        if (Size_ > 0) {
+            std::memcpy(block.Data, Block_.Data, Size_ * sizeof(T));
+        }
+        TLargeAllocator::Deallocate(Block_);
+        Block_ = block;
+        Capacity_ = block.Bytes / sizeof(T);
+    }
+
+    void Resize(size_type count) {
+        if (count > Capacity_) {
+            Reserve(count);
+        }
+        if (count > Size_) {
+            std::memset(static_cast<void*>(Data() + Size_), 0, (count - Size_) * sizeof(T));
+        }
+        Size_ = count;
+    }
+
+    void PushBack(const T& value) {
+        if (Size_ == Capacity_) {
+            Reserve(Capacity_ < 8 ? 8 : Capacity_ * 2);
+        }
+        Data()[Size_++] = value;
+    }
+
+    void Fill(const T& value) {
+        for (size_type i = 0; i < Size_; ++i) {
+            Data()[i] = value;
+        }
+    }
+
+    void Clear() noexcept { Size_ = 0; }
+
+    void Swap(TLargeArray& other) noexcept {
+        std::swap(Block_, other.Block_);
+        std::swap(Size_, other.Size_);
+        std::swap(Capacity_, other.Capacity_);
+        std::swap(Mode_, other.Mode_);
+    }
+
+private:
+    TLargeAllocator::TBlock Block_;
+    size_type Size_;
+    size_type Capacity_;
+    EHugePages Mode_;
+};
+
+/**
+ * Прогрев памяти индекса перед первыми запросами
+ *
+ * Диапазоны делятся между потоками; каждый читает по байту с каждой страницы 4 КиБ.
+ * Это префолтит ещё не тронутые страницы (в т.ч. mmap-блоки TLargeArray) и заполняет TLB/кэш,
+ * так что первые запросы после выкладки не платят за page fault.
+ */
+class TMemoryWarmer {
+public:
+    void AddRange(const void* data, size_t bytes) {
+        if (!data || bytes == 0) return;
+        TRange range;
+        range.Data = static_cast<const unsigned char*>(data);
+        range.Bytes = bytes;
+        Ranges_.PushBack(range);
+        TotalBytes_ += bytes;
+    }
+
+    template <typename TContainer>
+    void AddContainer(const TContainer& container) {
+        AddRange(container.Data(), container.Size() * sizeof(*container.Data()));
+    }
+
+    size_t TotalBytes() const { return TotalBytes_; }
+
+    /**
+     * Возвращает число прочитанных страниц. threads = 0 — по числу ядер.
+     */
+    size_t Run(size_t threads = 0) const {
+        if (Ranges_.Empty()) return 0;
+        if (threads == 0) {
+            threads = std::thread::hardware_concurrency();
+            if (threads == 0) threads = 1;
+        }
+        size_t perThread = (TotalBytes_ + threads - 1) / threads;
+        if (perThread < MIN_BYTES_PER_THREAD) {
+            perThread = MIN_BYTES_PER_THREAD;
+        }
+
+        TVector<size_t> pages(threads, 0);
+        TVector<std::thread> workers;
+        size_t begin = 0;
+        for (size_t t = 0; t < threads && begin < TotalBytes_; ++t) {
+            size_t end = begin + perThread < TotalBytes_ ? begin + perThread : TotalBytes_;
+            workers.PushBack(std::thread([this, begin, end, &pages, t]() {
+                pages[t] = Touch(begin, end);
+            }));
+            begin = end;
+        }
+        for (size_t t = 0; t < workers.Size(); ++t) {
+            workers[t].join();
+        }
+
+        size_t total = 0;
+        for (size_t t = 0; t < pages.Size(); ++t) {
+            total += pages[t];
+        }
+        return total;
+    }
+
+private:
+    static constexpr size_t MIN_BYTES_PER_THREAD = size_t(8) << 20;
+
+    struct TRange {
+        const unsigned char* Data = nullptr;
+        size_t Bytes = 0;
+    };
+
+    /**
+     * Читает страницы в глобальном отрезке [begin, end) склеенных диапазонов.
+     * Страницы отсчитываются от начала каждого диапазона, так что при любом
+     * делении на потоки каждая читается ровно один раз.
+     */
+    size_t Touch(size_t begin, size_t end) const {
+        size_t pages = 0;
+        unsigned char sink = 0;
+        size_t offset = 0;
+        for (size_t r = 0; r < Ranges_.Size() && offset < end; ++r) {
+            const TRange& range = Ranges_[r];
+            size_t rangeEnd = offset + range.Bytes;
+            if (rangeEnd > begin) {
+                size_t from = begin > offset ? begin - offset : 0;
+                from = (from + TLargeAllocator::PAGE_SIZE - 1) & ~(TLargeAllocator::PAGE_SIZE - 1);
+                size_t to = end < rangeEnd ? end - offset : range.Bytes;
+                for (size_t pos = from; pos < to; pos += TLargeAllocator::PAGE_SIZE) {
+                    sink ^= *static_cast<const volatile unsigned char*>(range.Data + pos);
+                    ++pages;
+                }
+            }
+            offset = rangeEnd;
+        }
+        Sink_ = sink;
+        return pages;
+    }
+
+    TVector<TRange> Ranges_;
+    size_t TotalBytes_ = 0;
+    mutable volatile unsigned char Sink_ = 0;
+};
+
+} // namespace NCollections
@@ -0,0 +1,82 @@
+#include <lib/collections/large_array/large_array.h>
+
+#include <gtest/gtest.h>
+
+using namespace NCollections;
+
+TEST(TLargeArray, ResizeZeroFills) {
+    TLargeArray<int> a;
+    a.Resize(10);
+    EXPECT_EQ(a.Size(), 10u);
+    for (size_t i = 0; i < a.Size(); ++i) {
+        EXPECT_EQ(a[i], 0);
+    }
+    a.Fill(7);
+    a.Resize(3);
+    a.Resize(6);
+    EXPECT_EQ(a[2], 7);
+    EXPECT_EQ(a[3], 0);
+}
+
+TEST(TLargeArray, PushBackGrowsAndKeepsValues) {
+    TLargeArray<size_t> a;
+    for (size_t i = 0; i < 1000; ++i) {
+        a.PushBack(i * 3);
+    }
+    ASSERT_EQ(a.Size(), 1000u);
+    for (size_t i = 0; i < a.Size(); ++i) {
+        EXPECT_EQ(a[i], i * 3);
+    }
+    EXPECT_EQ(a.Back(), 999u * 3);
+}
+
+TEST(TLargeArray, CopyMoveSwap) {
+    TLargeArray<int> a(4);
+    a[1] = 5;
+    TLargeArray<int> b(a);
+    b[1] = 6;
+    EXPECT_EQ(a[1], 5);
+
+    TLargeArray<int> c(std::move(b));
+    EXPECT_EQ(c[1], 6);
+    EXPECT_TRUE(b.Empty());
+
+    a.Swap(c);
+    EXPECT_EQ(a[1], 6);
+    EXPECT_EQ(c[1], 5);
+}
+
+TEST(TLargeArray, LargeAllocationIsMappedAndZeroed) {
+    const size_t count = (TLargeAllocator::HUGE_PAGE_SIZE * 3) / sizeof(uint64_t) + 17;
+    TLargeArray<uint64_t> a(count, EHugePages::Advise);
+    ASSERT_EQ(a.Size(), count);
+    EXPECT_GE(a.Capacity(), count);
+    EXPECT_EQ(a[0], 0u);
+    EXPECT_EQ(a[count - 1], 0u);
+    a[count - 1] = 42;
+    EXPECT_EQ(a[count - 1], 42u);
+
+    // Пул MAP_HUGETLB в песочнице обычно пуст — должен сработать откат на обычный mmap
+    TLargeArray<uint64_t> b(count, EHugePages::Explicit);
+    EXPECT_EQ(b[count / 2], 0u);
+
+    TLargeArray<uint64_t> heap(count, EHugePages::Disabled);
+    EXPECT_FALSE(heap.IsHugePageBacked());
+    EXPECT_EQ(heap[count - 1], 0u);
+}
+
+TEST(TMemoryWarmer, TouchesEveryPageOnce) {
+    TLargeArray<unsigned char> a(TLargeAllocator::HUGE_PAGE_SIZE * 8);
+    TVector<int> small(100, 1);
+
+    TMemoryWarmer warmer;
+    warmer.AddContainer(a);
+    warmer.AddContainer(small);
+    warmer.AddRange(nullptr, 100);
+    EXPECT_EQ(warmer.TotalBytes(), a.Size() + small.Size() * sizeof(int));
+
+    size_t expected = a.Size() / TLargeAllocator::PAGE_SIZE + 1;
+    EXPECT_EQ(warmer.Run(1), expected);
+    EXPECT_EQ(warmer.Run(4), expected);
+    EXPECT_EQ(TMemoryWarmer().Run(), 0u);
+}
@@ -145,6 +145,7 @@ public:
     static constexpr size_type DEFAULT_CAPACITY = 16;
     static constexpr float MAX_LOAD_FACTOR = 0.75f;
     static constexpr size_type MAX_PROBE_DISTANCE = 128;
+    static constexpr size_type FIND_MANY_BATCH = 16;
 
 public:
     TUnorderedMap() : Slots_(nullptr), Capacity_(0), Size_(0), Mask_(0), Hash_(), Equal_() { InitSlots(DEFAULT_CAPACITY); }
@@ -320,6 +321,30 @@ public:
         return idx == Capacity_ ? end() : const_iterator(Slots_, idx, Capacity_);
     }
 
+    /**
+     * Пакетный поиск: сначала считаются хеши всей пачки и в кэш заранее подтягиваются
+     * их слоты, затем ключи разрешаются по уже загруженным слотам — промахи по памяти
+     * для разных ключей перекрываются, а не идут друг за другом.
+     * values[i] — указатель на значение keys[i] или nullptr; keys[i] == nullptr пропускается.
+     */
+    void FindMany(const K* const* keys, size_type count, const V** values) const {
+        size_type hashes[FIND_MANY_BATCH];
+        for (size_type start = 0; start < count; start += FIND_MANY_BATCH) {
+            size_type batch = count - start < FIND_MANY_BATCH ? count - start : FIND_MANY_BATCH;
+            for (size_type i = 0; i < batch; ++i) {
+                const K* key = keys[start + i];
+                if (!key) continue;
+                hashes[i] = Hash_(*key);
+                __builtin_prefetch(&Slots_[hashes[i] & Mask_]);
+            }
+            for (size_type i = 0; i < batch; ++i) {
+                const K* key = keys[start + i];
+                size_type idx = key ? FindIndexHashed(*key, hashes[i]) : Capacity_;
+                values[start + i] = idx != Capacity_ ? &Slots_[idx].Value() : nullptr;
+            }
+        }
+    }
+
     bool Contains(const K& key) const { return FindIndex(key) != Capacity_; }
     size_type Count(const K& key) const { return Contains(key) ? 1 : 0; }
 
@@ -354,7 +379,11 @@ private:
 
     size_type FindIndex(const K& key) const {
         if (Capacity_ == 0) return Capacity_;
-        size_type hash = Hash_(key);
+        return FindIndexHashed(key, Hash_(key));
+    }
+
+    size_type FindIndexHashed(const K& key, size_type hash) const {
+        if (Capacity_ == 0) return Capacity_;
         size_type idx = hash & Mask_;
         unsigned char probeDistance = 0;
         
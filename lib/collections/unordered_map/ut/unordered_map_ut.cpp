@@ -212,3 +212,28 @@ TEST(TUnorderedMap, ManyElements) {
     }
 }
 
+
+TEST(TUnorderedMap, FindManyMatchesFind) {
+    TUnorderedMap<int, int> m;
+    for (int i = 0; i < 1000; i += 2) {
+        m[i] = i * 3;
+    }
+    const int count = 40;
+    int keys[count];
+    const int* keyPtrs[count];
+    const int* values[count];
+    for (int i = 0; i < count; ++i) {
+        keys[i] = i * 7;
+        keyPtrs[i] = (i % 10 == 9) ? nullptr : &keys[i];
+    }
+    m.FindMany(keyPtrs, count, values);
+    for (int i = 0; i < count; ++i) {
+        if (!keyPtrs[i] || keys[i] % 2 != 0) {
+            EXPECT_EQ(values[i], nullptr) << i;
+        } else {
+            ASSERT_NE(values[i], nullptr) << i;
+            EXPECT_EQ(*values[i], keys[i] * 3);
+            EXPECT_EQ(values[i], &m.Find(keys[i]).Value());
+        }
+    }
+}
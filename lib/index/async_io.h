@@ -0,0 +1,400 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <lib/collections/vector/vector.h>
+#include <lib/collections/queue/queue.h>
+#include <lib/index/index_io.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define INFO_SEARCH_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+namespace NIndex {
+
+using NCollections::TVector;
+using NCollections::TQueue;
+
+/**
+ * Пакетное асинхронное чтение диапазонов файла.
+ *
+ * IoUring: все чтения пакета уходят в кольцо io_uring (не больше QueueDepth в полёте),
+ * обработчик вызывается в вызывающем потоке по мере завершения, в порядке готовности.
+ * ThreadPool: чтения раздаются Threads потокам с pread, обработчик вызывается в них же,
+ * поэтому распаковка идёт параллельно. Auto — io_uring, если ядро его даёт, иначе потоки.
+ * В обоих случаях обработчик для разных индексов может выполняться одновременно
+ * с другими чтениями и должен трогать только своё.
+ */
+class TAsyncReader {
+public:
+    enum class EBackend {
+        Auto,
+        IoUring,
+        ThreadPool
+    };
+
+    struct TOptions {
+        EBackend Backend = EBackend::Auto;
+        size_t QueueDepth = 64;
+        size_t Threads = 4;
+    };
+
+    struct TRange {
+        uint64_t Offset = 0;
+        size_t Size = 0;
+    };
+
+    TAsyncReader() = default;
+    TAsyncReader(const TAsyncReader&) = delete;
+    TAsyncReader& operator=(const TAsyncReader&) = delete;
+
+    ~TAsyncReader() {
+        Close();
+    }
+
+    /**
+     * false — файл не открылся или явно запрошенный io_uring недоступен.
+     */
+    bool Open(const char* path, const TOptions& options) {
+        Close();
+        Options_ = options;
+        if (Options_.QueueDepth == 0) Options_.QueueDepth = 1;
+        Fd_ = ::open(path, O_RDONLY);
+        if (Fd_ < 0) return false;
+        struct stat info;
+        if (::fstat(Fd_, &info) != 0) {
+            Close();
+            return false;
+        }
+        FileSize_ = static_cast<uint64_t>(info.st_size);
+
+        if (Options_.Backend != EBackend::ThreadPool && SetupRing()) {
+            Backend_ = EBackend::IoUring;
+            return true;
+        }
+        if (Options_.Backend == EBackend::IoUring) {
+            Close();
+            return false;
+        }
+        Backend_ = EBackend::ThreadPool;
+        Stopping_ = false;
+        for (size_t i = 0; i < Options_.Threads; ++i) {
+            Workers_.PushBack(std::thread([this]() { Work(); }));
+        }
+        return true;
+    }
+
+    void Close() {
+        {
+            std::lock_guard<std::mutex> lock(QueueMutex_);
+            Stopping_ = true;
+            QueueReady_.notify_all();
+        }
+        for (size_t i = 0; i < Workers_.Size(); ++i) {
+            Workers_[i].join();
+        }
+        Workers_.Clear();
+        CloseRing();
+        if (Fd_ >= 0) {
+            ::close(Fd_);
+            Fd_ = -1;
+        }
+        FileSize_ = 0;
+        Backend_ = EBackend::Auto;
+    }
+
+    bool IsOpen() const { return Fd_ >= 0; }
+    uint64_t GetFileSize() const { return FileSize_; }
+
+    /**
+     * Фактический механизм после Open: IoUring или ThreadPool.
+     */
+    EBackend GetBackend() const { return Backend_; }
+
+    /**
+     * Читает все диапазоны и для каждого вызывает onRead(index, data, size).
+     * false — хотя бы одно чтение не удалось (для него обработчик не вызывается).
+     */
+    template <typename TOnRead>
+    bool ReadBatch(const TVector<TRange>& ranges, TOnRead&& onRead) {
+        if (ranges.Empty()) return true;
+        if (!IsOpen()) return false;
+        TBatch batch;
+        batch.Ranges = &ranges;
+        batch.Context = &onRead;
+        batch.Callback = [](void* context, size_t index, const unsigned char* data, size_t size) {
+            (*static_cast<typename std::remove_reference<TOnRead>::type*>(context))(index, data, size);
+        };
+        if (Backend_ == EBackend::IoUring) {
+            RunRing(batch);
+        } else {
+            RunPool(batch);
+        }
+        return !batch.Failed.load();
+    }
+
+private:
+    using TCallback = void (*)(void* context, size_t index, const unsigned char* data, size_t size);
+
+    struct TBatch {
+        const TVector<TRange>* Ranges = nullptr;
+        void* Context = nullptr;
+        TCallback Callback = nullptr;
+        size_t Remaining = 0;
+        std::atomic<bool> Failed{false};
+    };
+
+    struct TJob {
+        TBatch* Batch;
+        size_t Index;
+    };
+
+    bool ReadRange(const TRange& range, TByteBuffer* out) const {
+        out->Resize(range.Size);
+        return ReadInto(range.Offset, out->Data(), range.Size);
+    }
+
+    bool ReadInto(uint64_t offset, unsigned char* data, size_t size) const {
+        size_t done = 0;
+        while (done < size) {
+            ssize_t got = ::pread(Fd_, data + done, size - done, static_cast<off_t>(offset + done));
+            if (got <= 0) return false;
+            done += static_cast<size_t>(got);
+        }
+        return true;
+    }
+
+    void Complete(TBatch& batch, size_t index, const TByteBuffer& data, bool ok) {
+        if (ok) {
+            batch.Callback(batch.Context, index, data.Data(), data.Size());
+        } else {
+            batch.Failed.store(true);
+        }
+    }
+
+    void RunPool(TBatch& batch) {
+        const size_t n = batch.Ranges->Size();
+        if (Workers_.Empty() || n == 1) {
+            TByteBuffer data;
+            for (size_t i = 0; i < n; ++i) {
+                Complete(batch, i, data, ReadRange((*batch.Ranges)[i], &data));
+            }
+            return;
+        }
+        std::unique_lock<std::mutex> lock(QueueMutex_);
+        batch.Remaining = n;
+        for (size_t i = 0; i < n; ++i) {
+            Jobs_.Push(TJob{&batch, i});
+        }
+        QueueReady_.notify_all();
+        BatchDone_.wait(lock, [&batch]() { return batch.Remaining == 0; });
+    }
+
+    void Work() {
+        TByteBuffer data;
+        std::unique_lock<std::mutex> lock(QueueMutex_);
+        while (true) {
+            QueueReady_.wait(lock, [this]() { return Stopping_ || !Jobs_.Empty(); });
+            if (Jobs_.Empty()) return;
+            TJob job = Jobs_.Front();
+            Jobs_.Pop();
+            lock.unlock();
+            Complete(*job.Batch, job.Index, data, ReadRange((*job.Batch->Ranges)[job.Index], &data));
+            lock.lock();
+            if (--job.Batch->Remaining == 0) {
+                BatchDone_.notify_all();
+            }
+        }
+    }
+
+#ifdef INFO_SEARCH_IO_URING
+    bool SetupRing() {
+        io_uring_params params = {};
+        int ring = static_cast<int>(::syscall(__NR_io_uring_setup, static_cast<unsigned>(Options_.QueueDepth), &params));
+        if (ring < 0) return false;
+        RingFd_ = ring;
+
+        SqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        CqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single && CqRingSize_ > SqRingSize_) SqRingSize_ = CqRingSize_;
+        SqRing_ = ::mmap(nullptr, SqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, RingFd_, IORING_OFF_SQ_RING);
+        if (SqRing_ == MAP_FAILED) {
+            SqRing_ = nullptr;
+            CloseRing();
+            return false;
+        }
+        CqRing_ = single ? SqRing_ : ::mmap(nullptr, CqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                           RingFd_, IORING_OFF_CQ_RING);
+        SqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = ::mmap(nullptr, SqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, RingFd_, IORING_OFF_SQES);
+        if (CqRing_ == MAP_FAILED || sqes == MAP_FAILED) {
+            if (CqRing_ == MAP_FAILED) CqRing_ = nullptr;
+            if (sqes != MAP_FAILED) ::munmap(sqes, SqesSize_);
+            CloseRing();
+            return false;
+        }
+        Sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+        char* sq = static_cast<char*>(SqRing_);
+        char* cq = static_cast<char*>(CqRing_);
+        SqTail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        SqMask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        SqArray_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        CqHead_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        CqTail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        CqMask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        Cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        RingEntries_ = params.sq_entries;
+        return true;
+    }
+
+    void CloseRing() {
+        if (Sqes_) ::munmap(Sqes_, SqesSize_);
+        if (CqRing_ && CqRing_ != SqRing_) ::munmap(CqRing_, CqRingSize_);
+        if (SqRing_) ::munmap(SqRing_, SqRingSize_);
+        if (RingFd_ >= 0) ::close(RingFd_);
+        Sqes_ = nullptr;
+        SqRing_ = nullptr;
+        CqRing_ = nullptr;
+        RingFd_ = -1;
+        RingBroken_ = false;
+        Orphans_.Clear();
+    }
+
+    /**
+     * Подаёт чтения, пока есть место в кольце, и разбирает завершения; когда подавать
+     * больше нечего или кольцо заполнено, ждёт хотя бы одно. Короткое чтение дочитывается pread. Если кольцо
+     * отказало, недочитанное берётся pread, а буферы чтений в полёте живут до Close.
+     */
+    void RunRing(TBatch& batch) {
+        std::lock_guard<std::mutex> lock(RingMutex_);
+        if (RingBroken_) {
+            RunPool(batch);
+            return;
+        }
+        const TVector<TRange>& ranges = *batch.Ranges;
+        const size_t n = ranges.Size();
+        TVector<TByteBuffer> buffers(n);
+        TVector<bool> done(n, false);
+        size_t prepared = 0;
+        size_t queued = 0;
+        size_t inFlight = 0;
+        while (prepared < n || queued > 0 || inFlight > 0) {
+            unsigned tail = *SqTail_;
+            while (prepared < n && inFlight + queued < RingEntries_) {
+                buffers[prepared].Resize(ranges[prepared].Size);
+                unsigned slot = tail & SqMask_;
+                io_uring_sqe& sqe = Sqes_[slot];
+                sqe = io_uring_sqe();
+                sqe.opcode = IORING_OP_READ;
+                sqe.fd = Fd_;
+                sqe.addr = reinterpret_cast<uint64_t>(buffers[prepared].Data());
+                sqe.len = static_cast<unsigned>(ranges[prepared].Size);
+                sqe.off = ranges[prepared].Offset;
+                sqe.user_data = prepared;
+                SqArray_[slot] = slot;
+                ++tail;
+                ++queued;
+                ++prepared;
+            }
+            __atomic_store_n(SqTail_, tail, __ATOMIC_RELEASE);
+
+            unsigned wait = prepared == n || inFlight + queued >= RingEntries_ ? 1 : 0;
+            int entered = static_cast<int>(::syscall(__NR_io_uring_enter, RingFd_, static_cast<unsigned>(queued), wait,
+                                                     IORING_ENTER_GETEVENTS, nullptr, 0));
+            if (entered >= 0) {
+                queued -= static_cast<size_t>(entered);
+                inFlight += static_cast<size_t>(entered);
+            } else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                RingBroken_ = true;
+                for (size_t i = 0; i < n; ++i) {
+                    if (!done[i]) {
+                        TByteBuffer data;
+                        Complete(batch, i, data, ReadRange(ranges[i], &data));
+                    }
+                }
+                for (size_t i = 0; i < n; ++i) {
+                    if (!done[i]) Orphans_.PushBack(std::move(buffers[i]));
+                }
+                return;
+            }
+
+            unsigned head = *CqHead_;
+            unsigned ready = __atomic_load_n(CqTail_, __ATOMIC_ACQUIRE);
+            while (head != ready) {
+                const io_uring_cqe& cqe = Cqes_[head & CqMask_];
+                size_t index = static_cast<size_t>(cqe.user_data);
+                int result = cqe.res;
+                ++head;
+                __atomic_store_n(CqHead_, head, __ATOMIC_RELEASE);
+                --inFlight;
+
+                TByteBuffer& data = buffers[index];
+                bool ok = result >= 0;
+                if (ok && static_cast<size_t>(result) < data.Size()) {
+                    ok = ReadInto(ranges[index].Offset + result, data.Data() + result, data.Size() - result);
+                }
+                Complete(batch, index, data, ok);
+                done[index] = true;
+                TByteBuffer().Swap(data);
+                ready = __atomic_load_n(CqTail_, __ATOMIC_ACQUIRE);
+            }
+        }
+    }
+#else
+    bool SetupRing() { return false; }
+    void CloseRing() {}
+    void RunRing(TBatch& batch) { RunPool(batch); }
+#endif
+
+    TOptions Options_;
+    EBackend Backend_ = EBackend::Auto;
+    int Fd_ = -1;
+    uint64_t FileSize_ = 0;
+
+    std::mutex QueueMutex_;
+    std::condition_variable QueueReady_;
+    std::condition_variable BatchDone_;
+    TQueue<TJob> Jobs_;
+    TVector<std::thread> Workers_;
+    bool Stopping_ = false;
+
+#ifdef INFO_SEARCH_IO_URING
+    std::mutex RingMutex_;
+    int RingFd_ = -1;
+    void* SqRing_ = nullptr;
+    void* CqRing_ = nullptr;
+    size_t SqRingSize_ = 0;
+    size_t CqRingSize_ = 0;
+    size_t SqesSize_ = 0;
+    io_uring_sqe* Sqes_ = nullptr;
+    io_uring_cqe* Cqes_ = nullptr;
+    unsigned* SqTail_ = nullptr;
+    unsigned* SqArray_ = nullptr;
+    unsigned* CqHead_ = nullptr;
+    unsigned* CqTail_ = nullptr;
+    unsigned SqMask_ = 0;
+    unsigned CqMask_ = 0;
+    unsigned RingEntries_ = 0;
+    bool RingBroken_ = false;
+    TVector<TByteBuffer> Orphans_;
+#endif
+};
+
+} // namespace NIndex
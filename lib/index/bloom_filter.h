@@ -0,0 +1,160 @@
+#pragma once
+
+#include <cstdint>
+
+#include <lib/collections/large_array/large_array.h>
+#include <lib/collections/unordered_map/unordered_map.h>
+#include <lib/index/index_io.h>
+
+namespace NIndex {
+
+using NCollections::TLargeArray;
+
+/**
+ * Блочный фильтр Блума
+ *
+ * Ключ целиком попадает в один блок размером с кэш-линию (8 слов по 64 бита)
+ * и ставит по одному биту в каждом слове блока, поэтому проверка — один промах
+ * по кэшу вместо k. Ответ "нет" точный, "да" ошибается с вероятностью ~1-2% при 10 битах на ключ.
+ * На вход подаётся готовый хеш ключа (TString::Hash), он дополнительно перемешивается.
+ */
+class TBlockedBloomFilter {
+public:
+    static constexpr size_t WORDS_PER_BLOCK = 8;
+    static constexpr size_t BLOCK_BYTES = WORDS_PER_BLOCK * sizeof(uint64_t);
+    static constexpr size_t DEFAULT_BITS_PER_KEY = 10;
+
+    TBlockedBloomFilter() : Blocks_(0), Offset_(0) {}
+
+    TBlockedBloomFilter(const TBlockedBloomFilter& other) : Blocks_(0), Offset_(0) {
+        CopyFrom(other);
+    }
+
+    TBlockedBloomFilter& operator=(const TBlockedBloomFilter& other) {
+        if (this != &other) CopyFrom(other);
+        return *this;
+    }
+
+    void Reset(size_t expectedKeys, size_t bitsPerKey = DEFAULT_BITS_PER_KEY) {
+        size_t bits = expectedKeys * bitsPerKey;
+        Allocate((bits + BLOCK_BYTES * 8 - 1) / (BLOCK_BYTES * 8));
+    }
+
+    void Insert(size_t hash) {
+        uint64_t h = Mix(hash);
+        uint64_t* block = Block(h);
+        uint32_t key = static_cast<uint32_t>(h);
+        for (size_t i = 0; i < WORDS_PER_BLOCK; ++i) {
+            block[i] |= uint64_t(1) << Bit(key, i);
+        }
+    }
+
+    bool MayContain(size_t hash) const {
+        if (Blocks_ == 0) return true;
+        uint64_t h = Mix(hash);
+        const uint64_t* block = Block(h);
+        uint32_t key = static_cast<uint32_t>(h);
+        for (size_t i = 0; i < WORDS_PER_BLOCK; ++i) {
+            if (!(block[i] & (uint64_t(1) << Bit(key, i)))) return false;
+        }
+        return true;
+    }
+
+    bool Empty() const { return Blocks_ == 0; }
+    size_t SizeBytes() const { return Blocks_ * BLOCK_BYTES; }
+    const uint64_t* Data() const { return Blocks_ ? Words() : nullptr; }
+
+    void Clear() {
+        TLargeArray<uint64_t>().Swap(Storage_);
+        Blocks_ = 0;
+        Offset_ = 0;
+    }
+
+    void Save(TBinaryWriter& writer) const {
+        writer.WriteVarint(Blocks_);
+        const uint64_t* words = Words();
+        for (size_t i = 0; i < Blocks_ * WORDS_PER_BLOCK; ++i) {
+            writer.WriteU64(words[i]);
+        }
+    }
+
+    bool Load(TBinaryReader& reader) {
+        size_t blocks = reader.ReadCount(BLOCK_BYTES);
+        if (blocks == 0) {
+            Clear();
+            return reader.Ok();
+        }
+        Allocate(blocks);
+        uint64_t* words = Words();
+        for (size_t i = 0; i < blocks * WORDS_PER_BLOCK && reader.Ok(); ++i) {
+            words[i] = reader.ReadU64();
+        }
+        if (!reader.Ok()) {
+            Clear();
+            return false;
+        }
+        return true;
+    }
+
+private:
+    static constexpr uint32_t SALTS[WORDS_PER_BLOCK] = {
+        0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+        0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+    };
+
+    static uint64_t Mix(uint64_t h) {
+        return NCollections::THash<uint64_t>()(h);
+    }
+
+    static size_t Bit(uint32_t key, size_t word) {
+        return static_cast<size_t>((key * SALTS[word]) >> 26);
+    }
+
+    /**
+     * Номер блока — старшие 32 бита хеша, сжатые в [0, Blocks_) умножением (без деления).
+     */
+    uint64_t* Block(uint64_t h) {
+        size_t index = static_cast<size_t>(((h >> 32) * static_cast<uint64_t>(Blocks_)) >> 32);
+        return Words() + index * WORDS_PER_BLOCK;
+    }
+
+    const uint64_t* Block(uint64_t h) const {
+        return const_cast<TBlockedBloomFilter*>(this)->Block(h);
+    }
+
+    /**
+     * Хранилище выделяется с запасом в один блок, чтобы начало первого блока
+     * было выровнено по кэш-линии. Большой фильтр ложится на huge pages: пробы
+     * случайны по всему массиву, и с 4 КиБ страницами каждая стоит промаха TLB.
+     */
+    void Allocate(size_t blocks) {
+        if (blocks == 0) blocks = 1;
+        Blocks_ = blocks;
+        TLargeArray<uint64_t>((blocks + 1) * WORDS_PER_BLOCK).Swap(Storage_);
+        uintptr_t address = reinterpret_cast<uintptr_t>(Storage_.Data());
+        uintptr_t aligned = (address + BLOCK_BYTES - 1) & ~static_cast<uintptr_t>(BLOCK_BYTES - 1);
+        Offset_ = (aligned - address) / sizeof(uint64_t);
+    }
+
+    void CopyFrom(const TBlockedBloomFilter& other) {
+        if (other.Blocks_ == 0) {
+            Clear();
+            return;
+        }
+        Allocate(other.Blocks_);
+        const uint64_t* source = other.Words();
+        uint64_t* target = Words();
+        for (size_t i = 0; i < Blocks_ * WORDS_PER_BLOCK; ++i) {
+            target[i] = source[i];
+        }
+    }
+
+    uint64_t* Words() { return Storage_.Data() + Offset_; }
+    const uint64_t* Words() const { return Storage_.Data() + Offset_; }
+
+    TLargeArray<uint64_t> Storage_;
+    size_t Blocks_;
+    size_t Offset_;
+};
+
+} // namespace NIndex
@@ -2,26 +2,53 @@
 
 #include <lib/types/string/string.h>
 #include <lib/collections/vector/vector.h>
+#include <lib/collections/large_array/large_array.h>
 #include <lib/collections/unordered_map/unordered_map.h>
 #include <lib/collections/unordered_set/unordered_set.h>
+#include <lib/index/posting_ops.h>
+#include <lib/index/index_io.h>
+#include <lib/index/math.h>
+#include <lib/index/bloom_filter.h>
+#include <lib/index/cardinality.h>
+#include <lib/index/scoring.h>
 
 namespace NIndex {
 
 using NTypes::TString;
 using NCollections::TVector;
+using NCollections::TLargeArray;
+using NCollections::TMemoryWarmer;
 using NCollections::TUnorderedMap;
 using NCollections::TUnorderedSet;
 using NCollections::TStringHash;
 
-using TDocId = size_t;
-using TPostingList = TVector<TDocId>;
+/**
+ * Постинги терма: отсортированные id документов и параллельный массив частот.
+ * PrunedCount — сколько постингов выброшено статическим прунингом: df терма
+ * (а значит и IDF) считается по исходному списку.
+ * Sketch заполнен только у частых термов (см. TInvertedIndex::BuildSketches).
+ * Impacts — квантованные вклады постингов, параллельно Docs (см. TInvertedIndex::BuildImpacts).
+ */
+struct TTermPostings {
+    TPostingList Docs;
+    TVector<TTermFreq> Freqs;
+    size_t PrunedCount = 0;
+    THyperLogLog Sketch;
+    TVector<unsigned char> Impacts;
+};
 
 /**
  * Инвертированный индекс для булева поиска
+ *
+ * Документ сначала сворачивается в гистограмму термов (переиспользуемую в пределах потока),
+ * после чего каждый глобальный список постингов трогается ровно один раз на уникальный терм.
  */
 class TInvertedIndex {
 public:
-    TInvertedIndex() : NextDocId_(0) {}
+    static constexpr size_t SKETCH_MIN_DOC_FREQUENCY = 1024;
+    static constexpr double IMPACT_LEVELS = 255;
+
+    TInvertedIndex() : TotalLength_(0), ImpactScale_(0), NextDocId_(0) {}
 
     TDocId AddDocument(const TVector<TString>& terms) {
         return AddDocument(terms.begin(), terms.end());
@@ -35,15 +62,27 @@ public:
     TDocId AddDocument(InputIt first, InputIt last) {
         TDocId docId = NextDocId_++;
 
+        THistogram& histogram = LocalHistogram();
+
         size_t termCount = 0;
         for (auto it = first; it != last; ++it) {
             TString term = *it;
-            AddTermToIndex(term, docId);
-            IncrementTermFrequency(docId, term);
+            auto h = histogram.Find(term);
+            if (h != histogram.end()) {
+                ++h.Value();
+            } else {
+                histogram.Insert(std::move(term), TTermFreq(1));
+            }
             ++termCount;
         }
 
-        DocTermCounts_.Insert(docId, termCount);
+        for (auto h = histogram.begin(); h != histogram.end(); ++h) {
+            AppendPosting(h.Key(), docId, h.Value());
+        }
+
+        DocLengths_.PushBack(termCount);
+        TotalLength_ += termCount;
+        ImpactScale_ = 0;
         return docId;
     }
 
@@ -55,40 +94,59 @@ public:
     }
 
     const TPostingList& GetPostingList(const TString& term) const {
-        static const TPostingList empty;
-        auto it = Index_.Find(term);
-        if (it != Index_.end()) {
-            return it.Value();
-        }
-        return empty;
+        return GetTermPostings(term).Docs;
+    }
+
+    const TTermPostings& GetTermPostings(const TString& term) const {
+        static const TTermPostings empty;
+        const TTermPostings* postings = FindTerm(term);
+        return postings ? *postings : empty;
     }
 
     bool ContainsTerm(const TString& term) const {
-        return Index_.Contains(term);
+        return FindTerm(term) != nullptr;
     }
 
     size_t GetDocumentFrequency(const TString& term) const {
-        auto it = Index_.Find(term);
-        if (it != Index_.end()) {
-            return it.Value().Size();
+        const TTermPostings* postings = FindTerm(term);
+        if (postings) {
+            return postings->Docs.Size() + postings->PrunedCount;
         }
         return 0;
     }
 
+    size_t GetPostingCount() const {
+        size_t total = 0;
+        for (auto it = Index_.begin(); it != Index_.end(); ++it) {
+            total += it.Value().Docs.Size();
+        }
+        return total;
+    }
+
     size_t GetTermFrequency(TDocId docId, const TString& term) const {
-        auto docIt = TermFrequencies_.Find(docId);
-        if (docIt == TermFrequencies_.end()) return 0;
-        
-        auto termIt = docIt.Value().Find(term);
-        if (termIt == docIt.Value().end()) return 0;
-        
-        return termIt.Value();
+        const TTermPostings* found = FindTerm(term);
+        if (!found) return 0;
+
+        const TTermPostings& postings = *found;
+        size_t lo = 0;
+        size_t hi = postings.Docs.Size();
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (postings.Docs[mid] < docId) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if (lo < postings.Docs.Size() && postings.Docs[lo] == docId) {
+            return postings.Freqs[lo];
+        }
+        return 0;
     }
 
     size_t GetDocumentLength(TDocId docId) const {
-        auto it = DocTermCounts_.Find(docId);
-        if (it != DocTermCounts_.end()) {
-            return it.Value();
+        if (docId < DocLengths_.Size()) {
+            return DocLengths_[docId];
         }
         return 0;
     }
@@ -98,11 +156,7 @@ public:
 
     double GetAverageDocumentLength() const {
         if (NextDocId_ == 0) return 0;
-        size_t total = 0;
-        for (auto it = DocTermCounts_.begin(); it != DocTermCounts_.end(); ++it) {
-            total += it.Value();
-        }
-        return static_cast<double>(total) / NextDocId_;
+        return static_cast<double>(TotalLength_) / NextDocId_;
     }
 
     TString GetDocument(TDocId docId) const {
@@ -129,49 +183,444 @@ public:
         return result;
     }
 
+    /**
+     * Строит фильтр Блума по словарю: запросы с отсутствующими термами (опечатки,
+     * редкие слова) отсекаются до пробы хеш-таблицы. Размер берётся с запасом вдвое:
+     * новые термы, добавленные позже, дописываются в фильтр. Термы, удалённые прунингом,
+     * остаются в нём ложными срабатываниями.
+     */
+    void BuildTermFilter(size_t bitsPerKey = TBlockedBloomFilter::DEFAULT_BITS_PER_KEY) {
+        TermFilter_.Reset(Index_.Size() * 2, bitsPerKey);
+        for (auto it = Index_.begin(); it != Index_.end(); ++it) {
+            TermFilter_.Insert(it.Key().Hash());
+        }
+    }
+
+    const TBlockedBloomFilter& GetTermFilter() const { return TermFilter_; }
+
+    /**
+     * Регистрирует для прогрева массивы, которые читаются на горячем пути запроса:
+     * постинги и частоты всех термов, длины документов, фильтр словаря.
+     */
+    void AddWarmupRanges(TMemoryWarmer& warmer) const {
+        for (auto it = Index_.begin(); it != Index_.end(); ++it) {
+            warmer.AddContainer(it.Value().Docs);
+            warmer.AddContainer(it.Value().Freqs);
+        }
+        warmer.AddContainer(DocLengths_);
+        warmer.AddRange(TermFilter_.Data(), TermFilter_.SizeBytes());
+    }
+
+    /**
+     * HyperLogLog-скетчи для термов с df >= minDocFrequency. Редкие термы скетча не получают:
+     * при оценке их постинги добавляются во временный скетч напрямую, это дешевле хранения.
+     * Скетчи строятся по текущим id, поэтому Remap их сбрасывает.
+     */
+    void BuildSketches(size_t minDocFrequency = SKETCH_MIN_DOC_FREQUENCY) {
+        for (auto it = Index_.begin(); it != Index_.end(); ++it) {
+            TTermPostings& postings = it.Value();
+            postings.Sketch.Clear();
+            if (postings.Docs.Size() >= minDocFrequency) {
+                postings.Sketch.AddAll(postings.Docs);
+            }
+        }
+    }
+
+    /**
+     * Оценка |A1 ∪ ... ∪ Ak|: объединение скетчей, зажатое между max |Ai| и суммой длин.
+     */
+    size_t EstimateUnion(const TVector<const TTermPostings*>& terms) const {
+        THyperLogLog merged;
+        size_t largest = 0;
+        size_t total = 0;
+        for (size_t i = 0; i < terms.Size(); ++i) {
+            const TTermPostings* postings = terms[i];
+            if (!postings || postings->Docs.Empty()) continue;
+            size_t size = postings->Docs.Size();
+            total += size;
+            if (size > largest) largest = size;
+            if (!postings->Sketch.Empty()) {
+                merged.Merge(postings->Sketch);
+            } else {
+                merged.AddAll(postings->Docs);
+            }
+        }
+        if (total == 0) return 0;
+        size_t estimate = static_cast<size_t>(merged.Estimate() + 0.5);
+        if (estimate < largest) return largest;
+        if (estimate > total) return total;
+        return estimate;
+    }
+
+    /**
+     * Постинги нескольких термов за один пакетный проход по словарю (FindMany с префетчем
+     * слотов); nullptr для отсутствующих. Термы, отсечённые фильтром, в таблицу не идут.
+     */
+    TVector<const TTermPostings*> FindTerms(const TVector<TString>& terms) const {
+        TVector<const TString*> keys(terms.Size(), nullptr);
+        for (size_t i = 0; i < terms.Size(); ++i) {
+            if (TermFilter_.MayContain(terms[i].Hash())) {
+                keys[i] = &terms[i];
+            }
+        }
+        TVector<const TTermPostings*> result(terms.Size(), nullptr);
+        Index_.FindMany(keys.Data(), keys.Size(), result.Data());
+        return result;
+    }
+
+    const TLargeArray<size_t>& GetDocumentLengths() const { return DocLengths_; }
+
+    /**
+     * Квантует TF-IDF-вклад каждого постинга в байт 1..255 относительно наибольшего вклада
+     * по индексу (TImpactScorer). Любое изменение индекса делает импакты недействительными
+     * (HasImpacts() == false), после него их нужно перестроить.
+     */
+    void BuildImpacts() {
+        TTfIdfScorer scorer(NextDocId_, DocLengths_.Data());
+        double maxImpact = 0;
+        for (auto it = Index_.begin(); it != Index_.end(); ++it) {
+            const TTermPostings& postings = it.Value();
+            TTfIdfScorer::TTerm term = scorer.Prepare(postings);
+            for (size_t j = 0; j < postings.Docs.Size(); ++j) {
+                double impact = scorer.Score(term, j, postings.Docs[j]);
+                if (impact > maxImpact) maxImpact = impact;
+            }
+        }
+
+        ImpactScale_ = maxImpact / IMPACT_LEVELS;
+        for (auto it = Index_.begin(); it != Index_.end(); ++it) {
+            TTermPostings& postings = it.Value();
+            postings.Impacts.Clear();
+            if (ImpactScale_ <= 0) continue;
+            TTfIdfScorer::TTerm term = scorer.Prepare(postings);
+            postings.Impacts.Resize(postings.Docs.Size());
+            for (size_t j = 0; j < postings.Docs.Size(); ++j) {
+                double level = scorer.Score(term, j, postings.Docs[j]) / ImpactScale_ + 0.5;
+                if (level < 1) level = 1;
+                if (level > IMPACT_LEVELS) level = IMPACT_LEVELS;
+                postings.Impacts[j] = static_cast<unsigned char>(level);
+            }
+        }
+    }
+
+    bool HasImpacts() const { return ImpactScale_ > 0; }
+    double GetImpactScale() const { return ImpactScale_; }
+
+    /**
+     * Есть ли скетч хотя бы у одного терма. Без скетчей оценка стоит столько же,
+     * сколько само объединение, и планировщик обходится суммой длин.
+     */
+    static bool HasSketches(const TVector<const TTermPostings*>& terms) {
+        for (size_t i = 0; i < terms.Size(); ++i) {
+            if (terms[i] && !terms[i]->Sketch.Empty()) return true;
+        }
+        return false;
+    }
+
+    size_t EstimateUnion(const TVector<TString>& terms) const {
+        return EstimateUnion(FindTerms(terms));
+    }
+
+    /**
+     * Оценка |A1 ∩ ... ∩ Ak|. Для пары — включение-исключение по скетчам;
+     * для k списков доли вхождения самого короткого в остальные перемножаются
+     * (предположение о независимости), результат не больше длины самого короткого.
+     */
+    size_t EstimateIntersection(const TVector<const TTermPostings*>& terms) const {
+        if (terms.Empty()) return 0;
+        const TTermPostings* smallest = nullptr;
+        for (size_t i = 0; i < terms.Size(); ++i) {
+            if (!terms[i] || terms[i]->Docs.Empty()) return 0;
+            if (!smallest || terms[i]->Docs.Size() < smallest->Docs.Size()) {
+                smallest = terms[i];
+            }
+        }
+        double estimate = static_cast<double>(smallest->Docs.Size());
+        for (size_t i = 0; i < terms.Size(); ++i) {
+            if (terms[i] == smallest) continue;
+            TVector<const TTermPostings*> pair;
+            pair.PushBack(smallest);
+            pair.PushBack(terms[i]);
+            double a = static_cast<double>(smallest->Docs.Size());
+            double b = static_cast<double>(terms[i]->Docs.Size());
+            double both = a + b - static_cast<double>(EstimateUnion(pair));
+            if (both < 0) both = 0;
+            estimate *= both / a;
+        }
+        return static_cast<size_t>(estimate + 0.5);
+    }
+
+    size_t EstimateIntersection(const TVector<TString>& terms) const {
+        return EstimateIntersection(FindTerms(terms));
+    }
+
+    template <typename Func>
+    void ForEachTerm(Func&& func) const {
+        for (auto it = Index_.begin(); it != Index_.end(); ++it) {
+            func(it.Key(), it.Value());
+        }
+    }
+
+    /**
+     * Перенумеровывает документы по перестановке newIdOf[old] = new.
+     * Постинги перестраиваются через прямой индекс за O(P) и остаются отсортированными.
+     */
+    void Remap(const TVector<TDocId>& newIdOf) {
+        size_t n = NextDocId_;
+        if (newIdOf.Size() != n) throw "Remap permutation size mismatch";
+
+        TVector<TTermPostings*> terms;
+        terms.Reserve(Index_.Size());
+        for (auto it = Index_.begin(); it != Index_.end(); ++it) {
+            terms.PushBack(&it.Value());
+        }
+
+        TVector<size_t> offsets(n + 1, 0);
+        for (size_t t = 0; t < terms.Size(); ++t) {
+            const TPostingList& docs = terms[t]->Docs;
+            for (size_t i = 0; i < docs.Size(); ++i) {
+                ++offsets[docs[i] + 1];
+            }
+        }
+        for (size_t d = 0; d < n; ++d) {
+            offsets[d + 1] += offsets[d];
+        }
+
+        TVector<size_t> fill(offsets);
+        TVector<size_t> forwardTerms(offsets[n]);
+        TVector<TTermFreq> forwardFreqs(offsets[n]);
+        for (size_t t = 0; t < terms.Size(); ++t) {
+            TTermPostings& postings = *terms[t];
+            for (size_t i = 0; i < postings.Docs.Size(); ++i) {
+                size_t slot = fill[postings.Docs[i]]++;
+                forwardTerms[slot] = t;
+                forwardFreqs[slot] = postings.Freqs[i];
+            }
+            postings.Docs.Clear();
+            postings.Freqs.Clear();
+        }
+
+        TVector<TDocId> oldIdOf(n);
+        for (size_t d = 0; d < n; ++d) {
+            oldIdOf[newIdOf[d]] = static_cast<TDocId>(d);
+        }
+        for (size_t t = 0; t < terms.Size(); ++t) {
+            terms[t]->Sketch.Clear();
+            terms[t]->Impacts.Clear();
+        }
+        ImpactScale_ = 0;
+
+        TLargeArray<size_t> lengths(n);
+        for (size_t newId = 0; newId < n; ++newId) {
+            TDocId oldId = oldIdOf[newId];
+            for (size_t slot = offsets[oldId]; slot < offsets[oldId + 1]; ++slot) {
+                TTermPostings& postings = *terms[forwardTerms[slot]];
+                postings.Docs.PushBack(static_cast<TDocId>(newId));
+                postings.Freqs.PushBack(forwardFreqs[slot]);
+            }
+            lengths[newId] = DocLengths_[oldId];
+        }
+        DocLengths_.Swap(lengths);
+
+        TUnorderedMap<TDocId, TString> documents;
+        for (auto it = Documents_.begin(); it != Documents_.end(); ++it) {
+            documents.Insert(TDocId(newIdOf[it.Key()]), std::move(it.Value()));
+        }
+        Documents_.Swap(documents);
+    }
+
+    /**
+     * Статический прунинг: keep(term, postings, i) решает, остаётся ли i-й постинг терма.
+     * Термы обходятся в том же порядке, что и в ForEachTerm. Терм, у которого не осталось
+     * постингов, удаляется из словаря. Возвращает число выброшенных постингов.
+     */
+    template <typename Func>
+    size_t RetainPostings(Func&& keep) {
+        size_t removed = 0;
+        TVector<TString> emptied;
+        for (auto it = Index_.begin(); it != Index_.end(); ++it) {
+            TTermPostings& postings = it.Value();
+            size_t out = 0;
+            for (size_t i = 0; i < postings.Docs.Size(); ++i) {
+                if (keep(it.Key(), static_cast<const TTermPostings&>(postings), i)) {
+                    postings.Docs[out] = postings.Docs[i];
+                    postings.Freqs[out] = postings.Freqs[i];
+                    ++out;
+                }
+            }
+            size_t dropped = postings.Docs.Size() - out;
+            if (dropped == 0) continue;
+            removed += dropped;
+            postings.PrunedCount += dropped;
+            postings.Docs.Resize(out);
+            postings.Freqs.Resize(out);
+            postings.Docs.ShrinkToFit();
+            postings.Freqs.ShrinkToFit();
+            if (!postings.Sketch.Empty()) {
+                postings.Sketch.Clear();
+                postings.Sketch.AddAll(postings.Docs);
+            }
+            if (out == 0) {
+                emptied.PushBack(it.Key());
+            }
+        }
+        for (size_t i = 0; i < emptied.Size(); ++i) {
+            Index_.Erase(emptied[i]);
+        }
+        if (removed > 0) {
+            ImpactScale_ = 0;
+        }
+        return removed;
+    }
+
+    /**
+     * Бинарный образ: длины документов, затем словарь с дельта-varint постингами.
+     */
+    void Save(TBinaryWriter& writer) const {
+        writer.WriteVarint(NextDocId_);
+        for (size_t d = 0; d < DocLengths_.Size(); ++d) {
+            writer.WriteVarint(DocLengths_[d]);
+        }
+
+        writer.WriteVarint(Index_.Size());
+        for (auto it = Index_.begin(); it != Index_.end(); ++it) {
+            const TTermPostings& postings = it.Value();
+            writer.WriteString(it.Key());
+            writer.WriteVarint(postings.PrunedCount);
+            writer.WriteVarint(postings.Docs.Size());
+            TDocId prev = 0;
+            for (size_t i = 0; i < postings.Docs.Size(); ++i) {
+                writer.WriteVarint(postings.Docs[i] - prev);
+                prev = postings.Docs[i];
+            }
+            for (size_t i = 0; i < postings.Freqs.Size(); ++i) {
+                writer.WriteVarint(postings.Freqs[i]);
+            }
+            postings.Sketch.Save(writer);
+        }
+
+        writer.WriteVarint(Documents_.Size());
+        for (auto it = Documents_.begin(); it != Documents_.end(); ++it) {
+            writer.WriteVarint(it.Key());
+            writer.WriteString(it.Value());
+        }
+
+        TermFilter_.Save(writer);
+    }
+
+    bool Load(TBinaryReader& reader) {
+        Clear();
+        size_t docCount = reader.ReadCount();
+        DocLengths_.Reserve(docCount);
+        for (size_t d = 0; d < docCount && reader.Ok(); ++d) {
+            DocLengths_.PushBack(static_cast<size_t>(reader.ReadVarint()));
+            TotalLength_ += DocLengths_.Back();
+        }
+        NextDocId_ = static_cast<TDocId>(docCount);
+
+        size_t termCount = reader.ReadCount();
+        for (size_t t = 0; t < termCount && reader.Ok(); ++t) {
+            TString term = reader.ReadString();
+            TTermPostings postings;
+            postings.PrunedCount = static_cast<size_t>(reader.ReadVarint());
+            size_t count = reader.ReadCount();
+            postings.Docs.Reserve(count);
+            postings.Freqs.Reserve(count);
+            uint64_t doc = 0;
+            for (size_t i = 0; i < count && reader.Ok(); ++i) {
+                uint64_t delta = reader.ReadVarint();
+                if (i > 0 && delta == 0) return Fail();
+                doc += delta;
+                if (doc >= docCount) return Fail();
+                postings.Docs.PushBack(static_cast<TDocId>(doc));
+            }
+            for (size_t i = 0; i < count && reader.Ok(); ++i) {
+                postings.Freqs.PushBack(static_cast<TTermFreq>(reader.ReadVarint()));
+            }
+            if (!postings.Sketch.Load(reader)) return Fail();
+            Index_.Insert(std::move(term), std::move(postings));
+        }
+
+        size_t stored = reader.ReadCount();
+        for (size_t i = 0; i < stored && reader.Ok(); ++i) {
+            uint64_t docId = reader.ReadVarint();
+            TString content = reader.ReadString();
+            if (docId >= docCount) return Fail();
+            Documents_.Insert(static_cast<TDocId>(docId), std::move(content));
+        }
+
+        if (!reader.Ok() || !TermFilter_.Load(reader)) return Fail();
+        return true;
+    }
+
     void Clear() {
         Index_.Clear();
         Documents_.Clear();
-        TermFrequencies_.Clear();
-        DocTermCounts_.Clear();
+        DocLengths_.Clear();
+        TermFilter_.Clear();
+        TotalLength_ = 0;
+        ImpactScale_ = 0;
         NextDocId_ = 0;
     }
 
 private:
-    void AddTermToIndex(const TString& term, TDocId docId) {
+    const TTermPostings* FindTerm(const TString& term) const {
+        if (!TermFilter_.MayContain(term.Hash())) return nullptr;
         auto it = Index_.Find(term);
-        if (it != Index_.end()) {
-            TPostingList& list = it.Value();
-            if (list.Empty() || list.Back() != docId) {
-                list.PushBack(docId);
-            }
+        return it != Index_.end() ? &it.Value() : nullptr;
+    }
+
+    bool Fail() {
+        Clear();
+        return false;
+    }
+
+    using THistogram = TUnorderedMap<TString, TTermFreq, TStringHash>;
+
+    static constexpr size_t HISTOGRAM_SHRINK_RATIO = 8;
+
+    /**
+     * Пустая гистограмма потока. Clear и обход открытой адресации идут по всей ёмкости,
+     * а она остаётся от самого длинного документа; если прошлая гистограмма заняла меньше
+     * 1/HISTOGRAM_SHRINK_RATIO слотов, таблица пересоздаётся под её размер.
+     */
+    static THistogram& LocalHistogram() {
+        static thread_local THistogram histogram;
+        const size_t fill = histogram.Size();
+        if (histogram.BucketCount() > HISTOGRAM_SHRINK_RATIO * (fill + THistogram::DEFAULT_CAPACITY)) {
+            THistogram(2 * fill).Swap(histogram);
         } else {
-            TPostingList list;
-            list.PushBack(docId);
-            Index_.Insert(term, std::move(list));
+            histogram.Clear();
         }
+        return histogram;
     }
 
-    void IncrementTermFrequency(TDocId docId, const TString& term) {
-        auto docIt = TermFrequencies_.Find(docId);
-        if (docIt == TermFrequencies_.end()) {
-            TUnorderedMap<TString, size_t, TStringHash> termMap;
-            termMap.Insert(term, 1);
-            TermFrequencies_.Insert(docId, std::move(termMap));
+    void AppendPosting(const TString& term, TDocId docId, TTermFreq freq) {
+        auto it = Index_.Find(term);
+        if (it != Index_.end()) {
+            TTermPostings& postings = it.Value();
+            postings.Docs.PushBack(docId);
+            postings.Freqs.PushBack(freq);
+            if (!postings.Sketch.Empty()) {
+                postings.Sketch.Add(docId);
+            }
         } else {
-            auto termIt = docIt.Value().Find(term);
-            if (termIt == docIt.Value().end()) {
-                docIt.Value().Insert(term, 1);
-            } else {
-                ++termIt.Value();
+            TTermPostings postings;
+            postings.Docs.PushBack(docId);
+            postings.Freqs.PushBack(freq);
+            Index_.Insert(TString(term), std::move(postings));
+            if (!TermFilter_.Empty()) {
+                TermFilter_.Insert(term.Hash());
             }
         }
     }
 
-    TUnorderedMap<TString, TPostingList, TStringHash> Index_;
+    TUnorderedMap<TString, TTermPostings, TStringHash> Index_;
     TUnorderedMap<TDocId, TString> Documents_;
-    TUnorderedMap<TDocId, TUnorderedMap<TString, size_t, TStringHash>> TermFrequencies_;
-    TUnorderedMap<TDocId, size_t> DocTermCounts_;
+    TLargeArray<size_t> DocLengths_;
+    TBlockedBloomFilter TermFilter_;
+    size_t TotalLength_;
+    double ImpactScale_;
     TDocId NextDocId_;
 };
 
@@ -195,29 +644,42 @@ public:
         return SearchOr(terms.begin(), terms.end());
     }
 
+    /**
+     * Списки пересекаются от короткого к длинному: промежуточный результат сразу мал,
+     * а Intersect сам переходит на галоп, когда следующий список намного длиннее.
+     */
     template <typename InputIt>
     TPostingList SearchAnd(InputIt first, InputIt last) const {
         if (first == last) return TPostingList();
 
-        TString firstTerm = *first;
-        TPostingList result = Search(firstTerm);
-        ++first;
-        for (auto it = first; it != last; ++it) {
-            TString term = *it;
-            result = Intersect(result, Index_.GetPostingList(term));
-            if (result.Empty()) break;
+        TVector<const TTermPostings*> terms = ResolveTerms(first, last);
+        for (size_t i = 0; i < terms.Size(); ++i) {
+            for (size_t j = i + 1; j < terms.Size(); ++j) {
+                if (terms[j]->Docs.Size() < terms[i]->Docs.Size()) {
+                    const TTermPostings* tmp = terms[i];
+                    terms[i] = terms[j];
+                    terms[j] = tmp;
+                }
+            }
+        }
+
+        TPostingList result(terms[0]->Docs);
+        for (size_t i = 1; i < terms.Size() && !result.Empty(); ++i) {
+            result = Intersect(result, terms[i]->Docs);
         }
         return result;
     }
 
     template <typename InputIt>
     TPostingList SearchOr(InputIt first, InputIt last) const {
-        TPostingList result;
-        for (auto it = first; it != last; ++it) {
-            TString term = *it;
-            result = Union(result, Index_.GetPostingList(term));
+        TVector<const TTermPostings*> terms = ResolveTerms(first, last);
+        TVector<const TPostingList*> lists;
+        lists.Reserve(terms.Size());
+        for (size_t i = 0; i < terms.Size(); ++i) {
+            lists.PushBack(&terms[i]->Docs);
         }
-        return result;
+        size_t estimate = Index_.HasSketches(terms) ? Index_.EstimateUnion(terms) : 0;
+        return TPostingOps::UnionMany(lists, estimate);
     }
 
     TPostingList SearchNot(const TString& term, const TPostingList& universe) const {
@@ -258,39 +720,24 @@ public:
 
 private:
     static TPostingList Intersect(const TPostingList& a, const TPostingList& b) {
-        TPostingList result;
-        size_t i = 0, j = 0;
-        while (i < a.Size() && j < b.Size()) {
-            if (a[i] == b[j]) {
-                result.PushBack(a[i]);
-                ++i; ++j;
-            } else if (a[i] < b[j]) {
-                ++i;
-            } else {
-                ++j;
-            }
-        }
-        return result;
+        return TPostingOps::Intersect(a, b);
     }
 
-    static TPostingList Union(const TPostingList& a, const TPostingList& b) {
-        TPostingList result;
-        size_t i = 0, j = 0;
-        while (i < a.Size() && j < b.Size()) {
-            if (a[i] == b[j]) {
-                result.PushBack(a[i]);
-                ++i; ++j;
-            } else if (a[i] < b[j]) {
-                result.PushBack(a[i]);
-                ++i;
-            } else {
-                result.PushBack(b[j]);
-                ++j;
-            }
+    /**
+     * Постинги термов запроса одним пакетом; отсутствующим термам соответствует пустой список.
+     */
+    template <typename InputIt>
+    TVector<const TTermPostings*> ResolveTerms(InputIt first, InputIt last) const {
+        static const TTermPostings empty;
+        TVector<TString> queryTerms;
+        for (auto it = first; it != last; ++it) {
+            queryTerms.PushBack(TString(*it));
         }
-        while (i < a.Size()) { result.PushBack(a[i]); ++i; }
-        while (j < b.Size()) { result.PushBack(b[j]); ++j; }
-        return result;
+        TVector<const TTermPostings*> terms = Index_.FindTerms(queryTerms);
+        for (size_t i = 0; i < terms.Size(); ++i) {
+            if (!terms[i]) terms[i] = &empty;
+        }
+        return terms;
     }
 
     const TInvertedIndex& Index_;
@@ -305,17 +752,7 @@ private:
  */
 class TTfIdf {
 public:
-    struct TSearchResult {
-        TDocId DocId;
-        double Score;
-        
-        TSearchResult() : DocId(0), Score(0) {}
-        TSearchResult(TDocId id, double s) : DocId(id), Score(s) {}
-        
-        bool operator<(const TSearchResult& other) const {
-            return Score > other.Score;
-        }
-    };
+    using TSearchResult = TScoredDoc;
 
     explicit TTfIdf(const TInvertedIndex& index) : Index_(index) {}
 
@@ -331,8 +768,11 @@ public:
     }
 
     double ComputeIDF(const TString& term) const {
+        return ComputeIDF(Index_.GetDocumentFrequency(term));
+    }
+
+    double ComputeIDF(size_t df) const {
         size_t N = Index_.GetDocumentCount();
-        size_t df = Index_.GetDocumentFrequency(term);
         if (N == 0 || df == 0) return 0;
         return Log(static_cast<double>(N + 1) / static_cast<double>(df + 1)) + 1.0;
     }
@@ -359,35 +799,18 @@ public:
         return score;
     }
 
+    /**
+     * Ранжирование одной из специализаций ядра (см. TScoringDispatcher): скорер,
+     * фильтр и коллектор выбираются по запросу один раз, внутренний цикл без ветвлений по ним.
+     */
+    TScoringResult Score(const TVector<TString>& queryTerms, const TScoringRequest& request) const {
+        return TScoringDispatcher::Run(Index_, queryTerms, request);
+    }
+
     TVector<TSearchResult> Search(const TVector<TString>& queryTerms, size_t topK = 10) const {
-        TUnorderedSet<TDocId> candidateDocs;
-        for (size_t i = 0; i < queryTerms.Size(); ++i) {
-            const TPostingList& docs = Index_.GetPostingList(queryTerms[i]);
-            for (size_t j = 0; j < docs.Size(); ++j) {
-                candidateDocs.Insert(docs[j]);
-            }
-        }
-        
-        TVector<TSearchResult> results;
-        for (auto it = candidateDocs.begin(); it != candidateDocs.end(); ++it) {
-            TDocId docId = it.Value();
-            double score = ComputeDocumentScore(docId, queryTerms);
-            if (score > 0) {
-                results.PushBack(TSearchResult(docId, score));
-            }
-        }
-        
-        SortResults(results);
-        
-        if (results.Size() > topK) {
-            TVector<TSearchResult> topResults;
-            for (size_t i = 0; i < topK; ++i) {
-                topResults.PushBack(results[i]);
-            }
-            return topResults;
-        }
-        
-        return results;
+        TScoringRequest request;
+        request.TopK = topK;
+        return Score(queryTerms, request).Hits;
     }
 
     template <typename InputIt>
@@ -418,29 +841,6 @@ public:
     }
 
 private:
-    static double Log(double x) {
-        if (x <= 0) return 0;
-        double result = 0;
-        while (x > 2.718281828) { x /= 2.718281828; result += 1; }
-        while (x < 0.367879441) { x *= 2.718281828; result -= 1; }
-        double y = (x - 1) / (x + 1);
-        double y2 = y * y;
-        result += 2 * y * (1 + y2/3 + y2*y2/5 + y2*y2*y2/7);
-        return result;
-    }
-
-    static void SortResults(TVector<TSearchResult>& results) {
-        for (size_t i = 0; i < results.Size(); ++i) {
-            for (size_t j = i + 1; j < results.Size(); ++j) {
-                if (results[j].Score > results[i].Score) {
-                    TSearchResult tmp = results[i];
-                    results[i] = results[j];
-                    results[j] = tmp;
-                }
-            }
-        }
-    }
-
     const TInvertedIndex& Index_;
 };
 
@@ -0,0 +1,378 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <lib/collections/vector/vector.h>
+#include <lib/collections/queue/queue.h>
+#include <lib/collections/unordered_map/unordered_map.h>
+#include <lib/index/index_io.h>
+
+namespace NIndex {
+
+using NCollections::TVector;
+using NCollections::TQueue;
+using NCollections::TUnorderedMap;
+
+/**
+ * Кэш страниц файла только для чтения поверх pread.
+ *
+ * Файл делится на страницы PageSize байт; кэш разбит на Shards независимых шардов
+ * (страница попадает в шард по номеру), у каждого свой мьютекс и своя стрелка CLOCK:
+ * попадание только ставит бит обращения, вытеснение идёт по кругу и пропускает
+ * (сбрасывая бит) страницы, к которым обращались после прошлого прохода.
+ *
+ * ReadMany собирает промахи всех диапазонов пакета и отдаёт их пулу из IoThreads потоков
+ * разом — чтения разных термов идут параллельно, а не по очереди. IoThreads = 0 — читать
+ * в вызывающем потоке. Методы потокобезопасны.
+ */
+class TBufferPool {
+public:
+    struct TOptions {
+        size_t CapacityBytes = 64 << 20;
+        size_t PageSize = 16 << 10;
+        size_t Shards = 16;
+        size_t IoThreads = 4;
+    };
+
+    /**
+     * Счётчики с момента открытия: попадания и промахи по страницам, вытеснения,
+     * число pread, прочитанные байты, суммарная и наибольшая задержка одного pread.
+     */
+    struct TStats {
+        size_t Hits = 0;
+        size_t Misses = 0;
+        size_t Evictions = 0;
+        size_t Reads = 0;
+        size_t BytesRead = 0;
+        uint64_t ReadNanos = 0;
+        uint64_t MaxReadNanos = 0;
+    };
+
+    struct TRange {
+        uint64_t Offset = 0;
+        size_t Size = 0;
+    };
+
+    TBufferPool() = default;
+    TBufferPool(const TBufferPool&) = delete;
+    TBufferPool& operator=(const TBufferPool&) = delete;
+
+    ~TBufferPool() {
+        Close();
+    }
+
+    bool Open(const char* path, const TOptions& options) {
+        Close();
+        Options_ = options;
+        if (Options_.PageSize == 0) Options_.PageSize = TOptions().PageSize;
+        if (Options_.Shards == 0) Options_.Shards = 1;
+        Fd_ = ::open(path, O_RDONLY);
+        if (Fd_ < 0) return false;
+        FileSize_ = static_cast<uint64_t>(::lseek(Fd_, 0, SEEK_END));
+
+        size_t pages = Options_.CapacityBytes / Options_.PageSize;
+        size_t perShard = pages / Options_.Shards > 0 ? pages / Options_.Shards : 1;
+        Shards_.reset(new TShard[Options_.Shards]);
+        for (size_t i = 0; i < Options_.Shards; ++i) {
+            Shards_[i].Capacity = perShard;
+            Shards_[i].Data.Resize(perShard * Options_.PageSize);
+        }
+        ResetStats();
+
+        Stopping_ = false;
+        for (size_t i = 0; i < Options_.IoThreads; ++i) {
+            Workers_.PushBack(std::thread([this]() { Work(); }));
+        }
+        return true;
+    }
+
+    void Close() {
+        {
+            std::lock_guard<std::mutex> lock(QueueMutex_);
+            Stopping_ = true;
+            QueueReady_.notify_all();
+        }
+        for (size_t i = 0; i < Workers_.Size(); ++i) {
+            Workers_[i].join();
+        }
+        Workers_.Clear();
+        if (Fd_ >= 0) {
+            ::close(Fd_);
+            Fd_ = -1;
+        }
+        Shards_.reset();
+        FileSize_ = 0;
+    }
+
+    bool IsOpen() const { return Fd_ >= 0; }
+    uint64_t GetFileSize() const { return FileSize_; }
+    const TOptions& GetOptions() const { return Options_; }
+
+    bool Read(uint64_t offset, size_t size, TByteBuffer* out) {
+        TVector<TRange> ranges;
+        ranges.PushBack(TRange{offset, size});
+        TVector<TByteBuffer> outs;
+        if (!ReadMany(ranges, &outs)) return false;
+        out->Swap(outs[0]);
+        return true;
+    }
+
+    /**
+     * pread мимо кэша и счётчиков — для однократных чтений вроде словаря при открытии.
+     */
+    bool ReadUncached(uint64_t offset, size_t size, TByteBuffer* out) const {
+        if (!IsOpen() || offset + size > FileSize_) return false;
+        out->Resize(size);
+        size_t done = 0;
+        while (done < size) {
+            ssize_t got = ::pread(Fd_, out->Data() + done, size - done, static_cast<off_t>(offset + done));
+            if (got <= 0) return false;
+            done += static_cast<size_t>(got);
+        }
+        return true;
+    }
+
+    /**
+     * Читает все диапазоны: сначала снимает попадания из кэша, затем промахи всех диапазонов
+     * одним пакетом уходят в пул ввода-вывода, прочитанные страницы кладутся в кэш.
+     */
+    bool ReadMany(const TVector<TRange>& ranges, TVector<TByteBuffer>* outs) {
+        if (!IsOpen()) return false;
+        TUnorderedMap<uint64_t, size_t> slotOf;
+        TVector<TPageRead> pages;
+        for (size_t r = 0; r < ranges.Size(); ++r) {
+            if (ranges[r].Size == 0) continue;
+            if (ranges[r].Offset + ranges[r].Size > FileSize_) return false;
+            uint64_t first = ranges[r].Offset / Options_.PageSize;
+            uint64_t last = (ranges[r].Offset + ranges[r].Size - 1) / Options_.PageSize;
+            for (uint64_t page = first; page <= last; ++page) {
+                if (slotOf.Contains(page)) continue;
+                slotOf.Insert(page, pages.Size());
+                pages.PushBack(TPageRead{page, TByteBuffer(), false});
+            }
+        }
+
+        TVector<TPageRead*> misses;
+        for (size_t i = 0; i < pages.Size(); ++i) {
+            if (Lookup(pages[i].Page, &pages[i].Data)) {
+                Hits_.fetch_add(1, std::memory_order_relaxed);
+                pages[i].Ok = true;
+            } else {
+                Misses_.fetch_add(1, std::memory_order_relaxed);
+                misses.PushBack(&pages[i]);
+            }
+        }
+        ReadPages(misses);
+        for (size_t i = 0; i < misses.Size(); ++i) {
+            if (!misses[i]->Ok) return false;
+            Insert(misses[i]->Page, misses[i]->Data);
+        }
+
+        outs->Clear();
+        outs->Resize(ranges.Size());
+        for (size_t r = 0; r < ranges.Size(); ++r) {
+            TByteBuffer& out = (*outs)[r];
+            out.Resize(ranges[r].Size);
+            size_t done = 0;
+            while (done < ranges[r].Size) {
+                uint64_t position = ranges[r].Offset + done;
+                const TPageRead& page = pages[slotOf.Find(position / Options_.PageSize).Value()];
+                size_t inPage = static_cast<size_t>(position % Options_.PageSize);
+                size_t chunk = page.Data.Size() - inPage;
+                if (chunk > ranges[r].Size - done) chunk = ranges[r].Size - done;
+                std::memcpy(out.Data() + done, page.Data.Data() + inPage, chunk);
+                done += chunk;
+            }
+        }
+        return true;
+    }
+
+    TStats GetStats() const {
+        TStats stats;
+        stats.Hits = Hits_.load();
+        stats.Misses = Misses_.load();
+        stats.Evictions = Evictions_.load();
+        stats.Reads = Reads_.load();
+        stats.BytesRead = BytesRead_.load();
+        stats.ReadNanos = ReadNanos_.load();
+        stats.MaxReadNanos = MaxReadNanos_.load();
+        return stats;
+    }
+
+    void ResetStats() {
+        Hits_.store(0);
+        Misses_.store(0);
+        Evictions_.store(0);
+        Reads_.store(0);
+        BytesRead_.store(0);
+        ReadNanos_.store(0);
+        MaxReadNanos_.store(0);
+    }
+
+private:
+    struct TPageRead {
+        uint64_t Page;
+        TByteBuffer Data;
+        bool Ok;
+    };
+
+    struct TFrame {
+        uint64_t Page = 0;
+        size_t Size = 0;
+        bool Referenced = false;
+    };
+
+    struct TShard {
+        std::mutex Mutex;
+        TUnorderedMap<uint64_t, size_t> FrameOf;
+        TVector<TFrame> Frames;
+        TByteBuffer Data;
+        size_t Capacity = 0;
+        size_t Hand = 0;
+    };
+
+    /**
+     * Пакет промахов одного ReadMany: Remaining уменьшается под QueueMutex_,
+     * поэтому после нуля ни один поток пула к пакету уже не обращается.
+     */
+    struct TBatch {
+        size_t Remaining = 0;
+    };
+
+    struct TJob {
+        TPageRead* Read;
+        TBatch* Batch;
+    };
+
+    TShard& ShardOf(uint64_t page) const {
+        return Shards_[page % Options_.Shards];
+    }
+
+    bool Lookup(uint64_t page, TByteBuffer* out) {
+        TShard& shard = ShardOf(page);
+        std::lock_guard<std::mutex> lock(shard.Mutex);
+        auto it = shard.FrameOf.Find(page);
+        if (it == shard.FrameOf.end()) return false;
+        TFrame& frame = shard.Frames[it.Value()];
+        frame.Referenced = true;
+        const unsigned char* data = shard.Data.Data() + it.Value() * Options_.PageSize;
+        out->Resize(frame.Size);
+        std::memcpy(out->Data(), data, frame.Size);
+        return true;
+    }
+
+    void Insert(uint64_t page, const TByteBuffer& bytes) {
+        TShard& shard = ShardOf(page);
+        std::lock_guard<std::mutex> lock(shard.Mutex);
+        if (shard.FrameOf.Contains(page)) return;
+        size_t slot;
+        if (shard.Frames.Size() < shard.Capacity) {
+            slot = shard.Frames.Size();
+            shard.Frames.PushBack(TFrame());
+        } else {
+            while (shard.Frames[shard.Hand].Referenced) {
+                shard.Frames[shard.Hand].Referenced = false;
+                shard.Hand = (shard.Hand + 1) % shard.Frames.Size();
+            }
+            slot = shard.Hand;
+            shard.Hand = (shard.Hand + 1) % shard.Frames.Size();
+            shard.FrameOf.Erase(shard.Frames[slot].Page);
+            Evictions_.fetch_add(1, std::memory_order_relaxed);
+        }
+        TFrame& frame = shard.Frames[slot];
+        frame.Page = page;
+        frame.Size = bytes.Size();
+        frame.Referenced = false;
+        std::memcpy(shard.Data.Data() + slot * Options_.PageSize, bytes.Data(), bytes.Size());
+        shard.FrameOf.Insert(page, slot);
+    }
+
+    void ReadPages(const TVector<TPageRead*>& reads) {
+        if (reads.Empty()) return;
+        if (Workers_.Empty() || reads.Size() == 1) {
+            for (size_t i = 0; i < reads.Size(); ++i) {
+                ReadPage(*reads[i]);
+            }
+            return;
+        }
+        TBatch batch;
+        batch.Remaining = reads.Size();
+        std::unique_lock<std::mutex> lock(QueueMutex_);
+        for (size_t i = 0; i < reads.Size(); ++i) {
+            Jobs_.Push(TJob{reads[i], &batch});
+        }
+        QueueReady_.notify_all();
+        BatchDone_.wait(lock, [&batch]() { return batch.Remaining == 0; });
+    }
+
+    void Work() {
+        std::unique_lock<std::mutex> lock(QueueMutex_);
+        while (true) {
+            QueueReady_.wait(lock, [this]() { return Stopping_ || !Jobs_.Empty(); });
+            if (Jobs_.Empty()) return;
+            TJob job = Jobs_.Front();
+            Jobs_.Pop();
+            lock.unlock();
+            ReadPage(*job.Read);
+            lock.lock();
+            if (--job.Batch->Remaining == 0) {
+                BatchDone_.notify_all();
+            }
+        }
+    }
+
+    void ReadPage(TPageRead& read) {
+        uint64_t offset = read.Page * Options_.PageSize;
+        size_t size = Options_.PageSize;
+        if (offset + size > FileSize_) size = static_cast<size_t>(FileSize_ - offset);
+        read.Data.Resize(size);
+        auto start = std::chrono::steady_clock::now();
+        size_t done = 0;
+        while (done < size) {
+            ssize_t got = ::pread(Fd_, read.Data.Data() + done, size - done, static_cast<off_t>(offset + done));
+            if (got <= 0) break;
+            done += static_cast<size_t>(got);
+        }
+        uint64_t nanos = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count());
+        read.Ok = done == size;
+        Reads_.fetch_add(1, std::memory_order_relaxed);
+        BytesRead_.fetch_add(done, std::memory_order_relaxed);
+        ReadNanos_.fetch_add(nanos, std::memory_order_relaxed);
+        uint64_t max = MaxReadNanos_.load(std::memory_order_relaxed);
+        while (nanos > max && !MaxReadNanos_.compare_exchange_weak(max, nanos, std::memory_order_relaxed)) {
+        }
+    }
+
+    TOptions Options_;
+    int Fd_ = -1;
+    uint64_t FileSize_ = 0;
+    std::unique_ptr<TShard[]> Shards_;
+
+    std::mutex QueueMutex_;
+    std::condition_variable QueueReady_;
+    std::condition_variable BatchDone_;
+    TQueue<TJob> Jobs_;
+    TVector<std::thread> Workers_;
+    bool Stopping_ = false;
+
+    std::atomic<size_t> Hits_{0};
+    std::atomic<size_t> Misses_{0};
+    std::atomic<size_t> Evictions_{0};
+    std::atomic<size_t> Reads_{0};
+    std::atomic<size_t> BytesRead_{0};
+    std::atomic<uint64_t> ReadNanos_{0};
+    std::atomic<uint64_t> MaxReadNanos_{0};
+};
+
+} // namespace NIndex
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+
+#include <lib/collections/vector/vector.h>
+#include <lib/collections/unordered_map/unordered_map.h>
+#include <lib/index/posting_ops.h>
+#include <lib/index/index_io.h>
+#include <lib/index/math.h>
+
+namespace NIndex {
+
+using NCollections::TVector;
+
+/**
+ * HyperLogLog-скетч множества документов
+ *
+ * 2^PRECISION однобайтовых регистров (1 КиБ), относительная ошибка ~1.04/sqrt(m) ≈ 3%.
+ * Скетчи объединяются поэлементным максимумом, поэтому оценка размера OR-а
+ * нескольких термов стоит O(m) на терм независимо от длины списков.
+ * Малые мощности уточняются линейным счётом по пустым регистрам.
+ */
+class THyperLogLog {
+public:
+    static constexpr size_t PRECISION = 10;
+    static constexpr size_t REGISTERS = size_t(1) << PRECISION;
+
+    bool Empty() const { return Registers_.Empty(); }
+
+    void Add(TDocId docId) {
+        if (Registers_.Empty()) {
+            Registers_.Resize(REGISTERS, 0);
+        }
+        uint64_t h = Mix(static_cast<uint64_t>(docId));
+        size_t index = static_cast<size_t>(h >> (64 - PRECISION));
+        uint64_t rest = (h << PRECISION) | (uint64_t(1) << (PRECISION - 1));
+        unsigned char rank = static_cast<unsigned char>(__builtin_clzll(rest) + 1);
+        if (rank > Registers_[index]) {
+            Registers_[index] = rank;
+        }
+    }
+
+    void AddAll(const TPostingList& docs) {
+        for (size_t i = 0; i < docs.Size(); ++i) {
+            Add(docs[i]);
+        }
+    }
+
+    void Merge(const THyperLogLog& other) {
+        if (other.Registers_.Empty()) return;
+        if (Registers_.Empty()) {
+            Registers_ = other.Registers_;
+            return;
+        }
+        for (size_t i = 0; i < REGISTERS; ++i) {
+            if (other.Registers_[i] > Registers_[i]) {
+                Registers_[i] = other.Registers_[i];
+            }
+        }
+    }
+
+    double Estimate() const {
+        if (Registers_.Empty()) return 0;
+        double m = static_cast<double>(REGISTERS);
+        double sum = 0;
+        size_t zeros = 0;
+        for (size_t i = 0; i < REGISTERS; ++i) {
+            sum += 1.0 / static_cast<double>(uint64_t(1) << Registers_[i]);
+            if (Registers_[i] == 0) ++zeros;
+        }
+        double alpha = 0.7213 / (1.0 + 1.079 / m);
+        double estimate = alpha * m * m / sum;
+        if (estimate <= 2.5 * m && zeros > 0) {
+            return m * Log(m / static_cast<double>(zeros));
+        }
+        return estimate;
+    }
+
+    void Clear() {
+        Registers_.Clear();
+        Registers_.ShrinkToFit();
+    }
+
+    void Save(TBinaryWriter& writer) const {
+        writer.WriteBytes(Registers_.Data(), Registers_.Size());
+    }
+
+    bool Load(TBinaryReader& reader) {
+        Registers_ = reader.ReadBytes();
+        return reader.Ok() && (Registers_.Empty() || Registers_.Size() == REGISTERS);
+    }
+
+private:
+    static uint64_t Mix(uint64_t h) {
+        return NCollections::THash<uint64_t>()(h);
+    }
+
+    TVector<unsigned char> Registers_;
+};
+
+} // namespace NIndex
@@ -0,0 +1,762 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <string>
+
+#include <unistd.h>
+
+#include <lib/types/string/string.h>
+#include <lib/collections/vector/vector.h>
+#include <lib/collections/heap/heap.h>
+#include <lib/collections/large_array/large_array.h>
+#include <lib/collections/unordered_map/unordered_map.h>
+#include <lib/index/boolean_index.h>
+#include <lib/index/buffer_pool.h>
+#include <lib/index/index_io.h>
+#include <lib/index/posting_ops.h>
+#include <lib/index/scoring.h>
+
+namespace NIndex {
+
+using NTypes::TString;
+using NCollections::TVector;
+using NCollections::THeap;
+using NCollections::TGreater;
+using NCollections::TLargeArray;
+using NCollections::TUnorderedMap;
+using NCollections::TStringHash;
+
+/**
+ * Инвертированный индекс на диске для корпусов больше памяти.
+ *
+ * В памяти только словарь, длины документов и данные пропуска: для каждого блока
+ * из BLOCK_POSTINGS постингов — смещение, размер и последний id. Сами блоки
+ * (дельта-varint id, затем varint частоты) читаются через TBufferPool.
+ * Постинги всех термов запроса запрашиваются одним пакетом, поэтому промахи
+ * читаются параллельно. Формат: заголовок, блоки постингов по термам подряд,
+ * словарь, в конце [смещение словаря: u64][magic: u32]. Файл пишется потоком (TWriter);
+ * без индекса в памяти его строит TDiskIndexBuilder.
+ */
+class TDiskIndex {
+public:
+    static constexpr uint32_t FILE_MAGIC = 0x58445349; // "ISDX"
+    static constexpr uint32_t FILE_VERSION = 1;
+    static constexpr size_t BLOCK_POSTINGS = 128;
+    static constexpr size_t FOOTER_SIZE = 12;
+
+    struct TSkipEntry {
+        uint64_t Offset = 0;
+        size_t Size = 0;
+        TDocId LastDoc = 0;
+    };
+
+    struct TDiskTerm {
+        size_t Count = 0;
+        size_t PrunedCount = 0;
+        TVector<TSkipEntry> Blocks;
+    };
+
+    TDiskIndex() = default;
+    TDiskIndex(const TDiskIndex&) = delete;
+    TDiskIndex& operator=(const TDiskIndex&) = delete;
+
+    /**
+     * Потоковая запись файла: постинги терма подаются по возрастанию id и уходят в файл
+     * блоками через буфер WRITE_BUFFER байт. В памяти копятся только словарь (данные
+     * пропуска по термам) и длины документов — то же, что Open держит при чтении.
+     */
+    class TWriter {
+    public:
+        static constexpr size_t WRITE_BUFFER = 1 << 20;
+
+        TWriter() = default;
+        TWriter(const TWriter&) = delete;
+        TWriter& operator=(const TWriter&) = delete;
+
+        ~TWriter() {
+            if (File_) std::fclose(File_);
+        }
+
+        bool Open(const char* path) {
+            File_ = std::fopen(path, "wb");
+            if (!File_) return false;
+            Out_.WriteU32(FILE_MAGIC);
+            Out_.WriteU32(FILE_VERSION);
+            return true;
+        }
+
+        void BeginTerm(const TString& term, size_t prunedCount) {
+            Term_ = term;
+            PrunedCount_ = prunedCount;
+            Count_ = 0;
+            Blocks_.Clear();
+        }
+
+        void AddPosting(TDocId docId, TTermFreq freq) {
+            BlockDocs_.PushBack(docId);
+            BlockFreqs_.PushBack(freq);
+            if (BlockDocs_.Size() == BLOCK_POSTINGS) FlushBlock();
+        }
+
+        void EndTerm() {
+            if (!BlockDocs_.Empty()) FlushBlock();
+            Terms_.WriteString(Term_);
+            Terms_.WriteVarint(PrunedCount_);
+            Terms_.WriteVarint(Count_);
+            TDocId base = 0;
+            uint64_t prevOffset = 0;
+            for (size_t b = 0; b < Blocks_.Size(); ++b) {
+                Terms_.WriteVarint(Blocks_[b].Offset - prevOffset);
+                Terms_.WriteVarint(Blocks_[b].Size);
+                Terms_.WriteVarint(Blocks_[b].LastDoc - base);
+                prevOffset = Blocks_[b].Offset;
+                base = Blocks_[b].LastDoc;
+            }
+            ++TermCount_;
+        }
+
+        /**
+         * Дописывает словарь и концевик и дожидается сброса файла на диск (fsync).
+         */
+        bool Finish(const TLargeArray<size_t>& lengths) {
+            if (!File_) return false;
+            const uint64_t dictionaryOffset = Offset();
+            Out_.WriteVarint(lengths.Size());
+            for (size_t d = 0; d < lengths.Size(); ++d) {
+                Out_.WriteVarint(lengths[d]);
+                if (Out_.Size() >= WRITE_BUFFER) Flush();
+            }
+            Out_.WriteVarint(TermCount_);
+            Flush();
+            const TByteBuffer& terms = Terms_.GetBuffer();
+            if (!terms.Empty() && std::fwrite(terms.Data(), 1, terms.Size(), File_) != terms.Size()) {
+                Failed_ = true;
+            }
+            Flushed_ += terms.Size();
+            Out_.WriteU64(dictionaryOffset);
+            Out_.WriteU32(FILE_MAGIC);
+            bool ok = Flush() && std::fflush(File_) == 0 && ::fsync(::fileno(File_)) == 0;
+            ok = std::fclose(File_) == 0 && ok;
+            File_ = nullptr;
+            return ok;
+        }
+
+    private:
+        void FlushBlock() {
+            const uint64_t offset = Offset();
+            TDocId prev = Blocks_.Empty() ? 0 : Blocks_.Back().LastDoc;
+            for (size_t i = 0; i < BlockDocs_.Size(); ++i) {
+                Out_.WriteVarint(BlockDocs_[i] - prev);
+                prev = BlockDocs_[i];
+            }
+            for (size_t i = 0; i < BlockFreqs_.Size(); ++i) {
+                Out_.WriteVarint(BlockFreqs_[i]);
+            }
+            TSkipEntry entry;
+            entry.Offset = offset;
+            entry.Size = static_cast<size_t>(Offset() - offset);
+            entry.LastDoc = prev;
+            Blocks_.PushBack(entry);
+            Count_ += BlockDocs_.Size();
+            BlockDocs_.Clear();
+            BlockFreqs_.Clear();
+            if (Out_.Size() >= WRITE_BUFFER) Flush();
+        }
+
+        uint64_t Offset() const { return Flushed_ + Out_.Size(); }
+
+        bool Flush() {
+            TByteBuffer bytes = Out_.TakeBuffer();
+            Flushed_ += bytes.Size();
+            if (!Failed_ && !bytes.Empty() && std::fwrite(bytes.Data(), 1, bytes.Size(), File_) != bytes.Size()) {
+                Failed_ = true;
+            }
+            return !Failed_;
+        }
+
+        FILE* File_ = nullptr;
+        TBinaryWriter Out_;
+        uint64_t Flushed_ = 0;
+        bool Failed_ = false;
+        TBinaryWriter Terms_;
+        size_t TermCount_ = 0;
+        TString Term_;
+        size_t PrunedCount_ = 0;
+        size_t Count_ = 0;
+        TVector<TSkipEntry> Blocks_;
+        TPostingList BlockDocs_;
+        TVector<TTermFreq> BlockFreqs_;
+    };
+
+    /**
+     * Выгружает индекс в файл path в дисковом формате.
+     */
+    static bool Write(const TInvertedIndex& index, const char* path) {
+        TWriter writer;
+        if (!writer.Open(path)) return false;
+        index.ForEachTerm([&](const TString& term, const TTermPostings& postings) {
+            writer.BeginTerm(term, postings.PrunedCount);
+            for (size_t i = 0; i < postings.Docs.Size(); ++i) {
+                writer.AddPosting(postings.Docs[i], postings.Freqs[i]);
+            }
+            writer.EndTerm();
+        });
+        return writer.Finish(index.GetDocumentLengths());
+    }
+
+    /**
+     * Открывает файл, читая в память только словарь и данные пропуска.
+     */
+    bool Open(const char* path, const TBufferPool::TOptions& options = TBufferPool::TOptions()) {
+        Close();
+        if (!Pool_.Open(path, options)) return false;
+        const uint64_t fileSize = Pool_.GetFileSize();
+        TByteBuffer bytes;
+        if (fileSize < 8 + FOOTER_SIZE || !ReadDirect(fileSize - FOOTER_SIZE, FOOTER_SIZE, &bytes)) return Fail();
+        TBinaryReader footer(bytes);
+        const uint64_t dictionaryOffset = footer.ReadU64();
+        if (footer.ReadU32() != FILE_MAGIC || dictionaryOffset < 8 || dictionaryOffset > fileSize - FOOTER_SIZE) {
+            return Fail();
+        }
+        if (!ReadDirect(0, 8, &bytes)) return Fail();
+        TBinaryReader header(bytes);
+        if (header.ReadU32() != FILE_MAGIC || header.ReadU32() != FILE_VERSION) return Fail();
+
+        if (!ReadDirect(dictionaryOffset, static_cast<size_t>(fileSize - FOOTER_SIZE - dictionaryOffset), &bytes)) {
+            return Fail();
+        }
+        TBinaryReader reader(bytes);
+        if (!LoadDictionary(reader, dictionaryOffset) || !reader.AtEnd()) return Fail();
+        return true;
+    }
+
+    void Close() {
+        Pool_.Close();
+        Terms_.Clear();
+        DocLengths_.Clear();
+        TotalLength_ = 0;
+        DocCount_ = 0;
+    }
+
+    bool IsOpen() const { return Pool_.IsOpen(); }
+
+    size_t GetDocumentCount() const { return DocCount_; }
+    size_t GetTermCount() const { return Terms_.Size(); }
+    const TLargeArray<size_t>& GetDocumentLengths() const { return DocLengths_; }
+
+    double GetAverageDocumentLength() const {
+        if (DocCount_ == 0) return 0;
+        return static_cast<double>(TotalLength_) / DocCount_;
+    }
+
+    bool ContainsTerm(const TString& term) const {
+        return Terms_.Contains(term);
+    }
+
+    /**
+     * Обход словаря без чтения постингов: func(term, docFrequency).
+     */
+    template <typename Func>
+    void ForEachTerm(Func&& func) const {
+        for (auto it = Terms_.begin(); it != Terms_.end(); ++it) {
+            func(it.Key(), it.Value().Count + it.Value().PrunedCount);
+        }
+    }
+
+    size_t GetDocumentFrequency(const TString& term) const {
+        auto it = Terms_.Find(term);
+        return it != Terms_.end() ? it.Value().Count + it.Value().PrunedCount : 0;
+    }
+
+    /**
+     * Постинги термов запроса; страницы всех термов читаются одним пакетом.
+     * Отсутствующему терму соответствует пустой список. false — страницы не удалось
+     * прочитать или блоки не декодируются; *postings тогда не заполнен.
+     */
+    bool FetchTerms(const TVector<TString>& terms, TVector<TTermPostings>* postings) const {
+        TVector<TTermPostings> result(terms.Size());
+        TVector<const TDiskTerm*> found(terms.Size(), nullptr);
+        TVector<TBufferPool::TRange> ranges;
+        TVector<size_t> rangeOf(terms.Size(), 0);
+        for (size_t i = 0; i < terms.Size(); ++i) {
+            auto it = Terms_.Find(terms[i]);
+            if (it == Terms_.end()) continue;
+            const TDiskTerm& term = it.Value();
+            found[i] = &term;
+            result[i].PrunedCount = term.PrunedCount;
+            if (term.Blocks.Empty()) continue;
+            const TSkipEntry& last = term.Blocks.Back();
+            rangeOf[i] = ranges.Size();
+            ranges.PushBack(TBufferPool::TRange{term.Blocks[0].Offset,
+                static_cast<size_t>(last.Offset + last.Size - term.Blocks[0].Offset)});
+        }
+
+        TVector<TByteBuffer> bytes;
+        if (!Pool_.ReadMany(ranges, &bytes)) return false;
+        for (size_t i = 0; i < terms.Size(); ++i) {
+            if (!found[i] || found[i]->Blocks.Empty()) continue;
+            TBinaryReader reader(bytes[rangeOf[i]]);
+            if (!DecodeBlocks(reader, *found[i], 0, found[i]->Blocks.Size(), &result[i])) return false;
+        }
+        postings->Swap(result);
+        return true;
+    }
+
+    bool GetPostingList(const TString& term, TPostingList* docs) const {
+        TVector<TString> terms;
+        terms.PushBack(term);
+        TVector<TTermPostings> postings;
+        if (!FetchTerms(terms, &postings)) return false;
+        *docs = std::move(postings[0].Docs);
+        return true;
+    }
+
+    /**
+     * Частота терма в документе: по данным пропуска читается один блок.
+     */
+    size_t GetTermFrequency(TDocId docId, const TString& term) const {
+        auto it = Terms_.Find(term);
+        if (it == Terms_.end()) return 0;
+        const TDiskTerm& found = it.Value();
+        size_t lo = 0;
+        size_t hi = found.Blocks.Size();
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (found.Blocks[mid].LastDoc < docId) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if (lo == found.Blocks.Size()) return 0;
+
+        TByteBuffer bytes;
+        if (!Pool_.Read(found.Blocks[lo].Offset, found.Blocks[lo].Size, &bytes)) return 0;
+        TBinaryReader reader(bytes);
+        TTermPostings block;
+        if (!DecodeBlocks(reader, found, lo, lo + 1, &block)) return 0;
+        for (size_t i = 0; i < block.Docs.Size(); ++i) {
+            if (block.Docs[i] == docId) return block.Freqs[i];
+        }
+        return 0;
+    }
+
+    bool SearchAnd(const TVector<TString>& terms, TPostingList* docs) const {
+        *docs = TPostingList();
+        if (terms.Empty()) return true;
+        TVector<TTermPostings> postings;
+        if (!FetchTerms(terms, &postings)) return false;
+        TPostingList result(postings[0].Docs);
+        for (size_t i = 1; i < postings.Size() && !result.Empty(); ++i) {
+            result = TPostingOps::Intersect(result, postings[i].Docs);
+        }
+        *docs = std::move(result);
+        return true;
+    }
+
+    bool SearchOr(const TVector<TString>& terms, TPostingList* docs) const {
+        *docs = TPostingList();
+        TVector<TTermPostings> postings;
+        if (!FetchTerms(terms, &postings)) return false;
+        TVector<const TPostingList*> lists;
+        for (size_t i = 0; i < postings.Size(); ++i) {
+            lists.PushBack(&postings[i].Docs);
+        }
+        *docs = TPostingOps::UnionMany(lists);
+        return true;
+    }
+
+    /**
+     * Ранжирование тем же ядром, что и в памяти (TScoringDispatcher), по постингам,
+     * прочитанным одним пакетом. Импактов на диске нет: импакт-скорер откатывается на TF-IDF.
+     * false — постинги не прочитаны, *result пуст.
+     */
+    bool Score(const TVector<TString>& queryTerms, const TScoringRequest& request, TScoringResult* result) const {
+        *result = TScoringResult();
+        TVector<TTermPostings> postings;
+        if (!FetchTerms(queryTerms, &postings)) return false;
+        TQueryView view(*this, std::move(postings));
+        *result = TScoringDispatcher::Run(view, queryTerms, request);
+        return true;
+    }
+
+    TBufferPool::TStats GetCacheStats() const { return Pool_.GetStats(); }
+    void ResetCacheStats() { Pool_.ResetStats(); }
+
+private:
+    /**
+     * Индекс одного запроса для TScoringDispatcher: постинги уже прочитаны.
+     */
+    class TQueryView {
+    public:
+        TQueryView(const TDiskIndex& index, TVector<TTermPostings>&& postings)
+            : Index_(index)
+            , Postings_(std::move(postings))
+        {}
+
+        TVector<const TTermPostings*> FindTerms(const TVector<TString>& terms) const {
+            TVector<const TTermPostings*> result(terms.Size(), nullptr);
+            for (size_t i = 0; i < terms.Size() && i < Postings_.Size(); ++i) {
+                result[i] = &Postings_[i];
+            }
+            return result;
+        }
+
+        size_t GetDocumentCount() const { return Index_.GetDocumentCount(); }
+        const TLargeArray<size_t>& GetDocumentLengths() const { return Index_.GetDocumentLengths(); }
+        double GetAverageDocumentLength() const { return Index_.GetAverageDocumentLength(); }
+        bool HasImpacts() const { return false; }
+        double GetImpactScale() const { return 0; }
+
+    private:
+        const TDiskIndex& Index_;
+        TVector<TTermPostings> Postings_;
+    };
+
+    bool LoadDictionary(TBinaryReader& reader, uint64_t dictionaryOffset) {
+        const size_t docCount = reader.ReadCount();
+        DocLengths_.Reserve(docCount);
+        for (size_t d = 0; d < docCount && reader.Ok(); ++d) {
+            DocLengths_.PushBack(static_cast<size_t>(reader.ReadVarint()));
+            TotalLength_ += DocLengths_.Back();
+        }
+        DocCount_ = docCount;
+
+        const size_t termCount = reader.ReadCount();
+        for (size_t t = 0; t < termCount && reader.Ok(); ++t) {
+            TString term = reader.ReadString();
+            TDiskTerm diskTerm;
+            diskTerm.PrunedCount = static_cast<size_t>(reader.ReadVarint());
+            diskTerm.Count = reader.ReadCount(0);
+            const size_t blocks = (diskTerm.Count + BLOCK_POSTINGS - 1) / BLOCK_POSTINGS;
+            diskTerm.Blocks.Reserve(blocks);
+            uint64_t offset = 0;
+            uint64_t lastDoc = 0;
+            for (size_t b = 0; b < blocks && reader.Ok(); ++b) {
+                TSkipEntry entry;
+                offset += reader.ReadVarint();
+                entry.Offset = offset;
+                entry.Size = static_cast<size_t>(reader.ReadVarint());
+                lastDoc += reader.ReadVarint();
+                entry.LastDoc = static_cast<TDocId>(lastDoc);
+                if (entry.Offset < 8 || entry.Offset + entry.Size > dictionaryOffset || lastDoc >= docCount) {
+                    return false;
+                }
+                diskTerm.Blocks.PushBack(entry);
+            }
+            Terms_.Insert(std::move(term), std::move(diskTerm));
+        }
+        return reader.Ok();
+    }
+
+    /**
+     * Декодирует блоки [first, last) терма; reader стоит в начале блока first.
+     */
+    static bool DecodeBlocks(TBinaryReader& reader, const TDiskTerm& term, size_t first, size_t last,
+                             TTermPostings* out) {
+        TDocId base = first > 0 ? term.Blocks[first - 1].LastDoc : 0;
+        for (size_t b = first; b < last; ++b) {
+            const size_t begin = b * BLOCK_POSTINGS;
+            const size_t count = term.Count - begin < BLOCK_POSTINGS ? term.Count - begin : BLOCK_POSTINGS;
+            TDocId doc = base;
+            for (size_t i = 0; i < count; ++i) {
+                doc += static_cast<TDocId>(reader.ReadVarint());
+                out->Docs.PushBack(doc);
+            }
+            for (size_t i = 0; i < count; ++i) {
+                out->Freqs.PushBack(static_cast<TTermFreq>(reader.ReadVarint()));
+            }
+            if (doc != term.Blocks[b].LastDoc) return false;
+            base = doc;
+        }
+        return reader.Ok();
+    }
+
+    bool ReadDirect(uint64_t offset, size_t size, TByteBuffer* out) const {
+        return Pool_.ReadUncached(offset, size, out);
+    }
+
+    bool Fail() {
+        Close();
+        return false;
+    }
+
+    mutable TBufferPool Pool_;
+    TUnorderedMap<TString, TDiskTerm, TStringHash> Terms_;
+    TLargeArray<size_t> DocLengths_;
+    size_t TotalLength_ = 0;
+    size_t DocCount_ = 0;
+};
+
+/**
+ * Построение TDiskIndex по документам, без индекса в памяти (spill-and-merge).
+ *
+ * Постинги копятся в памяти прогоном; когда оценка его размера доходит до memoryBytes,
+ * прогон уходит во временный файл path.runN: термы по возрастанию, у каждого число
+ * постингов и пары (дельта id, частота). Finish сливает прогоны кучей по терму: прогоны
+ * покрывают возрастающие диапазоны id, поэтому постинги терма — их конкатенация в порядке
+ * прогонов, и они сразу уходят в TDiskIndex::TWriter. Одновременно в памяти только текущий
+ * прогон, буферы чтения прогонов, словарь и длины документов. Временные файлы удаляются
+ * в Finish и в деструкторе.
+ */
+class TDiskIndexBuilder {
+public:
+    static constexpr size_t DEFAULT_MEMORY_BYTES = 64 << 20;
+    static constexpr size_t RUN_BUFFER = 64 << 10;
+
+    explicit TDiskIndexBuilder(const TString& path, size_t memoryBytes = DEFAULT_MEMORY_BYTES)
+        : Path_(path)
+        , MemoryBytes_(memoryBytes)
+    {}
+
+    TDiskIndexBuilder(const TDiskIndexBuilder&) = delete;
+    TDiskIndexBuilder& operator=(const TDiskIndexBuilder&) = delete;
+
+    ~TDiskIndexBuilder() {
+        RemoveRuns();
+    }
+
+    template <typename InputIt>
+    TDocId AddDocument(InputIt first, InputIt last) {
+        const TDocId docId = static_cast<TDocId>(Lengths_.Size());
+        Histogram_.Clear();
+        size_t termCount = 0;
+        for (auto it = first; it != last; ++it) {
+            TString term = *it;
+            auto h = Histogram_.Find(term);
+            if (h != Histogram_.end()) {
+                ++h.Value();
+            } else {
+                Histogram_.Insert(std::move(term), TTermFreq(1));
+            }
+            ++termCount;
+        }
+
+        for (auto h = Histogram_.begin(); h != Histogram_.end(); ++h) {
+            auto it = Run_.Find(h.Key());
+            if (it == Run_.end()) {
+                Run_.Insert(TString(h.Key()), TRunPostings());
+                it = Run_.Find(h.Key());
+                RunBytes_ += h.Key().Size() + TERM_OVERHEAD;
+            }
+            it.Value().Docs.PushBack(docId);
+            it.Value().Freqs.PushBack(h.Value());
+            RunBytes_ += sizeof(TDocId) + sizeof(TTermFreq);
+        }
+        Lengths_.PushBack(termCount);
+        if (RunBytes_ >= MemoryBytes_) Spill();
+        return docId;
+    }
+
+    size_t GetDocumentCount() const { return Lengths_.Size(); }
+    size_t GetRunCount() const { return Runs_.Size(); }
+
+    /**
+     * Сбрасывает последний прогон, сливает все прогоны в файл индекса и удаляет их.
+     * false — ошибка записи или чтения временных файлов; файл индекса тогда неполон.
+     */
+    bool Finish() {
+        bool ok = Spill();
+        TDiskIndex::TWriter writer;
+        ok = ok && writer.Open(Path_.CStr());
+
+        TVector<std::unique_ptr<TRunReader>> readers;
+        THeap<TRunCursor, TGreater<TRunCursor>> heap;
+        for (size_t r = 0; r < Runs_.Size() && ok; ++r) {
+            readers.PushBack(std::unique_ptr<TRunReader>(new TRunReader()));
+            ok = readers.Back()->Open(Runs_[r]);
+            if (ok && !readers.Back()->AtEnd()) heap.Push(TRunCursor(&readers.Back()->GetTerm(), r));
+        }
+        while (ok && !heap.Empty()) {
+            const TString term = *heap.Top().Term;
+            writer.BeginTerm(term, 0);
+            while (ok && !heap.Empty() && *heap.Top().Term == term) {
+                const size_t run = heap.ExtractTop().Run;
+                TRunReader& reader = *readers[run];
+                ok = reader.CopyPostings(writer) && reader.Next();
+                if (ok && !reader.AtEnd()) heap.Push(TRunCursor(&reader.GetTerm(), run));
+            }
+            writer.EndTerm();
+        }
+        readers.Clear();
+        ok = ok && writer.Finish(Lengths_);
+        RemoveRuns();
+        return ok;
+    }
+
+private:
+    /**
+     * Ориентировочная цена нового терма в прогоне сверх его текста: узел таблицы и два вектора.
+     */
+    static constexpr size_t TERM_OVERHEAD = 96;
+
+    struct TRunPostings {
+        TPostingList Docs;
+        TVector<TTermFreq> Freqs;
+    };
+
+    /**
+     * Последовательное чтение файла прогона через буфер RUN_BUFFER байт.
+     */
+    class TRunReader {
+    public:
+        TRunReader() = default;
+        TRunReader(const TRunReader&) = delete;
+        TRunReader& operator=(const TRunReader&) = delete;
+
+        ~TRunReader() {
+            if (File_) std::fclose(File_);
+        }
+
+        bool Open(const TString& path) {
+            File_ = std::fopen(path.CStr(), "rb");
+            return File_ && Next();
+        }
+
+        /**
+         * Переходит к следующему терму; в конце файла AtEnd().
+         */
+        bool Next() {
+            if (Pos_ == Buffer_.Size() && !Fill()) {
+                AtEnd_ = true;
+                return Ok_;
+            }
+            const size_t size = static_cast<size_t>(ReadVarint());
+            TVector<char> bytes(size);
+            for (size_t i = 0; i < size && Ok_; ++i) {
+                bytes[i] = static_cast<char>(ReadByte());
+            }
+            Term_ = TString(bytes.Data(), size);
+            Count_ = static_cast<size_t>(ReadVarint());
+            return Ok_;
+        }
+
+        bool CopyPostings(TDiskIndex::TWriter& writer) {
+            TDocId docId = 0;
+            for (size_t i = 0; i < Count_ && Ok_; ++i) {
+                docId += static_cast<TDocId>(ReadVarint());
+                writer.AddPosting(docId, static_cast<TTermFreq>(ReadVarint()));
+            }
+            return Ok_;
+        }
+
+        bool AtEnd() const { return AtEnd_; }
+        const TString& GetTerm() const { return Term_; }
+
+    private:
+        bool Fill() {
+            Buffer_.Resize(RUN_BUFFER);
+            const size_t got = std::fread(Buffer_.Data(), 1, Buffer_.Size(), File_);
+            Buffer_.Resize(got);
+            Pos_ = 0;
+            if (got == 0 && std::ferror(File_)) Ok_ = false;
+            return got > 0;
+        }
+
+        unsigned char ReadByte() {
+            if (Pos_ == Buffer_.Size() && !Fill()) {
+                Ok_ = false;
+                return 0;
+            }
+            return Buffer_[Pos_++];
+        }
+
+        uint64_t ReadVarint() {
+            uint64_t value = 0;
+            for (size_t shift = 0; shift < 64 && Ok_; shift += 7) {
+                unsigned char byte = ReadByte();
+                value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+                if (!(byte & 0x80)) return value;
+            }
+            Ok_ = false;
+            return 0;
+        }
+
+        FILE* File_ = nullptr;
+        TByteBuffer Buffer_;
+        size_t Pos_ = 0;
+        bool Ok_ = true;
+        bool AtEnd_ = false;
+        TString Term_;
+        size_t Count_ = 0;
+    };
+
+    struct TRunCursor {
+        const TString* Term;
+        size_t Run;
+
+        TRunCursor() : Term(nullptr), Run(0) {}
+        TRunCursor(const TString* term, size_t run) : Term(term), Run(run) {}
+
+        bool operator>(const TRunCursor& other) const {
+            return *other.Term < *Term || (*Term == *other.Term && Run > other.Run);
+        }
+    };
+
+    /**
+     * Пишет текущий прогон в файл path.runN, термы по возрастанию.
+     */
+    bool Spill() {
+        if (Failed_) return false;
+        if (Run_.Empty()) return true;
+        TVector<const TString*> terms;
+        terms.Reserve(Run_.Size());
+        for (auto it = Run_.begin(); it != Run_.end(); ++it) {
+            terms.PushBack(&it.Key());
+        }
+        std::sort(terms.begin(), terms.end(), [](const TString* a, const TString* b) { return *a < *b; });
+
+        TString path = Path_;
+        path.Append(".run");
+        path.Append(std::to_string(Runs_.Size()).c_str());
+        FILE* file = std::fopen(path.CStr(), "wb");
+        if (!file) return Fail();
+        Runs_.PushBack(path);
+        bool ok = true;
+        TBinaryWriter out;
+        for (size_t t = 0; t < terms.Size() && ok; ++t) {
+            const TRunPostings& postings = Run_.Find(*terms[t]).Value();
+            out.WriteString(*terms[t]);
+            out.WriteVarint(postings.Docs.Size());
+            TDocId prev = 0;
+            for (size_t i = 0; i < postings.Docs.Size(); ++i) {
+                out.WriteVarint(postings.Docs[i] - prev);
+                out.WriteVarint(postings.Freqs[i]);
+                prev = postings.Docs[i];
+            }
+            if (out.Size() >= RUN_BUFFER || t + 1 == terms.Size()) {
+                TByteBuffer bytes = out.TakeBuffer();
+                ok = std::fwrite(bytes.Data(), 1, bytes.Size(), file) == bytes.Size();
+            }
+        }
+        ok = std::fclose(file) == 0 && ok;
+        Run_.Clear();
+        RunBytes_ = 0;
+        return ok || Fail();
+    }
+
+    void RemoveRuns() {
+        for (size_t r = 0; r < Runs_.Size(); ++r) {
+            std::remove(Runs_[r].CStr());
+        }
+        Runs_.Clear();
+    }
+
+    bool Fail() {
+        Failed_ = true;
+        return false;
+    }
+
+    TString Path_;
+    size_t MemoryBytes_;
+    TUnorderedMap<TString, TRunPostings, TStringHash> Run_;
+    size_t RunBytes_ = 0;
+    TUnorderedMap<TString, TTermFreq, TStringHash> Histogram_;
+    TLargeArray<size_t> Lengths_;
+    TVector<TString> Runs_;
+    bool Failed_ = false;
+};
+
+} // namespace NIndex
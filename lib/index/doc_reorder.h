@@ -0,0 +1,93 @@
+#pragma once
+
+#include <lib/collections/vector/vector.h>
+#include <lib/collections/unordered_map/unordered_map.h>
+#include <lib/collections/heap/heap.h>
+#include <lib/index/boolean_index.h>
+
+namespace NIndex {
+
+using NCollections::TVector;
+using NCollections::THeap;
+using NCollections::TGreater;
+
+/**
+ * Перенумерация документов для компактности постингов
+ *
+ * Каждому документу строится MinHash-подпись по множеству его термов;
+ * документы сортируются по подписи, так что похожие тексты получают соседние id
+ * и разрывы в списках постингов уменьшаются. Результат — перестановка old -> new.
+ */
+class TDocReorderer {
+public:
+    static constexpr size_t SIGNATURE_SIZE = 4;
+
+    static TVector<TDocId> ComputeOrder(const TInvertedIndex& index) {
+        size_t n = index.GetDocumentCount();
+        TVector<TSignature> signatures(n);
+        for (size_t d = 0; d < n; ++d) {
+            signatures[d].Doc = static_cast<TDocId>(d);
+        }
+
+        index.ForEachTerm([&](const TString& term, const TTermPostings& postings) {
+            size_t base = term.Hash();
+            size_t hashes[SIGNATURE_SIZE];
+            for (size_t k = 0; k < SIGNATURE_SIZE; ++k) {
+                hashes[k] = Mix(base ^ SEEDS[k]);
+            }
+            for (size_t i = 0; i < postings.Docs.Size(); ++i) {
+                TSignature& sig = signatures[postings.Docs[i]];
+                for (size_t k = 0; k < SIGNATURE_SIZE; ++k) {
+                    if (hashes[k] < sig.Hashes[k]) {
+                        sig.Hashes[k] = hashes[k];
+                    }
+                }
+            }
+        });
+
+        THeap<TSignature, TGreater<TSignature>> heap(signatures.begin(), signatures.end());
+        TVector<TDocId> newIdOf(n);
+        for (size_t rank = 0; rank < n; ++rank) {
+            newIdOf[heap.Top().Doc] = static_cast<TDocId>(rank);
+            heap.Pop();
+        }
+        return newIdOf;
+    }
+
+    static TVector<TDocId> Invert(const TVector<TDocId>& newIdOf) {
+        TVector<TDocId> oldIdOf(newIdOf.Size());
+        for (size_t d = 0; d < newIdOf.Size(); ++d) {
+            oldIdOf[newIdOf[d]] = static_cast<TDocId>(d);
+        }
+        return oldIdOf;
+    }
+
+private:
+    static constexpr size_t SEEDS[SIGNATURE_SIZE] = {
+        0x9e3779b97f4a7c15ULL, 0xbf58476d1ce4e5b9ULL, 0x94d049bb133111ebULL, 0x2545f4914f6cdd1dULL
+    };
+
+    struct TSignature {
+        size_t Hashes[SIGNATURE_SIZE];
+        TDocId Doc;
+
+        TSignature() : Doc(0) {
+            for (size_t k = 0; k < SIGNATURE_SIZE; ++k) {
+                Hashes[k] = static_cast<size_t>(-1);
+            }
+        }
+
+        bool operator>(const TSignature& other) const {
+            for (size_t k = 0; k < SIGNATURE_SIZE; ++k) {
+                if (Hashes[k] != other.Hashes[k]) return Hashes[k] > other.Hashes[k];
+            }
+            return Doc > other.Doc;
+        }
+    };
+
+    static size_t Mix(size_t h) {
+        return NCollections::THash<uint64_t>()(h);
+    }
+};
+
+} // namespace NIndex
@@ -0,0 +1,229 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <unistd.h>
+
+#include <lib/types/string/string.h>
+#include <lib/collections/vector/vector.h>
+
+namespace NIndex {
+
+using NTypes::TString;
+using NCollections::TVector;
+
+using TByteBuffer = TVector<unsigned char>;
+
+/**
+ * Запись бинарного образа индекса в память
+ *
+ * Целые пишутся в little-endian, счётчики и разности id — varint (7 бит на байт),
+ * поэтому дельта-кодированные постинги после перенумерации занимают 1-2 байта на запись.
+ */
+class TBinaryWriter {
+public:
+    void WriteU8(unsigned char value) {
+        Buffer_.PushBack(value);
+    }
+
+    void WriteU32(uint32_t value) {
+        for (size_t i = 0; i < 4; ++i) {
+            Buffer_.PushBack(static_cast<unsigned char>(value >> (i * 8)));
+        }
+    }
+
+    void WriteU64(uint64_t value) {
+        for (size_t i = 0; i < 8; ++i) {
+            Buffer_.PushBack(static_cast<unsigned char>(value >> (i * 8)));
+        }
+    }
+
+    void WriteDouble(double value) {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        WriteU64(bits);
+    }
+
+    void WriteVarint(uint64_t value) {
+        while (value >= 0x80) {
+            Buffer_.PushBack(static_cast<unsigned char>(value | 0x80));
+            value >>= 7;
+        }
+        Buffer_.PushBack(static_cast<unsigned char>(value));
+    }
+
+    void WriteBytes(const unsigned char* data, size_t size) {
+        WriteVarint(size);
+        WriteRaw(data, size);
+    }
+
+    /**
+     * Байты без префикса длины: читатель знает размер из другого места формата.
+     */
+    void WriteRaw(const unsigned char* data, size_t size) {
+        for (size_t i = 0; i < size; ++i) {
+            Buffer_.PushBack(data[i]);
+        }
+    }
+
+    void WriteString(const TString& value) {
+        WriteBytes(reinterpret_cast<const unsigned char*>(value.Data()), value.Size());
+    }
+
+    const TByteBuffer& GetBuffer() const { return Buffer_; }
+    size_t Size() const { return Buffer_.Size(); }
+
+    TByteBuffer TakeBuffer() {
+        TByteBuffer buffer;
+        buffer.Swap(Buffer_);
+        return buffer;
+    }
+
+    /**
+     * sync — дождаться сброса файла на диск (fsync) перед возвратом.
+     */
+    bool SaveToFile(const char* path, bool sync = false) const {
+        FILE* file = std::fopen(path, "wb");
+        if (!file) return false;
+        size_t written = Buffer_.Empty() ? 0 : std::fwrite(Buffer_.Data(), 1, Buffer_.Size(), file);
+        bool ok = written == Buffer_.Size();
+        if (sync) {
+            ok = ok && std::fflush(file) == 0 && ::fsync(::fileno(file)) == 0;
+        }
+        ok = std::fclose(file) == 0 && ok;
+        return ok;
+    }
+
+private:
+    TByteBuffer Buffer_;
+};
+
+/**
+ * Чтение бинарного образа индекса
+ *
+ * Выход за границу буфера не бросает исключение, а взводит флаг ошибки:
+ * вызывающий проверяет Ok() один раз после разбора секции.
+ */
+class TBinaryReader {
+public:
+    explicit TBinaryReader(const TByteBuffer& buffer)
+        : Data_(buffer.Data()), Size_(buffer.Size()), Pos_(0), Failed_(false) {}
+
+    TBinaryReader(const unsigned char* data, size_t size)
+        : Data_(data), Size_(size), Pos_(0), Failed_(false) {}
+
+    unsigned char ReadU8() {
+        if (!Require(1)) return 0;
+        return Data_[Pos_++];
+    }
+
+    uint32_t ReadU32() {
+        if (!Require(4)) return 0;
+        uint32_t value = 0;
+        for (size_t i = 0; i < 4; ++i) {
+            value |= static_cast<uint32_t>(Data_[Pos_++]) << (i * 8);
+        }
+        return value;
+    }
+
+    uint64_t ReadU64() {
+        if (!Require(8)) return 0;
+        uint64_t value = 0;
+        for (size_t i = 0; i < 8; ++i) {
+            value |= static_cast<uint64_t>(Data_[Pos_++]) << (i * 8);
+        }
+        return value;
+    }
+
+    double ReadDouble() {
+        uint64_t bits = ReadU64();
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    uint64_t ReadVarint() {
+        uint64_t value = 0;
+        for (size_t shift = 0; shift < 64; shift += 7) {
+            if (!Require(1)) return 0;
+            unsigned char byte = Data_[Pos_++];
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return value;
+        }
+        Failed_ = true;
+        return 0;
+    }
+
+    TString ReadString() {
+        size_t size = static_cast<size_t>(ReadVarint());
+        if (!Require(size)) return TString();
+        TString value(reinterpret_cast<const char*>(Data_ + Pos_), size);
+        Pos_ += size;
+        return value;
+    }
+
+    TByteBuffer ReadBytes() {
+        size_t size = static_cast<size_t>(ReadVarint());
+        if (!Require(size)) return TByteBuffer();
+        TByteBuffer value(Data_ + Pos_, Data_ + Pos_ + size);
+        Pos_ += size;
+        return value;
+    }
+
+    /**
+     * Пропускает значение, записанное WriteBytes/WriteString.
+     */
+    void SkipBytes() {
+        size_t size = static_cast<size_t>(ReadVarint());
+        if (Require(size)) Pos_ += size;
+    }
+
+    /**
+     * Счётчик элементов, каждый из которых занимает хотя бы minBytes байт.
+     * Заведомо невозможный счётчик (битый файл) сразу даёт ошибку, а не огромный Reserve.
+     */
+    size_t ReadCount(size_t minBytes = 1) {
+        uint64_t count = ReadVarint();
+        if (minBytes > 0 && count > Remaining() / minBytes) {
+            Failed_ = true;
+            return 0;
+        }
+        return static_cast<size_t>(count);
+    }
+
+    bool Ok() const { return !Failed_; }
+    bool AtEnd() const { return Pos_ == Size_; }
+    size_t Remaining() const { return Size_ - Pos_; }
+
+    static bool LoadFile(const char* path, TByteBuffer* buffer) {
+        FILE* file = std::fopen(path, "rb");
+        if (!file) return false;
+        bool ok = std::fseek(file, 0, SEEK_END) == 0;
+        long size = ok ? std::ftell(file) : -1;
+        ok = ok && size >= 0 && std::fseek(file, 0, SEEK_SET) == 0;
+        if (ok) {
+            buffer->Resize(static_cast<size_t>(size));
+            ok = size == 0 || std::fread(buffer->Data(), 1, buffer->Size(), file) == buffer->Size();
+        }
+        std::fclose(file);
+        return ok;
+    }
+
+private:
+    bool Require(size_t bytes) {
+        if (Failed_ || bytes > Size_ - Pos_) {
+            Failed_ = true;
+            return false;
+        }
+        return true;
+    }
+
+    const unsigned char* Data_;
+    size_t Size_;
+    size_t Pos_;
+    bool Failed_;
+};
+
+} // namespace NIndex
@@ -0,0 +1,231 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include <lib/types/string/string.h>
+#include <lib/collections/vector/vector.h>
+#include <lib/collections/unordered_map/unordered_map.h>
+#include <lib/index/posting_ops.h>
+
+namespace NIndex {
+
+using NTypes::TString;
+using NCollections::TVector;
+using NCollections::TUnorderedMap;
+using NCollections::TStringHash;
+
+/**
+ * Внешние ключи документов (ObjectId, номер строки JSONL и т.п.) в обе стороны.
+ *
+ * Ключи лежат одним массивом фиксированной ширины: ключ id — байты
+ * [id * Width, (id + 1) * Width), короче ширины — добиваются нулями, поэтому ключ
+ * не может содержать '\0'. Ширина — длина самого длинного ключа и растёт с перепаковкой,
+ * но не больше MaxWidth: более длинные ключи лежат отдельно (LongKeys_/LongIds_), чтобы
+ * один выброс не раздувал слот каждого документа.
+ * Обратное отображение — хеш-таблица с открытой адресацией, в слотах только id:
+ * ключ для сравнения берётся из того же массива. Пустой ключ не индексируется;
+ * при повторе ключа поиск отдаёт последний id. Псевдонимы (AddAlias) — редкие
+ * дополнительные ключи id, например ключи пропущенных дубликатов; они лежат в обычной
+ * хеш-таблице и уступают основным ключам, поэтому результат не зависит от порядка загрузки.
+ */
+class TExternalKeyMap {
+public:
+    static constexpr size_t DEFAULT_MAX_WIDTH = 64;
+
+    explicit TExternalKeyMap(size_t maxWidth = DEFAULT_MAX_WIDTH) : MaxWidth_(maxWidth) {}
+
+    size_t Size() const { return Size_; }
+    size_t GetWidth() const { return Width_; }
+    size_t GetKeyCount() const { return Count_; }
+    size_t GetMaxWidth() const { return MaxWidth_; }
+    size_t GetLongKeyCount() const { return LongKeys_.Size(); }
+
+    void Resize(size_t size) {
+        if (size <= Size_) return;
+        Keys_.Resize(size * Width_, 0);
+        Size_ = size;
+    }
+
+    /**
+     * Задаёт ключ id (массив растёт до id + 1). false — у id уже есть ключ.
+     */
+    bool Set(size_t id, const TString& key) {
+        Resize(id + 1);
+        if ((Width_ > 0 && Slot(id)[0] != 0) || (!LongKeys_.Empty() && LongKeys_.Contains(id))) return false;
+        if (key.Empty()) return true;
+        if (key.Size() > MaxWidth_) {
+            LongKeys_.Insert(id, key);
+            if (LongIds_.Insert(key, id)) ++Count_;
+            return true;
+        }
+        if (key.Size() > Width_) Widen(key.Size());
+        std::memcpy(Slot(id), key.Data(), key.Size());
+        Insert(static_cast<TDocId>(id));
+        return true;
+    }
+
+    /**
+     * Дополнительный ключ id: Find(key) отдаёт id, Get(id) — по-прежнему основной ключ.
+     * false — ключ пуст или уже отображается (основным ключом или псевдонимом).
+     */
+    bool AddAlias(size_t id, const TString& key) {
+        size_t existing = 0;
+        if (key.Empty() || Find(key, &existing)) return false;
+        Resize(id + 1);
+        Aliases_.Insert(key, id);
+        AliasesOf_[id].PushBack(key);
+        return true;
+    }
+
+    /**
+     * Псевдонимы id в порядке добавления; nullptr — их нет.
+     */
+    const TVector<TString>* GetAliases(size_t id) const {
+        auto it = AliasesOf_.Find(id);
+        return it != AliasesOf_.end() ? &it.Value() : nullptr;
+    }
+
+    size_t GetAliasCount() const { return Aliases_.Size(); }
+
+    void Append(const TString& key) {
+        Set(Size_, key);
+    }
+
+    /**
+     * Ключ id; пустая строка — ключа нет.
+     */
+    TString Get(size_t id) const {
+        if (!LongKeys_.Empty()) {
+            auto it = LongKeys_.Find(id);
+            if (it != LongKeys_.end()) return it.Value();
+        }
+        if (id >= Size_ || Width_ == 0) return TString();
+        const char* key = Slot(id);
+        return TString(key, KeyLength(key));
+    }
+
+    bool Find(const TString& key, size_t* id) const {
+        if (key.Empty()) return false;
+        if (key.Size() <= Width_ && !Table_.Empty()) {
+            const size_t mask = Table_.Size() - 1;
+            for (size_t pos = Hash(key.Data(), key.Size()) & mask; Table_[pos] != EMPTY; pos = (pos + 1) & mask) {
+                if (Equals(Table_[pos], key.Data(), key.Size())) {
+                    *id = Table_[pos];
+                    return true;
+                }
+            }
+        }
+        if (key.Size() > MaxWidth_ && !LongIds_.Empty()) {
+            auto it = LongIds_.Find(key);
+            if (it != LongIds_.end()) {
+                *id = it.Value();
+                return true;
+            }
+        }
+        if (Aliases_.Empty()) return false;
+        auto alias = Aliases_.Find(key);
+        if (alias == Aliases_.end()) return false;
+        *id = alias.Value();
+        return true;
+    }
+
+    size_t GetMemoryBytes() const {
+        size_t bytes = Keys_.Size() + Table_.Size() * sizeof(TDocId);
+        for (auto it = LongKeys_.begin(); it != LongKeys_.end(); ++it) {
+            bytes += 2 * it.Value().Size() + 2 * sizeof(size_t);
+        }
+        return bytes;
+    }
+
+    void Clear() {
+        Keys_.Clear();
+        Table_.Clear();
+        LongKeys_.Clear();
+        LongIds_.Clear();
+        Aliases_.Clear();
+        AliasesOf_.Clear();
+        Size_ = 0;
+        Width_ = 0;
+        Count_ = 0;
+    }
+
+private:
+    static constexpr TDocId EMPTY = static_cast<TDocId>(-1);
+    static constexpr size_t MIN_TABLE = 16;
+
+    char* Slot(size_t id) { return Keys_.Data() + id * Width_; }
+    const char* Slot(size_t id) const { return Keys_.Data() + id * Width_; }
+
+    size_t KeyLength(const char* key) const {
+        size_t length = 0;
+        while (length < Width_ && key[length] != 0) ++length;
+        return length;
+    }
+
+    static size_t Hash(const char* data, size_t size) {
+        uint64_t hash = 14695981039346656037ULL;
+        for (size_t i = 0; i < size; ++i) {
+            hash ^= static_cast<unsigned char>(data[i]);
+            hash *= 1099511628211ULL;
+        }
+        return static_cast<size_t>(hash ^ (hash >> 32));
+    }
+
+    bool Equals(TDocId id, const char* key, size_t size) const {
+        const char* stored = Slot(id);
+        return std::memcmp(stored, key, size) == 0 && (size == Width_ || stored[size] == 0);
+    }
+
+    void Widen(size_t width) {
+        TVector<char> widened(Size_ * width, 0);
+        for (size_t id = 0; id < Size_ && Width_ > 0; ++id) {
+            std::memcpy(widened.Data() + id * width, Slot(id), Width_);
+        }
+        Keys_.Swap(widened);
+        Width_ = width;
+    }
+
+    void Insert(TDocId id) {
+        if ((Count_ + 1) * 2 > Table_.Size()) Rehash(Table_.Empty() ? MIN_TABLE : Table_.Size() * 2);
+        const char* key = Slot(id);
+        const size_t size = KeyLength(key);
+        const size_t mask = Table_.Size() - 1;
+        size_t pos = Hash(key, size) & mask;
+        for (; Table_[pos] != EMPTY; pos = (pos + 1) & mask) {
+            if (Equals(Table_[pos], key, size)) {
+                Table_[pos] = id;
+                return;
+            }
+        }
+        Table_[pos] = id;
+        ++Count_;
+    }
+
+    void Rehash(size_t capacity) {
+        TVector<TDocId> old;
+        old.Swap(Table_);
+        Table_.Resize(capacity, EMPTY);
+        const size_t mask = capacity - 1;
+        for (size_t i = 0; i < old.Size(); ++i) {
+            if (old[i] == EMPTY) continue;
+            const char* key = Slot(old[i]);
+            size_t pos = Hash(key, KeyLength(key)) & mask;
+            while (Table_[pos] != EMPTY) pos = (pos + 1) & mask;
+            Table_[pos] = old[i];
+        }
+    }
+
+    TVector<char> Keys_;
+    TVector<TDocId> Table_;
+    TUnorderedMap<size_t, TString> LongKeys_;
+    TUnorderedMap<TString, size_t, TStringHash> LongIds_;
+    TUnorderedMap<TString, size_t, TStringHash> Aliases_;
+    TUnorderedMap<size_t, TVector<TString>> AliasesOf_;
+    size_t MaxWidth_;
+    size_t Size_ = 0;
+    size_t Width_ = 0;
+    size_t Count_ = 0;
+};
+
+} // namespace NIndex
@@ -0,0 +1,20 @@
+#pragma once
+
+namespace NIndex {
+
+/**
+ * Натуральный логарифм без libm: аргумент делением на e приводится к [1/e, e],
+ * остаток считается рядом 2·artanh((x - 1) / (x + 1)) до седьмой степени. Для x <= 0 — 0.
+ */
+inline double Log(double x) {
+    if (x <= 0) return 0;
+    double result = 0;
+    while (x > 2.718281828) { x /= 2.718281828; result += 1; }
+    while (x < 0.367879441) { x *= 2.718281828; result -= 1; }
+    double y = (x - 1) / (x + 1);
+    double y2 = y * y;
+    result += 2 * y * (1 + y2/3 + y2*y2/5 + y2*y2*y2/7);
+    return result;
+}
+
+} // namespace NIndex
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstdint>
+
+#include <lib/types/string/string.h>
+#include <lib/collections/vector/vector.h>
+#include <lib/collections/unordered_map/unordered_map.h>
+#include <lib/index/index_io.h>
+
+namespace NIndex {
+
+using NTypes::TString;
+using NCollections::TVector;
+using NCollections::TUnorderedMap;
+
+/**
+ * Поиск почти-дубликатов по SimHash
+ *
+ * 64-битная подпись строится по уже токенизированным термам; подписи раскладываются
+ * в LSH-индекс из BANDS полос. При допустимом расстоянии Хэмминга < BANDS хотя бы
+ * одна полоса совпадает точно (принцип Дирихле), поэтому кандидаты берутся только
+ * из корзин совпавших полос. Подпись — чистая функция термов и может считаться
+ * в потоках загрузки, сам индекс — O(BANDS) поисков на документ.
+ * Корзины хранят 32-битные номера записей, подписи и группы лежат в плоских массивах.
+ */
+class TNearDuplicateIndex {
+public:
+    using TSignature = uint64_t;
+
+    static constexpr size_t BANDS = 6;
+
+    struct TOptions {
+        size_t MaxHammingDistance = BANDS - 1;
+    };
+
+    TNearDuplicateIndex() : Options_() {}
+    explicit TNearDuplicateIndex(const TOptions& options) : Options_(options) {}
+
+    template <typename InputIt>
+    static TSignature ComputeSignature(InputIt first, InputIt last) {
+        int weights[64] = {0};
+        bool any = false;
+        for (auto it = first; it != last; ++it) {
+            const TString& term = *it;
+            uint64_t h = Mix(static_cast<uint64_t>(term.Hash()));
+            for (size_t bit = 0; bit < 64; ++bit) {
+                weights[bit] += ((h >> bit) & 1) ? 1 : -1;
+            }
+            any = true;
+        }
+        if (!any) return 0;
+
+        TSignature signature = 0;
+        for (size_t bit = 0; bit < 64; ++bit) {
+            if (weights[bit] > 0) {
+                signature |= TSignature(1) << bit;
+            }
+        }
+        return signature;
+    }
+
+    static size_t HammingDistance(TSignature a, TSignature b) {
+        return static_cast<size_t>(__builtin_popcountll(a ^ b));
+    }
+
+    /**
+     * Ищет группу, к которой относится подпись. Возвращает true и id группы,
+     * если найден почти-дубликат на расстоянии не больше MaxHammingDistance.
+     */
+    bool Find(TSignature signature, size_t* group) const {
+        size_t best = Options_.MaxHammingDistance + 1;
+        for (size_t band = 0; band < BANDS; ++band) {
+            auto it = Bands_.Find(BandKey(signature, band));
+            if (it == Bands_.end()) continue;
+            const TVector<uint32_t>& bucket = it.Value();
+            for (size_t i = 0; i < bucket.Size(); ++i) {
+                size_t distance = HammingDistance(signature, Signatures_[bucket[i]]);
+                if (distance < best) {
+                    best = distance;
+                    *group = Groups_[bucket[i]];
+                }
+            }
+        }
+        return best <= Options_.MaxHammingDistance;
+    }
+
+    void Add(TSignature signature, size_t group) {
+        uint32_t entry = static_cast<uint32_t>(Signatures_.Size());
+        Signatures_.PushBack(signature);
+        Groups_.PushBack(group);
+        for (size_t band = 0; band < BANDS; ++band) {
+            Bands_[BandKey(signature, band)].PushBack(entry);
+        }
+    }
+
+    size_t Size() const { return Signatures_.Size(); }
+
+    void Clear() {
+        Bands_.Clear();
+        Signatures_.Clear();
+        Groups_.Clear();
+    }
+
+    /**
+     * Сохраняются только подписи и группы, корзины полос строятся заново при загрузке.
+     */
+    void Save(TBinaryWriter& writer) const {
+        writer.WriteVarint(Signatures_.Size());
+        for (size_t i = 0; i < Signatures_.Size(); ++i) {
+            writer.WriteU64(Signatures_[i]);
+            writer.WriteVarint(Groups_[i]);
+        }
+    }
+
+    bool Load(TBinaryReader& reader) {
+        Clear();
+        size_t count = reader.ReadCount(9);
+        for (size_t i = 0; i < count && reader.Ok(); ++i) {
+            TSignature signature = reader.ReadU64();
+            size_t group = static_cast<size_t>(reader.ReadVarint());
+            Add(signature, group);
+        }
+        return reader.Ok();
+    }
+
+private:
+    static uint64_t BandKey(TSignature signature, size_t band) {
+        size_t begin = band * 64 / BANDS;
+        size_t end = (band + 1) * 64 / BANDS;
+        uint64_t mask = (uint64_t(1) << (end - begin)) - 1;
+        return (static_cast<uint64_t>(band) << 56) | ((signature >> begin) & mask);
+    }
+
+    static uint64_t Mix(uint64_t h) {
+        return NCollections::THash<uint64_t>()(h);
+    }
+
+    TOptions Options_;
+    TUnorderedMap<uint64_t, TVector<uint32_t>> Bands_;
+    TVector<TSignature> Signatures_;
+    TVector<size_t> Groups_;
+};
+
+} // namespace NIndex
@@ -0,0 +1,325 @@
+#pragma once
+
+#include <cstdint>
+
+#include <lib/types/string/string.h>
+#include <lib/collections/vector/vector.h>
+#include <lib/collections/unordered_set/unordered_set.h>
+#include <lib/index/pipeline.h>
+#include <lib/index/index_io.h>
+
+namespace NIndex {
+
+using NTypes::TString;
+using NCollections::TVector;
+using NCollections::TUnorderedSet;
+
+/**
+ * Индекс фрагментов стихотворений: строк или строф
+ *
+ * Текст делится на фрагменты по переводам строк (Line) или по пустым строкам (Stanza),
+ * каждый фрагмент — отдельный документ своего TInvertedIndex со ссылкой на родителя,
+ * байтовым диапазоном в тексте и номерами строк. Границы фиксируются при токенизации:
+ * Tokenize прогоняет конвейер по фрагментам, и термы документа — их конкатенация,
+ * второго прохода по тексту нет. Фрагменты ранжируются тем же ядром TScoringDispatcher;
+ * документ получает оценку лучшего фрагмента (max-passage), а сниппет — диапазон этого
+ * фрагмента. Фрагменты родителя идут подряд, родители дописываются по возрастанию.
+ */
+class TPassageIndex {
+public:
+    enum class EUnit {
+        None,
+        Line,
+        Stanza
+    };
+
+    /**
+     * Байты [Begin, End) текста родителя, строки [FirstLine, FirstLine + LineCount) с нуля.
+     */
+    struct TSpan {
+        uint32_t Begin = 0;
+        uint32_t End = 0;
+        uint32_t FirstLine = 0;
+        uint32_t LineCount = 0;
+    };
+
+    /**
+     * Разбор документа: Terms — все термы подряд, фрагмент i владеет
+     * Terms[TermEnds[i - 1], TermEnds[i]). Фрагменты без термов отброшены.
+     */
+    struct TTokenized {
+        TVector<TString> Terms;
+        TVector<TSpan> Spans;
+        TVector<size_t> TermEnds;
+    };
+
+    struct THit {
+        TDocId Passage;
+        TDocId Parent;
+        double Score;
+    };
+
+    TPassageIndex() {
+        FirstPassage_.PushBack(0);
+    }
+
+    EUnit GetUnit() const { return Unit_; }
+    void SetUnit(EUnit unit) { Unit_ = unit; }
+    bool IsEnabled() const { return Unit_ != EUnit::None; }
+
+    size_t Size() const { return Parent_.Size(); }
+    size_t GetParentCount() const { return FirstPassage_.Size() - 1; }
+    const TInvertedIndex& GetIndex() const { return Index_; }
+
+    /**
+     * Фрагменты текста; для None — пусто.
+     */
+    static TVector<TSpan> Split(const TString& text, EUnit unit) {
+        TVector<TSpan> spans;
+        if (unit == EUnit::None) return spans;
+        TSpan current;
+        bool open = false;
+        uint32_t line = 0;
+        for (size_t begin = 0; begin < text.Size(); ++line) {
+            size_t end = begin;
+            while (end < text.Size() && text[end] != '\n') ++end;
+            size_t stop = end;
+            while (stop > begin && (text[stop - 1] == '\r' || text[stop - 1] == ' ' || text[stop - 1] == '\t')) --stop;
+            size_t start = begin;
+            while (start < stop && (text[start] == ' ' || text[start] == '\t')) ++start;
+
+            if (start == stop) {
+                if (open) spans.PushBack(current);
+                open = false;
+            } else if (unit == EUnit::Line || !open) {
+                if (open) spans.PushBack(current);
+                current.Begin = static_cast<uint32_t>(start);
+                current.End = static_cast<uint32_t>(stop);
+                current.FirstLine = line;
+                current.LineCount = 1;
+                open = true;
+            } else {
+                current.End = static_cast<uint32_t>(stop);
+                current.LineCount = line - current.FirstLine + 1;
+            }
+            begin = end + 1;
+        }
+        if (open) spans.PushBack(current);
+        return spans;
+    }
+
+    static TTokenized Tokenize(const TTextPipeline& pipeline, const TString& text, EUnit unit) {
+        TTokenized result;
+        if (unit == EUnit::None) {
+            result.Terms = pipeline.Process(text);
+            return result;
+        }
+        TVector<TSpan> spans = Split(text, unit);
+        for (size_t i = 0; i < spans.Size(); ++i) {
+            TVector<TString> terms = pipeline.Process(TString(text.Data() + spans[i].Begin, spans[i].End - spans[i].Begin));
+            if (terms.Empty()) continue;
+            for (size_t t = 0; t < terms.Size(); ++t) {
+                result.Terms.PushBack(std::move(terms[t]));
+            }
+            result.Spans.PushBack(spans[i]);
+            result.TermEnds.PushBack(result.Terms.Size());
+        }
+        return result;
+    }
+
+    /**
+     * Фрагменты родителя parent; false — parent меньше уже добавленного.
+     */
+    bool AddDocument(TDocId parent, const TTokenized& doc) {
+        if (parent < GetParentCount()) return false;
+        while (GetParentCount() < parent) {
+            FirstPassage_.PushBack(Parent_.Size());
+        }
+        size_t from = 0;
+        for (size_t i = 0; i < doc.Spans.Size(); ++i) {
+            Index_.AddDocument(doc.Terms.begin() + from, doc.Terms.begin() + doc.TermEnds[i]);
+            Parent_.PushBack(parent);
+            Spans_.PushBack(doc.Spans[i]);
+            from = doc.TermEnds[i];
+        }
+        FirstPassage_.PushBack(Parent_.Size());
+        return true;
+    }
+
+    TDocId GetParent(TDocId passage) const { return Parent_[passage]; }
+    const TSpan& GetSpan(TDocId passage) const { return Spans_[passage]; }
+
+    /**
+     * Фрагменты родителя — [*first, *last).
+     */
+    void GetPassages(TDocId parent, size_t* first, size_t* last) const {
+        *first = *last = 0;
+        if (parent >= GetParentCount()) return;
+        *first = FirstPassage_[parent];
+        *last = FirstPassage_[parent + 1];
+    }
+
+    TString GetText(TDocId passage, const TString& parentText) const {
+        const TSpan& span = Spans_[passage];
+        if (span.End > parentText.Size()) return TString();
+        return TString(parentText.Data() + span.Begin, span.End - span.Begin);
+    }
+
+    /**
+     * Фрагменты удалённого родителя перестают попадать в выдачу (tombstones, как у базы).
+     */
+    void DeleteParent(TDocId parent) {
+        size_t first = 0;
+        size_t last = 0;
+        GetPassages(parent, &first, &last);
+        for (size_t p = first; p < last; ++p) {
+            Deleted_.Set(static_cast<TDocId>(p));
+        }
+        DeletedCount_ += last - first;
+    }
+
+    /**
+     * Ранжирование фрагментов; request.Deleted заполняется удалёнными фрагментами.
+     */
+    TVector<THit> SearchPassages(const TVector<TString>& queryTerms, TScoringRequest request) const {
+        request.Deleted = DeletedCount_ > 0 ? &Deleted_ : nullptr;
+        TScoringResult scored = TScoringDispatcher::Run(Index_, queryTerms, request);
+        TVector<THit> hits;
+        hits.Reserve(scored.Hits.Size());
+        for (size_t i = 0; i < scored.Hits.Size(); ++i) {
+            hits.PushBack(THit{scored.Hits[i].DocId, Parent_[scored.Hits[i].DocId], scored.Hits[i].Score});
+        }
+        return hits;
+    }
+
+    /**
+     * Max-passage: по родителю — лучший фрагмент с его оценкой, topK родителей.
+     * Фрагменты берутся ограниченным top-k с запасом (PASSAGE_OVERFETCH на родителя):
+     * в отсортированной выдаче первый фрагмент родителя — лучший, и если в ней набралось
+     * topK родителей, это и есть ответ. Иначе запас удваивается, пока фрагменты не кончатся.
+     */
+    TVector<THit> SearchDocuments(const TVector<TString>& queryTerms, TScoringRequest request) const {
+        const size_t topK = request.TopK;
+        TVector<THit> best;
+        if (topK == 0) return best;
+        const size_t passageCount = Parent_.Size();
+        request.Collector = ECollector::TopK;
+        request.TopK = topK * PASSAGE_OVERFETCH < passageCount ? topK * PASSAGE_OVERFETCH : passageCount;
+        for (;;) {
+            TVector<THit> passages = SearchPassages(queryTerms, request);
+            best.Clear();
+            TUnorderedSet<TDocId> seen;
+            for (size_t i = 0; i < passages.Size() && best.Size() < topK; ++i) {
+                if (seen.Contains(passages[i].Parent)) continue;
+                seen.Insert(passages[i].Parent);
+                best.PushBack(passages[i]);
+            }
+            if (best.Size() == topK || passages.Size() < request.TopK || request.TopK == passageCount) break;
+            request.TopK = request.TopK * 2 < passageCount ? request.TopK * 2 : passageCount;
+        }
+        return best;
+    }
+
+    void BuildImpacts() {
+        Index_.BuildImpacts();
+    }
+
+    void AddWarmupRanges(TMemoryWarmer& warmer) const {
+        Index_.AddWarmupRanges(warmer);
+        warmer.AddContainer(Spans_);
+    }
+
+    size_t GetMemoryBytes() const {
+        return Parent_.Size() * sizeof(TDocId) + Spans_.Size() * sizeof(TSpan) + FirstPassage_.Size() * sizeof(size_t);
+    }
+
+    /**
+     * Единица, индекс фрагментов, затем по фрагменту: разность родителя, начало, длина, строки.
+     * Удалённые не пишутся: база восстанавливает их из своих tombstones (DeleteParent).
+     */
+    void Save(TBinaryWriter& writer) const {
+        writer.WriteU8(static_cast<unsigned char>(Unit_));
+        if (!IsEnabled()) return;
+        Index_.Save(writer);
+        writer.WriteVarint(GetParentCount());
+        TDocId prev = 0;
+        for (size_t p = 0; p < Parent_.Size(); ++p) {
+            writer.WriteVarint(Parent_[p] - prev);
+            prev = Parent_[p];
+            writer.WriteVarint(Spans_[p].Begin);
+            writer.WriteVarint(Spans_[p].End - Spans_[p].Begin);
+            writer.WriteVarint(Spans_[p].FirstLine);
+            writer.WriteVarint(Spans_[p].LineCount);
+        }
+    }
+
+    /**
+     * parentCount — число документов базы: родитель вне диапазона — битый образ.
+     */
+    bool Load(TBinaryReader& reader, size_t parentCount) {
+        Clear();
+        unsigned char unit = reader.ReadU8();
+        if (unit > static_cast<unsigned char>(EUnit::Stanza)) return false;
+        Unit_ = static_cast<EUnit>(unit);
+        if (!IsEnabled()) return reader.Ok();
+        if (!Index_.Load(reader)) return false;
+        size_t parents = static_cast<size_t>(reader.ReadVarint());
+        if (parents > parentCount) return false;
+        const size_t count = Index_.GetDocumentCount();
+        Parent_.Reserve(count);
+        Spans_.Reserve(count);
+        uint64_t parent = 0;
+        for (size_t p = 0; p < count && reader.Ok(); ++p) {
+            parent += reader.ReadVarint();
+            if (parent >= parents) return false;
+            TSpan span;
+            uint64_t begin = reader.ReadVarint();
+            uint64_t end = begin + reader.ReadVarint();
+            if (end > UINT32_MAX) return false;
+            span.Begin = static_cast<uint32_t>(begin);
+            span.End = static_cast<uint32_t>(end);
+            span.FirstLine = static_cast<uint32_t>(reader.ReadVarint());
+            span.LineCount = static_cast<uint32_t>(reader.ReadVarint());
+            Parent_.PushBack(static_cast<TDocId>(parent));
+            Spans_.PushBack(span);
+        }
+        RebuildOffsets(parents);
+        return reader.Ok();
+    }
+
+    /**
+     * Удаляет фрагменты, единица остаётся.
+     */
+    void Clear() {
+        Index_.Clear();
+        Parent_.Clear();
+        Spans_.Clear();
+        FirstPassage_.Clear();
+        FirstPassage_.PushBack(0);
+        Deleted_.Clear();
+        DeletedCount_ = 0;
+    }
+
+private:
+    static constexpr size_t PASSAGE_OVERFETCH = 4;
+
+    void RebuildOffsets(size_t parents) {
+        FirstPassage_.Clear();
+        FirstPassage_.PushBack(0);
+        size_t p = 0;
+        for (size_t parent = 0; parent < parents; ++parent) {
+            while (p < Parent_.Size() && Parent_[p] == parent) ++p;
+            FirstPassage_.PushBack(p);
+        }
+    }
+
+    EUnit Unit_ = EUnit::None;
+    TInvertedIndex Index_;
+    TVector<TDocId> Parent_;
+    TVector<TSpan> Spans_;
+    TVector<size_t> FirstPassage_;
+    TDocBitset Deleted_;
+    size_t DeletedCount_ = 0;
+};
+
+} // namespace NIndex
@@ -0,0 +1,231 @@
+#pragma once
+
+#include <cstddef>
+
+#include <lib/types/string/string.h>
+#include <lib/collections/vector/vector.h>
+#include <lib/collections/unordered_map/unordered_map.h>
+#include <lib/index/boolean_index.h>
+
+namespace NIndex {
+
+using NTypes::TString;
+using NCollections::TVector;
+using NCollections::TUnorderedMap;
+using NCollections::TStringHash;
+
+/**
+ * Фонетический словарь термов (упрощённый Metaphone)
+ *
+ * Код терма — согласные по правилам чтения (ck/c/q -> K, ph -> F, sh/ch/tio -> X,
+ * th -> 0, немые буквы выбрасываются), гласные — только первая буква. Варианты
+ * написания получают один код: musick/music -> MSK, shew/show -> X. Словарь
+ * "код -> термы словаря индекса" строится целиком по TInvertedIndex (Build, при Seal);
+ * кодировщик пишет в буфер вызывающего и не выделяет память.
+ */
+class TPhoneticIndex {
+public:
+    static constexpr size_t MAX_CODE_LENGTH = 8;
+
+    /**
+     * Код слова word[0, size) в code (не больше MAX_CODE_LENGTH символов, без '\0'),
+     * возвращает длину; 0 — в слове нет латинских букв. Регистр не важен, прочие символы пропускаются.
+     */
+    static size_t Encode(const char* word, size_t size, char* code) {
+        char letters[MAX_WORD_LENGTH];
+        size_t n = 0;
+        for (size_t i = 0; i < size && n < MAX_WORD_LENGTH; ++i) {
+            char c = word[i];
+            if (c >= 'A' && c <= 'Z') c = static_cast<char>(c - 'A' + 'a');
+            if (c >= 'a' && c <= 'z') letters[n++] = c;
+        }
+        if (n == 0) return 0;
+
+        auto at = [&](size_t i) -> char { return i < n ? letters[i] : '\0'; };
+        size_t length = 0;
+        auto emit = [&](char c) {
+            if (length < MAX_CODE_LENGTH) code[length++] = c;
+        };
+
+        size_t i = 0;
+        const char a = at(0);
+        const char b = at(1);
+        bool leadingVowel = true;
+        if ((a == 'a' && b == 'e') || (b == 'n' && (a == 'g' || a == 'k' || a == 'p')) || (a == 'w' && b == 'r')) {
+            i = 1;
+        } else if (a == 'x') {
+            emit('S');
+            leadingVowel = false;
+            i = 1;
+        } else if (a == 'w' && b == 'h') {
+            emit('W');
+            leadingVowel = false;
+            i = 2;
+        }
+        if (leadingVowel && i < n && IsVowel(at(i))) {
+            emit(static_cast<char>(at(i) - 'a' + 'A'));
+            ++i;
+        }
+
+        for (; i < n; ++i) {
+            const char c = letters[i];
+            const char prev = i > 0 ? letters[i - 1] : '\0';
+            const char next = at(i + 1);
+            if (c == prev && c != 'c') continue;
+            switch (c) {
+                case 'b':
+                    if (!(prev == 'm' && i + 1 == n)) emit('B');
+                    break;
+                case 'c':
+                    if (next == 'i' && at(i + 2) == 'a') {
+                        emit('X');
+                    } else if (next == 'h') {
+                        emit(prev == 's' ? 'K' : 'X');
+                        ++i;
+                    } else if (next == 'i' || next == 'e' || next == 'y') {
+                        if (prev != 's') emit('S');
+                    } else {
+                        emit('K');
+                    }
+                    break;
+                case 'd':
+                    if (next == 'g' && (at(i + 2) == 'e' || at(i + 2) == 'i' || at(i + 2) == 'y')) {
+                        emit('J');
+                        i += 2;
+                    } else {
+                        emit('T');
+                    }
+                    break;
+                case 'g':
+                    if (next == 'h' && i + 2 < n && !IsVowel(at(i + 2))) {
+                        ++i;
+                    } else if (next == 'n' && (i + 2 == n || (at(i + 2) == 'e' && at(i + 3) == 'd' && i + 4 == n))) {
+                        break;
+                    } else if ((next == 'i' || next == 'e' || next == 'y') && prev != 'g') {
+                        emit('J');
+                    } else {
+                        emit('K');
+                    }
+                    break;
+                case 'h':
+                    if (IsVowel(next) && !IsSilencingBeforeH(prev)) emit('H');
+                    break;
+                case 'k':
+                    if (prev != 'c') emit('K');
+                    break;
+                case 'p':
+                    if (next == 'h') {
+                        emit('F');
+                        ++i;
+                    } else {
+                        emit('P');
+                    }
+                    break;
+                case 'q':
+                    emit('K');
+                    break;
+                case 's':
+                    if (next == 'h') {
+                        emit('X');
+                        ++i;
+                    } else if (next == 'i' && (at(i + 2) == 'o' || at(i + 2) == 'a')) {
+                        emit('X');
+                    } else {
+                        emit('S');
+                    }
+                    break;
+                case 't':
+                    if (next == 'i' && (at(i + 2) == 'o' || at(i + 2) == 'a')) {
+                        emit('X');
+                    } else if (next == 'h') {
+                        emit('0');
+                        ++i;
+                    } else if (!(next == 'c' && at(i + 2) == 'h')) {
+                        emit('T');
+                    }
+                    break;
+                case 'v':
+                    emit('F');
+                    break;
+                case 'w':
+                case 'y':
+                    if (IsVowel(next)) emit(static_cast<char>(c - 'a' + 'A'));
+                    break;
+                case 'x':
+                    emit('K');
+                    emit('S');
+                    break;
+                case 'z':
+                    emit('S');
+                    break;
+                case 'f':
+                case 'j':
+                case 'l':
+                case 'm':
+                case 'n':
+                case 'r':
+                    emit(static_cast<char>(c - 'a' + 'A'));
+                    break;
+                default:
+                    break;
+            }
+        }
+        return length;
+    }
+
+    static TString Encode(const TString& word) {
+        char code[MAX_CODE_LENGTH];
+        return TString(code, Encode(word.Data(), word.Size(), code));
+    }
+
+    /**
+     * Перестраивает словарь по всем термам индекса.
+     */
+    void Build(const TInvertedIndex& index) {
+        Clear();
+        index.ForEachTerm([&](const TString& term, const TTermPostings&) {
+            Add(term);
+        });
+    }
+
+    /**
+     * Добавляет один терм словаря — для индексов, которые обходят термы сами (дисковый).
+     */
+    void Add(const TString& term) {
+        char code[MAX_CODE_LENGTH];
+        size_t length = Encode(term.Data(), term.Size(), code);
+        if (length > 0) Terms_[TString(code, length)].PushBack(term);
+    }
+
+    /**
+     * Термы словаря с тем же кодом, что у term; nullptr — таких нет.
+     */
+    const TVector<TString>* FindTerms(const TString& term) const {
+        char code[MAX_CODE_LENGTH];
+        size_t length = Encode(term.Data(), term.Size(), code);
+        if (length == 0) return nullptr;
+        auto it = Terms_.Find(TString(code, length));
+        return it != Terms_.end() ? &it.Value() : nullptr;
+    }
+
+    size_t Size() const { return Terms_.Size(); }
+
+    void Clear() {
+        Terms_.Clear();
+    }
+
+private:
+    static constexpr size_t MAX_WORD_LENGTH = 64;
+
+    static bool IsVowel(char c) {
+        return c == 'a' || c == 'e' || c == 'i' || c == 'o' || c == 'u';
+    }
+
+    static bool IsSilencingBeforeH(char c) {
+        return c == 'c' || c == 'g' || c == 'p' || c == 's' || c == 't';
+    }
+
+    TUnorderedMap<TString, TVector<TString>, TStringHash> Terms_;
+};
+
+} // namespace NIndex
@@ -0,0 +1,256 @@
+#pragma once
+
+#include <lib/types/string/string.h>
+#include <lib/collections/vector/vector.h>
+#include <lib/collections/unordered_map/unordered_map.h>
+#include <lib/collections/heap/heap.h>
+#include <lib/index/posting_ops.h>
+#include <lib/index/index_io.h>
+#include <lib/index/math.h>
+
+namespace NIndex {
+
+using NTypes::TString;
+using NCollections::TVector;
+using NCollections::TUnorderedMap;
+using NCollections::TStringHash;
+using NCollections::THeap;
+using NCollections::TGreater;
+
+/**
+ * Статический индекс частых пар соседних термов ("my love", "the sea")
+ *
+ * При загрузке копятся постинги всех пар и частоты термов; в Seal() пары отбираются
+ * по log-likelihood (G^2 Даннинга) таблицы сопряжённости пары — остаются устойчивые
+ * словосочетания, встретившиеся хотя бы в MinPairDocuments документах. Остальные
+ * кандидаты освобождаются. После Seal() новые документы дописываются только в отобранные пары.
+ */
+class TBigramIndex {
+public:
+    static constexpr char PAIR_SEPARATOR = ' ';
+
+    struct TOptions {
+        size_t MinPairDocuments = 50;
+        double MinLogLikelihood = 10.83;
+        size_t MaxPairs = 100000;
+    };
+
+    TBigramIndex() : Sealed_(false), TotalPairs_(0) {}
+
+    template <typename InputIt>
+    void AddDocument(TDocId docId, InputIt first, InputIt last) {
+        TString prev;
+        bool hasPrev = false;
+        for (auto it = first; it != last; ++it) {
+            TString term = *it;
+            if (!Sealed_) {
+                ++TermCounts_[term];
+            }
+            if (hasPrev) {
+                AddPair(docId, MakeKey(prev, term));
+            }
+            prev = std::move(term);
+            hasPrev = true;
+        }
+    }
+
+    /**
+     * Отбирает пары по статистике совместной встречаемости и фиксирует индекс.
+     */
+    void Seal(const TOptions& options) {
+        if (Sealed_) return;
+
+        THeap<TScoredPair, TGreater<TScoredPair>> best;
+        for (auto it = Candidates_.begin(); it != Candidates_.end(); ++it) {
+            const TCandidate& candidate = it.Value();
+            if (candidate.Docs.Size() < options.MinPairDocuments) continue;
+            double score = LogLikelihood(it.Key(), candidate.Count);
+            if (score < options.MinLogLikelihood) continue;
+            best.Push(TScoredPair(score, &it.Key()));
+            if (best.Size() > options.MaxPairs) {
+                best.Pop();
+            }
+        }
+
+        while (!best.Empty()) {
+            const TString& key = *best.Top().Key;
+            auto it = Candidates_.Find(key);
+            Pairs_.Insert(TString(key), std::move(it.Value().Docs));
+            best.Pop();
+        }
+
+        Candidates_.Clear();
+        TermCounts_.Clear();
+        TotalPairs_ = 0;
+        Sealed_ = true;
+    }
+
+    /**
+     * Постинги пары (first, second) или nullptr, если пара не попала в индекс.
+     */
+    const TPostingList* Find(const TString& first, const TString& second) const {
+        if (!Sealed_) return nullptr;
+        auto it = Pairs_.Find(MakeKey(first, second));
+        if (it == Pairs_.end()) return nullptr;
+        return &it.Value();
+    }
+
+    size_t Size() const { return Pairs_.Size(); }
+    bool IsSealed() const { return Sealed_; }
+
+    void AddWarmupRanges(NCollections::TMemoryWarmer& warmer) const {
+        for (auto it = Pairs_.begin(); it != Pairs_.end(); ++it) {
+            warmer.AddContainer(it.Value());
+        }
+    }
+
+    void Remap(const TVector<TDocId>& newIdOf) {
+        TVector<TPostingList*> lists;
+        for (auto it = Pairs_.begin(); it != Pairs_.end(); ++it) {
+            lists.PushBack(&it.Value());
+        }
+        for (auto it = Candidates_.begin(); it != Candidates_.end(); ++it) {
+            lists.PushBack(&it.Value().Docs);
+        }
+        TPostingOps::RemapLists(lists, newIdOf);
+    }
+
+    /**
+     * В образ попадает только отобранный индекс; незапечатанные кандидаты не сохраняются.
+     */
+    void Save(TBinaryWriter& writer) const {
+        writer.WriteU8(Sealed_ ? 1 : 0);
+        writer.WriteVarint(Pairs_.Size());
+        for (auto it = Pairs_.begin(); it != Pairs_.end(); ++it) {
+            const TPostingList& docs = it.Value();
+            writer.WriteString(it.Key());
+            writer.WriteVarint(docs.Size());
+            TDocId prev = 0;
+            for (size_t i = 0; i < docs.Size(); ++i) {
+                writer.WriteVarint(docs[i] - prev);
+                prev = docs[i];
+            }
+        }
+    }
+
+    bool Load(TBinaryReader& reader, size_t documentCount) {
+        Clear();
+        Sealed_ = reader.ReadU8() != 0;
+        size_t count = reader.ReadCount();
+        for (size_t p = 0; p < count && reader.Ok(); ++p) {
+            TString key = reader.ReadString();
+            size_t size = reader.ReadCount();
+            TPostingList docs;
+            docs.Reserve(size);
+            uint64_t doc = 0;
+            for (size_t i = 0; i < size && reader.Ok(); ++i) {
+                uint64_t delta = reader.ReadVarint();
+                doc += delta;
+                if ((i > 0 && delta == 0) || doc >= documentCount) {
+                    Clear();
+                    return false;
+                }
+                docs.PushBack(static_cast<TDocId>(doc));
+            }
+            Pairs_.Insert(std::move(key), std::move(docs));
+        }
+        if (!reader.Ok()) {
+            Clear();
+            return false;
+        }
+        return true;
+    }
+
+    void Clear() {
+        Candidates_.Clear();
+        TermCounts_.Clear();
+        Pairs_.Clear();
+        TotalPairs_ = 0;
+        Sealed_ = false;
+    }
+
+private:
+    struct TCandidate {
+        TPostingList Docs;
+        size_t Count = 0;
+    };
+
+    struct TScoredPair {
+        double Score;
+        const TString* Key;
+
+        TScoredPair() : Score(0), Key(nullptr) {}
+        TScoredPair(double score, const TString* key) : Score(score), Key(key) {}
+
+        bool operator>(const TScoredPair& other) const {
+            return Score > other.Score;
+        }
+    };
+
+    static TString MakeKey(const TString& first, const TString& second) {
+        TString key;
+        key.Reserve(first.Size() + 1 + second.Size());
+        key.Append(first);
+        key.PushBack(PAIR_SEPARATOR);
+        key.Append(second);
+        return key;
+    }
+
+    void AddPair(TDocId docId, TString&& key) {
+        if (Sealed_) {
+            auto it = Pairs_.Find(key);
+            if (it != Pairs_.end() && (it.Value().Empty() || it.Value().Back() != docId)) {
+                it.Value().PushBack(docId);
+            }
+            return;
+        }
+        ++TotalPairs_;
+        TCandidate& candidate = Candidates_[key];
+        ++candidate.Count;
+        if (candidate.Docs.Empty() || candidate.Docs.Back() != docId) {
+            candidate.Docs.PushBack(docId);
+        }
+    }
+
+    /**
+     * G^2 для таблицы 2x2: пара ab, a без b, b без a, остальные пары.
+     * Пары, встречающиеся реже, чем при независимости термов, отбрасываются.
+     */
+    double LogLikelihood(const TString& key, size_t pairCount) const {
+        size_t split = key.Find(PAIR_SEPARATOR);
+        double ab = static_cast<double>(pairCount);
+        double a = static_cast<double>(TermCount(TString(key.Data(), split)));
+        double b = static_cast<double>(TermCount(TString(key.Data() + split + 1, key.Size() - split - 1)));
+        double n = static_cast<double>(TotalPairs_);
+        if (a < ab) a = ab;
+        if (b < ab) b = ab;
+        if (ab * n <= a * b) return 0;
+
+        double k12 = a - ab;
+        double k21 = b - ab;
+        double k22 = n - a - b + ab;
+        if (k22 < 0) k22 = 0;
+
+        double cells = XLogX(ab) + XLogX(k12) + XLogX(k21) + XLogX(k22);
+        double rows = XLogX(ab + k12) + XLogX(k21 + k22);
+        double cols = XLogX(ab + k21) + XLogX(k12 + k22);
+        return 2 * (cells - rows - cols + XLogX(n));
+    }
+
+    size_t TermCount(const TString& term) const {
+        auto it = TermCounts_.Find(term);
+        return it != TermCounts_.end() ? it.Value() : 0;
+    }
+
+    static double XLogX(double x) {
+        return x > 0 ? x * Log(x) : 0;
+    }
+
+    bool Sealed_;
+    size_t TotalPairs_;
+    TUnorderedMap<TString, TCandidate, TStringHash> Candidates_;
+    TUnorderedMap<TString, size_t, TStringHash> TermCounts_;
+    TUnorderedMap<TString, TPostingList, TStringHash> Pairs_;
+};
+
+} // namespace NIndex
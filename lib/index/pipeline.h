@@ -3,8 +3,11 @@
 #include <lib/types/string/string.h>
 #include <lib/collections/vector/vector.h>
 #include <lib/tokenizer/tokenizer.h>
+#include <lib/tokenizer/stopwords.h>
+#include <lib/simd/simd.h>
 #include <lib/stemmer/stemmer.h>
 #include <lib/index/boolean_index.h>
+#include <lib/index/pruning.h>
 
 namespace NIndex {
 
@@ -12,14 +15,70 @@ using NTypes::TString;
 using NCollections::TVector;
 using NTokenizer::TTokenizer;
 using NTokenizer::TToken;
+using NTokenizer::TStopwords;
 using NStemmer::TPorterStemmer;
 using NStemmer::TLemmatizer;
 
+namespace NPipelineImpl {
+
+/**
+ * Классы символов токенизатора одной таблицей: вместо цепочки сравнений
+ * на каждый байт — один индекс.
+ */
+constexpr unsigned char CHAR_ALPHA = 1;
+constexpr unsigned char CHAR_DIGIT = 2;
+constexpr unsigned char CHAR_WORD_TAIL = 4;
+constexpr unsigned char CHAR_NUMBER_TAIL = 8;
+constexpr unsigned char CHAR_SPACE = 16;
+
+struct TCharClasses {
+    unsigned char Flags[256] = {};
+
+    constexpr TCharClasses() {
+        for (int c = 0; c < 256; ++c) {
+            bool alpha = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+            bool digit = c >= '0' && c <= '9';
+            unsigned char flags = 0;
+            if (alpha) flags |= CHAR_ALPHA;
+            if (digit) flags |= CHAR_DIGIT;
+            if (alpha || digit || c == '_' || c == '-') flags |= CHAR_WORD_TAIL;
+            if (digit || c == '.' || c == ',') flags |= CHAR_NUMBER_TAIL;
+            if (c == ' ' || c == '\t' || c == '\n' || c == '\r') flags |= CHAR_SPACE;
+            Flags[c] = flags;
+        }
+    }
+
+    constexpr unsigned char operator[](char c) const {
+        return Flags[static_cast<unsigned char>(c)];
+    }
+};
+
+inline constexpr TCharClasses CHAR_CLASSES{};
+
+} // namespace NPipelineImpl
+
 /**
  * Конвейер обработки текста: токенизация -> нормализация -> стемминг/лемматизация
+ *
+ * Стоп-слова: Keep — индексировать как есть, Remove — выбрасывать,
+ * CommonGrams — выбрасывать, но индексировать биграммы со стоп-словом ("to_be", "the_sea"),
+ * чтобы такие фразы оставались находимыми без огромных списков постингов.
+ *
+ * Process и NormalizeTerm не проверяют опции на каждом токене: при создании
+ * (и в SetOptions) выбирается вариант, специализированный шаблоном по
+ * нормализатору, LowerCase, SkipNumbers и режиму стоп-слов, где разбор,
+ * приведение регистра, фильтры и стемминг слиты в один проход по тексту.
  */
 class TTextPipeline {
 public:
+    enum class EStopwordMode {
+        Keep,
+        Remove,
+        CommonGrams
+    };
+
+    static constexpr char GRAM_SEPARATOR = '_';
+
     struct TOptions {
         bool LowerCase = true;
         bool UseStemming = true;
@@ -28,33 +87,21 @@ public:
         bool SkipNumbers = true;
         size_t MinTokenLength = 2;
         size_t MaxTokenLength = 100;
+        EStopwordMode Stopwords = EStopwordMode::Keep;
     };
 
-    TTextPipeline() : Options_() {}
-    explicit TTextPipeline(const TOptions& options) : Options_(options) {}
+    TTextPipeline() : Options_() {
+        Bind();
+    }
+
+    explicit TTextPipeline(const TOptions& options) : Options_(options) {
+        Bind();
+    }
 
     TVector<TString> Process(const TString& text) const {
-        TTokenizer::TOptions tokOpts;
-        tokOpts.LowerCase = Options_.LowerCase;
-        tokOpts.SkipPunctuation = Options_.SkipPunctuation;
-        tokOpts.SkipNumbers = Options_.SkipNumbers;
-        tokOpts.MinTokenLength = Options_.MinTokenLength;
-        tokOpts.MaxTokenLength = Options_.MaxTokenLength;
-        
-        TTokenizer tokenizer(tokOpts);
-        TVector<TString> tokens = tokenizer.TokenizeToStrings(text);
-        
-        if (Options_.UseLemmatization) {
-            TLemmatizer lemmatizer;
-            return lemmatizer.LemmatizeAll(tokens);
-        }
-        
-        if (Options_.UseStemming) {
-            TPorterStemmer stemmer;
-            return stemmer.StemAll(tokens);
-        }
-        
-        return tokens;
+        TVector<TString> terms;
+        Process_(Options_, text, terms);
+        return terms;
     }
 
     TVector<TToken> Tokenize(const TString& text) const {
@@ -70,39 +117,185 @@ public:
     }
 
     TString NormalizeTerm(const TString& term) const {
-        TString result = term;
-        
-        if (Options_.LowerCase) {
-            result = TTokenizer::ToLower(result);
-        }
-        
-        if (Options_.UseLemmatization) {
-            TLemmatizer lemmatizer;
-            return lemmatizer.Lemmatize(result);
-        }
-        
-        if (Options_.UseStemming) {
-            TPorterStemmer stemmer;
-            return stemmer.Stem(result);
-        }
-        
-        return result;
+        return NormalizeTerm_(term);
     }
 
     TVector<TString> NormalizeTerms(const TVector<TString>& terms) const {
         TVector<TString> result;
         result.Reserve(terms.Size());
         for (size_t i = 0; i < terms.Size(); ++i) {
-            result.PushBack(NormalizeTerm(terms[i]));
+            result.PushBack(NormalizeTerm_(terms[i]));
         }
         return result;
     }
 
     const TOptions& GetOptions() const { return Options_; }
-    void SetOptions(const TOptions& options) { Options_ = options; }
+
+    void SetOptions(const TOptions& options) {
+        Options_ = options;
+        Bind();
+    }
 
 private:
+    enum class ENormalizer {
+        None,
+        Stem,
+        Lemma
+    };
+
+    using TProcessFn = void (*)(const TOptions& options, const TString& text, TVector<TString>& terms);
+    using TNormalizeFn = TString (*)(const TString& term);
+
+    static const TPorterStemmer& Stemmer() {
+        static const TPorterStemmer stemmer;
+        return stemmer;
+    }
+
+    static const TLemmatizer& Lemmatizer() {
+        static const TLemmatizer lemmatizer;
+        return lemmatizer;
+    }
+
+    template <ENormalizer Normalizer>
+    static TString Normalize(TString&& token) {
+        if constexpr (Normalizer == ENormalizer::Lemma) {
+            return Lemmatizer().Lemmatize(token);
+        } else if constexpr (Normalizer == ENormalizer::Stem) {
+            return Stemmer().Stem(token);
+        } else {
+            return std::move(token);
+        }
+    }
+
+    template <ENormalizer Normalizer, bool LowerCase>
+    static TString NormalizeOne(const TString& term) {
+        if constexpr (LowerCase) {
+            return Normalize<Normalizer>(TTokenizer::ToLower(term));
+        } else {
+            return Normalize<Normalizer>(TString(term));
+        }
+    }
+
+    /**
+     * Один проход по тексту для фиксированного набора опций. Правила разбора
+     * совпадают с TTokenizer: слово начинается с буквы, число — с цифры,
+     * прочие не пробельные байты — одиночные знаки препинания.
+     */
+    template <ENormalizer Normalizer, bool LowerCase, bool SkipNumbers, EStopwordMode Stopwords>
+    struct TFused {
+        struct TGramState {
+            TString Prev;
+            bool PrevStop = false;
+            bool HasPrev = false;
+        };
+
+        static void Process(const TOptions& options, const TString& text, TVector<TString>& terms) {
+            using namespace NPipelineImpl;
+            const char* data = text.Data();
+            const size_t len = text.Size();
+            const NSimd::TKernels& kernels = NSimd::Kernels();
+            TGramState grams;
+
+            size_t pos = 0;
+            while (pos < len) {
+                const unsigned char flags = CHAR_CLASSES[data[pos]];
+                const size_t start = pos++;
+                if (flags & CHAR_SPACE) {
+                    continue;
+                }
+                if (flags & CHAR_ALPHA) {
+                    while (pos < len && (CHAR_CLASSES[data[pos]] & CHAR_WORD_TAIL)) ++pos;
+                    const size_t size = pos - start;
+                    if (size < options.MinTokenLength || size > options.MaxTokenLength) {
+                        continue;
+                    }
+                    TString token(data + start, size);
+                    if constexpr (LowerCase) {
+                        kernels.LowerAscii(token.Data(), token.Data(), size);
+                    }
+                    Emit(std::move(token), grams, terms);
+                } else if (flags & CHAR_DIGIT) {
+                    while (pos < len && (CHAR_CLASSES[data[pos]] & CHAR_NUMBER_TAIL)) ++pos;
+                    if constexpr (!SkipNumbers) {
+                        Emit(TString(data + start, pos - start), grams, terms);
+                    }
+                } else if (!options.SkipPunctuation) {
+                    Emit(TString(data + start, 1), grams, terms);
+                }
+            }
+        }
+
+        static void Emit(TString&& token, TGramState& grams, TVector<TString>& terms) {
+            if constexpr (Stopwords == EStopwordMode::Keep) {
+                terms.PushBack(Normalize<Normalizer>(std::move(token)));
+            } else if constexpr (Stopwords == EStopwordMode::Remove) {
+                if (!TStopwords::Contains(token)) {
+                    terms.PushBack(Normalize<Normalizer>(std::move(token)));
+                }
+            } else {
+                const bool stop = TStopwords::Contains(token);
+                if (grams.HasPrev && (grams.PrevStop || stop)) {
+                    TString gram;
+                    gram.Reserve(grams.Prev.Size() + 1 + token.Size());
+                    gram.Append(grams.Prev);
+                    gram.PushBack(GRAM_SEPARATOR);
+                    gram.Append(token);
+                    terms.PushBack(std::move(gram));
+                }
+                if (!stop) {
+                    terms.PushBack(Normalize<Normalizer>(TString(token)));
+                }
+                grams.Prev = std::move(token);
+                grams.PrevStop = stop;
+                grams.HasPrev = true;
+            }
+        }
+    };
+
+    template <ENormalizer Normalizer, bool LowerCase, bool SkipNumbers>
+    static TProcessFn SelectProcess(EStopwordMode stopwords) {
+        switch (stopwords) {
+            case EStopwordMode::Remove:
+                return &TFused<Normalizer, LowerCase, SkipNumbers, EStopwordMode::Remove>::Process;
+            case EStopwordMode::CommonGrams:
+                return &TFused<Normalizer, LowerCase, SkipNumbers, EStopwordMode::CommonGrams>::Process;
+            case EStopwordMode::Keep:
+                break;
+        }
+        return &TFused<Normalizer, LowerCase, SkipNumbers, EStopwordMode::Keep>::Process;
+    }
+
+    template <ENormalizer Normalizer, bool LowerCase>
+    static TProcessFn SelectProcess(const TOptions& options) {
+        return options.SkipNumbers
+            ? SelectProcess<Normalizer, LowerCase, true>(options.Stopwords)
+            : SelectProcess<Normalizer, LowerCase, false>(options.Stopwords);
+    }
+
+    template <ENormalizer Normalizer>
+    void Bind() {
+        if (Options_.LowerCase) {
+            Process_ = SelectProcess<Normalizer, true>(Options_);
+            NormalizeTerm_ = &NormalizeOne<Normalizer, true>;
+        } else {
+            Process_ = SelectProcess<Normalizer, false>(Options_);
+            NormalizeTerm_ = &NormalizeOne<Normalizer, false>;
+        }
+    }
+
+    void Bind() {
+        if (Options_.UseLemmatization) {
+            Bind<ENormalizer::Lemma>();
+        } else if (Options_.UseStemming) {
+            Bind<ENormalizer::Stem>();
+        } else {
+            Bind<ENormalizer::None>();
+        }
+    }
+
     TOptions Options_;
+    TProcessFn Process_ = nullptr;
+    TNormalizeFn NormalizeTerm_ = nullptr;
 };
 
 /**
@@ -143,6 +336,14 @@ public:
         return TfIdf_.Search(queryTerms, topK);
     }
 
+    TScoringResult Score(const TString& query, const TScoringRequest& request) const {
+        return TfIdf_.Score(Pipeline_.Process(query), request);
+    }
+
+    TScoringResult ScoreTerms(const TVector<TString>& queryTerms, const TScoringRequest& request) const {
+        return TfIdf_.Score(queryTerms, request);
+    }
+
     TVector<TTfIdf::TSearchResult> SearchTerms(const TVector<TString>& queryTerms, size_t topK = 10) const {
         return TfIdf_.Search(queryTerms, topK);
     }
@@ -206,6 +407,58 @@ public:
     const TTfIdf& GetTfIdf() const { return TfIdf_; }
     const TBooleanSearch& GetBooleanSearch() const { return BooleanSearch_; }
 
+    void Remap(const TVector<TDocId>& newIdOf) {
+        Index_.Remap(newIdOf);
+        TUnorderedMap<TDocId, TString> titles;
+        for (auto it = Titles_.begin(); it != Titles_.end(); ++it) {
+            titles.Insert(TDocId(newIdOf[it.Key()]), std::move(it.Value()));
+        }
+        Titles_.Swap(titles);
+    }
+
+    TStaticPruner::TReport Prune(const TStaticPruner::TOptions& options) {
+        return TStaticPruner(options).Prune(Index_);
+    }
+
+    void BuildTermFilter(size_t bitsPerKey) {
+        Index_.BuildTermFilter(bitsPerKey);
+    }
+
+    void BuildSketches(size_t minDocFrequency) {
+        Index_.BuildSketches(minDocFrequency);
+    }
+
+    void BuildImpacts() {
+        Index_.BuildImpacts();
+    }
+
+    void AddWarmupRanges(TMemoryWarmer& warmer) const {
+        Index_.AddWarmupRanges(warmer);
+        for (auto it = Titles_.begin(); it != Titles_.end(); ++it) {
+            warmer.AddContainer(it.Value());
+        }
+    }
+
+    void Save(TBinaryWriter& writer) const {
+        Index_.Save(writer);
+        writer.WriteVarint(Titles_.Size());
+        for (auto it = Titles_.begin(); it != Titles_.end(); ++it) {
+            writer.WriteVarint(it.Key());
+            writer.WriteString(it.Value());
+        }
+    }
+
+    bool Load(TBinaryReader& reader) {
+        Titles_.Clear();
+        if (!Index_.Load(reader)) return false;
+        size_t count = reader.ReadCount();
+        for (size_t i = 0; i < count && reader.Ok(); ++i) {
+            TDocId docId = static_cast<TDocId>(reader.ReadVarint());
+            Titles_.Insert(docId, reader.ReadString());
+        }
+        return reader.Ok();
+    }
+
     void Clear() {
         Index_.Clear();
         Titles_.Clear();
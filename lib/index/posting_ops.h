@@ -0,0 +1,263 @@
+#pragma once
+
+#include <cstdint>
+
+#include <lib/collections/vector/vector.h>
+#include <lib/collections/heap/heap.h>
+#include <lib/collections/large_array/large_array.h>
+#include <lib/simd/simd.h>
+
+namespace NIndex {
+
+using NCollections::TVector;
+using NCollections::THeap;
+using NCollections::TGreater;
+
+/**
+ * Ширина id документа задаётся при сборке: по умолчанию 32 бита (корпус меньше 4 млрд документов),
+ * INFO_SEARCH_WIDE_DOC_IDS возвращает size_t. Наружу (C API) id всегда отдаются как size_t.
+ */
+#ifdef INFO_SEARCH_WIDE_DOC_IDS
+using TDocId = size_t;
+#else
+using TDocId = uint32_t;
+#endif
+
+using TPostingList = TVector<TDocId>;
+using TTermFreq = unsigned int;
+
+/**
+ * Операции над отсортированными списками документов
+ *
+ * UnionMany объединяет k списков за один проход: курсоры списков лежат в min-куче,
+ * результат не перекопируется k раз, как при попарном свёртывании.
+ * Если ожидаемый результат плотный, вместо кучи используется битовая карта;
+ * оценку размера результата может передать вызывающий (скетчи индекса), иначе берётся сумма длин.
+ * Intersect при сильно разных длинах списков переходит на галоп по длинному списку.
+ */
+class TPostingOps {
+public:
+    static constexpr size_t DENSE_DIVISOR = 16;
+    static constexpr size_t GALLOP_RATIO = 32;
+    static constexpr size_t PREFETCH_DISTANCE = 16;
+
+    static TPostingList Intersect(const TPostingList& a, const TPostingList& b) {
+        if (a.Size() * GALLOP_RATIO < b.Size()) return IntersectGalloping(a, b);
+        if (b.Size() * GALLOP_RATIO < a.Size()) return IntersectGalloping(b, a);
+        return IntersectMerge(a, b);
+    }
+
+    /**
+     * Для 32-битных id слияние выполняет векторное ядро, выбранное под процессор (NSimd).
+     */
+    static TPostingList IntersectMerge(const TPostingList& a, const TPostingList& b) {
+        TPostingList result;
+        if constexpr (sizeof(TDocId) == sizeof(uint32_t)) {
+            result.Resize(a.Size() < b.Size() ? a.Size() : b.Size());
+            size_t size = NSimd::Kernels().IntersectU32(
+                reinterpret_cast<const uint32_t*>(a.Data()), a.Size(),
+                reinterpret_cast<const uint32_t*>(b.Data()), b.Size(),
+                reinterpret_cast<uint32_t*>(result.Data()));
+            result.Resize(size);
+            return result;
+        }
+        size_t i = 0, j = 0;
+        while (i < a.Size() && j < b.Size()) {
+            if (a[i] == b[j]) {
+                result.PushBack(a[i]);
+                ++i; ++j;
+            } else if (a[i] < b[j]) {
+                ++i;
+            } else {
+                ++j;
+            }
+        }
+        return result;
+    }
+
+    /**
+     * Каждый элемент короткого списка ищется в длинном экспоненциальным поиском
+     * от предыдущей найденной позиции: O(|small| * log(|large| / |small|)).
+     */
+    static TPostingList IntersectGalloping(const TPostingList& small, const TPostingList& large) {
+        TPostingList result;
+        size_t lo = 0;
+        for (size_t i = 0; i < small.Size() && lo < large.Size(); ++i) {
+            TDocId doc = small[i];
+            size_t step = 1;
+            size_t hi = lo;
+            while (hi < large.Size() && large[hi] < doc) {
+                lo = hi + 1;
+                hi += step;
+                step *= 2;
+            }
+            if (hi > large.Size()) hi = large.Size();
+            while (lo < hi) {
+                size_t mid = lo + (hi - lo) / 2;
+                if (large[mid] < doc) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            if (lo < large.Size() && large[lo] == doc) {
+                result.PushBack(doc);
+                ++lo;
+            }
+        }
+        return result;
+    }
+
+    static TPostingList Union(const TPostingList& a, const TPostingList& b) {
+        TPostingList result;
+        result.Reserve(a.Size() + b.Size());
+        size_t i = 0, j = 0;
+        while (i < a.Size() && j < b.Size()) {
+            if (a[i] == b[j]) {
+                result.PushBack(a[i]);
+                ++i; ++j;
+            } else if (a[i] < b[j]) {
+                result.PushBack(a[i]);
+                ++i;
+            } else {
+                result.PushBack(b[j]);
+                ++j;
+            }
+        }
+        while (i < a.Size()) { result.PushBack(a[i]); ++i; }
+        while (j < b.Size()) { result.PushBack(b[j]); ++j; }
+        return result;
+    }
+
+    static TPostingList UnionMany(const TVector<const TPostingList*>& lists) {
+        return UnionMany(lists, 0);
+    }
+
+    static TPostingList UnionMany(const TVector<const TPostingList*>& lists, size_t estimatedSize) {
+        TVector<const TPostingList*> nonEmpty;
+        size_t total = 0;
+        size_t universe = 0;
+        for (size_t i = 0; i < lists.Size(); ++i) {
+            const TPostingList* list = lists[i];
+            if (!list || list->Empty()) continue;
+            nonEmpty.PushBack(list);
+            total += list->Size();
+            if (static_cast<size_t>(list->Back()) + 1 > universe) {
+                universe = static_cast<size_t>(list->Back()) + 1;
+            }
+        }
+
+        if (nonEmpty.Empty()) return TPostingList();
+        if (nonEmpty.Size() == 1) return TPostingList(*nonEmpty[0]);
+        if (nonEmpty.Size() == 2) return Union(*nonEmpty[0], *nonEmpty[1]);
+
+        size_t estimate = estimatedSize > 0 && estimatedSize < total ? estimatedSize : total;
+        if (IsDense(estimate, universe)) {
+            return UnionBitmap(nonEmpty, universe);
+        }
+        return UnionHeap(nonEmpty, estimate);
+    }
+
+    static bool IsDense(size_t estimatedSize, size_t universe) {
+        return universe > 0 && estimatedSize * DENSE_DIVISOR >= universe;
+    }
+
+    /**
+     * Перенумерация набора списков по перестановке newIdOf[old] = new без сортировки:
+     * записи раскладываются по новым id (CSR) и собираются обратно по возрастанию.
+     */
+    static void RemapLists(const TVector<TPostingList*>& lists, const TVector<TDocId>& newIdOf) {
+        size_t n = newIdOf.Size();
+        TVector<size_t> offsets(n + 1, 0);
+        for (size_t l = 0; l < lists.Size(); ++l) {
+            const TPostingList& list = *lists[l];
+            for (size_t i = 0; i < list.Size(); ++i) {
+                ++offsets[newIdOf[list[i]] + 1];
+            }
+        }
+        for (size_t d = 0; d < n; ++d) {
+            offsets[d + 1] += offsets[d];
+        }
+
+        TVector<size_t> fill(offsets);
+        TVector<size_t> owners(offsets[n]);
+        for (size_t l = 0; l < lists.Size(); ++l) {
+            TPostingList& list = *lists[l];
+            for (size_t i = 0; i < list.Size(); ++i) {
+                owners[fill[newIdOf[list[i]]]++] = l;
+            }
+            list.Clear();
+        }
+
+        for (size_t newId = 0; newId < n; ++newId) {
+            for (size_t slot = offsets[newId]; slot < offsets[newId + 1]; ++slot) {
+                lists[owners[slot]]->PushBack(static_cast<TDocId>(newId));
+            }
+        }
+    }
+
+private:
+    struct TCursor {
+        TDocId Doc;
+        size_t List;
+
+        TCursor() : Doc(0), List(0) {}
+        TCursor(TDocId doc, size_t list) : Doc(doc), List(list) {}
+
+        bool operator>(const TCursor& other) const {
+            return Doc > other.Doc;
+        }
+    };
+
+    static TPostingList UnionHeap(const TVector<const TPostingList*>& lists, size_t total) {
+        TVector<size_t> positions(lists.Size(), 0);
+        THeap<TCursor, TGreater<TCursor>> heap;
+        heap.Reserve(lists.Size());
+        for (size_t i = 0; i < lists.Size(); ++i) {
+            heap.Push(TCursor((*lists[i])[0], i));
+        }
+
+        TPostingList result;
+        result.Reserve(total);
+        while (!heap.Empty()) {
+            TCursor top = heap.ExtractTop();
+            if (result.Empty() || result.Back() != top.Doc) {
+                result.PushBack(top.Doc);
+            }
+            const TPostingList& list = *lists[top.List];
+            size_t next = ++positions[top.List];
+            if (next < list.Size()) {
+                heap.Push(TCursor(list[next], top.List));
+            }
+        }
+        return result;
+    }
+
+    static TPostingList UnionBitmap(const TVector<const TPostingList*>& lists, size_t universe) {
+        using TWord = uint64_t;
+        NCollections::TLargeArray<TWord> bits((universe + 63) / 64);
+        for (size_t i = 0; i < lists.Size(); ++i) {
+            const TPostingList& list = *lists[i];
+            for (size_t j = 0; j < list.Size(); ++j) {
+                if (j + PREFETCH_DISTANCE < list.Size()) {
+                    __builtin_prefetch(&bits[list[j + PREFETCH_DISTANCE] >> 6], 1);
+                }
+                bits[list[j] >> 6] |= TWord(1) << (list[j] & 63);
+            }
+        }
+
+        TPostingList result;
+        result.Reserve(NSimd::Kernels().PopCount(bits.Data(), bits.Size()));
+        for (size_t w = 0; w < bits.Size(); ++w) {
+            TWord word = bits[w];
+            while (word) {
+                size_t bit = static_cast<size_t>(__builtin_ctzll(word));
+                result.PushBack(static_cast<TDocId>(w * 64 + bit));
+                word &= word - 1;
+            }
+        }
+        return result;
+    }
+};
+
+} // namespace NIndex
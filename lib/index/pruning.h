@@ -0,0 +1,178 @@
+#pragma once
+
+#include <lib/collections/vector/vector.h>
+#include <lib/collections/heap/heap.h>
+#include <lib/index/boolean_index.h>
+#include <lib/index/index_io.h>
+
+namespace NIndex {
+
+using NCollections::TVector;
+using NCollections::THeap;
+using NCollections::TGreater;
+
+/**
+ * Статический прунинг индекса под компактную реплику
+ *
+ * Импакт постинга — его вклад в TF-IDF: tf/|d| * idf(t). Постинги с пренебрежимым
+ * вкладом в любой top-K выбрасываются заранее:
+ * TermCentric — у каждого терма остаются постинги с импактом >= Epsilon * (K-й по величине импакт терма),
+ * так что для однотерминных запросов top-K сохраняется точно (Carmel et al.);
+ * DocumentCentric — у каждого документа остаётся доля DocumentFraction его самых весомых термов
+ * (не меньше MinTermsPerDocument). df и длины документов не меняются, поэтому
+ * скоры оставшихся постингов совпадают с исходными.
+ */
+class TStaticPruner {
+public:
+    enum class EMode {
+        TermCentric,
+        DocumentCentric
+    };
+
+    struct TOptions {
+        EMode Mode = EMode::TermCentric;
+        size_t TopK = 10;
+        double Epsilon = 0.5;
+        double DocumentFraction = 0.5;
+        size_t MinTermsPerDocument = 1;
+    };
+
+    struct TReport {
+        size_t PostingsBefore = 0;
+        size_t PostingsAfter = 0;
+        size_t TermsBefore = 0;
+        size_t TermsAfter = 0;
+        size_t BytesBefore = 0;
+        size_t BytesAfter = 0;
+    };
+
+    TStaticPruner() : Options_() {}
+    explicit TStaticPruner(const TOptions& options) : Options_(options) {}
+
+    TReport Prune(TInvertedIndex& index) const {
+        TReport report;
+        report.PostingsBefore = index.GetPostingCount();
+        report.TermsBefore = index.GetTermCount();
+        report.BytesBefore = SerializedSize(index);
+
+        if (Options_.Mode == EMode::TermCentric) {
+            PruneTermCentric(index);
+        } else {
+            PruneDocumentCentric(index);
+        }
+
+        report.PostingsAfter = index.GetPostingCount();
+        report.TermsAfter = index.GetTermCount();
+        report.BytesAfter = SerializedSize(index);
+        return report;
+    }
+
+    static double Impact(const TInvertedIndex& index, const TTermPostings& postings, size_t i, double idf) {
+        size_t length = index.GetDocumentLength(postings.Docs[i]);
+        if (length == 0) return 0;
+        return static_cast<double>(postings.Freqs[i]) / length * idf;
+    }
+
+private:
+    void PruneTermCentric(TInvertedIndex& index) const {
+        TTfIdf tfIdf(index);
+        double threshold = 0;
+        const TTermPostings* current = nullptr;
+        double idf = 0;
+        index.RetainPostings([&](const TString& term, const TTermPostings& postings, size_t i) {
+            if (&postings != current) {
+                current = &postings;
+                idf = tfIdf.ComputeIDF(term);
+                threshold = Options_.Epsilon * KthImpact(index, postings, idf);
+            }
+            return Impact(index, postings, i, idf) >= threshold;
+        });
+    }
+
+    /**
+     * K-й по величине импакт терма (0, если постингов не больше K — тогда терм не трогаем).
+     */
+    double KthImpact(const TInvertedIndex& index, const TTermPostings& postings, double idf) const {
+        if (Options_.TopK == 0 || postings.Docs.Size() <= Options_.TopK) return 0;
+        THeap<double, TGreater<double>> top;
+        top.Reserve(Options_.TopK + 1);
+        for (size_t i = 0; i < postings.Docs.Size(); ++i) {
+            double impact = Impact(index, postings, i, idf);
+            if (top.Size() < Options_.TopK) {
+                top.Push(impact);
+            } else if (impact > top.Top()) {
+                top.Pop();
+                top.Push(impact);
+            }
+        }
+        return top.Top();
+    }
+
+    /**
+     * Порог каждого документа — импакт его ceil(fraction * n)-го по весу терма.
+     * Импакты раскладываются по документам так же, как прямой индекс в TInvertedIndex::Remap.
+     */
+    void PruneDocumentCentric(TInvertedIndex& index) const {
+        size_t n = index.GetDocumentCount();
+        TTfIdf tfIdf(index);
+
+        TVector<size_t> offsets(n + 1, 0);
+        index.ForEachTerm([&](const TString&, const TTermPostings& postings) {
+            for (size_t i = 0; i < postings.Docs.Size(); ++i) {
+                ++offsets[postings.Docs[i] + 1];
+            }
+        });
+        for (size_t d = 0; d < n; ++d) {
+            offsets[d + 1] += offsets[d];
+        }
+
+        TVector<size_t> fill(offsets);
+        TVector<double> impacts(offsets[n]);
+        index.ForEachTerm([&](const TString& term, const TTermPostings& postings) {
+            double idf = tfIdf.ComputeIDF(term);
+            for (size_t i = 0; i < postings.Docs.Size(); ++i) {
+                impacts[fill[postings.Docs[i]]++] = Impact(index, postings, i, idf);
+            }
+        });
+
+        TVector<double> thresholds(n, 0.0);
+        for (size_t d = 0; d < n; ++d) {
+            size_t count = offsets[d + 1] - offsets[d];
+            size_t keep = static_cast<size_t>(count * Options_.DocumentFraction + 0.999999);
+            if (keep < Options_.MinTermsPerDocument) keep = Options_.MinTermsPerDocument;
+            if (keep == 0 || keep >= count) continue;
+
+            THeap<double, TGreater<double>> top;
+            top.Reserve(keep + 1);
+            for (size_t slot = offsets[d]; slot < offsets[d + 1]; ++slot) {
+                if (top.Size() < keep) {
+                    top.Push(impacts[slot]);
+                } else if (impacts[slot] > top.Top()) {
+                    top.Pop();
+                    top.Push(impacts[slot]);
+                }
+            }
+            thresholds[d] = top.Top();
+        }
+
+        const TTermPostings* current = nullptr;
+        double idf = 0;
+        index.RetainPostings([&](const TString& term, const TTermPostings& postings, size_t i) {
+            if (&postings != current) {
+                current = &postings;
+                idf = tfIdf.ComputeIDF(term);
+            }
+            return Impact(index, postings, i, idf) >= thresholds[postings.Docs[i]];
+        });
+    }
+
+    static size_t SerializedSize(const TInvertedIndex& index) {
+        TBinaryWriter writer;
+        index.Save(writer);
+        return writer.Size();
+    }
+
+    TOptions Options_;
+};
+
+} // namespace NIndex
@@ -0,0 +1,549 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include <lib/types/string/string.h>
+#include <lib/collections/vector/vector.h>
+#include <lib/collections/unordered_map/unordered_map.h>
+#include <lib/index/posting_ops.h>
+#include <lib/index/passage_index.h>
+#include <lib/index/index_io.h>
+
+namespace NIndex {
+
+using NTypes::TString;
+using NCollections::TVector;
+using NCollections::TUnorderedMap;
+using NCollections::TStringHash;
+
+namespace NRhymeImpl {
+
+/**
+ * Правило таблицы: слово (или его окончание) -> рифменная часть в условной фонетике
+ * (AY — "ай", EY — "эй", AH — "а" в love, ER — "ёр" в her и т.д.).
+ */
+struct TRule {
+    const char* Spelling;
+    const char* Sound;
+};
+
+/**
+ * Слова, которые читаются не по общим правилам, — целиком.
+ */
+inline constexpr TRule WORD_RULES[] = {
+    {"are", "AAR"}, {"were", "ER"}, {"there", "EHR"}, {"where", "EHR"}, {"their", "EHR"},
+    {"bear", "EHR"}, {"wear", "EHR"}, {"pear", "EHR"}, {"swear", "EHR"}, {"heart", "AART"},
+    {"eye", "AY"}, {"do", "UW"}, {"to", "UW"}, {"who", "UW"}, {"two", "UW"}, {"you", "UW"},
+    {"through", "UW"}, {"though", "OW"}, {"although", "OW"}, {"was", "AHZ"}, {"does", "AHZ"},
+    {"one", "AHN"}, {"done", "AHN"}, {"none", "AHN"}, {"won", "AHN"}, {"son", "AHN"},
+    {"gone", "AON"}, {"have", "AEV"}, {"give", "IHV"}, {"live", "IHV"}, {"forgive", "IHV"},
+    {"shove", "AHV"}, {"great", "EYT"}, {"break", "EYK"}, {"again", "EHN"}, {"said", "EHD"},
+    {"says", "EHZ"}, {"head", "EHD"}, {"dead", "EHD"}, {"bread", "EHD"}, {"spread", "EHD"},
+    {"thread", "EHD"}, {"instead", "EHD"}, {"death", "EHTH"}, {"breath", "EHTH"}, {"been", "IHN"},
+    {"key", "IY"}, {"obey", "EY"}, {"only", "OWNLIY"}, {"own", "OWN"}, {"known", "OWN"},
+    {"grown", "OWN"}, {"shown", "OWN"}, {"flown", "OWN"}, {"blown", "OWN"}, {"sown", "OWN"},
+    {"thrown", "OWN"}, {"how", "AW"}, {"now", "AW"}, {"brow", "AW"}, {"vow", "AW"},
+    {"cow", "AW"}, {"allow", "AW"}, {"bough", "AW"}, {"plough", "AW"}, {"word", "ERD"},
+    {"world", "ERLD"}, {"work", "ERK"}, {"worth", "ERTH"}, {"worm", "ERM"}, {"heard", "ERD"},
+    {"four", "AOR"}, {"pour", "AOR"}, {"your", "AOR"}, {"court", "AORT"}, {"course", "AORS"},
+    {"source", "AORS"}, {"poor", "UHR"}, {"blood", "AHD"}, {"flood", "AHD"}, {"food", "UWD"},
+    {"mood", "UWD"}, {"brood", "UWD"}, {"foot", "UHT"}, {"laugh", "AEF"}, {"enough", "AHF"},
+    {"rough", "AHF"}, {"tough", "AHF"}, {"cough", "AOF"}, {"most", "OWST"}, {"ghost", "OWST"},
+    {"host", "OWST"}, {"post", "OWST"}, {"friend", "EHND"},
+};
+
+/**
+ * Окончания с устойчивым нестандартным чтением; побеждает самое длинное совпадение.
+ */
+inline constexpr TRule ENDING_RULES[] = {
+    {"ought", "AOT"}, {"aught", "AOT"}, {"ough", "OW"}, {"ould", "UHD"}, {"ood", "UHD"},
+    {"ook", "UHK"}, {"ind", "AYND"}, {"ild", "AYLD"}, {"old", "OWLD"}, {"olt", "OWLT"},
+    {"ign", "AYN"}, {"alk", "AOK"}, {"all", "AOL"}, {"alm", "AAM"}, {"oor", "AOR"},
+    {"earn", "ERN"}, {"earth", "ERTH"}, {"love", "AHV"}, {"dove", "AHV"}, {"bove", "AHV"},
+    {"move", "UWV"}, {"prove", "UWV"}, {"come", "AHM"}, {"some", "AHM"},
+};
+
+/**
+ * Безударные окончания: рифма — ударная часть основы плюс звук окончания.
+ * RestoreE — основа могла потерять немое e (loving -> love, hated -> hate).
+ * StemVowel — основа может кончаться гласной (holy -> ho + LIY).
+ */
+struct TSuffix {
+    const char* Spelling;
+    const char* Sound;
+    bool RestoreE;
+    bool StemVowel;
+};
+
+inline constexpr TSuffix SUFFIXES[] = {
+    {"ing", "IHNG", true, true},
+    {"er", "ER", false, false},
+    {"ly", "LIY", false, true},
+    {"ey", "IY", false, false},
+    {"y", "IY", false, false},
+};
+
+/**
+ * Гласные группы: буквосочетание -> звук.
+ */
+inline constexpr TRule VOWEL_GROUPS[] = {
+    {"ai", "EY"}, {"ay", "EY"}, {"ei", "EY"}, {"ey", "EY"}, {"ea", "IY"}, {"ee", "IY"},
+    {"ie", "IY"}, {"oa", "OW"}, {"oe", "OW"}, {"ow", "OW"}, {"owe", "AW"}, {"oo", "UW"},
+    {"ou", "AW"}, {"oi", "OY"}, {"oy", "OY"}, {"au", "AO"}, {"aw", "AO"}, {"ue", "UW"},
+    {"ew", "UW"}, {"ui", "UW"}, {"eau", "OW"}, {"eye", "AY"}, {"uy", "AY"}, {"ye", "AY"},
+};
+
+/**
+ * Гласная перед r: звук вместе с r (star, her, more, care, near, fire, cure, hour).
+ */
+inline constexpr TRule R_COLORED[] = {
+    {"AE", "AAR"}, {"AA", "AOR"}, {"EH", "ER"}, {"IH", "ER"}, {"AH", "ER"}, {"EY", "EHR"},
+    {"IY", "IHR"}, {"AY", "AYR"}, {"OW", "AOR"}, {"UW", "UHR"}, {"AW", "AWR"}, {"AO", "AOR"},
+    {"OY", "OYR"},
+};
+
+} // namespace NRhymeImpl
+
+/**
+ * Индекс рифм по последним словам строк
+ *
+ * Ключ — рифменная подпись слова: последняя ударная гласная и всё после неё в условной
+ * фонетике (night, white, bite -> AYT; love, above -> AHV). Ударение приближается последним
+ * слогом, кроме безударных окончаний (-ing, -er, -y, -ly), для которых берётся ударная
+ * часть основы (river -> IHVER). Чтение — по таблицам правил NRhymeImpl: исключения
+ * целыми словами, окончания, гласные группы, немое e, r после гласной; только латиница.
+ * Постинг подписи — отсортированные документы и по каждому номера строк (с нуля).
+ * Подписи строк считаются отдельно (Extract), поэтому разбор идёт в параллельной части загрузки.
+ */
+class TRhymeIndex {
+public:
+    struct TLineRhyme {
+        uint32_t Line = 0;
+        TString Signature;
+    };
+
+    struct TEntry {
+        TDocId Doc;
+        uint32_t Line;
+    };
+
+    /**
+     * Строки документа Docs[i] — Lines[Ends[i - 1], Ends[i]).
+     */
+    struct TPostings {
+        TPostingList Docs;
+        TVector<uint32_t> Ends;
+        TVector<uint32_t> Lines;
+    };
+
+    bool IsEnabled() const { return Enabled_; }
+    void SetEnabled(bool enabled) { Enabled_ = enabled; }
+    size_t Size() const { return Postings_.Size(); }
+
+    /**
+     * Рифменная подпись слова; пустая — в слове нет латинских гласных.
+     */
+    static TString Signature(const TString& word) {
+        TString letters;
+        for (size_t i = 0; i < word.Size(); ++i) {
+            char c = word[i];
+            if (c >= 'A' && c <= 'Z') c = static_cast<char>(c - 'A' + 'a');
+            if (c >= 'a' && c <= 'z') letters.PushBack(c);
+        }
+        return Rime(letters);
+    }
+
+    /**
+     * Последнее слово каждой непустой строки и его подпись.
+     */
+    static TVector<TLineRhyme> Extract(const TString& text) {
+        TVector<TLineRhyme> rhymes;
+        TVector<TPassageIndex::TSpan> lines = TPassageIndex::Split(text, TPassageIndex::EUnit::Line);
+        for (size_t i = 0; i < lines.Size(); ++i) {
+            size_t end = lines[i].End;
+            while (end > lines[i].Begin && !IsLetter(text[end - 1])) --end;
+            size_t begin = end;
+            while (begin > lines[i].Begin && (IsLetter(text[begin - 1]) || text[begin - 1] == '\'')) --begin;
+            TString signature = Signature(TString(text.Data() + begin, end - begin));
+            if (signature.Empty()) continue;
+            TLineRhyme rhyme;
+            rhyme.Line = lines[i].FirstLine;
+            rhyme.Signature = std::move(signature);
+            rhymes.PushBack(std::move(rhyme));
+        }
+        return rhymes;
+    }
+
+    /**
+     * docId не меньше всех добавленных раньше (порядок добавления в индекс).
+     */
+    void AddDocument(TDocId docId, const TVector<TLineRhyme>& lines) {
+        for (size_t i = 0; i < lines.Size(); ++i) {
+            TPostings& postings = Postings_[lines[i].Signature];
+            if (postings.Docs.Empty() || postings.Docs.Back() != docId) {
+                postings.Docs.PushBack(docId);
+                postings.Ends.PushBack(static_cast<uint32_t>(postings.Lines.Size()));
+            }
+            postings.Lines.PushBack(lines[i].Line);
+            postings.Ends.Back() = static_cast<uint32_t>(postings.Lines.Size());
+        }
+    }
+
+    const TPostings* Find(const TString& word) const {
+        TString signature = Signature(word);
+        if (signature.Empty()) return nullptr;
+        auto it = Postings_.Find(signature);
+        return it != Postings_.end() ? &it.Value() : nullptr;
+    }
+
+    /**
+     * Документы, где хоть одна строка рифмуется со словом.
+     */
+    TPostingList FindDocuments(const TString& word) const {
+        const TPostings* postings = Find(word);
+        return postings ? postings->Docs : TPostingList();
+    }
+
+    TVector<TEntry> FindLines(const TString& word) const {
+        TVector<TEntry> entries;
+        const TPostings* postings = Find(word);
+        if (!postings) return entries;
+        uint32_t from = 0;
+        for (size_t i = 0; i < postings->Docs.Size(); ++i) {
+            for (uint32_t l = from; l < postings->Ends[i]; ++l) {
+                entries.PushBack(TEntry{postings->Docs[i], postings->Lines[l]});
+            }
+            from = postings->Ends[i];
+        }
+        return entries;
+    }
+
+    /**
+     * Перенумерация документов (см. TPostingOps::RemapLists): подсчётом по новым id,
+     * строки переезжают вместе со своим документом.
+     */
+    void Remap(const TVector<TDocId>& newIdOf) {
+        TVector<TPostings*> lists;
+        for (auto it = Postings_.begin(); it != Postings_.end(); ++it) {
+            lists.PushBack(&it.Value());
+        }
+        const size_t n = newIdOf.Size();
+        TVector<size_t> offsets(n + 1, 0);
+        for (size_t l = 0; l < lists.Size(); ++l) {
+            for (size_t i = 0; i < lists[l]->Docs.Size(); ++i) {
+                ++offsets[newIdOf[lists[l]->Docs[i]] + 1];
+            }
+        }
+        for (size_t d = 0; d < n; ++d) {
+            offsets[d + 1] += offsets[d];
+        }
+
+        TVector<size_t> fill(offsets);
+        TVector<size_t> owners(offsets[n]);
+        TVector<size_t> positions(offsets[n]);
+        TVector<TPostings> old(lists.Size());
+        for (size_t l = 0; l < lists.Size(); ++l) {
+            for (size_t i = 0; i < lists[l]->Docs.Size(); ++i) {
+                size_t slot = fill[newIdOf[lists[l]->Docs[i]]]++;
+                owners[slot] = l;
+                positions[slot] = i;
+            }
+            old[l] = std::move(*lists[l]);
+            *lists[l] = TPostings();
+        }
+
+        for (size_t newId = 0; newId < n; ++newId) {
+            for (size_t slot = offsets[newId]; slot < offsets[newId + 1]; ++slot) {
+                const TPostings& from = old[owners[slot]];
+                TPostings& to = *lists[owners[slot]];
+                const size_t i = positions[slot];
+                to.Docs.PushBack(static_cast<TDocId>(newId));
+                for (uint32_t l = i > 0 ? from.Ends[i - 1] : 0; l < from.Ends[i]; ++l) {
+                    to.Lines.PushBack(from.Lines[l]);
+                }
+                to.Ends.PushBack(static_cast<uint32_t>(to.Lines.Size()));
+            }
+        }
+    }
+
+    void AddWarmupRanges(TMemoryWarmer& warmer) const {
+        for (auto it = Postings_.begin(); it != Postings_.end(); ++it) {
+            warmer.AddContainer(it.Value().Docs);
+            warmer.AddContainer(it.Value().Lines);
+        }
+    }
+
+    /**
+     * Флаг, затем по подписи: дельты документов, число строк документа и дельты строк.
+     */
+    void Save(TBinaryWriter& writer) const {
+        writer.WriteU8(Enabled_ ? 1 : 0);
+        if (!Enabled_) return;
+        writer.WriteVarint(Postings_.Size());
+        for (auto it = Postings_.begin(); it != Postings_.end(); ++it) {
+            const TPostings& postings = it.Value();
+            writer.WriteString(it.Key());
+            writer.WriteVarint(postings.Docs.Size());
+            TDocId prev = 0;
+            uint32_t from = 0;
+            for (size_t i = 0; i < postings.Docs.Size(); ++i) {
+                writer.WriteVarint(postings.Docs[i] - prev);
+                prev = postings.Docs[i];
+                writer.WriteVarint(postings.Ends[i] - from);
+                uint32_t line = 0;
+                for (uint32_t l = from; l < postings.Ends[i]; ++l) {
+                    writer.WriteVarint(postings.Lines[l] - line);
+                    line = postings.Lines[l];
+                }
+                from = postings.Ends[i];
+            }
+        }
+    }
+
+    bool Load(TBinaryReader& reader, size_t documentCount) {
+        Clear();
+        Enabled_ = reader.ReadU8() != 0;
+        if (!Enabled_) return reader.Ok();
+        size_t count = reader.ReadCount();
+        for (size_t s = 0; s < count && reader.Ok(); ++s) {
+            TString signature = reader.ReadString();
+            TPostings postings;
+            size_t docs = reader.ReadCount(2);
+            uint64_t doc = 0;
+            for (size_t i = 0; i < docs && reader.Ok(); ++i) {
+                uint64_t delta = reader.ReadVarint();
+                if (i > 0 && delta == 0) return false;
+                doc += delta;
+                if (doc >= documentCount) return false;
+                postings.Docs.PushBack(static_cast<TDocId>(doc));
+                size_t lines = reader.ReadCount();
+                uint64_t line = 0;
+                for (size_t l = 0; l < lines && reader.Ok(); ++l) {
+                    line += reader.ReadVarint();
+                    if (line > UINT32_MAX) return false;
+                    postings.Lines.PushBack(static_cast<uint32_t>(line));
+                }
+                postings.Ends.PushBack(static_cast<uint32_t>(postings.Lines.Size()));
+            }
+            Postings_.Insert(std::move(signature), std::move(postings));
+        }
+        return reader.Ok();
+    }
+
+    /**
+     * Удаляет постинги, флаг остаётся.
+     */
+    void Clear() {
+        Postings_.Clear();
+    }
+
+private:
+    static bool IsLetter(char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+    }
+
+    static bool IsVowelLetter(char c) {
+        return c == 'a' || c == 'e' || c == 'i' || c == 'o' || c == 'u';
+    }
+
+    /**
+     * y — гласная не в начале слова, w — только после a/e/o (aw, ew, ow).
+     */
+    static bool IsVowelAt(const TString& w, size_t i) {
+        char c = w[i];
+        if (IsVowelLetter(c)) return true;
+        if (c == 'y') return i > 0;
+        if (c == 'w') return i > 0 && (w[i - 1] == 'a' || w[i - 1] == 'e' || w[i - 1] == 'o');
+        return false;
+    }
+
+    static bool HasVowel(const TString& w, size_t end) {
+        for (size_t i = 0; i < end; ++i) {
+            if (IsVowelAt(w, i)) return true;
+        }
+        return false;
+    }
+
+    static bool EndsWith(const TString& w, const char* ending) {
+        size_t size = std::strlen(ending);
+        return w.Size() >= size && std::memcmp(w.Data() + w.Size() - size, ending, size) == 0;
+    }
+
+    static TString Prefix(const TString& w, size_t size) {
+        return TString(w.Data(), size);
+    }
+
+    template <size_t N>
+    static const char* Lookup(const NRhymeImpl::TRule (&rules)[N], const TString& key) {
+        for (size_t i = 0; i < N; ++i) {
+            if (key == rules[i].Spelling) return rules[i].Sound;
+        }
+        return nullptr;
+    }
+
+    static TString Rime(const TString& w) {
+        if (w.Empty()) return TString();
+        if (const char* sound = Lookup(NRhymeImpl::WORD_RULES, w)) return TString(sound);
+
+        const char* ending = nullptr;
+        size_t endingSize = 0;
+        for (const NRhymeImpl::TRule& rule : NRhymeImpl::ENDING_RULES) {
+            size_t size = std::strlen(rule.Spelling);
+            if (size > endingSize && EndsWith(w, rule.Spelling)) {
+                ending = rule.Sound;
+                endingSize = size;
+            }
+        }
+        if (ending) return TString(ending);
+
+        const size_t n = w.Size();
+        if (n >= 4 && EndsWith(w, "ies")) return Inflected(Prefix(w, n - 3) + TString("y"), "Z");
+        if (n >= 4 && w[n - 1] == 's' && w[n - 2] != 's' && w[n - 2] != 'u' && w[n - 2] != 'i') {
+            return Inflected(Prefix(w, n - 1), "Z");
+        }
+        if (n >= 4 && EndsWith(w, "ied")) return Inflected(Prefix(w, n - 3) + TString("y"), "D");
+        if (n >= 4 && EndsWith(w, "ed") && w[n - 3] != 'e') {
+            if (w[n - 3] == 't' || w[n - 3] == 'd') {
+                TString stem = Stem(w, n - 2, true);
+                TString rime = Rime(stem);
+                if (!rime.Empty()) return rime + TString("IHD");
+            } else {
+                TString stem = IsVowelAt(w, n - 3) ? Prefix(w, n - 2) : Stem(w, n - 2, true);
+                TString rime = Rime(stem);
+                if (!rime.Empty()) return rime + TString("D");
+            }
+        }
+
+        for (const NRhymeImpl::TSuffix& suffix : NRhymeImpl::SUFFIXES) {
+            const size_t size = std::strlen(suffix.Spelling);
+            if (n < size + 2 || !EndsWith(w, suffix.Spelling)) continue;
+            const size_t stemSize = n - size;
+            if (!HasVowel(w, stemSize)) continue;
+            if (!suffix.StemVowel && IsVowelAt(w, stemSize - 1)) continue;
+            TString rime = Rime(Stem(w, stemSize, suffix.RestoreE));
+            if (!rime.Empty()) return rime + TString(suffix.Sound);
+        }
+        return GeneralRime(w);
+    }
+
+    static TString Inflected(const TString& stem, const char* sound) {
+        TString rime = Rime(stem);
+        return rime.Empty() ? rime : rime + TString(sound);
+    }
+
+    /**
+     * Основа w[0, size): удвоенная согласная схлопывается (stopped -> stop), у основы
+     * вида согласная-гласная-согласная восстанавливается немое e (loving -> love).
+     */
+    static TString Stem(const TString& w, size_t size, bool restoreE) {
+        if (size >= 2 && w[size - 1] == w[size - 2] && !IsVowelAt(w, size - 1)) {
+            return Prefix(w, size - 1);
+        }
+        TString stem = Prefix(w, size);
+        if (restoreE && size >= 3 && !IsVowelAt(w, size - 1) && IsVowelLetter(w[size - 2]) &&
+            !IsVowelAt(w, size - 3) && w[size - 1] != 'w' && w[size - 1] != 'x') {
+            stem.PushBack('e');
+        }
+        return stem;
+    }
+
+    static TString GeneralRime(const TString& w) {
+        size_t end = w.Size();
+        bool silentE = false;
+        if (end >= 3 && w[end - 1] == 'e' && !IsVowelAt(w, end - 2) && HasVowel(w, end - 2)) {
+            silentE = true;
+            --end;
+        }
+        size_t codaBegin = end;
+        while (codaBegin > 0 && !IsVowelAt(w, codaBegin - 1)) --codaBegin;
+        if (codaBegin == 0) return TString();
+        size_t groupBegin = codaBegin;
+        while (groupBegin > 0 && IsVowelAt(w, groupBegin - 1)) --groupBegin;
+        if (w[groupBegin] == 'u' && groupBegin > 0 && codaBegin - groupBegin > 1 &&
+            (w[groupBegin - 1] == 'q' || w[groupBegin - 1] == 'g')) {
+            ++groupBegin;
+        }
+
+        TString group(w.Data() + groupBegin, codaBegin - groupBegin);
+        TString coda(w.Data() + codaBegin, end - codaBegin);
+        const bool monosyllable = !HasVowel(w, groupBegin);
+        const bool open = coda.Empty() && !silentE;
+        const bool magic = silentE && group.Size() == 1 && (coda.Size() == 1 || coda == "th");
+
+        TString vowel;
+        size_t codaFrom = 0;
+        if (coda.Size() >= 2 && coda[0] == 'g' && coda[1] == 'h') {
+            codaFrom = 2;
+            const bool ei = group.Size() >= 2 && group[group.Size() - 2] == 'e';
+            vowel = group.Back() == 'i' ? TString(ei ? "EY" : "AY") : Vowel(group, magic, open, monosyllable);
+        } else {
+            vowel = Vowel(group, magic, open, monosyllable);
+            if (group == "ow" && !coda.Empty()) vowel = TString("AW");
+        }
+
+        if (codaFrom < coda.Size() && coda[codaFrom] == 'r') {
+            const char* colored = Lookup(NRhymeImpl::R_COLORED, vowel);
+            vowel = TString(colored ? colored : "ER");
+            while (codaFrom < coda.Size() && coda[codaFrom] == 'r') ++codaFrom;
+        }
+        return vowel + Consonants(coda, codaFrom, silentE);
+    }
+
+    static TString Vowel(const TString& group, bool magic, bool open, bool monosyllable) {
+        if (group.Size() == 1) {
+            switch (group[0]) {
+                case 'a': return TString(magic ? "EY" : open ? "AA" : "AE");
+                case 'e': return TString(magic || open ? "IY" : "EH");
+                case 'i': return TString(magic || open ? "AY" : "IH");
+                case 'o': return TString(magic || open ? "OW" : "AA");
+                case 'u': return TString(magic || open ? "UW" : "AH");
+                case 'y': return TString(magic || (open && monosyllable) ? "AY" : open ? "IY" : "IH");
+                default: return TString();
+            }
+        }
+        if (open && !monosyllable && (group == "ey" || group == "ie")) return TString("IY");
+        if (open && monosyllable && group == "ie") return TString("AY");
+        if (const char* sound = Lookup(NRhymeImpl::VOWEL_GROUPS, group)) return TString(sound);
+        return Vowel(TString(1, group[0]), false, false, monosyllable);
+    }
+
+    static TString Consonants(const TString& coda, size_t from, bool silentE) {
+        TString sound;
+        for (size_t i = from; i < coda.Size(); ++i) {
+            const char c = coda[i];
+            const bool last = i + 1 == coda.Size();
+            const char next = last ? 0 : coda[i + 1];
+            if (next == c) continue;
+            if (c == 't' && next == 'c' && i + 2 < coda.Size() && coda[i + 2] == 'h') {
+                sound += TString("CH");
+                i += 2;
+            } else if (next == 'h' && (c == 'c' || c == 's' || c == 't' || c == 'p' || c == 'g')) {
+                sound += TString(c == 'c' ? "CH" : c == 's' ? "SH" : c == 't' ? "TH" : c == 'p' ? "F" : "");
+                ++i;
+            } else if (c == 'd' && next == 'g') {
+                sound += TString("J");
+                ++i;
+            } else if (c == 'm' && (next == 'b' || next == 'n') && i + 2 == coda.Size()) {
+                sound += TString("M");
+                ++i;
+            } else if (c == 'c' || c == 'k' || c == 'q') {
+                sound += TString(c == 'c' && last && silentE ? "S" : "K");
+            } else if (c == 'g') {
+                sound += TString(last && silentE ? "J" : "G");
+            } else if (c == 's') {
+                sound += TString(last && silentE ? "Z" : "S");
+            } else if (c == 'x') {
+                sound += TString("KS");
+            } else if (c != 'h' && c != 'w' && c != 'y') {
+                sound.PushBack(static_cast<char>(c - 'a' + 'A'));
+            }
+        }
+        return sound;
+    }
+
+    bool Enabled_ = false;
+    TUnorderedMap<TString, TPostings, TStringHash> Postings_;
+};
+
+} // namespace NIndex
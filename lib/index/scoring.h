@@ -0,0 +1,483 @@
+#pragma once
+
+#include <cstdint>
+
+#include <lib/types/string/string.h>
+#include <lib/collections/vector/vector.h>
+#include <lib/collections/heap/heap.h>
+#include <lib/collections/large_array/large_array.h>
+#include <lib/simd/simd.h>
+#include <lib/index/posting_ops.h>
+#include <lib/index/math.h>
+
+namespace NIndex {
+
+using NTypes::TString;
+using NCollections::TVector;
+using NCollections::THeap;
+using NCollections::TLargeArray;
+
+/**
+ * Документ с его скором в выдаче. operator< упорядочивает по убыванию скора.
+ */
+struct TScoredDoc {
+    TDocId DocId;
+    double Score;
+
+    TScoredDoc() : DocId(0), Score(0) {}
+    TScoredDoc(TDocId id, double s) : DocId(id), Score(s) {}
+
+    bool operator<(const TScoredDoc& other) const {
+        return Score > other.Score;
+    }
+};
+
+/**
+ * Битовое множество id документов. Id за пределами Size() считаются не входящими.
+ */
+class TDocBitset {
+public:
+    TDocBitset() : Size_(0) {}
+    explicit TDocBitset(size_t size) : Size_(0) { Resize(size); }
+
+    /**
+     * Ёмкость растёт вдвое: Set по возрастающим id не переносит весь массив каждые 64 id.
+     */
+    void Resize(size_t size) {
+        const size_t words = (size + 63) / 64;
+        if (words > Words_.Capacity()) {
+            Words_.Reserve(words > Words_.Capacity() * 2 ? words : Words_.Capacity() * 2);
+        }
+        Words_.Resize(words);
+        if (size < Size_ && size % 64 != 0) {
+            Words_[size / 64] &= (uint64_t(1) << (size % 64)) - 1;
+        }
+        Size_ = size;
+    }
+
+    void Set(TDocId doc) {
+        if (doc >= Size_) Resize(static_cast<size_t>(doc) + 1);
+        Words_[doc >> 6] |= uint64_t(1) << (doc & 63);
+    }
+
+    void Reset(TDocId doc) {
+        if (doc < Size_) Words_[doc >> 6] &= ~(uint64_t(1) << (doc & 63));
+    }
+
+    bool Test(TDocId doc) const {
+        return doc < Size_ && (Words_[doc >> 6] >> (doc & 63)) & 1;
+    }
+
+    size_t Size() const { return Size_; }
+    size_t Count() const { return NSimd::Kernels().PopCount(Words_.Data(), Words_.Size()); }
+    const uint64_t* Data() const { return Words_.Data(); }
+    size_t WordCount() const { return Words_.Size(); }
+
+    void Clear() {
+        Words_.Clear();
+        Size_ = 0;
+    }
+
+private:
+    TLargeArray<uint64_t> Words_;
+    size_t Size_;
+};
+
+/**
+ * Политики ядра ранжирования
+ *
+ * Скореры: Prepare(postings) один раз на терм запроса готовит состояние терма (TTerm),
+ * Score(term, j, doc) — вклад j-го постинга. Все члены, не зависящие от документа,
+ * вычисляются в Prepare; внутренний цикл — несколько умножений без ветвлений по настройкам.
+ * Prefetch(doc) подтягивает то, что Score прочитает для документа doc.
+ */
+class TTfIdfScorer {
+public:
+    struct TTerm {
+        const TTermFreq* Freqs;
+        double Idf;
+    };
+
+    TTfIdfScorer(size_t docCount, const size_t* lengths) : DocCount_(docCount), Lengths_(lengths) {}
+
+    template <typename TPostings>
+    TTerm Prepare(const TPostings& postings) const {
+        return TTerm{postings.Freqs.Data(), Idf(postings.Docs.Size() + postings.PrunedCount)};
+    }
+
+    void Prefetch(TDocId doc) const { __builtin_prefetch(Lengths_ + doc); }
+
+    double Score(const TTerm& term, size_t j, TDocId doc) const {
+        size_t docLen = Lengths_[doc];
+        return docLen ? static_cast<double>(term.Freqs[j]) / docLen * term.Idf : 0;
+    }
+
+    /**
+     * Та же формула, что TTfIdf::ComputeIDF.
+     */
+    double Idf(size_t df) const {
+        if (DocCount_ == 0 || df == 0) return 0;
+        return Log(static_cast<double>(DocCount_ + 1) / static_cast<double>(df + 1)) + 1.0;
+    }
+
+private:
+    size_t DocCount_;
+    const size_t* Lengths_;
+};
+
+/**
+ * Okapi BM25: idf * f * (k1 + 1) / (f + k1 * (1 - b + b * |d| / avgdl)).
+ * Знаменатель разложен в k1 * (1 - b) + (k1 * b / avgdl) * |d|.
+ */
+class TBm25Scorer {
+public:
+    static constexpr double DEFAULT_K1 = 1.2;
+    static constexpr double DEFAULT_B = 0.75;
+
+    struct TTerm {
+        const TTermFreq* Freqs;
+        double Weight;
+    };
+
+    TBm25Scorer(size_t docCount, const size_t* lengths, double averageLength,
+                double k1 = DEFAULT_K1, double b = DEFAULT_B)
+        : DocCount_(docCount)
+        , Lengths_(lengths)
+        , K1_(k1)
+        , NormBase_(k1 * (1 - b))
+        , NormPerToken_(averageLength > 0 ? k1 * b / averageLength : 0)
+    {}
+
+    template <typename TPostings>
+    TTerm Prepare(const TPostings& postings) const {
+        double df = static_cast<double>(postings.Docs.Size() + postings.PrunedCount);
+        double n = static_cast<double>(DocCount_);
+        double idf = Log(1.0 + (n - df + 0.5) / (df + 0.5));
+        return TTerm{postings.Freqs.Data(), idf * (K1_ + 1)};
+    }
+
+    void Prefetch(TDocId doc) const { __builtin_prefetch(Lengths_ + doc); }
+
+    double Score(const TTerm& term, size_t j, TDocId doc) const {
+        double f = static_cast<double>(term.Freqs[j]);
+        return term.Weight * f / (f + NormBase_ + NormPerToken_ * static_cast<double>(Lengths_[doc]));
+    }
+
+private:
+    size_t DocCount_;
+    const size_t* Lengths_;
+    double K1_;
+    double NormBase_;
+    double NormPerToken_;
+};
+
+/**
+ * Квантованные импакты: вклад постинга заранее посчитан индексом (TInvertedIndex::BuildImpacts)
+ * и хранится байтом; скор — сумма байтов, умноженная на общий масштаб. Длины документов не читаются.
+ */
+class TImpactScorer {
+public:
+    struct TTerm {
+        const unsigned char* Impacts;
+    };
+
+    explicit TImpactScorer(double scale) : Scale_(scale) {}
+
+    template <typename TPostings>
+    TTerm Prepare(const TPostings& postings) const {
+        return TTerm{postings.Impacts.Data()};
+    }
+
+    void Prefetch(TDocId) const {}
+
+    double Score(const TTerm& term, size_t j, TDocId) const {
+        return term.Impacts[j] * Scale_;
+    }
+
+private:
+    double Scale_;
+};
+
+/**
+ * Фильтры: Accept(doc) решает, участвует ли документ в выдаче.
+ */
+struct TNoFilter {
+    bool Accept(TDocId) const { return true; }
+};
+
+/**
+ * Разрешённое множество (например, результат булева запроса).
+ */
+class TBitsetFilter {
+public:
+    explicit TBitsetFilter(const TDocBitset& allowed) : Allowed_(allowed) {}
+    bool Accept(TDocId doc) const { return Allowed_.Test(doc); }
+
+private:
+    const TDocBitset& Allowed_;
+};
+
+/**
+ * Живые документы: в множестве отмечены удалённые, всё остальное (в т.ч. добавленное
+ * позже, за пределами Size()) — живое.
+ */
+class TLiveDocsFilter {
+public:
+    explicit TLiveDocsFilter(const TDocBitset& deleted) : Deleted_(deleted) {}
+    bool Accept(TDocId doc) const { return !Deleted_.Test(doc); }
+
+private:
+    const TDocBitset& Deleted_;
+};
+
+/**
+ * Коллекторы: Collect(doc, score) получает каждый документ с положительным скором ровно один раз.
+ * Порядок выдачи — по убыванию скора, при равенстве — по возрастанию id.
+ */
+class TTopKCollector {
+public:
+    explicit TTopKCollector(size_t topK) : TopK_(topK), Count_(0) {
+        Heap_.Reserve(topK < RESERVE_LIMIT ? topK + 1 : RESERVE_LIMIT);
+    }
+
+    void Collect(TDocId doc, double score) {
+        ++Count_;
+        if (TopK_ == 0) return;
+        TRanked entry(doc, score);
+        if (Heap_.Size() < TopK_) {
+            Heap_.Push(entry);
+        } else if (entry > Heap_.Top()) {
+            Heap_.Pop();
+            Heap_.Push(entry);
+        }
+    }
+
+    size_t Count() const { return Count_; }
+
+    TVector<TScoredDoc> Finish() {
+        TVector<TScoredDoc> results(Heap_.Size());
+        for (size_t i = results.Size(); i > 0; --i) {
+            TRanked worst = Heap_.ExtractTop();
+            results[i - 1] = TScoredDoc(worst.DocId, worst.Score);
+        }
+        return results;
+    }
+
+private:
+    static constexpr size_t RESERVE_LIMIT = 4096;
+
+    struct TRanked {
+        TDocId DocId;
+        double Score;
+
+        TRanked() : DocId(0), Score(0) {}
+        TRanked(TDocId doc, double score) : DocId(doc), Score(score) {}
+
+        bool operator>(const TRanked& other) const {
+            return Score > other.Score || (Score == other.Score && DocId < other.DocId);
+        }
+    };
+
+    size_t TopK_;
+    size_t Count_;
+    THeap<TRanked, NCollections::TGreater<TRanked>> Heap_;
+};
+
+class TCountCollector {
+public:
+    TCountCollector() : Count_(0) {}
+
+    void Collect(TDocId, double) { ++Count_; }
+    size_t Count() const { return Count_; }
+    TVector<TScoredDoc> Finish() { return TVector<TScoredDoc>(); }
+
+private:
+    size_t Count_;
+};
+
+/**
+ * Все найденные документы; сортировка — одним проходом top-K без ограничения.
+ */
+class TAllCollector {
+public:
+    TAllCollector() : Ranked_(static_cast<size_t>(-1)) {}
+
+    void Collect(TDocId doc, double score) { Ranked_.Collect(doc, score); }
+    size_t Count() const { return Ranked_.Count(); }
+    TVector<TScoredDoc> Finish() { return Ranked_.Finish(); }
+
+private:
+    TTopKCollector Ranked_;
+};
+
+/**
+ * Ядро ранжирования term-at-a-time, специализированное политиками на этапе компиляции
+ *
+ * Вклады постингов копятся в плотном массиве аккумуляторов (по потоку, переиспользуется
+ * между запросами и обнуляется только в тронутых ячейках). Аккумулятор и данные скорера
+ * подтягиваются на PREFETCH_DISTANCE постингов вперёд.
+ */
+template <typename TScorer, typename TFilter, typename TCollector>
+class TScoringCore {
+public:
+    static constexpr size_t PREFETCH_DISTANCE = 16;
+
+    template <typename TPostings>
+    static void Run(const TVector<const TPostings*>& terms, size_t docCount,
+                    const TScorer& scorer, const TFilter& filter, TCollector& collector)
+    {
+        TLargeArray<double>& scores = LocalAccumulators();
+        if (scores.Size() < docCount) {
+            scores.Resize(docCount);
+        }
+
+        TVector<TDocId>& touched = LocalTouched();
+        touched.Clear();
+        for (size_t t = 0; t < terms.Size(); ++t) {
+            if (!terms[t]) continue;
+            const TPostingList& docs = terms[t]->Docs;
+            typename TScorer::TTerm term = scorer.Prepare(*terms[t]);
+            size_t size = docs.Size();
+            for (size_t j = 0; j < size; ++j) {
+                if (j + PREFETCH_DISTANCE < size) {
+                    TDocId ahead = docs[j + PREFETCH_DISTANCE];
+                    __builtin_prefetch(&scores[ahead], 1);
+                    scorer.Prefetch(ahead);
+                }
+                TDocId doc = docs[j];
+                if (!filter.Accept(doc)) continue;
+                double contribution = scorer.Score(term, j, doc);
+                if (contribution <= 0) continue;
+                if (scores[doc] == 0) {
+                    touched.PushBack(doc);
+                }
+                scores[doc] += contribution;
+            }
+        }
+
+        for (size_t i = 0; i < touched.Size(); ++i) {
+            TDocId doc = touched[i];
+            collector.Collect(doc, scores[doc]);
+            scores[doc] = 0;
+        }
+    }
+
+private:
+    static TLargeArray<double>& LocalAccumulators() {
+        static thread_local TLargeArray<double> scores;
+        return scores;
+    }
+
+    static TVector<TDocId>& LocalTouched() {
+        static thread_local TVector<TDocId> touched;
+        return touched;
+    }
+};
+
+enum class EScorer {
+    TfIdf,
+    Bm25,
+    Impact
+};
+
+enum class ECollector {
+    TopK,
+    Count,
+    All
+};
+
+/**
+ * Параметры запроса к ядру. Filter выбирается по заполненным указателям:
+ * Allowed — только эти документы, Deleted — все, кроме этих.
+ */
+struct TScoringRequest {
+    EScorer Scorer = EScorer::TfIdf;
+    ECollector Collector = ECollector::TopK;
+    size_t TopK = 10;
+    const TDocBitset* Allowed = nullptr;
+    const TDocBitset* Deleted = nullptr;
+    double Bm25K1 = TBm25Scorer::DEFAULT_K1;
+    double Bm25B = TBm25Scorer::DEFAULT_B;
+};
+
+struct TScoringResult {
+    TVector<TScoredDoc> Hits;
+    size_t Count = 0;
+};
+
+/**
+ * Рантайм-диспетчер: по запросу выбирает одну из заранее инстанцированных
+ * специализаций TScoringCore (3 скорера x 3 фильтра x 3 коллектора).
+ * TIndex — TInvertedIndex (шаблон только для того, чтобы не зависеть от его определения).
+ * Импакт-скорер без построенных импактов откатывается на TF-IDF.
+ */
+class TScoringDispatcher {
+public:
+    template <typename TIndex>
+    static TScoringResult Run(const TIndex& index, const TVector<TString>& queryTerms, const TScoringRequest& request) {
+        auto terms = index.FindTerms(queryTerms);
+        size_t docCount = index.GetDocumentCount();
+        const size_t* lengths = index.GetDocumentLengths().Data();
+        switch (request.Scorer) {
+            case EScorer::Bm25:
+                return WithFilter(terms, docCount, TBm25Scorer(docCount, lengths,
+                    index.GetAverageDocumentLength(), request.Bm25K1, request.Bm25B), request);
+            case EScorer::Impact:
+                if (index.HasImpacts()) {
+                    return WithFilter(terms, docCount, TImpactScorer(index.GetImpactScale()), request);
+                }
+                [[fallthrough]];
+            case EScorer::TfIdf:
+            default:
+                return WithFilter(terms, docCount, TTfIdfScorer(docCount, lengths), request);
+        }
+    }
+
+private:
+    template <typename TPostings, typename TScorer>
+    static TScoringResult WithFilter(const TVector<const TPostings*>& terms, size_t docCount,
+                                     const TScorer& scorer, const TScoringRequest& request)
+    {
+        if (request.Allowed) {
+            return WithCollector(terms, docCount, scorer, TBitsetFilter(*request.Allowed), request);
+        }
+        if (request.Deleted) {
+            return WithCollector(terms, docCount, scorer, TLiveDocsFilter(*request.Deleted), request);
+        }
+        return WithCollector(terms, docCount, scorer, TNoFilter(), request);
+    }
+
+    template <typename TPostings, typename TScorer, typename TFilter>
+    static TScoringResult WithCollector(const TVector<const TPostings*>& terms, size_t docCount,
+                                        const TScorer& scorer, const TFilter& filter, const TScoringRequest& request)
+    {
+        switch (request.Collector) {
+            case ECollector::Count: {
+                TCountCollector collector;
+                return Collect(terms, docCount, scorer, filter, collector);
+            }
+            case ECollector::All: {
+                TAllCollector collector;
+                return Collect(terms, docCount, scorer, filter, collector);
+            }
+            case ECollector::TopK:
+            default: {
+                TTopKCollector collector(request.TopK);
+                return Collect(terms, docCount, scorer, filter, collector);
+            }
+        }
+    }
+
+    template <typename TPostings, typename TScorer, typename TFilter, typename TCollector>
+    static TScoringResult Collect(const TVector<const TPostings*>& terms, size_t docCount,
+                                  const TScorer& scorer, const TFilter& filter, TCollector& collector)
+    {
+        TScoringCore<TScorer, TFilter, TCollector>::Run(terms, docCount, scorer, filter, collector);
+        TScoringResult result;
+        result.Count = collector.Count();
+        result.Hits = collector.Finish();
+        return result;
+    }
+};
+
+} // namespace NIndex
@@ -0,0 +1,364 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <lib/types/string/string.h>
+#include <lib/collections/vector/vector.h>
+#include <lib/collections/unordered_set/unordered_set.h>
+#include <lib/index/index_io.h>
+#include <lib/index/wal.h>
+
+namespace NIndex {
+
+using NTypes::TString;
+using NCollections::TVector;
+using NCollections::TUnorderedSet;
+
+/**
+ * Каталог инкрементальных снимков: файлы сегментов именуются хешем содержимого
+ * ("<16 hex>.seg"), поэтому неизменившийся сегмент не переписывается, а одинаковые
+ * сегменты разных снимков хранятся один раз. Какие сегменты составляют снимок,
+ * перечисляет небольшой файл manifest.
+ */
+class TSegmentStore {
+public:
+    static constexpr const char* MANIFEST_NAME = "manifest";
+    static constexpr const char* SEGMENT_SUFFIX = ".seg";
+
+    /**
+     * FNV-1a по содержимому сегмента. 0 зарезервирован под «хеш неизвестен».
+     */
+    static uint64_t ContentHash(const TByteBuffer& bytes) {
+        uint64_t hash = 14695981039346656037ULL;
+        for (size_t i = 0; i < bytes.Size(); ++i) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash == 0 ? 1 : hash;
+    }
+
+    static TString SegmentPath(const TString& dir, uint64_t hash) {
+        static const char HEX[] = "0123456789abcdef";
+        TString path = dir;
+        path.PushBack('/');
+        for (int shift = 60; shift >= 0; shift -= 4) {
+            path.PushBack(HEX[(hash >> shift) & 0xF]);
+        }
+        path.Append(SEGMENT_SUFFIX);
+        return path;
+    }
+
+    static TString ManifestPath(const TString& dir) {
+        TString path = dir;
+        path.PushBack('/');
+        path.Append(MANIFEST_NAME);
+        return path;
+    }
+
+    static bool Exists(const TString& path) {
+        struct stat info;
+        return ::stat(path.CStr(), &info) == 0;
+    }
+
+    static bool EnsureDirectory(const TString& dir) {
+        struct stat info;
+        if (::stat(dir.CStr(), &info) == 0) return S_ISDIR(info.st_mode);
+        return ::mkdir(dir.CStr(), 0755) == 0;
+    }
+
+    /**
+     * Удаляет файлы сегментов (и брошенные .tmp), которых нет в keep. Возвращает число удалённых.
+     */
+    static size_t RemoveUnreferenced(const TString& dir, const TUnorderedSet<uint64_t>& keep) {
+        DIR* handle = ::opendir(dir.CStr());
+        if (!handle) return 0;
+        TVector<TString> garbage;
+        while (struct dirent* entry = ::readdir(handle)) {
+            TString name(entry->d_name);
+            uint64_t hash = 0;
+            bool temporary = EndsWith(name, ".tmp");
+            if (temporary || (ParseSegmentName(name, &hash) && !keep.Contains(hash))) {
+                TString path = dir;
+                path.PushBack('/');
+                path.Append(name);
+                garbage.PushBack(path);
+            }
+        }
+        ::closedir(handle);
+        size_t removed = 0;
+        for (size_t i = 0; i < garbage.Size(); ++i) {
+            removed += std::remove(garbage[i].CStr()) == 0 ? 1 : 0;
+        }
+        return removed;
+    }
+
+private:
+    static bool EndsWith(const TString& name, const char* suffix) {
+        size_t len = 0;
+        while (suffix[len]) ++len;
+        if (name.Size() < len) return false;
+        for (size_t i = 0; i < len; ++i) {
+            if (name[name.Size() - len + i] != suffix[i]) return false;
+        }
+        return true;
+    }
+
+    static bool ParseSegmentName(const TString& name, uint64_t* hash) {
+        if (name.Size() != 16 + 4 || !EndsWith(name, SEGMENT_SUFFIX)) return false;
+        uint64_t value = 0;
+        for (size_t i = 0; i < 16; ++i) {
+            char c = name[i];
+            int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+            if (digit < 0) return false;
+            value = (value << 4) | static_cast<uint64_t>(digit);
+        }
+        *hash = value;
+        return true;
+    }
+};
+
+/**
+ * Фоновая запись снимка базы.
+ *
+ * Снимок снимается в вызывающем потоке как неизменяемые части файлов в памяти (без диска
+ * и fsync) и передаётся сюда по shared_ptr: потоку записи не нужна сама база, запросы
+ * и загрузка продолжаются сразу. Часть — готовые байты или замороженный объект, который
+ * сериализует уже поток записи. Поток пишет файлы по порядку кусками, ограничивая скорость
+ * BytesPerSecond (0 — без ограничения); каждый файл — через временный, fsync и rename,
+ * поэтому последний в списке (манифест или единственный образ) подменяет старый снимок
+ * только когда всё остальное уже на диске. Затем (если задан журнал) из журнала
+ * выбрасываются записи, покрытые снимком.
+ */
+class TSnapshotWriter {
+public:
+    enum class EState {
+        Idle,
+        Running,
+        Done,
+        Failed,
+        Cancelled
+    };
+
+    struct TOptions {
+        size_t BytesPerSecond = 0;
+        size_t ChunkBytes = 1 << 20;
+    };
+
+    /**
+     * Часть файла: готовые байты Bytes либо неизменяемый Source, который поток записи
+     * сериализует вызовом Serialize(Source.get(), writer).
+     */
+    struct TPart {
+        using TSerialize = void (*)(const void* source, TBinaryWriter& writer);
+
+        std::shared_ptr<const TByteBuffer> Bytes;
+        std::shared_ptr<const void> Source;
+        TSerialize Serialize = nullptr;
+
+        TPart() = default;
+        explicit TPart(std::shared_ptr<const TByteBuffer> bytes) : Bytes(std::move(bytes)) {}
+        TPart(std::shared_ptr<const void> source, TSerialize serialize)
+            : Source(std::move(source))
+            , Serialize(serialize)
+        {}
+    };
+
+    /**
+     * Содержимое файла — Data, а если он пуст — части Parts подряд.
+     */
+    struct TFile {
+        TString Path;
+        std::shared_ptr<const TByteBuffer> Data;
+        TVector<TPart> Parts;
+
+        TFile() = default;
+        TFile(const TString& path, std::shared_ptr<const TByteBuffer> data)
+            : Path(path)
+            , Data(std::move(data))
+        {}
+    };
+
+    struct TProgress {
+        EState State = EState::Idle;
+        size_t BytesWritten = 0;
+        size_t TotalBytes = 0;
+        uint64_t Lsn = 0;
+    };
+
+    TSnapshotWriter() = default;
+    TSnapshotWriter(const TSnapshotWriter&) = delete;
+    TSnapshotWriter& operator=(const TSnapshotWriter&) = delete;
+
+    ~TSnapshotWriter() {
+        Cancel();
+        Wait();
+    }
+
+    /**
+     * Запускает запись образа в path. lsn — последняя запись журнала wal, вошедшая в образ.
+     * false — предыдущая запись ещё идёт.
+     */
+    bool Start(std::shared_ptr<const TByteBuffer> image, const TString& path, const TOptions& options,
+               TWriteAheadLog* wal = nullptr, uint64_t lsn = 0) {
+        TVector<TFile> files;
+        files.PushBack(TFile(path, std::move(image)));
+        return Start(std::move(files), options, wal, lsn);
+    }
+
+    /**
+     * Запись нескольких файлов снимка по порядку; последний — тот, что делает снимок видимым.
+     */
+    bool Start(TVector<TFile> files, const TOptions& options, TWriteAheadLog* wal = nullptr, uint64_t lsn = 0) {
+        if (IsRunning()) return false;
+        Wait();
+
+        Files_ = std::move(files);
+        Options_ = options;
+        if (Options_.ChunkBytes == 0) Options_.ChunkBytes = TOptions().ChunkBytes;
+        Wal_ = wal;
+        Lsn_ = lsn;
+        size_t total = 0;
+        for (size_t i = 0; i < Files_.Size(); ++i) {
+            if (Files_[i].Data) total += Files_[i].Data->Size();
+            for (size_t j = 0; j < Files_[i].Parts.Size(); ++j) {
+                if (Files_[i].Parts[j].Bytes) total += Files_[i].Parts[j].Bytes->Size();
+            }
+        }
+        TotalBytes_.store(total);
+        BytesWritten_.store(0);
+        Cancelled_.store(false);
+        State_.store(EState::Running);
+        Thread_ = std::thread([this]() { Run(); });
+        return true;
+    }
+
+    bool IsRunning() const {
+        return State_.load() == EState::Running;
+    }
+
+    /**
+     * TotalBytes растёт, пока поток записи сериализует части-объекты.
+     */
+    TProgress GetProgress() const {
+        TProgress progress;
+        progress.State = State_.load();
+        progress.BytesWritten = BytesWritten_.load();
+        progress.TotalBytes = TotalBytes_.load();
+        progress.Lsn = Lsn_;
+        return progress;
+    }
+
+    /**
+     * Дожидается окончания записи. true — снимок на диске.
+     */
+    bool Wait() {
+        if (Thread_.joinable()) {
+            Thread_.join();
+            Files_.Clear();
+        }
+        return State_.load() == EState::Done;
+    }
+
+    /**
+     * Прерывает запись; старый снимок остаётся на месте.
+     */
+    void Cancel() {
+        std::lock_guard<std::mutex> lock(Mutex_);
+        Cancelled_.store(true);
+        Wake_.notify_all();
+    }
+
+private:
+    void Run() {
+        const auto start = std::chrono::steady_clock::now();
+        size_t written = 0;
+        bool ok = true;
+        for (size_t i = 0; i < Files_.Size() && ok; ++i) {
+            ok = Write(Files_[i], start, written);
+        }
+        EState result = ok ? EState::Done : (Cancelled_.load() ? EState::Cancelled : EState::Failed);
+        if (ok && Wal_ && !Wal_->DropThrough(Lsn_)) {
+            result = EState::Failed;
+        }
+        State_.store(result);
+    }
+
+    bool Write(const TFile& target, std::chrono::steady_clock::time_point start, size_t& written) {
+        TString tmpPath = target.Path;
+        tmpPath.Append(".tmp");
+        FILE* file = std::fopen(tmpPath.CStr(), "wb");
+        if (!file) return false;
+        bool ok = !target.Data || WriteBytes(file, *target.Data, start, written);
+        for (size_t i = 0; i < target.Parts.Size() && ok; ++i) {
+            const TPart& part = target.Parts[i];
+            if (part.Bytes) {
+                ok = WriteBytes(file, *part.Bytes, start, written);
+                continue;
+            }
+            TBinaryWriter serialized;
+            part.Serialize(part.Source.get(), serialized);
+            TotalBytes_.fetch_add(serialized.Size());
+            ok = WriteBytes(file, serialized.GetBuffer(), start, written);
+        }
+        ok = ok && std::fflush(file) == 0 && ::fsync(::fileno(file)) == 0;
+        ok = std::fclose(file) == 0 && ok;
+        ok = ok && !Cancelled_.load() && std::rename(tmpPath.CStr(), target.Path.CStr()) == 0;
+        if (!ok) {
+            std::remove(tmpPath.CStr());
+        }
+        return ok;
+    }
+
+    bool WriteBytes(FILE* file, const TByteBuffer& bytes, std::chrono::steady_clock::time_point start, size_t& written) {
+        const unsigned char* data = bytes.Data();
+        const size_t total = bytes.Size();
+        bool ok = true;
+        for (size_t offset = 0; offset < total && ok; ) {
+            size_t chunk = total - offset < Options_.ChunkBytes ? total - offset : Options_.ChunkBytes;
+            ok = std::fwrite(data + offset, 1, chunk, file) == chunk;
+            offset += chunk;
+            written += chunk;
+            BytesWritten_.store(written);
+            ok = ok && Throttle(start, written);
+        }
+        return ok;
+    }
+
+    /**
+     * Спит, пока средняя скорость записи выше BytesPerSecond. false — запись отменена.
+     */
+    bool Throttle(std::chrono::steady_clock::time_point start, size_t written) {
+        if (Options_.BytesPerSecond > 0) {
+            auto due = start + std::chrono::microseconds(
+                static_cast<long long>(written * 1000000.0 / static_cast<double>(Options_.BytesPerSecond)));
+            std::unique_lock<std::mutex> lock(Mutex_);
+            Wake_.wait_until(lock, due, [this]() { return Cancelled_.load(); });
+        }
+        return !Cancelled_.load();
+    }
+
+    TVector<TFile> Files_;
+    TOptions Options_;
+    TWriteAheadLog* Wal_ = nullptr;
+    uint64_t Lsn_ = 0;
+
+    std::atomic<EState> State_{EState::Idle};
+    std::atomic<size_t> BytesWritten_{0};
+    std::atomic<size_t> TotalBytes_{0};
+    std::atomic<bool> Cancelled_{false};
+    std::mutex Mutex_;
+    std::condition_variable Wake_;
+    std::thread Thread_;
+};
+
+} // namespace NIndex
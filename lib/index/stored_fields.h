@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cstdint>
+
+#include <lib/types/string/string.h>
+#include <lib/collections/vector/vector.h>
+#include <lib/index/index_io.h>
+
+namespace NIndex {
+
+using NTypes::TString;
+using NCollections::TVector;
+
+/**
+ * Хранимые поля документов (автор, год и т.п.) по небольшой схеме.
+ *
+ * Строка документа — блоб [varint длина][байты] по полю схемы подряд, блобы лежат
+ * одним массивом в порядке id, границы — в массиве смещений (Size() + 1 значений).
+ * Пустые хвостовые поля не пишутся, документ без полей — пустой блоб. Строки только
+ * дописываются: SetRow принимает id не меньше Size(), пропущенные получают пустые строки.
+ */
+class TStoredFields {
+public:
+    TStoredFields() {
+        Offsets_.PushBack(0);
+    }
+
+    explicit TStoredFields(const TVector<TString>& schema)
+        : TStoredFields()
+    {
+        Schema_ = schema;
+    }
+
+    const TVector<TString>& GetSchema() const { return Schema_; }
+    size_t GetFieldCount() const { return Schema_.Size(); }
+    size_t Size() const { return Offsets_.Size() - 1; }
+
+    /**
+     * Номер поля по имени; GetFieldCount() — такого поля нет.
+     */
+    size_t FindField(const TString& name) const {
+        for (size_t i = 0; i < Schema_.Size(); ++i) {
+            if (Schema_[i] == name) return i;
+        }
+        return Schema_.Size();
+    }
+
+    /**
+     * Строка документа id из значений по порядку схемы (лишние отбрасываются).
+     */
+    bool Set(size_t id, const TVector<TString>& values) {
+        size_t count = values.Size() < Schema_.Size() ? values.Size() : Schema_.Size();
+        while (count > 0 && values[count - 1].Empty()) --count;
+        TBinaryWriter row;
+        for (size_t i = 0; i < count; ++i) {
+            row.WriteString(values[i]);
+        }
+        const TByteBuffer& bytes = row.GetBuffer();
+        return SetRow(id, bytes.Data(), bytes.Size());
+    }
+
+    /**
+     * Готовый блоб строки (см. GetRow). false — id меньше Size() или блоб битый.
+     */
+    bool SetRow(size_t id, const unsigned char* data, size_t size) {
+        if (id < Size() || !ValidRow(data, size)) return false;
+        while (Size() < id) {
+            Offsets_.PushBack(Offsets_.Back());
+        }
+        for (size_t i = 0; i < size; ++i) {
+            Data_.PushBack(data[i]);
+        }
+        Offsets_.PushBack(Data_.Size());
+        return true;
+    }
+
+    /**
+     * Блоб строки id: указатель в общий массив, действителен до следующей записи.
+     */
+    const unsigned char* GetRow(size_t id, size_t* size) const {
+        if (id >= Size()) {
+            *size = 0;
+            return nullptr;
+        }
+        *size = static_cast<size_t>(Offsets_[id + 1] - Offsets_[id]);
+        return Data_.Data() + Offsets_[id];
+    }
+
+    TVector<TString> Get(size_t id) const {
+        TVector<TString> values(Schema_.Size());
+        size_t size = 0;
+        const unsigned char* row = GetRow(id, &size);
+        if (size == 0) return values;
+        TBinaryReader reader(row, size);
+        for (size_t i = 0; i < Schema_.Size() && !reader.AtEnd(); ++i) {
+            values[i] = reader.ReadString();
+        }
+        return values;
+    }
+
+    TString Get(size_t id, size_t field) const {
+        size_t size = 0;
+        const unsigned char* row = GetRow(id, &size);
+        if (size == 0 || field >= Schema_.Size()) return TString();
+        TBinaryReader reader(row, size);
+        for (size_t i = 0; i < field && !reader.AtEnd(); ++i) {
+            reader.SkipBytes();
+        }
+        return reader.AtEnd() ? TString() : reader.ReadString();
+    }
+
+    void SaveSchema(TBinaryWriter& writer) const {
+        writer.WriteVarint(Schema_.Size());
+        for (size_t i = 0; i < Schema_.Size(); ++i) {
+            writer.WriteString(Schema_[i]);
+        }
+    }
+
+    bool LoadSchema(TBinaryReader& reader) {
+        Clear();
+        Schema_.Clear();
+        size_t count = reader.ReadCount();
+        for (size_t i = 0; i < count && reader.Ok(); ++i) {
+            Schema_.PushBack(reader.ReadString());
+        }
+        return reader.Ok();
+    }
+
+    size_t GetMemoryBytes() const {
+        return Data_.Size() + Offsets_.Size() * sizeof(uint64_t);
+    }
+
+    /**
+     * Удаляет строки, схема остаётся.
+     */
+    void Clear() {
+        Data_.Clear();
+        Offsets_.Clear();
+        Offsets_.PushBack(0);
+    }
+
+private:
+    bool ValidRow(const unsigned char* data, size_t size) const {
+        if (size == 0) return true;
+        TBinaryReader reader(data, size);
+        size_t fields = 0;
+        while (!reader.AtEnd() && reader.Ok() && fields <= Schema_.Size()) {
+            reader.SkipBytes();
+            ++fields;
+        }
+        return reader.Ok() && reader.AtEnd() && fields <= Schema_.Size();
+    }
+
+    TVector<TString> Schema_;
+    TVector<unsigned char> Data_;
+    TVector<uint64_t> Offsets_;
+};
+
+} // namespace NIndex
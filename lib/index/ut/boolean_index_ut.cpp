@@ -1,7 +1,28 @@
 #include <lib/index/boolean_index.h>
 #include <lib/index/pipeline.h>
+#include <lib/index/doc_reorder.h>
+#include <lib/index/near_duplicates.h>
+#include <lib/index/pruning.h>
+#include <lib/index/index_io.h>
+#include <lib/index/bloom_filter.h>
+#include <lib/index/cardinality.h>
+#include <lib/index/scoring.h>
+#include <lib/index/wal.h>
+#include <lib/index/snapshot.h>
+#include <lib/index/buffer_pool.h>
+#include <lib/index/disk_index.h>
+#include <lib/index/async_io.h>
+#include <lib/index/key_map.h>
+#include <lib/index/stored_fields.h>
+#include <lib/index/passage_index.h>
+#include <lib/index/rhyme_index.h>
+#include <lib/index/phonetic_index.h>
 #include <gtest/gtest.h>
 
+#include <cstdio>
+#include <string>
+#include <thread>
+
 using namespace NIndex;
 using NTypes::TString;
 using NCollections::TVector;
@@ -68,6 +89,264 @@ TEST(TInvertedIndex, TermFrequency) {
     EXPECT_EQ(index.GetDocumentLength(docId), 3);
 }
 
+TEST(TInvertedIndex, TermPostingsCarryFrequencies) {
+    TInvertedIndex index;
+
+    TVector<TString> doc1;
+    doc1.PushBack(TString("sea"));
+    doc1.PushBack(TString("wind"));
+    doc1.PushBack(TString("sea"));
+    doc1.PushBack(TString("sea"));
+    index.AddDocument(doc1);
+
+    TVector<TString> doc2;
+    doc2.PushBack(TString("wind"));
+    index.AddDocument(doc2);
+
+    TVector<TString> doc3;
+    doc3.PushBack(TString("sea"));
+    doc3.PushBack(TString("wind"));
+    doc3.PushBack(TString("wind"));
+    index.AddDocument(doc3);
+
+    const TTermPostings& sea = index.GetTermPostings(TString("sea"));
+    ASSERT_EQ(sea.Docs.Size(), 2);
+    EXPECT_EQ(sea.Docs[0], 0);
+    EXPECT_EQ(sea.Freqs[0], 3);
+    EXPECT_EQ(sea.Docs[1], 2);
+    EXPECT_EQ(sea.Freqs[1], 1);
+
+    EXPECT_EQ(index.GetTermFrequency(2, TString("wind")), 2);
+    EXPECT_EQ(index.GetTermFrequency(1, TString("sea")), 0);
+    EXPECT_EQ(index.GetDocumentLength(0), 4);
+    EXPECT_EQ(index.GetDocumentLength(1), 1);
+    EXPECT_EQ(index.GetDocumentLength(2), 3);
+    EXPECT_EQ(index.GetDocumentLength(3), 0);
+}
+
+TEST(TInvertedIndex, ShortDocumentsAfterLongOneKeepFrequencies) {
+    TInvertedIndex index;
+
+    TVector<TString> big;
+    for (size_t i = 0; i < 50000; ++i) {
+        big.PushBack(TString(("t" + std::to_string(i)).c_str()));
+    }
+    big.PushBack(TString("t7"));
+    index.AddDocument(big);
+
+    for (size_t d = 0; d < 2000; ++d) {
+        TVector<TString> small;
+        small.PushBack(TString("t7"));
+        small.PushBack(TString(("s" + std::to_string(d % 10)).c_str()));
+        small.PushBack(TString("t7"));
+        index.AddDocument(small);
+    }
+
+    EXPECT_EQ(index.GetTermFrequency(0, TString("t7")), 2);
+    EXPECT_EQ(index.GetTermFrequency(0, TString("t49999")), 1);
+    EXPECT_EQ(index.GetDocumentFrequency(TString("t7")), 2001);
+    EXPECT_EQ(index.GetDocumentFrequency(TString("t8")), 1);
+    EXPECT_EQ(index.GetDocumentFrequency(TString("s3")), 200);
+    EXPECT_EQ(index.GetTermFrequency(2000, TString("t7")), 2);
+    EXPECT_EQ(index.GetDocumentLength(2000), 3);
+}
+
+#ifndef INFO_SEARCH_WIDE_DOC_IDS
+TEST(TInvertedIndex, DocIdIs32BitByDefault) {
+    EXPECT_EQ(sizeof(TDocId), 4u);
+    EXPECT_EQ(sizeof(TPostingList::value_type), 4u);
+}
+#endif
+
+TEST(TInvertedIndex, RemapKeepsPostingsSorted) {
+    TInvertedIndex index;
+
+    TVector<TString> doc0;
+    doc0.PushBack(TString("sea"));
+    doc0.PushBack(TString("sea"));
+    index.AddDocument(doc0, TString("zero"));
+
+    TVector<TString> doc1;
+    doc1.PushBack(TString("hill"));
+    index.AddDocument(doc1, TString("one"));
+
+    TVector<TString> doc2;
+    doc2.PushBack(TString("sea"));
+    doc2.PushBack(TString("hill"));
+    doc2.PushBack(TString("hill"));
+    index.AddDocument(doc2, TString("two"));
+
+    TVector<TDocId> newIdOf;
+    newIdOf.PushBack(2);
+    newIdOf.PushBack(0);
+    newIdOf.PushBack(1);
+    index.Remap(newIdOf);
+
+    const TTermPostings& sea = index.GetTermPostings(TString("sea"));
+    ASSERT_EQ(sea.Docs.Size(), 2);
+    EXPECT_EQ(sea.Docs[0], 1);
+    EXPECT_EQ(sea.Freqs[0], 1);
+    EXPECT_EQ(sea.Docs[1], 2);
+    EXPECT_EQ(sea.Freqs[1], 2);
+
+    EXPECT_EQ(index.GetTermFrequency(1, TString("hill")), 2);
+    EXPECT_EQ(index.GetDocumentLength(0), 1);
+    EXPECT_EQ(index.GetDocumentLength(1), 3);
+    EXPECT_EQ(index.GetDocument(2), TString("zero"));
+}
+
+TEST(TInvertedIndex, SaveLoadRoundTrip) {
+    TInvertedIndex index;
+    index.AddDocument(TVector<TString>{TString("sea"), TString("wave"), TString("sea")});
+    index.AddDocument(TVector<TString>{TString("moon")}, TString("raw moon"));
+    for (size_t i = 0; i < 300; ++i) {
+        index.AddDocument(TVector<TString>{TString("sea"), TString("star")});
+    }
+
+    TBinaryWriter writer;
+    index.Save(writer);
+
+    TInvertedIndex loaded;
+    TBinaryReader reader(writer.GetBuffer());
+    ASSERT_TRUE(loaded.Load(reader));
+    EXPECT_TRUE(reader.AtEnd());
+    EXPECT_EQ(loaded.GetDocumentCount(), index.GetDocumentCount());
+    EXPECT_EQ(loaded.GetTermCount(), index.GetTermCount());
+    EXPECT_EQ(loaded.GetPostingList(TString("sea")), index.GetPostingList(TString("sea")));
+    EXPECT_EQ(loaded.GetTermFrequency(0, TString("sea")), 2u);
+    EXPECT_EQ(loaded.GetDocumentLength(0), 3u);
+    EXPECT_EQ(loaded.GetDocument(1), TString("raw moon"));
+
+    TByteBuffer truncated(writer.GetBuffer().Data(), writer.GetBuffer().Data() + writer.Size() / 2);
+    TBinaryReader broken(truncated);
+    EXPECT_FALSE(loaded.Load(broken));
+    EXPECT_EQ(loaded.GetDocumentCount(), 0u);
+}
+
+TEST(TBlockedBloomFilter, NoFalseNegatives) {
+    TBlockedBloomFilter filter;
+    filter.Reset(1000);
+    EXPECT_EQ(filter.SizeBytes() % TBlockedBloomFilter::BLOCK_BYTES, 0u);
+
+    for (size_t i = 0; i < 1000; ++i) {
+        filter.Insert(TString(("word" + std::to_string(i)).c_str()).Hash());
+    }
+    for (size_t i = 0; i < 1000; ++i) {
+        EXPECT_TRUE(filter.MayContain(TString(("word" + std::to_string(i)).c_str()).Hash()));
+    }
+
+    size_t falsePositives = 0;
+    for (size_t i = 0; i < 10000; ++i) {
+        if (filter.MayContain(TString(("missing" + std::to_string(i)).c_str()).Hash())) {
+            ++falsePositives;
+        }
+    }
+    EXPECT_LT(falsePositives, 500u);
+}
+
+TEST(TInvertedIndex, TermFilterSurvivesSaveLoad) {
+    TInvertedIndex index;
+    index.AddDocument(TVector<TString>{TString("sea"), TString("wave")});
+    index.BuildTermFilter();
+    EXPECT_FALSE(index.GetTermFilter().Empty());
+
+    index.AddDocument(TVector<TString>{TString("moon")});
+    EXPECT_TRUE(index.ContainsTerm(TString("moon")));
+    EXPECT_EQ(index.GetPostingList(TString("sea")).Size(), 1u);
+    EXPECT_TRUE(index.GetPostingList(TString("seaa")).Empty());
+
+    TBinaryWriter writer;
+    index.Save(writer);
+    TInvertedIndex loaded;
+    TBinaryReader reader(writer.GetBuffer());
+    ASSERT_TRUE(loaded.Load(reader));
+    EXPECT_EQ(loaded.GetTermFilter().SizeBytes(), index.GetTermFilter().SizeBytes());
+    EXPECT_TRUE(loaded.GetTermFilter().MayContain(TString("moon").Hash()));
+    EXPECT_EQ(loaded.GetDocumentFrequency(TString("wave")), 1u);
+}
+
+TEST(TStaticPruner, TermCentricKeepsTopK) {
+    TInvertedIndex index;
+    for (size_t d = 0; d < 20; ++d) {
+        TVector<TString> terms;
+        for (size_t i = 0; i <= d; ++i) {
+            terms.PushBack(TString("filler"));
+        }
+        terms.PushBack(TString("sea"));
+        index.AddDocument(terms);
+    }
+    index.AddDocument(TVector<TString>{TString("moon")});
+
+    TTfIdf tfIdf(index);
+    auto before = tfIdf.Search(TVector<TString>{TString("sea")}, 3);
+    double idfBefore = tfIdf.ComputeIDF(TString("sea"));
+
+    TStaticPruner::TOptions options;
+    options.TopK = 3;
+    options.Epsilon = 0.9;
+    TStaticPruner::TReport report = TStaticPruner(options).Prune(index);
+
+    EXPECT_LT(report.PostingsAfter, report.PostingsBefore);
+    EXPECT_LT(report.BytesAfter, report.BytesBefore);
+    EXPECT_EQ(report.TermsAfter, report.TermsBefore);
+    EXPECT_GE(index.GetPostingList(TString("sea")).Size(), 3u);
+    EXPECT_EQ(index.GetPostingList(TString("moon")).Size(), 1u);
+    EXPECT_DOUBLE_EQ(tfIdf.ComputeIDF(TString("sea")), idfBefore);
+
+    auto after = tfIdf.Search(TVector<TString>{TString("sea")}, 3);
+    ASSERT_EQ(after.Size(), before.Size());
+    for (size_t i = 0; i < after.Size(); ++i) {
+        EXPECT_EQ(after[i].DocId, before[i].DocId);
+        EXPECT_DOUBLE_EQ(after[i].Score, before[i].Score);
+    }
+}
+
+TEST(TStaticPruner, DocumentCentricKeepsFraction) {
+    TInvertedIndex index;
+    index.AddDocument(TVector<TString>{TString("a"), TString("b"), TString("c"), TString("d")});
+    index.AddDocument(TVector<TString>{TString("a"), TString("b")});
+    index.AddDocument(TVector<TString>{TString("a"), TString("c")});
+
+    TStaticPruner::TOptions options;
+    options.Mode = TStaticPruner::EMode::DocumentCentric;
+    options.DocumentFraction = 0.5;
+    TStaticPruner::TReport report = TStaticPruner(options).Prune(index);
+
+    EXPECT_EQ(report.PostingsBefore, 8u);
+    EXPECT_EQ(report.PostingsAfter, 5u);
+    EXPECT_EQ(report.TermsAfter, report.TermsBefore - 1);
+    EXPECT_FALSE(index.ContainsTerm(TString("a")));
+    EXPECT_EQ(index.GetDocumentFrequency(TString("b")), 2u);
+    EXPECT_EQ(index.GetPostingList(TString("d")).Size(), 1u);
+}
+
+TEST(TDocReorderer, ClustersSimilarDocuments) {
+    TInvertedIndex index;
+    const char* docs[][3] = {
+        {"ocean", "wave", "salt"},
+        {"forest", "pine", "moss"},
+        {"ocean", "wave", "salt"},
+        {"forest", "pine", "moss"},
+    };
+    for (size_t i = 0; i < 4; ++i) {
+        TVector<TString> terms;
+        for (size_t j = 0; j < 3; ++j) terms.PushBack(TString(docs[i][j]));
+        index.AddDocument(terms);
+    }
+
+    TVector<TDocId> newIdOf = TDocReorderer::ComputeOrder(index);
+    ASSERT_EQ(newIdOf.Size(), 4);
+
+    auto distance = [](TDocId a, TDocId b) { return a > b ? a - b : b - a; };
+    EXPECT_EQ(distance(newIdOf[0], newIdOf[2]), 1u);
+    EXPECT_EQ(distance(newIdOf[1], newIdOf[3]), 1u);
+
+    TVector<TDocId> oldIdOf = TDocReorderer::Invert(newIdOf);
+    for (size_t d = 0; d < 4; ++d) {
+        EXPECT_EQ(oldIdOf[newIdOf[d]], d);
+    }
+}
+
 TEST(TBooleanSearch, SingleTerm) {
     TInvertedIndex index;
     
@@ -167,6 +446,116 @@ TEST(TBooleanSearch, OrSearch) {
     EXPECT_EQ(result.Size(), 2);
 }
 
+TEST(TBooleanSearch, OrSearchManyTerms) {
+    TInvertedIndex index;
+
+    for (size_t i = 0; i < 200; ++i) {
+        TVector<TString> doc;
+        doc.PushBack(TString("common"));
+        if (i % 50 == 0) doc.PushBack(TString("alpha"));
+        if (i % 70 == 3) doc.PushBack(TString("beta"));
+        if (i == 199) doc.PushBack(TString("gamma"));
+        index.AddDocument(doc);
+    }
+
+    TBooleanSearch search(index);
+
+    TVector<TString> query;
+    query.PushBack(TString("alpha"));
+    query.PushBack(TString("beta"));
+    query.PushBack(TString("gamma"));
+    query.PushBack(TString("missing"));
+
+    TPostingList result = search.SearchOr(query);
+
+    ASSERT_EQ(result.Size(), 8);
+    EXPECT_EQ(result[0], 0);
+    EXPECT_EQ(result[1], 3);
+    EXPECT_EQ(result[2], 50);
+    EXPECT_EQ(result[3], 73);
+    EXPECT_EQ(result[4], 100);
+    EXPECT_EQ(result[5], 143);
+    EXPECT_EQ(result[6], 150);
+    EXPECT_EQ(result[7], 199);
+}
+
+TEST(TPostingOps, UnionManyHeapAndBitmapAgree) {
+    TPostingList a, b, c, sparse;
+    for (TDocId d = 0; d < 1000; d += 2) a.PushBack(d);
+    for (TDocId d = 0; d < 1000; d += 3) b.PushBack(d);
+    for (TDocId d = 1; d < 1000; d += 7) c.PushBack(d);
+    sparse.PushBack(5000);
+
+    TVector<const TPostingList*> dense;
+    dense.PushBack(&a);
+    dense.PushBack(&b);
+    dense.PushBack(&c);
+    TPostingList denseResult = TPostingOps::UnionMany(dense);
+
+    TPostingList expected = TPostingOps::Union(TPostingOps::Union(a, b), c);
+    EXPECT_EQ(denseResult, expected);
+
+    dense.PushBack(&sparse);
+    TPostingList withSparse = TPostingOps::UnionMany(dense);
+    expected.PushBack(5000);
+    EXPECT_EQ(withSparse, expected);
+}
+
+TEST(TPostingOps, GallopingMatchesMerge) {
+    TPostingList small;
+    TPostingList large;
+    for (TDocId d = 0; d < 5000; ++d) {
+        large.PushBack(d * 3);
+    }
+    for (TDocId d = 0; d < 60; ++d) {
+        small.PushBack(d * 250 + (d % 2));
+    }
+    small.PushBack(14997);
+    small.PushBack(20000);
+
+    TPostingList merged = TPostingOps::IntersectMerge(small, large);
+    EXPECT_EQ(TPostingOps::IntersectGalloping(small, large), merged);
+    EXPECT_EQ(TPostingOps::Intersect(large, small), merged);
+    EXPECT_FALSE(merged.Empty());
+}
+
+TEST(THyperLogLog, EstimatesWithinFewPercent) {
+    THyperLogLog sketch;
+    for (TDocId d = 0; d < 50000; ++d) {
+        sketch.Add(d);
+    }
+    EXPECT_NEAR(sketch.Estimate(), 50000.0, 50000.0 * 0.1);
+
+    THyperLogLog small;
+    for (TDocId d = 0; d < 100; ++d) {
+        small.Add(d);
+        small.Add(d);
+    }
+    EXPECT_NEAR(small.Estimate(), 100.0, 5.0);
+}
+
+TEST(TInvertedIndex, SketchEstimatesUnionAndIntersection) {
+    TInvertedIndex index;
+    for (size_t d = 0; d < 6000; ++d) {
+        TVector<TString> terms;
+        if (d % 2 == 0) terms.PushBack(TString("even"));
+        if (d % 3 == 0) terms.PushBack(TString("third"));
+        terms.PushBack(TString("any"));
+        index.AddDocument(terms);
+    }
+    index.BuildSketches(1000);
+    EXPECT_FALSE(index.GetTermPostings(TString("even")).Sketch.Empty());
+
+    TVector<TString> terms{TString("even"), TString("third")};
+    EXPECT_NEAR(static_cast<double>(index.EstimateUnion(terms)), 4000.0, 400.0);
+    EXPECT_NEAR(static_cast<double>(index.EstimateIntersection(terms)), 1000.0, 400.0);
+    EXPECT_EQ(index.EstimateIntersection(TVector<TString>{TString("even"), TString("missing")}), 0u);
+
+    TBooleanSearch search(index);
+    EXPECT_EQ(search.SearchOr(terms).Size(), 4000u);
+    EXPECT_EQ(search.SearchAnd(terms).Size(), 1000u);
+}
+
 TEST(TBooleanSearch, AndNotSearch) {
     TInvertedIndex index;
     
@@ -317,6 +706,134 @@ TEST(TTfIdf, SearchIteratorOverload) {
     EXPECT_EQ(results[0].DocId, 0);
 }
 
+TEST(TDocBitset, AscendingSetsGrowGeometrically) {
+    const size_t n = 1 << 20;
+    TDocBitset bits;
+    size_t reallocations = 0;
+    const uint64_t* data = nullptr;
+    for (size_t doc = 0; doc < n; ++doc) {
+        bits.Set(static_cast<TDocId>(doc));
+        if (bits.Data() != data) {
+            data = bits.Data();
+            ++reallocations;
+        }
+    }
+    EXPECT_EQ(bits.Size(), n);
+    EXPECT_EQ(bits.Count(), n);
+    EXPECT_LT(reallocations, 16u);
+    bits.Resize(100);
+    EXPECT_EQ(bits.Count(), 100u);
+    EXPECT_FALSE(bits.Test(100));
+}
+
+TEST(TScoringDispatcher, VariantsMatchReference) {
+    const char* docs[] = {
+        "sea sea moon", "moon wind", "sea", "forest pine", "wind wind wind sea", "sea moon wind pine"
+    };
+    TInvertedIndex index;
+    for (const char* doc : docs) {
+        TVector<TString> terms;
+        std::string text(doc);
+        size_t start = 0;
+        while (start < text.size()) {
+            size_t end = text.find(' ', start);
+            if (end == std::string::npos) end = text.size();
+            terms.PushBack(TString(text.substr(start, end - start).c_str()));
+            start = end + 1;
+        }
+        index.AddDocument(terms);
+    }
+    TVector<TString> query;
+    query.PushBack(TString("sea"));
+    query.PushBack(TString("wind"));
+    query.PushBack(TString("absent"));
+
+    TTfIdf tfidf(index);
+    size_t n = index.GetDocumentCount();
+    double avgLen = index.GetAverageDocumentLength();
+    TVector<double> tfidfRef(n, 0.0), bm25Ref(n, 0.0);
+    for (TDocId d = 0; d < n; ++d) {
+        tfidfRef[d] = tfidf.ComputeDocumentScore(d, query);
+        for (size_t t = 0; t < query.Size(); ++t) {
+            double f = static_cast<double>(index.GetTermFrequency(d, query[t]));
+            if (f == 0) continue;
+            double df = static_cast<double>(index.GetDocumentFrequency(query[t]));
+            double idf = Log(1.0 + (n - df + 0.5) / (df + 0.5));
+            double len = static_cast<double>(index.GetDocumentLength(d));
+            bm25Ref[d] += idf * f * 2.2 / (f + 1.2 * (0.25 + 0.75 * len / avgLen));
+        }
+    }
+
+    TDocBitset deleted;
+    deleted.Set(4);
+    TDocBitset allowed;
+    allowed.Set(0);
+    allowed.Set(1);
+    allowed.Set(3);
+
+    const EScorer scorers[] = {EScorer::TfIdf, EScorer::Bm25};
+    for (EScorer scorer : scorers) {
+        const TVector<double>& ref = scorer == EScorer::TfIdf ? tfidfRef : bm25Ref;
+        for (int filter = 0; filter < 3; ++filter) {
+            TScoringRequest request;
+            request.Scorer = scorer;
+            request.Collector = ECollector::All;
+            request.Allowed = filter == 1 ? &allowed : nullptr;
+            request.Deleted = filter == 2 ? &deleted : nullptr;
+
+            size_t expectedCount = 0;
+            for (TDocId d = 0; d < n; ++d) {
+                bool accepted = filter == 1 ? allowed.Test(d) : filter == 2 ? !deleted.Test(d) : true;
+                if (accepted && ref[d] > 0) ++expectedCount;
+            }
+
+            TScoringResult all = tfidf.Score(query, request);
+            ASSERT_EQ(all.Hits.Size(), expectedCount);
+            EXPECT_EQ(all.Count, expectedCount);
+            for (size_t i = 0; i < all.Hits.Size(); ++i) {
+                EXPECT_NEAR(all.Hits[i].Score, ref[all.Hits[i].DocId], 1e-12);
+                if (i > 0) {
+                    EXPECT_GE(all.Hits[i - 1].Score, all.Hits[i].Score);
+                }
+            }
+
+            request.Collector = ECollector::TopK;
+            request.TopK = 2;
+            TScoringResult top = tfidf.Score(query, request);
+            ASSERT_EQ(top.Hits.Size(), expectedCount < 2 ? expectedCount : 2);
+            for (size_t i = 0; i < top.Hits.Size(); ++i) {
+                EXPECT_EQ(top.Hits[i].DocId, all.Hits[i].DocId);
+            }
+
+            request.Collector = ECollector::Count;
+            TScoringResult count = tfidf.Score(query, request);
+            EXPECT_EQ(count.Count, expectedCount);
+            EXPECT_TRUE(count.Hits.Empty());
+        }
+    }
+
+    TScoringRequest impact;
+    impact.Scorer = EScorer::Impact;
+    impact.Collector = ECollector::All;
+    EXPECT_FALSE(index.HasImpacts());
+    TScoringResult fallback = tfidf.Score(query, impact);
+    ASSERT_FALSE(fallback.Hits.Empty());
+    EXPECT_DOUBLE_EQ(fallback.Hits[0].Score, tfidfRef[fallback.Hits[0].DocId]);
+
+    index.BuildImpacts();
+    ASSERT_TRUE(index.HasImpacts());
+    TScoringResult quantized = tfidf.Score(query, impact);
+    ASSERT_EQ(quantized.Hits.Size(), fallback.Hits.Size());
+    for (size_t i = 0; i < quantized.Hits.Size(); ++i) {
+        EXPECT_NEAR(quantized.Hits[i].Score, tfidfRef[quantized.Hits[i].DocId], index.GetImpactScale() * query.Size());
+    }
+
+    TVector<TString> more;
+    more.PushBack(TString("sea"));
+    index.AddDocument(more);
+    EXPECT_FALSE(index.HasImpacts());
+}
+
 TEST(TTextPipeline, BasicProcess) {
     TTextPipeline pipeline;
     TVector<TString> terms = pipeline.Process(TString("Hello World"));
@@ -345,6 +862,126 @@ TEST(TTextPipeline, NormalizeTerm) {
     EXPECT_EQ(normalized, TString("run"));
 }
 
+TEST(TTextPipeline, RemoveStopwords) {
+    TTextPipeline::TOptions opts;
+    opts.Stopwords = TTextPipeline::EStopwordMode::Remove;
+    TTextPipeline pipeline(opts);
+
+    TVector<TString> terms = pipeline.Process(TString("The sea and the sky"));
+
+    ASSERT_EQ(terms.Size(), 2);
+    EXPECT_EQ(terms[0], TString("sea"));
+    EXPECT_EQ(terms[1], TString("sky"));
+}
+
+TEST(TTextPipeline, CommonGrams) {
+    TTextPipeline::TOptions opts;
+    opts.Stopwords = TTextPipeline::EStopwordMode::CommonGrams;
+    TTextPipeline pipeline(opts);
+
+    TVector<TString> terms = pipeline.Process(TString("To be or not to be, dreaming"));
+
+    TVector<TString> expected;
+    expected.PushBack(TString("to_be"));
+    expected.PushBack(TString("be_or"));
+    expected.PushBack(TString("or_not"));
+    expected.PushBack(TString("not_to"));
+    expected.PushBack(TString("to_be"));
+    expected.PushBack(TString("be_dreaming"));
+    expected.PushBack(TString("dream"));
+    EXPECT_EQ(terms, expected);
+}
+
+static TVector<TString> ReferencePipeline(const TTextPipeline::TOptions& opts, const TString& text) {
+    NTokenizer::TTokenizer::TOptions tokOpts;
+    tokOpts.LowerCase = opts.LowerCase;
+    tokOpts.SkipPunctuation = opts.SkipPunctuation;
+    tokOpts.SkipNumbers = opts.SkipNumbers;
+    tokOpts.MinTokenLength = opts.MinTokenLength;
+    tokOpts.MaxTokenLength = opts.MaxTokenLength;
+    TVector<TString> tokens = NTokenizer::TTokenizer(tokOpts).TokenizeToStrings(text);
+
+    NStemmer::TLemmatizer lemmatizer;
+    NStemmer::TPorterStemmer stemmer;
+    auto normalize = [&](const TString& token) {
+        if (opts.UseLemmatization) return lemmatizer.Lemmatize(token);
+        if (opts.UseStemming) return stemmer.Stem(token);
+        return token;
+    };
+
+    TVector<TString> result;
+    for (size_t i = 0; i < tokens.Size(); ++i) {
+        bool stop = opts.Stopwords != TTextPipeline::EStopwordMode::Keep && NTokenizer::TStopwords::Contains(tokens[i]);
+        if (!stop) {
+            result.PushBack(normalize(tokens[i]));
+        }
+        if (opts.Stopwords == TTextPipeline::EStopwordMode::CommonGrams && i + 1 < tokens.Size() &&
+            (stop || NTokenizer::TStopwords::Contains(tokens[i + 1]))) {
+            TString gram = tokens[i];
+            gram.PushBack(TTextPipeline::GRAM_SEPARATOR);
+            gram.Append(tokens[i + 1]);
+            result.PushBack(gram);
+        }
+    }
+    return result;
+}
+
+TEST(TTextPipeline, SpecializedVariantsMatchReference) {
+    const TString text(
+        "The Running foxes were JUMPING over 3.14 lazy-dogs, and THEY went_home! "
+        "To be or not to be:\tit is 42 dreams\r\nof a x y zz caf\xc3\xa9 (quoted) \"words\".");
+    const TTextPipeline::EStopwordMode modes[] = {
+        TTextPipeline::EStopwordMode::Keep,
+        TTextPipeline::EStopwordMode::Remove,
+        TTextPipeline::EStopwordMode::CommonGrams,
+    };
+    for (int mask = 0; mask < 32; ++mask) {
+        for (TTextPipeline::EStopwordMode mode : modes) {
+            TTextPipeline::TOptions opts;
+            opts.LowerCase = (mask & 1) != 0;
+            opts.UseStemming = (mask & 2) != 0;
+            opts.UseLemmatization = (mask & 4) != 0;
+            opts.SkipNumbers = (mask & 8) != 0;
+            opts.SkipPunctuation = (mask & 16) != 0;
+            opts.MinTokenLength = mask % 3;
+            opts.Stopwords = mode;
+
+            TTextPipeline pipeline(opts);
+            EXPECT_EQ(pipeline.Process(text), ReferencePipeline(opts, text)) << "mask=" << mask;
+
+            TString expected = opts.LowerCase ? NTokenizer::TTokenizer::ToLower(TString("Went")) : TString("Went");
+            if (opts.UseLemmatization) {
+                expected = NStemmer::TLemmatizer().Lemmatize(expected);
+            } else if (opts.UseStemming) {
+                expected = NStemmer::TPorterStemmer().Stem(expected);
+            }
+            EXPECT_EQ(pipeline.NormalizeTerm(TString("Went")), expected);
+        }
+    }
+
+    TTextPipeline pipeline;
+    TTextPipeline::TOptions opts = pipeline.GetOptions();
+    opts.UseStemming = false;
+    pipeline.SetOptions(opts);
+    ASSERT_EQ(pipeline.Process(TString("Running")).Size(), 1);
+    EXPECT_EQ(pipeline.Process(TString("Running"))[0], TString("running"));
+}
+
+TEST(TSearchEngine, CommonGramsPhraseSearchable) {
+    TSearchEngine::TOptions opts;
+    opts.PipelineOptions.Stopwords = TTextPipeline::EStopwordMode::CommonGrams;
+    TSearchEngine engine(opts);
+
+    engine.AddDocument(TString("to be or not to be"));
+    engine.AddDocument(TString("the sea is calm"));
+    engine.AddDocument(TString("be calm"));
+
+    EXPECT_EQ(engine.GetIndex().GetDocumentFrequency(TString("the")), 0);
+    TVector<TTfIdf::TSearchResult> results = engine.Search(TString("to be"), 10);
+    ASSERT_EQ(results.Size(), 1);
+    EXPECT_EQ(results[0].DocId, 0);
+}
+
 TEST(TSearchEngine, AddAndSearch) {
     TSearchEngine engine;
     
@@ -396,3 +1033,799 @@ TEST(TSearchEngine, Clear) {
     EXPECT_EQ(engine.GetDocumentCount(), 0);
     EXPECT_EQ(engine.GetTermCount(), 0);
 }
+
+TEST(TNearDuplicateIndex, FindsCloseSignatures) {
+    TNearDuplicateIndex index;
+
+    TTextPipeline pipeline;
+    TVector<TString> a = pipeline.Process(TString(
+        "Tyger Tyger, burning bright, In the forests of the night; What immortal hand or eye, "
+        "Could frame thy fearful symmetry? In what distant deeps or skies. Burnt the fire of thine eyes? "
+        "On what wings dare he aspire? What the hand, dare seize the fire?"));
+    TVector<TString> b = pipeline.Process(TString(
+        "Tyger Tyger, burning bright, In the forests of the night; What immortal hand or eye, "
+        "Dare frame thy fearful symmetry? In what distant deeps or skies. Burnt the fire of thine eyes? "
+        "On what wings dare he aspire? What the hand, dare seize the fire?"));
+
+    auto sigA = TNearDuplicateIndex::ComputeSignature(a.begin(), a.end());
+    auto sigB = TNearDuplicateIndex::ComputeSignature(b.begin(), b.end());
+    EXPECT_LT(TNearDuplicateIndex::HammingDistance(sigA, sigB), TNearDuplicateIndex::BANDS);
+
+    index.Add(sigA, 7);
+    size_t group = 0;
+    ASSERT_TRUE(index.Find(sigB, &group));
+    EXPECT_EQ(group, 7u);
+
+    EXPECT_FALSE(index.Find(~sigA, &group));
+}
+
+TEST(TWriteAheadLog, ReplaysRecordsAndCutsTornTail) {
+    std::string path = ::testing::TempDir() + "wal_roundtrip.log";
+    std::remove(path.c_str());
+    auto noRecords = [](uint64_t, const unsigned char*, size_t) { FAIL() << "unexpected record"; };
+
+    TWriteAheadLog::TOptions options;
+    {
+        TWriteAheadLog wal;
+        ASSERT_TRUE(wal.Open(path.c_str(), options, 0, noRecords));
+        for (int i = 0; i < 3; ++i) {
+            TBinaryWriter record;
+            record.WriteString(TString(std::to_string(i).c_str()));
+            EXPECT_EQ(wal.Append(record), static_cast<uint64_t>(i + 1));
+        }
+        EXPECT_TRUE(wal.CommitAll());
+    }
+
+    FILE* file = std::fopen(path.c_str(), "ab");
+    ASSERT_NE(file, nullptr);
+    const unsigned char garbage[] = {4, 0, 0, 0, 0, 0, 0, 0, 9, 0, 0, 0, 1, 2};
+    std::fwrite(garbage, 1, sizeof(garbage), file);
+    std::fclose(file);
+
+    TVector<uint64_t> lsns;
+    TVector<TString> values;
+    auto collect = [&](uint64_t lsn, const unsigned char* data, size_t size) {
+        TBinaryReader reader(data, size);
+        lsns.PushBack(lsn);
+        values.PushBack(reader.ReadString());
+    };
+    {
+        TWriteAheadLog wal;
+        ASSERT_TRUE(wal.Open(path.c_str(), options, 0, collect));
+        ASSERT_EQ(lsns.Size(), 3u);
+        EXPECT_EQ(values[2], TString("2"));
+        EXPECT_EQ(wal.GetLastLsn(), 3u);
+
+        TBinaryWriter record;
+        record.WriteString(TString("after"));
+        EXPECT_EQ(wal.Append(record), 4u);
+        EXPECT_TRUE(wal.CommitAll());
+    }
+
+    lsns.Clear();
+    values.Clear();
+    {
+        TWriteAheadLog wal;
+        ASSERT_TRUE(wal.Open(path.c_str(), options, 0, collect));
+        ASSERT_EQ(lsns.Size(), 4u);
+        EXPECT_EQ(lsns[3], 4u);
+        EXPECT_EQ(values[3], TString("after"));
+        EXPECT_TRUE(wal.Reset(4));
+    }
+
+    lsns.Clear();
+    {
+        TWriteAheadLog wal;
+        ASSERT_TRUE(wal.Open(path.c_str(), options, 0, collect));
+        EXPECT_TRUE(lsns.Empty());
+        EXPECT_EQ(wal.GetLastLsn(), 4u);
+    }
+    std::remove(path.c_str());
+}
+
+TEST(TWriteAheadLog, GroupCommitSharesSyncs) {
+    std::string path = ::testing::TempDir() + "wal_group.log";
+    std::remove(path.c_str());
+    TWriteAheadLog wal;
+    ASSERT_TRUE(wal.Open(path.c_str(), TWriteAheadLog::TOptions(), 0, [](uint64_t, const unsigned char*, size_t) {}));
+
+    const size_t threads = 8;
+    const size_t perThread = 50;
+    TVector<std::thread> writers;
+    for (size_t t = 0; t < threads; ++t) {
+        writers.PushBack(std::thread([&wal, t]() {
+            for (size_t i = 0; i < perThread; ++i) {
+                TBinaryWriter record;
+                record.WriteVarint(t * perThread + i);
+                EXPECT_TRUE(wal.Commit(wal.Append(record)));
+            }
+        }));
+    }
+    for (size_t t = 0; t < writers.Size(); ++t) {
+        writers[t].join();
+    }
+
+    TWriteAheadLog::TStats stats = wal.GetStats();
+    EXPECT_EQ(stats.Records, threads * perThread);
+    EXPECT_LE(stats.Commits, stats.Records);
+    EXPECT_EQ(stats.Syncs, stats.Commits);
+    wal.Close();
+
+    TVector<bool> seen(threads * perThread, false);
+    uint64_t expectedLsn = 1;
+    TWriteAheadLog reopened;
+    ASSERT_TRUE(reopened.Open(path.c_str(), TWriteAheadLog::TOptions(), 0,
+        [&](uint64_t lsn, const unsigned char* data, size_t size) {
+            EXPECT_EQ(lsn, expectedLsn++);
+            TBinaryReader reader(data, size);
+            size_t value = static_cast<size_t>(reader.ReadVarint());
+            ASSERT_LT(value, seen.Size());
+            seen[value] = true;
+        }));
+    for (size_t i = 0; i < seen.Size(); ++i) {
+        EXPECT_TRUE(seen[i]) << i;
+    }
+    std::remove(path.c_str());
+}
+
+TEST(TWriteAheadLog, PeriodicSyncFlushesIdleTail) {
+    std::string path = ::testing::TempDir() + "wal_periodic.log";
+    std::remove(path.c_str());
+    TWriteAheadLog::TOptions options;
+    options.Sync = TWriteAheadLog::ESyncPolicy::Periodic;
+    options.SyncIntervalMs = 200;
+    options.SyncIntervalBytes = 1 << 30;
+    TWriteAheadLog wal;
+    ASSERT_TRUE(wal.Open(path.c_str(), options, 0, [](uint64_t, const unsigned char*, size_t) {}));
+    TBinaryWriter record;
+    record.WriteVarint(42);
+    ASSERT_TRUE(wal.Commit(wal.Append(record)));
+    EXPECT_EQ(wal.GetStats().Syncs, 0u);
+    wal.Append(record);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(600));
+    EXPECT_GE(wal.GetStats().Syncs, 1u);
+    EXPECT_EQ(wal.GetStats().Commits, 1u);
+    size_t records = 0;
+    TWriteAheadLog reader;
+    ASSERT_TRUE(reader.Open(path.c_str(), TWriteAheadLog::TOptions(), 0,
+        [&](uint64_t, const unsigned char*, size_t) { ++records; }));
+    EXPECT_EQ(records, 2u);
+    reader.Close();
+    wal.Close();
+    std::remove(path.c_str());
+}
+
+TEST(TWriteAheadLog, DropThroughKeepsNewerRecords) {
+    std::string path = ::testing::TempDir() + "wal_drop.log";
+    std::remove(path.c_str());
+    TWriteAheadLog wal;
+    ASSERT_TRUE(wal.Open(path.c_str(), TWriteAheadLog::TOptions(), 0, [](uint64_t, const unsigned char*, size_t) {}));
+    for (size_t i = 0; i < 10; ++i) {
+        TBinaryWriter record;
+        record.WriteVarint(i);
+        wal.Commit(wal.Append(record));
+    }
+    TBinaryWriter pending;
+    pending.WriteVarint(10);
+    wal.Append(pending);
+
+    ASSERT_TRUE(wal.DropThrough(6));
+    TBinaryWriter after;
+    after.WriteVarint(11);
+    EXPECT_EQ(wal.Append(after), 12u);
+    EXPECT_TRUE(wal.CommitAll());
+    wal.Close();
+
+    TVector<uint64_t> lsns;
+    TWriteAheadLog reopened;
+    ASSERT_TRUE(reopened.Open(path.c_str(), TWriteAheadLog::TOptions(), 0,
+        [&](uint64_t lsn, const unsigned char*, size_t) { lsns.PushBack(lsn); }));
+    ASSERT_EQ(lsns.Size(), 6u);
+    EXPECT_EQ(lsns[0], 7u);
+    EXPECT_EQ(lsns.Back(), 12u);
+    reopened.Close();
+    std::remove(path.c_str());
+}
+
+TEST(TSnapshotWriter, ThrottledWriteReportsProgress) {
+    std::string path = ::testing::TempDir() + "snapshot_writer.bin";
+    auto image = std::make_shared<TByteBuffer>(64 * 1024);
+    for (size_t i = 0; i < image->Size(); ++i) {
+        (*image)[i] = static_cast<unsigned char>(i * 31);
+    }
+
+    TSnapshotWriter writer;
+    TSnapshotWriter::TOptions options;
+    options.ChunkBytes = 8 * 1024;
+    options.BytesPerSecond = 640 * 1024;
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_TRUE(writer.Start(image, TString(path.c_str()), options));
+    EXPECT_FALSE(writer.Start(image, TString(path.c_str()), options));
+    EXPECT_TRUE(writer.Wait());
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(90));
+
+    TSnapshotWriter::TProgress progress = writer.GetProgress();
+    EXPECT_EQ(progress.State, TSnapshotWriter::EState::Done);
+    EXPECT_EQ(progress.BytesWritten, image->Size());
+    EXPECT_EQ(progress.TotalBytes, image->Size());
+    TByteBuffer written;
+    ASSERT_TRUE(TBinaryReader::LoadFile(path.c_str(), &written));
+    EXPECT_TRUE(written == *image);
+
+    options.BytesPerSecond = 1024;
+    auto other = std::make_shared<TByteBuffer>(32 * 1024, 7);
+    ASSERT_TRUE(writer.Start(other, TString(path.c_str()), options));
+    writer.Cancel();
+    EXPECT_FALSE(writer.Wait());
+    EXPECT_EQ(writer.GetProgress().State, TSnapshotWriter::EState::Cancelled);
+    ASSERT_TRUE(TBinaryReader::LoadFile(path.c_str(), &written));
+    EXPECT_TRUE(written == *image);
+    std::remove(path.c_str());
+}
+
+TEST(TBufferPool, ClockCacheCountsHitsAndEvicts) {
+    std::string path = ::testing::TempDir() + "buffer_pool.bin";
+    TBinaryWriter writer;
+    for (size_t i = 0; i < 64 * 1024; ++i) {
+        writer.WriteU8(static_cast<unsigned char>(i * 13));
+    }
+    ASSERT_TRUE(writer.SaveToFile(path.c_str()));
+
+    TBufferPool pool;
+    TBufferPool::TOptions options;
+    options.PageSize = 4096;
+    options.CapacityBytes = 4 * 4096;
+    options.Shards = 2;
+    options.IoThreads = 3;
+    ASSERT_TRUE(pool.Open(path.c_str(), options));
+
+    TVector<TBufferPool::TRange> ranges;
+    ranges.PushBack(TBufferPool::TRange{100, 5000});
+    ranges.PushBack(TBufferPool::TRange{4096 * 3 + 7, 10});
+    TVector<TByteBuffer> outs;
+    ASSERT_TRUE(pool.ReadMany(ranges, &outs));
+    for (size_t r = 0; r < ranges.Size(); ++r) {
+        ASSERT_EQ(outs[r].Size(), ranges[r].Size);
+        for (size_t i = 0; i < ranges[r].Size; ++i) {
+            ASSERT_EQ(outs[r][i], static_cast<unsigned char>((ranges[r].Offset + i) * 13));
+        }
+    }
+    TBufferPool::TStats stats = pool.GetStats();
+    EXPECT_EQ(stats.Misses, 3u);
+    EXPECT_EQ(stats.Hits, 0u);
+    EXPECT_EQ(stats.Reads, 3u);
+    EXPECT_EQ(stats.BytesRead, 3u * 4096);
+    EXPECT_GE(stats.ReadNanos, stats.MaxReadNanos);
+
+    TByteBuffer out;
+    ASSERT_TRUE(pool.Read(200, 10, &out));
+    EXPECT_EQ(pool.GetStats().Hits, 1u);
+
+    for (size_t page = 4; page < 16; ++page) {
+        ASSERT_TRUE(pool.Read(page * 4096, 1, &out));
+    }
+    stats = pool.GetStats();
+    EXPECT_EQ(stats.Misses, 15u);
+    EXPECT_GT(stats.Evictions, 0u);
+    EXPECT_FALSE(pool.Read(64 * 1024 - 1, 2, &out));
+    pool.Close();
+    std::remove(path.c_str());
+}
+
+TEST(TAsyncReader, BatchReadOnBothBackends) {
+    std::string path = ::testing::TempDir() + "async_reader.bin";
+    TBinaryWriter writer;
+    for (size_t i = 0; i < 32 * 1024; ++i) {
+        writer.WriteU8(static_cast<unsigned char>(i * 7));
+    }
+    ASSERT_TRUE(writer.SaveToFile(path.c_str()));
+
+    TVector<TAsyncReader::TRange> ranges;
+    for (size_t r = 0; r < 40; ++r) {
+        ranges.PushBack(TAsyncReader::TRange{r * 811, 100 + r * 13});
+    }
+    const TAsyncReader::EBackend backends[] = {TAsyncReader::EBackend::Auto, TAsyncReader::EBackend::ThreadPool};
+    for (TAsyncReader::EBackend backend : backends) {
+        TAsyncReader reader;
+        TAsyncReader::TOptions options;
+        options.Backend = backend;
+        options.QueueDepth = 8;
+        options.Threads = 3;
+        ASSERT_TRUE(reader.Open(path.c_str(), options));
+        EXPECT_EQ(reader.GetFileSize(), 32u * 1024);
+        if (backend == TAsyncReader::EBackend::ThreadPool) {
+            EXPECT_EQ(reader.GetBackend(), TAsyncReader::EBackend::ThreadPool);
+        }
+
+        TVector<size_t> sizes(ranges.Size(), 0);
+        TVector<bool> correct(ranges.Size(), false);
+        ASSERT_TRUE(reader.ReadBatch(ranges, [&](size_t index, const unsigned char* data, size_t size) {
+            bool same = true;
+            for (size_t i = 0; i < size; ++i) {
+                same = same && data[i] == static_cast<unsigned char>((ranges[index].Offset + i) * 7);
+            }
+            sizes[index] = size;
+            correct[index] = same;
+        }));
+        for (size_t r = 0; r < ranges.Size(); ++r) {
+            EXPECT_EQ(sizes[r], ranges[r].Size);
+            EXPECT_TRUE(correct[r]);
+        }
+
+        TVector<TAsyncReader::TRange> beyond;
+        beyond.PushBack(TAsyncReader::TRange{32 * 1024 - 4, 8});
+        EXPECT_FALSE(reader.ReadBatch(beyond, [](size_t, const unsigned char*, size_t) {}));
+    }
+    std::remove(path.c_str());
+}
+
+TEST(TDiskIndex, MatchesInMemoryIndex) {
+    std::string path = ::testing::TempDir() + "disk_index.bin";
+    TInvertedIndex index;
+    for (size_t d = 0; d < 1000; ++d) {
+        TVector<TString> terms;
+        terms.PushBack(TString("common"));
+        if (d % 3 == 0) terms.PushBack(TString("fizz"));
+        if (d % 5 == 0) terms.PushBack(TString("buzz"));
+        if (d % 7 == 0) {
+            terms.PushBack(TString("seven"));
+            terms.PushBack(TString("seven"));
+        }
+        if (d == 999) terms.PushBack(TString("last"));
+        index.AddDocument(terms);
+    }
+    ASSERT_TRUE(TDiskIndex::Write(index, path.c_str()));
+
+    TDiskIndex disk;
+    TBufferPool::TOptions options;
+    options.PageSize = 512;
+    options.CapacityBytes = 8 * 512;
+    options.Shards = 4;
+    ASSERT_TRUE(disk.Open(path.c_str(), options));
+    EXPECT_EQ(disk.GetDocumentCount(), 1000u);
+    EXPECT_EQ(disk.GetTermCount(), index.GetTermCount());
+    EXPECT_EQ(disk.GetDocumentFrequency(TString("seven")), index.GetDocumentFrequency(TString("seven")));
+    EXPECT_DOUBLE_EQ(disk.GetAverageDocumentLength(), index.GetAverageDocumentLength());
+
+    TVector<TString> query;
+    query.PushBack(TString("fizz"));
+    query.PushBack(TString("seven"));
+    query.PushBack(TString("absent"));
+    query.PushBack(TString("last"));
+    TVector<TTermPostings> fetched;
+    ASSERT_TRUE(disk.FetchTerms(query, &fetched));
+    ASSERT_EQ(fetched.Size(), query.Size());
+    for (size_t i = 0; i < query.Size(); ++i) {
+        const TTermPostings& expected = index.GetTermPostings(query[i]);
+        EXPECT_TRUE(fetched[i].Docs == expected.Docs);
+        EXPECT_TRUE(fetched[i].Freqs == expected.Freqs);
+    }
+    EXPECT_EQ(disk.GetTermFrequency(770, TString("seven")), 2u);
+    EXPECT_EQ(disk.GetTermFrequency(771, TString("seven")), 0u);
+    EXPECT_EQ(disk.GetTermFrequency(999, TString("last")), 1u);
+
+    TVector<TString> pair;
+    pair.PushBack(TString("fizz"));
+    pair.PushBack(TString("buzz"));
+    TPostingList docs;
+    ASSERT_TRUE(disk.SearchAnd(pair, &docs));
+    EXPECT_TRUE(docs == TBooleanSearch(index).SearchAnd(pair));
+    ASSERT_TRUE(disk.SearchOr(pair, &docs));
+    EXPECT_TRUE(docs == TBooleanSearch(index).SearchOr(pair));
+
+    for (EScorer scorer : {EScorer::TfIdf, EScorer::Bm25}) {
+        TScoringRequest request;
+        request.Scorer = scorer;
+        request.TopK = 20;
+        TScoringResult expected = TScoringDispatcher::Run(index, query, request);
+        TScoringResult actual;
+        ASSERT_TRUE(disk.Score(query, request, &actual));
+        EXPECT_EQ(actual.Count, expected.Count);
+        ASSERT_EQ(actual.Hits.Size(), expected.Hits.Size());
+        for (size_t i = 0; i < expected.Hits.Size(); ++i) {
+            EXPECT_EQ(actual.Hits[i].DocId, expected.Hits[i].DocId);
+            EXPECT_DOUBLE_EQ(actual.Hits[i].Score, expected.Hits[i].Score);
+        }
+    }
+
+    disk.ResetCacheStats();
+    TVector<TString> small;
+    small.PushBack(TString("last"));
+    ASSERT_TRUE(disk.FetchTerms(small, &fetched));
+    ASSERT_TRUE(disk.FetchTerms(small, &fetched));
+    TBufferPool::TStats stats = disk.GetCacheStats();
+    EXPECT_GE(stats.Hits, 1u);
+    EXPECT_GE(stats.Hits, stats.Misses);
+    disk.Close();
+    std::remove(path.c_str());
+}
+
+TEST(TDiskIndex, ReadErrorsAreReportedNotEmpty) {
+    std::string path = ::testing::TempDir() + "disk_index_truncated.bin";
+    TInvertedIndex index;
+    for (size_t d = 0; d < 500; ++d) {
+        TVector<TString> terms;
+        terms.PushBack(TString("common"));
+        if (d % 3 == 0) terms.PushBack(TString("fizz"));
+        index.AddDocument(terms);
+    }
+    ASSERT_TRUE(TDiskIndex::Write(index, path.c_str()));
+
+    TDiskIndex disk;
+    ASSERT_TRUE(disk.Open(path.c_str()));
+    ASSERT_EQ(::truncate(path.c_str(), 16), 0);
+
+    TVector<TString> query;
+    query.PushBack(TString("fizz"));
+    query.PushBack(TString("common"));
+    TVector<TTermPostings> fetched;
+    EXPECT_FALSE(disk.FetchTerms(query, &fetched));
+    TPostingList docs;
+    EXPECT_FALSE(disk.SearchAnd(query, &docs));
+    EXPECT_TRUE(docs.Empty());
+    EXPECT_FALSE(disk.SearchOr(query, &docs));
+    EXPECT_FALSE(disk.GetPostingList(TString("fizz"), &docs));
+    TScoringResult scored;
+    EXPECT_FALSE(disk.Score(query, TScoringRequest(), &scored));
+    EXPECT_TRUE(scored.Hits.Empty());
+
+    TVector<TString> absent(1, TString("absent"));
+    EXPECT_TRUE(disk.FetchTerms(absent, &fetched));
+    EXPECT_TRUE(fetched[0].Docs.Empty());
+    disk.Close();
+    std::remove(path.c_str());
+}
+
+TEST(TDiskIndexBuilder, SpillsRunsAndMergesIntoDiskIndex) {
+    std::string path = ::testing::TempDir() + "disk_index_built.bin";
+    TInvertedIndex index;
+    TDiskIndexBuilder builder(TString(path.c_str()), 4096);
+    for (size_t d = 0; d < 2000; ++d) {
+        TVector<TString> terms;
+        terms.PushBack(TString("common"));
+        terms.PushBack(TString(("term" + std::to_string(d % 97)).c_str()));
+        if (d % 3 == 0) terms.PushBack(TString("fizz"));
+        if (d % 7 == 0) {
+            terms.PushBack(TString("seven"));
+            terms.PushBack(TString("seven"));
+        }
+        if (d == 1999) terms.PushBack(TString("last"));
+        EXPECT_EQ(builder.AddDocument(terms.begin(), terms.end()), index.AddDocument(terms));
+    }
+    EXPECT_GT(builder.GetRunCount(), 1u);
+    ASSERT_TRUE(builder.Finish());
+    EXPECT_EQ(builder.GetRunCount(), 0u);
+    EXPECT_EQ(std::fopen((path + ".run0").c_str(), "rb"), nullptr);
+
+    TDiskIndex disk;
+    ASSERT_TRUE(disk.Open(path.c_str()));
+    EXPECT_EQ(disk.GetDocumentCount(), index.GetDocumentCount());
+    EXPECT_EQ(disk.GetTermCount(), index.GetTermCount());
+    EXPECT_DOUBLE_EQ(disk.GetAverageDocumentLength(), index.GetAverageDocumentLength());
+    TVector<TString> terms;
+    index.ForEachTerm([&](const TString& term, const TTermPostings&) { terms.PushBack(term); });
+    TVector<TTermPostings> fetched;
+    ASSERT_TRUE(disk.FetchTerms(terms, &fetched));
+    for (size_t i = 0; i < terms.Size(); ++i) {
+        const TTermPostings& expected = index.GetTermPostings(terms[i]);
+        EXPECT_TRUE(fetched[i].Docs == expected.Docs);
+        EXPECT_TRUE(fetched[i].Freqs == expected.Freqs);
+    }
+    EXPECT_EQ(disk.GetTermFrequency(1995, TString("seven")), 2u);
+    disk.Close();
+    std::remove(path.c_str());
+}
+
+TEST(TSegmentStore, NamesByContentAndCollectsGarbage) {
+    TString dir((::testing::TempDir() + "segment_store").c_str());
+    ASSERT_TRUE(TSegmentStore::EnsureDirectory(dir));
+    ASSERT_TRUE(TSegmentStore::EnsureDirectory(dir));
+
+    TByteBuffer first(100, 1);
+    TByteBuffer second(100, 2);
+    uint64_t firstHash = TSegmentStore::ContentHash(first);
+    uint64_t secondHash = TSegmentStore::ContentHash(second);
+    EXPECT_NE(firstHash, secondHash);
+    EXPECT_EQ(firstHash, TSegmentStore::ContentHash(TByteBuffer(100, 1)));
+    EXPECT_NE(TSegmentStore::ContentHash(TByteBuffer()), 0u);
+
+    TString firstPath = TSegmentStore::SegmentPath(dir, firstHash);
+    TString secondPath = TSegmentStore::SegmentPath(dir, secondHash);
+    EXPECT_EQ(firstPath.Size(), dir.Size() + 1 + 16 + 4);
+    TString stray = dir;
+    stray.Append("/stray.seg.tmp");
+    for (const TString* path : {&firstPath, &secondPath, &stray}) {
+        FILE* file = std::fopen(path->CStr(), "wb");
+        ASSERT_NE(file, nullptr);
+        std::fclose(file);
+    }
+    TString manifest = TSegmentStore::ManifestPath(dir);
+    FILE* file = std::fopen(manifest.CStr(), "wb");
+    ASSERT_NE(file, nullptr);
+    std::fclose(file);
+
+    TUnorderedSet<uint64_t> keep;
+    keep.Insert(firstHash);
+    EXPECT_EQ(TSegmentStore::RemoveUnreferenced(dir, keep), 2u);
+    EXPECT_TRUE(TSegmentStore::Exists(firstPath));
+    EXPECT_FALSE(TSegmentStore::Exists(secondPath));
+    EXPECT_FALSE(TSegmentStore::Exists(stray));
+    EXPECT_TRUE(TSegmentStore::Exists(manifest));
+
+    std::remove(firstPath.CStr());
+    std::remove(manifest.CStr());
+    ::rmdir(dir.CStr());
+}
+
+TEST(TExternalKeyMap, FixedWidthKeysWithHashLookup) {
+    TExternalKeyMap keys;
+    keys.Append(TString("a1"));
+    keys.Append(TString());
+    keys.Append(TString("65f0c1a2b3c4d5e6f7a8b9c0"));
+    EXPECT_EQ(keys.Size(), 3u);
+    EXPECT_EQ(keys.GetWidth(), 24u);
+    EXPECT_EQ(keys.Get(0), TString("a1"));
+    EXPECT_TRUE(keys.Get(1).Empty());
+    EXPECT_FALSE(keys.Set(0, TString("other")));
+
+    for (size_t i = 0; i < 1000; ++i) {
+        keys.Append(TString(("line-" + std::to_string(i)).c_str()));
+    }
+    EXPECT_EQ(keys.GetKeyCount(), 1002u);
+    size_t id = 0;
+    ASSERT_TRUE(keys.Find(TString("65f0c1a2b3c4d5e6f7a8b9c0"), &id));
+    EXPECT_EQ(id, 2u);
+    ASSERT_TRUE(keys.Find(TString("line-999"), &id));
+    EXPECT_EQ(id, 1002u);
+    ASSERT_TRUE(keys.Find(TString("a1"), &id));
+    EXPECT_EQ(id, 0u);
+    EXPECT_FALSE(keys.Find(TString("a"), &id));
+    EXPECT_FALSE(keys.Find(TString("line-1000"), &id));
+
+    keys.Set(2000, TString("a1"));
+    ASSERT_TRUE(keys.Find(TString("a1"), &id));
+    EXPECT_EQ(id, 2000u);
+    EXPECT_EQ(keys.GetKeyCount(), 1002u);
+    EXPECT_TRUE(keys.Get(1500).Empty());
+
+    EXPECT_TRUE(keys.AddAlias(2, TString("skipped-copy")));
+    EXPECT_FALSE(keys.AddAlias(5, TString("skipped-copy")));
+    EXPECT_FALSE(keys.AddAlias(5, TString("line-7")));
+    ASSERT_TRUE(keys.Find(TString("skipped-copy"), &id));
+    EXPECT_EQ(id, 2u);
+    EXPECT_EQ(keys.Get(2), TString("65f0c1a2b3c4d5e6f7a8b9c0"));
+    ASSERT_NE(keys.GetAliases(2), nullptr);
+    EXPECT_EQ(keys.GetAliases(2)->Size(), 1u);
+    EXPECT_EQ(keys.GetAliases(5), nullptr);
+}
+
+TEST(TExternalKeyMap, LongKeysSpillPastMaxWidth) {
+    TExternalKeyMap keys(8);
+    const TString longKey("https://example.org/a/very/long/document/url");
+    keys.Append(TString("k0"));
+    keys.Append(longKey);
+    keys.Append(TString("k2"));
+    EXPECT_EQ(keys.GetWidth(), 2u);
+    EXPECT_EQ(keys.GetLongKeyCount(), 1u);
+    EXPECT_EQ(keys.GetKeyCount(), 3u);
+    EXPECT_EQ(keys.Get(1), longKey);
+    EXPECT_FALSE(keys.Set(1, TString("short")));
+
+    size_t id = 0;
+    ASSERT_TRUE(keys.Find(longKey, &id));
+    EXPECT_EQ(id, 1u);
+    ASSERT_TRUE(keys.Find(TString("k2"), &id));
+    EXPECT_EQ(id, 2u);
+    EXPECT_FALSE(keys.Find(TString("https://example.org/a/very/long"), &id));
+
+    keys.Set(5, longKey);
+    ASSERT_TRUE(keys.Find(longKey, &id));
+    EXPECT_EQ(id, 5u);
+    EXPECT_EQ(keys.GetKeyCount(), 3u);
+    EXPECT_FALSE(keys.AddAlias(7, longKey));
+    EXPECT_TRUE(keys.AddAlias(1, TString("https://example.org/another/long/alias")));
+
+    keys.Clear();
+    EXPECT_EQ(keys.GetMaxWidth(), 8u);
+    EXPECT_EQ(keys.GetLongKeyCount(), 0u);
+    EXPECT_FALSE(keys.Find(longKey, &id));
+}
+
+TEST(TStoredFields, RowBlobsBySchema) {
+    TVector<TString> schema;
+    schema.PushBack(TString("author"));
+    schema.PushBack(TString("year"));
+    TStoredFields fields(schema);
+    EXPECT_EQ(fields.FindField(TString("year")), 1u);
+    EXPECT_EQ(fields.FindField(TString("genre")), 2u);
+
+    TVector<TString> row;
+    row.PushBack(TString("Pushkin"));
+    row.PushBack(TString("1833"));
+    row.PushBack(TString("ignored"));
+    ASSERT_TRUE(fields.Set(0, row));
+    TVector<TString> authorOnly(1, TString("Blok"));
+    ASSERT_TRUE(fields.Set(3, authorOnly));
+    EXPECT_FALSE(fields.Set(2, row));
+    EXPECT_EQ(fields.Size(), 4u);
+
+    EXPECT_EQ(fields.Get(0, 1), TString("1833"));
+    EXPECT_EQ(fields.Get(3, 0), TString("Blok"));
+    EXPECT_TRUE(fields.Get(3, 1).Empty());
+    EXPECT_TRUE(fields.Get(1, 0).Empty());
+    TVector<TString> values = fields.Get(0);
+    ASSERT_EQ(values.Size(), 2u);
+    EXPECT_EQ(values[0], TString("Pushkin"));
+
+    size_t size = 0;
+    const unsigned char* blob = fields.GetRow(0, &size);
+    TStoredFields copy(schema);
+    ASSERT_TRUE(copy.SetRow(5, blob, size));
+    EXPECT_EQ(copy.Get(5, 0), TString("Pushkin"));
+    const unsigned char broken[] = {5, 'a'};
+    EXPECT_FALSE(copy.SetRow(6, broken, 2));
+
+    TBinaryWriter writer;
+    fields.SaveSchema(writer);
+    TStoredFields loaded;
+    TBinaryReader reader(writer.GetBuffer());
+    ASSERT_TRUE(loaded.LoadSchema(reader));
+    EXPECT_EQ(loaded.GetSchema().Size(), 2u);
+    EXPECT_EQ(loaded.GetSchema()[1], TString("year"));
+}
+
+TEST(TPassageIndex, SplitsStanzasAndScoresBestPassage) {
+    const TString poem("the night is still\r\n  the garden sleeps\n\n\nthe rose is red\n   \nlast line");
+    TVector<TPassageIndex::TSpan> lines = TPassageIndex::Split(poem, TPassageIndex::EUnit::Line);
+    ASSERT_EQ(lines.Size(), 4u);
+    EXPECT_EQ(TString(poem.Data() + lines[1].Begin, lines[1].End - lines[1].Begin), TString("the garden sleeps"));
+    EXPECT_EQ(lines[2].FirstLine, 4u);
+    TVector<TPassageIndex::TSpan> stanzas = TPassageIndex::Split(poem, TPassageIndex::EUnit::Stanza);
+    ASSERT_EQ(stanzas.Size(), 3u);
+    EXPECT_EQ(stanzas[0].LineCount, 2u);
+    EXPECT_EQ(stanzas[2].FirstLine, 6u);
+
+    TTextPipeline pipeline;
+    TPassageIndex index;
+    index.SetUnit(TPassageIndex::EUnit::Stanza);
+    TPassageIndex::TTokenized doc = TPassageIndex::Tokenize(pipeline, poem, index.GetUnit());
+    ASSERT_EQ(doc.Spans.Size(), 3u);
+    EXPECT_EQ(doc.Terms, pipeline.Process(poem));
+    ASSERT_TRUE(index.AddDocument(0, doc));
+    const TString other("rose rose rose\n\nrose garden");
+    ASSERT_TRUE(index.AddDocument(2, TPassageIndex::Tokenize(pipeline, other, index.GetUnit())));
+    EXPECT_FALSE(index.AddDocument(1, doc));
+    EXPECT_EQ(index.GetParentCount(), 3u);
+    EXPECT_EQ(index.Size(), 5u);
+
+    TScoringRequest request;
+    request.TopK = 10;
+    TVector<TString> query = pipeline.Process(TString("rose"));
+    TVector<TPassageIndex::THit> passages = index.SearchPassages(query, request);
+    EXPECT_EQ(passages.Size(), 3u);
+    TVector<TPassageIndex::THit> docs = index.SearchDocuments(query, request);
+    ASSERT_EQ(docs.Size(), 2u);
+    EXPECT_EQ(docs[0].Parent, 2u);
+    EXPECT_EQ(index.GetText(docs[0].Passage, other), TString("rose rose rose"));
+    EXPECT_EQ(index.GetText(docs[1].Passage, poem), TString("the rose is red"));
+
+    TBinaryWriter writer;
+    index.Save(writer);
+    TPassageIndex loaded;
+    TBinaryReader reader(writer.GetBuffer());
+    ASSERT_TRUE(loaded.Load(reader, 3));
+    EXPECT_EQ(loaded.GetUnit(), TPassageIndex::EUnit::Stanza);
+    loaded.DeleteParent(2);
+    docs = loaded.SearchDocuments(query, request);
+    ASSERT_EQ(docs.Size(), 1u);
+    EXPECT_EQ(docs[0].Parent, 0u);
+    EXPECT_EQ(loaded.GetSpan(docs[0].Passage).FirstLine, 4u);
+    TBinaryReader tooFew(writer.GetBuffer());
+    EXPECT_FALSE(loaded.Load(tooFew, 2));
+}
+
+TEST(TPassageIndex, SearchDocumentsRefillsPastDominantParent) {
+    TTextPipeline pipeline;
+    TPassageIndex index;
+    index.SetUnit(TPassageIndex::EUnit::Line);
+    TString dominant;
+    TString filler;
+    for (size_t i = 0; i < 30; ++i) {
+        dominant.Append("rose rose\n");
+        filler.Append("thorn hedge\n");
+    }
+    ASSERT_TRUE(index.AddDocument(0, TPassageIndex::Tokenize(pipeline, dominant, index.GetUnit())));
+    ASSERT_TRUE(index.AddDocument(1, TPassageIndex::Tokenize(pipeline, filler, index.GetUnit())));
+    ASSERT_TRUE(index.AddDocument(2, TPassageIndex::Tokenize(pipeline, TString("a rose by the old stone wall"), index.GetUnit())));
+
+    TScoringRequest request;
+    request.TopK = 2;
+    TVector<TPassageIndex::THit> docs = index.SearchDocuments(pipeline.Process(TString("rose")), request);
+    ASSERT_EQ(docs.Size(), 2u);
+    EXPECT_EQ(docs[0].Parent, 0u);
+    EXPECT_EQ(docs[1].Parent, 2u);
+    EXPECT_GT(docs[0].Score, docs[1].Score);
+    request.TopK = 5;
+    EXPECT_EQ(index.SearchDocuments(pipeline.Process(TString("rose")), request).Size(), 2u);
+}
+
+TEST(TRhymeIndex, SignaturesGroupRhymingLines) {
+    EXPECT_EQ(TRhymeIndex::Signature(TString("night")), TString("AYT"));
+    EXPECT_EQ(TRhymeIndex::Signature(TString("White")), TRhymeIndex::Signature(TString("bite")));
+    EXPECT_EQ(TRhymeIndex::Signature(TString("love")), TRhymeIndex::Signature(TString("above")));
+    EXPECT_EQ(TRhymeIndex::Signature(TString("day")), TRhymeIndex::Signature(TString("they")));
+    EXPECT_EQ(TRhymeIndex::Signature(TString("sea")), TRhymeIndex::Signature(TString("free")));
+    EXPECT_EQ(TRhymeIndex::Signature(TString("fire")), TRhymeIndex::Signature(TString("desire")));
+    EXPECT_EQ(TRhymeIndex::Signature(TString("heart")), TRhymeIndex::Signature(TString("apart")));
+    EXPECT_EQ(TRhymeIndex::Signature(TString("loving")), TRhymeIndex::Signature(TString("shoving")));
+    EXPECT_EQ(TRhymeIndex::Signature(TString("river")), TRhymeIndex::Signature(TString("shiver")));
+    EXPECT_EQ(TRhymeIndex::Signature(TString("skies")), TRhymeIndex::Signature(TString("eyes")));
+    EXPECT_NE(TRhymeIndex::Signature(TString("night")), TRhymeIndex::Signature(TString("day")));
+    EXPECT_TRUE(TRhymeIndex::Signature(TString("nth")).Empty());
+
+    const TString poem("The moon is bright tonight,\n\n  my love,\nthe stars above!\n123\n");
+    TVector<TRhymeIndex::TLineRhyme> lines = TRhymeIndex::Extract(poem);
+    ASSERT_EQ(lines.Size(), 3u);
+    EXPECT_EQ(lines[0].Signature, TString("AYT"));
+    EXPECT_EQ(lines[1].Line, 2u);
+    EXPECT_EQ(lines[2].Signature, lines[1].Signature);
+
+    TRhymeIndex index;
+    index.SetEnabled(true);
+    index.AddDocument(0, lines);
+    index.AddDocument(2, TRhymeIndex::Extract(TString("a dove\nin flight")));
+    EXPECT_EQ(index.FindDocuments(TString("glove")), TPostingList({0, 2}));
+    TVector<TRhymeIndex::TEntry> entries = index.FindLines(TString("glove"));
+    ASSERT_EQ(entries.Size(), 3u);
+    EXPECT_EQ(entries[1].Line, 3u);
+    EXPECT_EQ(entries[2].Doc, 2u);
+    EXPECT_TRUE(index.FindDocuments(TString("orange")).Empty());
+
+    index.Remap(TVector<TDocId>({2, 1, 0}));
+    EXPECT_EQ(index.FindDocuments(TString("light")), TPostingList({0, 2}));
+    entries = index.FindLines(TString("light"));
+    ASSERT_EQ(entries.Size(), 2u);
+    EXPECT_EQ(entries[0].Line, 1u);
+
+    TBinaryWriter writer;
+    index.Save(writer);
+    TRhymeIndex loaded;
+    TBinaryReader reader(writer.GetBuffer());
+    ASSERT_TRUE(loaded.Load(reader, 3));
+    EXPECT_TRUE(loaded.IsEnabled());
+    EXPECT_EQ(loaded.Size(), index.Size());
+    EXPECT_EQ(loaded.FindLines(TString("glove")).Size(), 3u);
+    TBinaryReader tooFew(writer.GetBuffer());
+    EXPECT_FALSE(loaded.Load(tooFew, 2));
+}
+
+TEST(TPhoneticIndex, VariantSpellingsShareCode) {
+    EXPECT_EQ(TPhoneticIndex::Encode(TString("musick")), TString("MSK"));
+    EXPECT_EQ(TPhoneticIndex::Encode(TString("Music")), TString("MSK"));
+    EXPECT_EQ(TPhoneticIndex::Encode(TString("shew")), TPhoneticIndex::Encode(TString("show")));
+    EXPECT_EQ(TPhoneticIndex::Encode(TString("phantasie")), TPhoneticIndex::Encode(TString("fantasy")));
+    EXPECT_EQ(TPhoneticIndex::Encode(TString("knight")), TString("NT"));
+    EXPECT_EQ(TPhoneticIndex::Encode(TString("thee")), TString("0"));
+    EXPECT_NE(TPhoneticIndex::Encode(TString("music")), TPhoneticIndex::Encode(TString("magic")));
+    EXPECT_TRUE(TPhoneticIndex::Encode(TString("1599")).Empty());
+    EXPECT_EQ(TPhoneticIndex::Encode(TString("incomprehensibilities")).Size(), TPhoneticIndex::MAX_CODE_LENGTH);
+
+    TInvertedIndex index;
+    index.AddDocument(TVector<TString>({TString("musick"), TString("hath"), TString("charms")}));
+    index.AddDocument(TVector<TString>({TString("the"), TString("music"), TString("night")}));
+    index.AddDocument(TVector<TString>({TString("magic")}));
+    TPhoneticIndex phonetic;
+    phonetic.Build(index);
+    const TVector<TString>* terms = phonetic.FindTerms(TString("musique"));
+    ASSERT_NE(terms, nullptr);
+    ASSERT_EQ(terms->Size(), 2u);
+    TVector<const TPostingList*> lists;
+    for (size_t i = 0; i < terms->Size(); ++i) {
+        lists.PushBack(&index.GetPostingList((*terms)[i]));
+    }
+    EXPECT_EQ(TPostingOps::UnionMany(lists), TPostingList({0, 1}));
+    EXPECT_EQ(phonetic.FindTerms(TString("zebra")), nullptr);
+    phonetic.Clear();
+    EXPECT_EQ(phonetic.Size(), 0u);
+}
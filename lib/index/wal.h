@@ -0,0 +1,460 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <lib/types/string/string.h>
+#include <lib/collections/vector/vector.h>
+#include <lib/index/index_io.h>
+
+namespace NIndex {
+
+using NTypes::TString;
+using NCollections::TVector;
+
+/**
+ * Журнал упреждающей записи (WAL): файл только на дозапись из пронумерованных записей.
+ *
+ * Формат: заголовок (magic, версия, базовый LSN), затем записи
+ * [LSN: u64][размер: u32][контрольная сумма: u32][данные]. Сумма (FNV-1a) покрывает
+ * LSN и данные, поэтому недописанный при падении хвост распознаётся и отрезается при открытии.
+ *
+ * Групповая фиксация: Append только кладёт запись в буфер, Commit(lsn) ждёт, пока она
+ * попадёт на диск. Первый пришедший в Commit поток становится лидером и одним write
+ * (и одним fdatasync по политике) сбрасывает всё, что накопили остальные; те просыпаются
+ * уже зафиксированными. Методы потокобезопасны.
+ */
+class TWriteAheadLog {
+public:
+    /**
+     * Когда вызывать fdatasync: None — никогда (данные в page cache переживают падение
+     * процесса, но не ОС), EveryCommit — на каждую групповую фиксацию,
+     * Periodic — не чаще SyncIntervalMs и не реже чем раз в SyncIntervalBytes. При Periodic
+     * фоновый поток раз в SyncIntervalMs дописывает и сбрасывает хвост, если фиксаций больше
+     * не было, поэтому при падении ОС теряется не больше последнего интервала.
+     */
+    enum class ESyncPolicy {
+        None,
+        EveryCommit,
+        Periodic
+    };
+
+    struct TOptions {
+        ESyncPolicy Sync = ESyncPolicy::EveryCommit;
+        size_t SyncIntervalMs = 100;
+        size_t SyncIntervalBytes = 1 << 20;
+    };
+
+    struct TStats {
+        size_t Records = 0;
+        size_t Commits = 0;
+        size_t Syncs = 0;
+    };
+
+    static constexpr uint32_t FILE_MAGIC = 0x4c575349; // "ISWL"
+    static constexpr uint32_t FILE_VERSION = 1;
+    static constexpr size_t HEADER_SIZE = 16;
+    static constexpr size_t RECORD_HEADER_SIZE = 16;
+
+    TWriteAheadLog() = default;
+    TWriteAheadLog(const TWriteAheadLog&) = delete;
+    TWriteAheadLog& operator=(const TWriteAheadLog&) = delete;
+
+    ~TWriteAheadLog() {
+        Close();
+    }
+
+    /**
+     * Открывает (или создаёт) журнал и передаёт visitor(lsn, data, size) каждую целую запись
+     * по порядку. Битый хвост отрезается, следующая запись получит LSN после последней
+     * прочитанной (но не меньше minLsn + 1, если журнал только что обнулён после снимка).
+     */
+    template <typename TVisitor>
+    bool Open(const char* path, const TOptions& options, uint64_t minLsn, TVisitor&& visitor) {
+        Close();
+        Options_ = options;
+        Path_ = TString(path);
+
+        TByteBuffer buffer;
+        size_t validSize = 0;
+        uint64_t lastLsn = minLsn;
+        if (TBinaryReader::LoadFile(path, &buffer) && buffer.Size() >= HEADER_SIZE) {
+            TBinaryReader reader(buffer);
+            if (reader.ReadU32() != FILE_MAGIC || reader.ReadU32() != FILE_VERSION) return false;
+            uint64_t baseLsn = reader.ReadU64();
+            if (baseLsn > lastLsn) lastLsn = baseLsn;
+            validSize = HEADER_SIZE;
+            while (reader.Remaining() >= RECORD_HEADER_SIZE) {
+                uint64_t lsn = reader.ReadU64();
+                uint32_t size = reader.ReadU32();
+                uint32_t checksum = reader.ReadU32();
+                if (size > reader.Remaining()) break;
+                const unsigned char* data = buffer.Data() + validSize + RECORD_HEADER_SIZE;
+                if (Checksum(lsn, data, size) != checksum) break;
+                visitor(lsn, data, static_cast<size_t>(size));
+                if (lsn > lastLsn) lastLsn = lsn;
+                validSize += RECORD_HEADER_SIZE + size;
+                reader = TBinaryReader(buffer.Data() + validSize, buffer.Size() - validSize);
+            }
+        }
+
+        Fd_ = ::open(path, O_WRONLY | O_CREAT, 0644);
+        if (Fd_ < 0) return false;
+        bool ok = ::ftruncate(Fd_, static_cast<off_t>(validSize)) == 0;
+        ok = ok && (validSize > 0 || WriteHeader(lastLsn));
+        ok = ok && ::lseek(Fd_, 0, SEEK_END) >= 0;
+        if (!ok) {
+            Close();
+            return false;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(Mutex_);
+            NextLsn_ = lastLsn + 1;
+            DurableLsn_ = lastLsn;
+            Failed_ = false;
+            Stopping_ = false;
+            LastSync_ = std::chrono::steady_clock::now();
+        }
+        if (Options_.Sync == ESyncPolicy::Periodic) {
+            Syncer_ = std::thread([this] { SyncLoop(); });
+        }
+        return true;
+    }
+
+    bool IsOpen() const { return Fd_ >= 0; }
+
+    bool Ok() const {
+        std::lock_guard<std::mutex> lock(Mutex_);
+        return !Failed_;
+    }
+
+    /**
+     * Ставит запись в очередь на запись и возвращает её LSN. До Commit запись не на диске.
+     */
+    uint64_t Append(const unsigned char* data, size_t size) {
+        std::lock_guard<std::mutex> lock(Mutex_);
+        uint64_t lsn = NextLsn_++;
+        uint32_t checksum = Checksum(lsn, data, size);
+        TBinaryWriter header;
+        header.WriteU64(lsn);
+        header.WriteU32(static_cast<uint32_t>(size));
+        header.WriteU32(checksum);
+        const TByteBuffer& bytes = header.GetBuffer();
+        for (size_t i = 0; i < bytes.Size(); ++i) {
+            Pending_.PushBack(bytes[i]);
+        }
+        for (size_t i = 0; i < size; ++i) {
+            Pending_.PushBack(data[i]);
+        }
+        ++Stats_.Records;
+        return lsn;
+    }
+
+    uint64_t Append(const TBinaryWriter& record) {
+        const TByteBuffer& bytes = record.GetBuffer();
+        return Append(bytes.Data(), bytes.Size());
+    }
+
+    /**
+     * Возвращает, когда запись lsn (и все предыдущие) записана в файл и, по политике, сброшена
+     * на диск. false — журнал в состоянии ошибки ввода-вывода, дальнейшие фиксации тоже не пройдут.
+     */
+    bool Commit(uint64_t lsn) {
+        std::unique_lock<std::mutex> lock(Mutex_);
+        while (DurableLsn_ < lsn && !Failed_ && Flushing_) {
+            Flushed_.wait(lock);
+        }
+        if (Failed_ || Fd_ < 0) return false;
+        if (DurableLsn_ >= lsn) return true;
+
+        Flushing_ = true;
+        TByteBuffer batch;
+        batch.Swap(Pending_);
+        uint64_t upto = NextLsn_ - 1;
+        bool sync = ShouldSync(batch.Size());
+        lock.unlock();
+
+        bool ok = WriteAll(batch.Data(), batch.Size()) && (!sync || ::fdatasync(Fd_) == 0);
+
+        lock.lock();
+        Flushing_ = false;
+        ++Stats_.Commits;
+        if (sync) {
+            ++Stats_.Syncs;
+            UnsyncedBytes_ = 0;
+            LastSync_ = std::chrono::steady_clock::now();
+        }
+        if (ok) {
+            DurableLsn_ = upto;
+        } else {
+            Failed_ = true;
+        }
+        Flushed_.notify_all();
+        return ok;
+    }
+
+    bool CommitAll() {
+        uint64_t last;
+        {
+            std::lock_guard<std::mutex> lock(Mutex_);
+            last = NextLsn_ - 1;
+        }
+        return Commit(last);
+    }
+
+    /**
+     * Обнуляет журнал после снимка, покрывающего записи до lsn включительно.
+     * Не должен идти одновременно с Append/Commit из других потоков.
+     */
+    bool Reset(uint64_t lsn) {
+        if (!CommitAll()) return false;
+        std::unique_lock<std::mutex> lock(Mutex_);
+        while (Flushing_) {
+            Flushed_.wait(lock);
+        }
+        bool ok = ::ftruncate(Fd_, 0) == 0 && ::lseek(Fd_, 0, SEEK_SET) == 0 && WriteHeader(lsn);
+        ok = ok && (Options_.Sync == ESyncPolicy::None || ::fdatasync(Fd_) == 0);
+        if (!ok) {
+            Failed_ = true;
+            return false;
+        }
+        if (NextLsn_ <= lsn) NextLsn_ = lsn + 1;
+        if (DurableLsn_ < lsn) DurableLsn_ = lsn;
+        UnsyncedBytes_ = 0;
+        return true;
+    }
+
+    /**
+     * Выбрасывает из файла записи с LSN <= lsn (их покрыл снимок), не останавливая писателей
+     * надолго: уже записанная часть файла фильтруется без блокировки, под блокировкой
+     * дописывается только то, что успело прийти за это время. Новый файл подменяет старый через rename.
+     */
+    bool DropThrough(uint64_t lsn) {
+        uint64_t stableSize = 0;
+        {
+            std::unique_lock<std::mutex> lock(Mutex_);
+            if (!FlushLocked(lock)) return false;
+            stableSize = static_cast<uint64_t>(::lseek(Fd_, 0, SEEK_END));
+        }
+
+        TByteBuffer buffer;
+        if (!TBinaryReader::LoadFile(Path_.CStr(), &buffer) || buffer.Size() < stableSize) return false;
+        TBinaryWriter kept;
+        kept.WriteU32(FILE_MAGIC);
+        kept.WriteU32(FILE_VERSION);
+        TBinaryReader header(buffer.Data(), HEADER_SIZE);
+        header.ReadU32();
+        header.ReadU32();
+        uint64_t baseLsn = header.ReadU64();
+        kept.WriteU64(baseLsn > lsn ? baseLsn : lsn);
+        for (size_t offset = HEADER_SIZE; offset + RECORD_HEADER_SIZE <= stableSize; ) {
+            TBinaryReader reader(buffer.Data() + offset, RECORD_HEADER_SIZE);
+            uint64_t recordLsn = reader.ReadU64();
+            size_t size = reader.ReadU32() + RECORD_HEADER_SIZE;
+            if (recordLsn > lsn) {
+                for (size_t i = 0; i < size; ++i) {
+                    kept.WriteU8(buffer[offset + i]);
+                }
+            }
+            offset += size;
+        }
+
+        TString tmpPath = Path_;
+        tmpPath.Append(".tmp");
+        int fd = ::open(tmpPath.CStr(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) return false;
+        bool ok = WriteAll(fd, kept.GetBuffer().Data(), kept.Size());
+
+        std::unique_lock<std::mutex> lock(Mutex_);
+        ok = ok && FlushLocked(lock);
+        uint64_t tailSize = static_cast<uint64_t>(::lseek(Fd_, 0, SEEK_END)) - stableSize;
+        if (ok && tailSize > 0) {
+            TByteBuffer tail(static_cast<size_t>(tailSize));
+            int in = ::open(Path_.CStr(), O_RDONLY);
+            ok = in >= 0 && ::pread(in, tail.Data(), tail.Size(), static_cast<off_t>(stableSize)) == static_cast<ssize_t>(tail.Size());
+            if (in >= 0) ::close(in);
+            ok = ok && WriteAll(fd, tail.Data(), tail.Size());
+        }
+        ok = ok && ::fdatasync(fd) == 0 && std::rename(tmpPath.CStr(), Path_.CStr()) == 0;
+        if (!ok) {
+            ::close(fd);
+            std::remove(tmpPath.CStr());
+            return false;
+        }
+        ::close(Fd_);
+        Fd_ = fd;
+        return true;
+    }
+
+    void Close() {
+        StopSyncer();
+        if (Fd_ < 0) return;
+        CommitAll();
+        if (Options_.Sync != ESyncPolicy::None) {
+            ::fdatasync(Fd_);
+        }
+        ::close(Fd_);
+        Fd_ = -1;
+        Pending_.Clear();
+    }
+
+    uint64_t GetLastLsn() const {
+        std::lock_guard<std::mutex> lock(Mutex_);
+        return NextLsn_ - 1;
+    }
+
+    TStats GetStats() const {
+        std::lock_guard<std::mutex> lock(Mutex_);
+        return Stats_;
+    }
+
+    static uint32_t Checksum(uint64_t lsn, const unsigned char* data, size_t size) {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < 8; ++i) {
+            hash ^= static_cast<unsigned char>(lsn >> (i * 8));
+            hash *= 16777619u;
+        }
+        for (size_t i = 0; i < size; ++i) {
+            hash ^= data[i];
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+private:
+    bool WriteHeader(uint64_t baseLsn) {
+        TBinaryWriter header;
+        header.WriteU32(FILE_MAGIC);
+        header.WriteU32(FILE_VERSION);
+        header.WriteU64(baseLsn);
+        return WriteAll(header.GetBuffer().Data(), header.Size());
+    }
+
+    /**
+     * Дожидается текущего лидера и фиксирует очередь сам. Вызывается под Mutex_.
+     */
+    bool FlushLocked(std::unique_lock<std::mutex>& lock) {
+        while (Flushing_) {
+            Flushed_.wait(lock);
+        }
+        if (Failed_ || Fd_ < 0) return false;
+        if (!Pending_.Empty()) {
+            bool sync = Options_.Sync != ESyncPolicy::None;
+            if (!WriteAll(Fd_, Pending_.Data(), Pending_.Size()) || (sync && ::fdatasync(Fd_) != 0)) {
+                Failed_ = true;
+                return false;
+            }
+            Pending_.Clear();
+            DurableLsn_ = NextLsn_ - 1;
+            ++Stats_.Commits;
+            if (sync) {
+                ++Stats_.Syncs;
+                UnsyncedBytes_ = 0;
+                LastSync_ = std::chrono::steady_clock::now();
+            }
+        }
+        return true;
+    }
+
+    bool WriteAll(const unsigned char* data, size_t size) {
+        return WriteAll(Fd_, data, size);
+    }
+
+    static bool WriteAll(int fd, const unsigned char* data, size_t size) {
+        while (size > 0) {
+            ssize_t written = ::write(fd, data, size);
+            if (written < 0) return false;
+            data += written;
+            size -= static_cast<size_t>(written);
+        }
+        return true;
+    }
+
+    /**
+     * Фоновый сброс для Periodic: хвост, который никто не зафиксировал и не синхронизировал
+     * за SyncIntervalMs, пишется и сбрасывается на диск тем же путём лидера, что и в Commit.
+     */
+    void SyncLoop() {
+        const auto interval = std::chrono::milliseconds(Options_.SyncIntervalMs > 0 ? Options_.SyncIntervalMs : 1);
+        std::unique_lock<std::mutex> lock(Mutex_);
+        while (!Stopping_) {
+            SyncWake_.wait_for(lock, interval);
+            if (Stopping_ || Flushing_ || Failed_ || Fd_ < 0) continue;
+            if (Pending_.Empty() && UnsyncedBytes_ == 0) continue;
+            if (std::chrono::steady_clock::now() - LastSync_ < interval) continue;
+
+            Flushing_ = true;
+            TByteBuffer batch;
+            batch.Swap(Pending_);
+            uint64_t upto = NextLsn_ - 1;
+            lock.unlock();
+
+            bool ok = WriteAll(batch.Data(), batch.Size()) && ::fdatasync(Fd_) == 0;
+
+            lock.lock();
+            Flushing_ = false;
+            ++Stats_.Syncs;
+            UnsyncedBytes_ = 0;
+            LastSync_ = std::chrono::steady_clock::now();
+            if (ok) {
+                if (upto > DurableLsn_) DurableLsn_ = upto;
+            } else {
+                Failed_ = true;
+            }
+            Flushed_.notify_all();
+        }
+    }
+
+    void StopSyncer() {
+        if (!Syncer_.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(Mutex_);
+            Stopping_ = true;
+        }
+        SyncWake_.notify_all();
+        Syncer_.join();
+    }
+
+    bool ShouldSync(size_t batchBytes) {
+        UnsyncedBytes_ += batchBytes;
+        switch (Options_.Sync) {
+            case ESyncPolicy::None:
+                return false;
+            case ESyncPolicy::EveryCommit:
+                return true;
+            case ESyncPolicy::Periodic:
+                break;
+        }
+        auto elapsed = std::chrono::steady_clock::now() - LastSync_;
+        return UnsyncedBytes_ >= Options_.SyncIntervalBytes ||
+               elapsed >= std::chrono::milliseconds(Options_.SyncIntervalMs);
+    }
+
+    TOptions Options_;
+    TString Path_;
+    int Fd_ = -1;
+
+    mutable std::mutex Mutex_;
+    std::condition_variable Flushed_;
+    TByteBuffer Pending_;
+    uint64_t NextLsn_ = 1;
+    uint64_t DurableLsn_ = 0;
+    bool Flushing_ = false;
+    bool Failed_ = false;
+    bool Stopping_ = false;
+    std::condition_variable SyncWake_;
+    std::thread Syncer_;
+    size_t UnsyncedBytes_ = 0;
+    std::chrono::steady_clock::time_point LastSync_;
+    TStats Stats_;
+};
+
+} // namespace NIndex
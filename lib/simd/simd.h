@@ -0,0 +1,328 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define INFO_SEARCH_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace NSimd {
+
+/**
+ * Уровень векторных инструкций. Один бинарник собирается со всеми вариантами ядер
+ * (через __attribute__((target))), а нужный выбирается при первом обращении по CPUID.
+ */
+enum class ECpuLevel {
+    Scalar,
+    SSE2,
+    AVX2,
+    AVX512
+};
+
+/**
+ * Таблица ядер одного уровня. Все варианты дают результат, побитово совпадающий со скалярным.
+ *
+ * LowerAscii — перевод 'A'..'Z' в нижний регистр, остальные байты (в т.ч. UTF-8) не трогаются;
+ * dst может совпадать с src.
+ * IntersectU32 — пересечение двух строго возрастающих списков, out вмещает min(na, nb) элементов;
+ * возвращает длину результата.
+ * PopCount — число единичных бит в массиве слов.
+ */
+struct TKernels {
+    ECpuLevel Level;
+    void (*LowerAscii)(const char* src, char* dst, size_t n);
+    size_t (*IntersectU32)(const uint32_t* a, size_t na, const uint32_t* b, size_t nb, uint32_t* out);
+    size_t (*PopCount)(const uint64_t* words, size_t n);
+};
+
+namespace NScalar {
+
+inline void LowerAscii(const char* src, char* dst, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        char c = src[i];
+        dst[i] = (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+    }
+}
+
+inline size_t IntersectU32(const uint32_t* a, size_t na, const uint32_t* b, size_t nb, uint32_t* out) {
+    size_t i = 0, j = 0, k = 0;
+    while (i < na && j < nb) {
+        if (a[i] == b[j]) {
+            out[k++] = a[i];
+            ++i; ++j;
+        } else if (a[i] < b[j]) {
+            ++i;
+        } else {
+            ++j;
+        }
+    }
+    return k;
+}
+
+inline size_t PopCount(const uint64_t* words, size_t n) {
+    size_t count = 0;
+    for (size_t i = 0; i < n; ++i) {
+        count += static_cast<size_t>(__builtin_popcountll(words[i]));
+    }
+    return count;
+}
+
+} // namespace NScalar
+
+#ifdef INFO_SEARCH_SIMD_X86
+
+namespace NSse2 {
+
+__attribute__((target("sse2")))
+inline void LowerAscii(const char* src, char* dst, size_t n) {
+    const __m128i lo = _mm_set1_epi8('A' - 1);
+    const __m128i hi = _mm_set1_epi8('Z' + 1);
+    const __m128i delta = _mm_set1_epi8('a' - 'A');
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(c, lo), _mm_cmplt_epi8(c, hi));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_add_epi8(c, _mm_and_si128(upper, delta)));
+    }
+    NScalar::LowerAscii(src + i, dst + i, n - i);
+}
+
+/**
+ * Пересечение блоками: блок из W элементов a сравнивается с каждым из W элементов блока b
+ * (broadcast + cmpeq), совпавшие элементы a выписываются по маске. Затем сдвигается блок
+ * с меньшим последним элементом. Хвосты дорабатывает скалярное слияние.
+ */
+__attribute__((target("sse2")))
+inline size_t IntersectU32(const uint32_t* a, size_t na, const uint32_t* b, size_t nb, uint32_t* out) {
+    size_t i = 0, j = 0, k = 0;
+    while (i + 4 <= na && j + 4 <= nb) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i eq = _mm_cmpeq_epi32(va, _mm_set1_epi32(static_cast<int>(b[j])));
+        eq = _mm_or_si128(eq, _mm_cmpeq_epi32(va, _mm_set1_epi32(static_cast<int>(b[j + 1]))));
+        eq = _mm_or_si128(eq, _mm_cmpeq_epi32(va, _mm_set1_epi32(static_cast<int>(b[j + 2]))));
+        eq = _mm_or_si128(eq, _mm_cmpeq_epi32(va, _mm_set1_epi32(static_cast<int>(b[j + 3]))));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(eq)));
+        while (mask) {
+            out[k++] = a[i + static_cast<size_t>(__builtin_ctz(mask))];
+            mask &= mask - 1;
+        }
+        uint32_t lastA = a[i + 3];
+        uint32_t lastB = b[j + 3];
+        if (lastA <= lastB) i += 4;
+        if (lastB <= lastA) j += 4;
+    }
+    return k + NScalar::IntersectU32(a + i, na - i, b + j, nb - j, out + k);
+}
+
+/**
+ * Побайтовый SWAR-подсчёт бит в 128-битном регистре, суммы байтов — через psadbw.
+ */
+__attribute__((target("sse2")))
+inline size_t PopCount(const uint64_t* words, size_t n) {
+    const __m128i m1 = _mm_set1_epi8(0x55);
+    const __m128i m2 = _mm_set1_epi8(0x33);
+    const __m128i m4 = _mm_set1_epi8(0x0f);
+    __m128i total = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(words + i));
+        v = _mm_sub_epi8(v, _mm_and_si128(_mm_srli_epi64(v, 1), m1));
+        v = _mm_add_epi8(_mm_and_si128(v, m2), _mm_and_si128(_mm_srli_epi64(v, 2), m2));
+        v = _mm_and_si128(_mm_add_epi8(v, _mm_srli_epi64(v, 4)), m4);
+        total = _mm_add_epi64(total, _mm_sad_epu8(v, _mm_setzero_si128()));
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), total);
+    return static_cast<size_t>(lanes[0] + lanes[1]) + NScalar::PopCount(words + i, n - i);
+}
+
+} // namespace NSse2
+
+namespace NAvx2 {
+
+__attribute__((target("avx2")))
+inline void LowerAscii(const char* src, char* dst, size_t n) {
+    const __m256i lo = _mm256_set1_epi8('A' - 1);
+    const __m256i hi = _mm256_set1_epi8('Z' + 1);
+    const __m256i delta = _mm256_set1_epi8('a' - 'A');
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(c, lo), _mm256_cmpgt_epi8(hi, c));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_add_epi8(c, _mm256_and_si256(upper, delta)));
+    }
+    NSse2::LowerAscii(src + i, dst + i, n - i);
+}
+
+__attribute__((target("avx2")))
+inline size_t IntersectU32(const uint32_t* a, size_t na, const uint32_t* b, size_t nb, uint32_t* out) {
+    size_t i = 0, j = 0, k = 0;
+    while (i + 8 <= na && j + 8 <= nb) {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i eq = _mm256_setzero_si256();
+        for (size_t r = 0; r < 8; ++r) {
+            eq = _mm256_or_si256(eq, _mm256_cmpeq_epi32(va, _mm256_set1_epi32(static_cast<int>(b[j + r]))));
+        }
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(eq)));
+        while (mask) {
+            out[k++] = a[i + static_cast<size_t>(__builtin_ctz(mask))];
+            mask &= mask - 1;
+        }
+        uint32_t lastA = a[i + 7];
+        uint32_t lastB = b[j + 7];
+        if (lastA <= lastB) i += 8;
+        if (lastB <= lastA) j += 8;
+    }
+    return k + NScalar::IntersectU32(a + i, na - i, b + j, nb - j, out + k);
+}
+
+/**
+ * Подсчёт бит таблицей по полубайтам (vpshufb), суммы байтов — через vpsadbw.
+ */
+__attribute__((target("avx2")))
+inline size_t PopCount(const uint64_t* words, size_t n) {
+    const __m256i table = _mm256_setr_epi8(
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low = _mm256_set1_epi8(0x0f);
+    __m256i total = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + i));
+        __m256i counts = _mm256_add_epi8(
+            _mm256_shuffle_epi8(table, _mm256_and_si256(v, low)),
+            _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(v, 4), low)));
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(counts, _mm256_setzero_si256()));
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), total);
+    return static_cast<size_t>(lanes[0] + lanes[1] + lanes[2] + lanes[3]) + NSse2::PopCount(words + i, n - i);
+}
+
+} // namespace NAvx2
+
+namespace NAvx512 {
+
+__attribute__((target("avx512f,avx512bw")))
+inline void LowerAscii(const char* src, char* dst, size_t n) {
+    const __m512i lo = _mm512_set1_epi8('A');
+    const __m512i hi = _mm512_set1_epi8('Z');
+    const __m512i delta = _mm512_set1_epi8('a' - 'A');
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        __m512i c = _mm512_loadu_si512(src + i);
+        __mmask64 upper = _mm512_cmpge_epi8_mask(c, lo) & _mm512_cmple_epi8_mask(c, hi);
+        _mm512_storeu_si512(dst + i, _mm512_mask_add_epi8(c, upper, c, delta));
+    }
+    NAvx2::LowerAscii(src + i, dst + i, n - i);
+}
+
+__attribute__((target("avx512f")))
+inline size_t IntersectU32(const uint32_t* a, size_t na, const uint32_t* b, size_t nb, uint32_t* out) {
+    size_t i = 0, j = 0, k = 0;
+    while (i + 16 <= na && j + 16 <= nb) {
+        __m512i va = _mm512_loadu_si512(a + i);
+        __mmask16 eq = 0;
+        for (size_t r = 0; r < 16; ++r) {
+            eq = static_cast<__mmask16>(eq | _mm512_cmpeq_epi32_mask(va, _mm512_set1_epi32(static_cast<int>(b[j + r]))));
+        }
+        unsigned mask = static_cast<unsigned>(eq);
+        while (mask) {
+            out[k++] = a[i + static_cast<size_t>(__builtin_ctz(mask))];
+            mask &= mask - 1;
+        }
+        uint32_t lastA = a[i + 15];
+        uint32_t lastB = b[j + 15];
+        if (lastA <= lastB) i += 16;
+        if (lastB <= lastA) j += 16;
+    }
+    return k + NScalar::IntersectU32(a + i, na - i, b + j, nb - j, out + k);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+inline size_t PopCount(const uint64_t* words, size_t n) {
+    const __m512i table = _mm512_broadcast_i32x4(_mm_setr_epi8(
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4));
+    const __m512i low = _mm512_set1_epi8(0x0f);
+    __m512i total = _mm512_setzero_si512();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m512i v = _mm512_loadu_si512(words + i);
+        __m512i counts = _mm512_add_epi8(
+            _mm512_shuffle_epi8(table, _mm512_and_si512(v, low)),
+            _mm512_shuffle_epi8(table, _mm512_and_si512(_mm512_srli_epi16(v, 4), low)));
+        total = _mm512_add_epi64(total, _mm512_sad_epu8(counts, _mm512_setzero_si512()));
+    }
+    return static_cast<size_t>(_mm512_reduce_add_epi64(total)) + NAvx2::PopCount(words + i, n - i);
+}
+
+} // namespace NAvx512
+
+#endif // INFO_SEARCH_SIMD_X86
+
+/**
+ * Умеет ли текущий процессор (и ОС, сохраняющая регистры) исполнять ядра уровня level.
+ */
+inline bool IsSupported(ECpuLevel level) {
+#ifdef INFO_SEARCH_SIMD_X86
+    __builtin_cpu_init();
+    switch (level) {
+        case ECpuLevel::Scalar: return true;
+        case ECpuLevel::SSE2: return __builtin_cpu_supports("sse2");
+        case ECpuLevel::AVX2: return __builtin_cpu_supports("avx2");
+        case ECpuLevel::AVX512: return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+    }
+    return false;
+#else
+    return level == ECpuLevel::Scalar;
+#endif
+}
+
+inline ECpuLevel DetectCpuLevel() {
+    if (IsSupported(ECpuLevel::AVX512)) return ECpuLevel::AVX512;
+    if (IsSupported(ECpuLevel::AVX2)) return ECpuLevel::AVX2;
+    if (IsSupported(ECpuLevel::SSE2)) return ECpuLevel::SSE2;
+    return ECpuLevel::Scalar;
+}
+
+/**
+ * Таблица ядер заданного уровня без проверки процессора (для тестов и бенчмарков;
+ * вызывать их можно только если IsSupported(level)).
+ */
+inline TKernels KernelsFor(ECpuLevel level) {
+    switch (level) {
+#ifdef INFO_SEARCH_SIMD_X86
+        case ECpuLevel::AVX512:
+            return TKernels{level, &NAvx512::LowerAscii, &NAvx512::IntersectU32, &NAvx512::PopCount};
+        case ECpuLevel::AVX2:
+            return TKernels{level, &NAvx2::LowerAscii, &NAvx2::IntersectU32, &NAvx2::PopCount};
+        case ECpuLevel::SSE2:
+            return TKernels{level, &NSse2::LowerAscii, &NSse2::IntersectU32, &NSse2::PopCount};
+#endif
+        default:
+            return TKernels{ECpuLevel::Scalar, &NScalar::LowerAscii, &NScalar::IntersectU32, &NScalar::PopCount};
+    }
+}
+
+/**
+ * Ядра для текущего процессора. Определение уровня выполняется один раз (потокобезопасная
+ * инициализация статической переменной), дальше — косвенный вызов через указатель.
+ */
+inline const TKernels& Kernels() {
+    static const TKernels kernels = KernelsFor(DetectCpuLevel());
+    return kernels;
+}
+
+inline const char* LevelName(ECpuLevel level) {
+    switch (level) {
+        case ECpuLevel::Scalar: return "scalar";
+        case ECpuLevel::SSE2: return "sse2";
+        case ECpuLevel::AVX2: return "avx2";
+        case ECpuLevel::AVX512: return "avx512";
+    }
+    return "unknown";
+}
+
+} // namespace NSimd
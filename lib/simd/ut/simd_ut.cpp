@@ -0,0 +1,103 @@
+#include <lib/simd/simd.h>
+#include <lib/collections/vector/vector.h>
+
+#include <gtest/gtest.h>
+
+using namespace NSimd;
+using NCollections::TVector;
+
+namespace {
+
+const ECpuLevel ALL_LEVELS[] = {ECpuLevel::Scalar, ECpuLevel::SSE2, ECpuLevel::AVX2, ECpuLevel::AVX512};
+
+uint64_t NextRandom(uint64_t& state) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+TVector<uint32_t> RandomSortedList(uint64_t& state, size_t size, uint32_t universe) {
+    TVector<uint32_t> list;
+    uint32_t value = 0;
+    for (size_t i = 0; i < size; ++i) {
+        value += 1 + static_cast<uint32_t>(NextRandom(state) % (universe / (size + 1) + 1));
+        list.PushBack(value);
+    }
+    return list;
+}
+
+} // namespace
+
+TEST(NSimd, ActiveKernelsMatchDetectedLevel) {
+    EXPECT_EQ(Kernels().Level, DetectCpuLevel());
+    EXPECT_TRUE(IsSupported(ECpuLevel::Scalar));
+    EXPECT_TRUE(IsSupported(Kernels().Level));
+}
+
+TEST(NSimd, LowerAsciiMatchesScalar) {
+    TKernels reference = KernelsFor(ECpuLevel::Scalar);
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+    for (ECpuLevel level : ALL_LEVELS) {
+        if (!IsSupported(level)) continue;
+        TKernels kernels = KernelsFor(level);
+        for (size_t n = 0; n < 300; n += 7) {
+            TVector<char> src(n);
+            for (size_t i = 0; i < n; ++i) {
+                src[i] = static_cast<char>(NextRandom(state));
+            }
+            TVector<char> expected(n, 0), actual(n, 0);
+            reference.LowerAscii(src.Data(), expected.Data(), n);
+            kernels.LowerAscii(src.Data(), actual.Data(), n);
+            for (size_t i = 0; i < n; ++i) {
+                ASSERT_EQ(actual[i], expected[i]) << LevelName(level) << " n=" << n << " i=" << i;
+            }
+            kernels.LowerAscii(src.Data(), src.Data(), n);
+            for (size_t i = 0; i < n; ++i) {
+                ASSERT_EQ(src[i], expected[i]) << LevelName(level) << " in place";
+            }
+        }
+    }
+}
+
+TEST(NSimd, IntersectMatchesScalar) {
+    TKernels reference = KernelsFor(ECpuLevel::Scalar);
+    uint64_t state = 0x2545f4914f6cdd1dULL;
+    const size_t sizes[] = {0, 1, 3, 8, 15, 16, 17, 100, 1000};
+    for (ECpuLevel level : ALL_LEVELS) {
+        if (!IsSupported(level)) continue;
+        TKernels kernels = KernelsFor(level);
+        for (size_t na : sizes) {
+            for (size_t nb : sizes) {
+                TVector<uint32_t> a = RandomSortedList(state, na, 4000);
+                TVector<uint32_t> b = RandomSortedList(state, nb, 4000);
+                size_t capacity = (na < nb ? na : nb) + 1;
+                TVector<uint32_t> expected(capacity, 0), actual(capacity, 0);
+                size_t expectedSize = reference.IntersectU32(a.Data(), na, b.Data(), nb, expected.Data());
+                size_t actualSize = kernels.IntersectU32(a.Data(), na, b.Data(), nb, actual.Data());
+                ASSERT_EQ(actualSize, expectedSize) << LevelName(level) << " " << na << "x" << nb;
+                for (size_t i = 0; i < expectedSize; ++i) {
+                    ASSERT_EQ(actual[i], expected[i]) << LevelName(level);
+                }
+            }
+        }
+    }
+}
+
+TEST(NSimd, PopCountMatchesScalar) {
+    TKernels reference = KernelsFor(ECpuLevel::Scalar);
+    uint64_t state = 0x853c49e6748fea9bULL;
+    for (ECpuLevel level : ALL_LEVELS) {
+        if (!IsSupported(level)) continue;
+        TKernels kernels = KernelsFor(level);
+        for (size_t n = 0; n < 70; ++n) {
+            TVector<uint64_t> words(n);
+            for (size_t i = 0; i < n; ++i) {
+                words[i] = NextRandom(state) & NextRandom(state);
+            }
+            if (n > 0) words[0] = ~uint64_t(0);
+            EXPECT_EQ(kernels.PopCount(words.Data(), n), reference.PopCount(words.Data(), n))
+                << LevelName(level) << " n=" << n;
+        }
+    }
+}
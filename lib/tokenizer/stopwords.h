@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <lib/types/string/string.h>
+
+namespace NTokenizer {
+
+using NTypes::TString;
+
+namespace NStopwordsImpl {
+
+    static constexpr const char* WORDS[] = {
+        "a", "about", "above", "after", "again", "against", "all", "am", "an", "and",
+        "any", "are", "as", "at", "be", "because", "been", "before", "being", "below",
+        "between", "both", "but", "by", "can", "could", "did", "do", "does", "doing",
+        "down", "during", "each", "few", "for", "from", "further", "had", "has", "have",
+        "having", "he", "her", "here", "hers", "herself", "him", "himself", "his", "how",
+        "i", "if", "in", "into", "is", "it", "its", "itself", "me", "more",
+        "most", "my", "myself", "no", "nor", "not", "now", "of", "off", "on",
+        "once", "only", "or", "other", "our", "ours", "ourselves", "out", "over", "own",
+        "same", "she", "should", "so", "some", "such", "than", "that", "the", "their",
+        "theirs", "them", "themselves", "then", "there", "these", "they", "this", "those", "through",
+        "to", "too", "under", "until", "up", "very", "was", "we", "were", "what",
+        "when", "where", "which", "while", "who", "whom", "why", "will", "with", "would",
+        "you", "your", "yours", "yourself", "yourselves", "thee", "thou", "thy", "thine", "ye"
+    };
+
+    static constexpr size_t WORD_COUNT = sizeof(WORDS) / sizeof(WORDS[0]);
+    static constexpr size_t TABLE_SIZE = 2048;
+    static constexpr size_t MAX_WORD_LENGTH = 16;
+
+    static_assert(WORD_COUNT < 256, "slot index must fit into unsigned char");
+
+    struct TTable {
+        unsigned char Slots[TABLE_SIZE] = {};
+        uint64_t Seed = 0;
+    };
+
+    constexpr size_t Length(const char* s) {
+        size_t n = 0;
+        while (s[n]) ++n;
+        return n;
+    }
+
+    constexpr uint64_t Hash(const char* s, size_t len, uint64_t seed) {
+        uint64_t h = 14695981039346656037ULL ^ seed;
+        for (size_t i = 0; i < len; ++i) {
+            h ^= static_cast<unsigned char>(s[i]);
+            h *= 1099511628211ULL;
+        }
+        h ^= h >> 29;
+        h *= 0xbf58476d1ce4e5b9ULL;
+        h ^= h >> 32;
+        return h;
+    }
+
+    constexpr bool Equal(const char* stored, const char* word, size_t len) {
+        for (size_t i = 0; i < len; ++i) {
+            if (stored[i] != word[i]) return false;
+        }
+        return stored[len] == '\0';
+    }
+
+    constexpr TTable BuildTable() {
+        for (uint64_t seed = 1;; ++seed) {
+            TTable table;
+            table.Seed = seed;
+            bool ok = true;
+            for (size_t i = 0; i < WORD_COUNT && ok; ++i) {
+                size_t slot = Hash(WORDS[i], Length(WORDS[i]), seed) & (TABLE_SIZE - 1);
+                if (table.Slots[slot] != 0) {
+                    ok = false;
+                } else {
+                    table.Slots[slot] = static_cast<unsigned char>(i + 1);
+                }
+            }
+            if (ok) return table;
+        }
+    }
+
+    static constexpr TTable TABLE = BuildTable();
+
+} // namespace NStopwordsImpl
+
+/**
+ * Множество английских стоп-слов на совершенной хеш-функции
+ *
+ * Таблица и seed подбираются при компиляции (constexpr): каждое слово попадает
+ * в свой слот без коллизий, поэтому проверка — один хеш и одно сравнение строк.
+ */
+class TStopwords {
+public:
+    static bool Contains(const TString& word) {
+        return Contains(word.Data(), word.Size());
+    }
+
+    static constexpr bool Contains(const char* word, size_t len) {
+        using namespace NStopwordsImpl;
+        if (len == 0 || len > MAX_WORD_LENGTH) return false;
+        unsigned char slot = TABLE.Slots[Hash(word, len, TABLE.Seed) & (TABLE_SIZE - 1)];
+        if (slot == 0) return false;
+        return Equal(WORDS[slot - 1], word, len);
+    }
+
+    static constexpr size_t Count() { return NStopwordsImpl::WORD_COUNT; }
+    static constexpr const char* Word(size_t i) { return NStopwordsImpl::WORDS[i]; }
+};
+
+static_assert(TStopwords::Contains("the", 3), "perfect hash must resolve stopwords");
+static_assert(!TStopwords::Contains("sea", 3), "perfect hash must reject other words");
+
+} // namespace NTokenizer
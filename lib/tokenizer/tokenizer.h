@@ -2,6 +2,7 @@
 
 #include <lib/types/string/string.h>
 #include <lib/collections/vector/vector.h>
+#include <lib/simd/simd.h>
 
 namespace NTokenizer {
 
@@ -80,7 +81,7 @@ public:
                 }
                 TString tokenText = text.SubStr(start, pos - start);
                 if (Options_.LowerCase) {
-                    tokenText = ToLower(tokenText);
+                    NSimd::Kernels().LowerAscii(tokenText.Data(), tokenText.Data(), tokenText.Size());
                 }
                 if (tokenText.Size() >= Options_.MinTokenLength && tokenText.Size() <= Options_.MaxTokenLength) {
                     tokens.PushBack(TToken(std::move(tokenText), start, pos - start));
@@ -121,11 +122,8 @@ public:
     const TOptions& GetOptions() const { return Options_; }
 
     static TString ToLower(const TString& str) {
-        TString result;
-        result.Reserve(str.Size());
-        for (size_t i = 0; i < str.Size(); ++i) {
-            result.PushBack(ToLowerChar(str[i]));
-        }
+        TString result(str.Size(), '\0');
+        NSimd::Kernels().LowerAscii(str.Data(), result.Data(), str.Size());
         return result;
     }
 
@@ -1,4 +1,5 @@
 #include <lib/tokenizer/tokenizer.h>
+#include <lib/tokenizer/stopwords.h>
 #include <gtest/gtest.h>
 
 using namespace NTokenizer;
@@ -183,3 +184,13 @@ TEST(TTokenizer, HyphenatedWords) {
     EXPECT_EQ(tokens[0].Text, TString("self-driving"));
     EXPECT_EQ(tokens[1].Text, TString("car"));
 }
+
+TEST(TStopwords, PerfectHashLookup) {
+    for (size_t i = 0; i < TStopwords::Count(); ++i) {
+        EXPECT_TRUE(TStopwords::Contains(TString(TStopwords::Word(i)))) << TStopwords::Word(i);
+    }
+    EXPECT_FALSE(TStopwords::Contains(TString("sea")));
+    EXPECT_FALSE(TStopwords::Contains(TString("th")));
+    EXPECT_FALSE(TStopwords::Contains(TString("thee_")));
+    EXPECT_FALSE(TStopwords::Contains(TString("")));
+}
@@ -19,6 +19,50 @@ struct SearchDBWrapper {
         opts.CompressDocuments = useCompression;
         db = std::make_unique<TSearchDatabase>(opts);
     }
+
+    explicit SearchDBWrapper(const SearchDBOptions& options) {
+        TSearchDatabase::TOptions opts;
+        opts.Pipeline.UseStemming = options.use_stemming != 0;
+        opts.CompressDocuments = options.use_compression != 0;
+        if (options.duplicate_policy == 1) {
+            opts.Duplicates = TSearchDatabase::EDuplicatePolicy::Flag;
+        } else if (options.duplicate_policy == 2) {
+            opts.Duplicates = TSearchDatabase::EDuplicatePolicy::Skip;
+        }
+        opts.CollapseDuplicates = options.collapse_duplicates != 0;
+        if (options.stopword_mode == 1) {
+            opts.Pipeline.Stopwords = NIndex::TTextPipeline::EStopwordMode::Remove;
+        } else if (options.stopword_mode == 2) {
+            opts.Pipeline.Stopwords = NIndex::TTextPipeline::EStopwordMode::CommonGrams;
+        }
+        opts.PhraseBigrams = options.phrase_bigrams != 0;
+        if (options.scorer == 1) {
+            opts.Scorer = NIndex::EScorer::Bm25;
+        } else if (options.scorer == 2) {
+            opts.Scorer = NIndex::EScorer::Impact;
+        }
+        opts.IncrementalSnapshots = options.incremental_snapshots != 0;
+        for (size_t i = 0; options.stored_fields && i < options.stored_field_count; ++i) {
+            opts.StoredFields.PushBack(TString(options.stored_fields[i] ? options.stored_fields[i] : ""));
+        }
+        if (options.passage_unit == 1) {
+            opts.Passages = NIndex::TPassageIndex::EUnit::Line;
+        } else if (options.passage_unit == 2) {
+            opts.Passages = NIndex::TPassageIndex::EUnit::Stanza;
+        }
+        opts.RhymeIndex = options.rhyme_index != 0;
+        opts.PhoneticIndex = options.phonetic_index != 0;
+        if (options.disk_index_path) {
+            opts.DiskIndexPath = TString(options.disk_index_path);
+        }
+        if (options.disk_build_bytes > 0) {
+            opts.DiskBuildMemoryBytes = options.disk_build_bytes;
+        }
+        if (options.disk_cache_bytes > 0) {
+            opts.DiskCache.CapacityBytes = options.disk_cache_bytes;
+        }
+        db = std::make_unique<TSearchDatabase>(opts);
+    }
 };
 
 static char* allocate_cstring(const TString& str) {
@@ -32,58 +76,336 @@ static char* allocate_cstring(const TString& str) {
     return result;
 }
 
+static TVector<TString> to_fields(const char* const* fields, size_t count) {
+    TVector<TString> values;
+    for (size_t i = 0; fields && i < count; ++i) {
+        values.PushBack(TString(fields[i] ? fields[i] : ""));
+    }
+    return values;
+}
+
+static FetchedResultList* to_fetched_list(const TSearchDatabase& db, const TVector<TSearchDatabase::TFetchedResult>& results) {
+    FetchedResultList* list = static_cast<FetchedResultList*>(malloc(sizeof(FetchedResultList)));
+    list->count = results.Size();
+    list->results = static_cast<FetchedResult*>(malloc(sizeof(FetchedResult) * (results.Size() > 0 ? results.Size() : 1)));
+    for (size_t i = 0; i < results.Size(); ++i) {
+        FetchedResult& out = list->results[i];
+        out.doc_id = db.ToExternalId(results[i].DocId);
+        out.score = results[i].Score;
+        out.document = allocate_cstring(results[i].Document);
+        out.title = allocate_cstring(results[i].Title);
+        out.field_count = results[i].Fields.Size();
+        out.fields = static_cast<char**>(malloc(sizeof(char*) * (out.field_count > 0 ? out.field_count : 1)));
+        for (size_t f = 0; f < out.field_count; ++f) {
+            out.fields[f] = allocate_cstring(results[i].Fields[f]);
+        }
+    }
+    return list;
+}
+
+static PassageResultList* to_passage_list(const TSearchDatabase& db, const TVector<TSearchDatabase::TPassageResult>& results) {
+    PassageResultList* list = static_cast<PassageResultList*>(malloc(sizeof(PassageResultList)));
+    list->count = results.Size();
+    list->results = static_cast<PassageResult*>(malloc(sizeof(PassageResult) * (results.Size() > 0 ? results.Size() : 1)));
+    for (size_t i = 0; i < results.Size(); ++i) {
+        PassageResult& out = list->results[i];
+        out.doc_id = db.ToExternalId(results[i].DocId);
+        out.passage_id = results[i].PassageId;
+        out.score = results[i].Score;
+        out.first_line = results[i].Span.FirstLine;
+        out.line_count = results[i].Span.LineCount;
+        out.snippet = allocate_cstring(results[i].Text);
+    }
+    return list;
+}
+
+static bool to_doc_id(const TSearchDatabase& db, size_t docId, TDocId* out) {
+    if (docId > static_cast<size_t>(static_cast<TDocId>(-1))) {
+        return false;
+    }
+    return db.ToInternalId(docId, out);
+}
+
 extern "C" {
 
 SearchDBHandle search_db_create(int use_stemming, int use_compression) {
     return new SearchDBWrapper(use_stemming != 0, use_compression != 0);
 }
 
+SearchDBHandle search_db_create_with_options(const SearchDBOptions* options) {
+    if (!options) return nullptr;
+    return new SearchDBWrapper(*options);
+}
+
 void search_db_destroy(SearchDBHandle handle) {
     delete static_cast<SearchDBWrapper*>(handle);
 }
 
 size_t search_db_add_document(SearchDBHandle handle, const char* content, const char* title) {
+    return search_db_add_document_with_key(handle, content, title, nullptr);
+}
+
+size_t search_db_add_document_with_key(SearchDBHandle handle, const char* content, const char* title, const char* key) {
+    return search_db_add_document_with_fields(handle, content, title, key, nullptr, 0);
+}
+
+size_t search_db_add_document_with_fields(SearchDBHandle handle, const char* content, const char* title,
+                                          const char* key, const char* const* fields, size_t field_count) {
     auto* wrapper = static_cast<SearchDBWrapper*>(handle);
     TString contentStr(content ? content : "");
     TString titleStr(title ? title : "");
-    return wrapper->db->AddDocument(contentStr, titleStr);
+    TString keyStr(key ? key : "");
+    TDocId docId = wrapper->db->AddDocument(contentStr, titleStr, keyStr, to_fields(fields, field_count));
+    if (docId == TSearchDatabase::INVALID_DOC_ID) return SEARCH_DB_INVALID_ID;
+    return wrapper->db->ToExternalId(docId);
 }
 
 const char* search_db_get_document(SearchDBHandle handle, size_t doc_id) {
     auto* wrapper = static_cast<SearchDBWrapper*>(handle);
-    TString doc = wrapper->db->GetDocument(doc_id);
+    TDocId id;
+    if (!to_doc_id(*wrapper->db, doc_id, &id)) return allocate_cstring(TString());
+    TString doc = wrapper->db->GetDocument(id);
     return allocate_cstring(doc);
 }
 
 const char* search_db_get_title(SearchDBHandle handle, size_t doc_id) {
     auto* wrapper = static_cast<SearchDBWrapper*>(handle);
-    TString title = wrapper->db->GetTitle(doc_id);
+    TDocId id;
+    if (!to_doc_id(*wrapper->db, doc_id, &id)) return allocate_cstring(TString());
+    TString title = wrapper->db->GetTitle(id);
     return allocate_cstring(title);
 }
 
+const char* search_db_get_external_key(SearchDBHandle handle, size_t doc_id) {
+    auto* wrapper = static_cast<SearchDBWrapper*>(handle);
+    TDocId id;
+    if (!to_doc_id(*wrapper->db, doc_id, &id)) return allocate_cstring(TString());
+    return allocate_cstring(wrapper->db->GetExternalKey(id));
+}
+
+size_t search_db_get_field_count(SearchDBHandle handle) {
+    auto* wrapper = static_cast<SearchDBWrapper*>(handle);
+    return wrapper->db->GetFieldNames().Size();
+}
+
+const char* search_db_get_field_name(SearchDBHandle handle, size_t index) {
+    auto* wrapper = static_cast<SearchDBWrapper*>(handle);
+    const TVector<TString>& names = wrapper->db->GetFieldNames();
+    return allocate_cstring(index < names.Size() ? names[index] : TString());
+}
+
+int search_db_find_by_key(SearchDBHandle handle, const char* key, size_t* doc_id) {
+    auto* wrapper = static_cast<SearchDBWrapper*>(handle);
+    TDocId id;
+    if (!key || !wrapper->db->FindByExternalKey(TString(key), &id)) return 0;
+    if (doc_id) *doc_id = wrapper->db->ToExternalId(id);
+    return 1;
+}
+
 size_t search_db_get_document_count(SearchDBHandle handle) {
     auto* wrapper = static_cast<SearchDBWrapper*>(handle);
     return wrapper->db->GetDocumentCount();
 }
 
+int search_db_seal(SearchDBHandle handle) {
+    auto* wrapper = static_cast<SearchDBWrapper*>(handle);
+    return wrapper->db->Seal() ? 1 : 0;
+}
+
+size_t search_db_get_duplicate_group(SearchDBHandle handle, size_t doc_id) {
+    auto* wrapper = static_cast<SearchDBWrapper*>(handle);
+    TDocId id;
+    if (!to_doc_id(*wrapper->db, doc_id, &id)) return doc_id;
+    return wrapper->db->GetDuplicateGroup(id);
+}
+
+int search_db_prune(SearchDBHandle handle, const SearchDBPruneOptions* options, SearchDBPruneReport* report) {
+    if (!options) return 0;
+    auto* wrapper = static_cast<SearchDBWrapper*>(handle);
+    TStaticPruner::TOptions opts;
+    opts.Mode = options->mode == 1 ? TStaticPruner::EMode::DocumentCentric : TStaticPruner::EMode::TermCentric;
+    opts.TopK = options->top_k;
+    opts.Epsilon = options->epsilon;
+    opts.DocumentFraction = options->doc_fraction;
+    TStaticPruner::TReport result = wrapper->db->Prune(opts);
+    if (report) {
+        report->postings_before = result.PostingsBefore;
+        report->postings_after = result.PostingsAfter;
+        report->terms_before = result.TermsBefore;
+        report->terms_after = result.TermsAfter;
+        report->bytes_before = result.BytesBefore;
+        report->bytes_after = result.BytesAfter;
+    }
+    return 1;
+}
+
+int search_db_save(SearchDBHandle handle, const char* path) {
+    if (!path) return 0;
+    auto* wrapper = static_cast<SearchDBWrapper*>(handle);
+    return wrapper->db->SaveToFile(path) ? 1 : 0;
+}
+
+int search_db_load(SearchDBHandle handle, const char* path) {
+    if (!path) return 0;
+    auto* wrapper = static_cast<SearchDBWrapper*>(handle);
+    return wrapper->db->LoadFromFile(path) ? 1 : 0;
+}
+
+int search_db_save_incremental(SearchDBHandle handle, const char* dir) {
+    if (!dir) return 0;
+    auto* wrapper = static_cast<SearchDBWrapper*>(handle);
+    return wrapper->db->SaveIncremental(dir) ? 1 : 0;
+}
+
+int search_db_load_incremental(SearchDBHandle handle, const char* dir) {
+    if (!dir) return 0;
+    auto* wrapper = static_cast<SearchDBWrapper*>(handle);
+    return wrapper->db->LoadIncremental(dir) ? 1 : 0;
+}
+
+int search_db_save_doc_store(SearchDBHandle handle, const char* path) {
+    auto* wrapper = static_cast<SearchDBWrapper*>(handle);
+    if (!path) return 0;
+    return wrapper->db->SaveDocStore(path) ? 1 : 0;
+}
+
+int search_db_open_doc_store(SearchDBHandle handle, const char* path, int backend) {
+    auto* wrapper = static_cast<SearchDBWrapper*>(handle);
+    if (!path) return 0;
+    NIndex::TAsyncReader::TOptions options;
+    if (backend == 1) {
+        options.Backend = NIndex::TAsyncReader::EBackend::IoUring;
+    } else if (backend == 2) {
+        options.Backend = NIndex::TAsyncReader::EBackend::ThreadPool;
+    }
+    return wrapper->db->OpenDocStore(path, options) ? 1 : 0;
+}
+
+size_t search_db_warmup(SearchDBHandle handle, size_t threads) {
+    auto* wrapper = static_cast<SearchDBWrapper*>(handle);
+    return wrapper->db->Warmup(threads);
+}
+
+size_t search_db_add_documents(SearchDBHandle handle, const char* const* contents, const char* const* titles,
+                               size_t count, size_t threads, size_t* out_ids) {
+    return search_db_add_documents_with_keys(handle, contents, titles, nullptr, count, threads, out_ids);
+}
+
+size_t search_db_add_documents_with_keys(SearchDBHandle handle, const char* const* contents, const char* const* titles,
+                                         const char* const* keys, size_t count, size_t threads, size_t* out_ids) {
+    return search_db_add_documents_with_fields(handle, contents, titles, keys, nullptr, 0, count, threads, out_ids);
+}
+
+size_t search_db_add_documents_with_fields(SearchDBHandle handle, const char* const* contents, const char* const* titles,
+                                           const char* const* keys, const char* const* fields, size_t field_count,
+                                           size_t count, size_t threads, size_t* out_ids) {
+    if (!contents) return 0;
+    auto* wrapper = static_cast<SearchDBWrapper*>(handle);
+    TVector<TString> contentStrs;
+    TVector<TString> titleStrs;
+    TVector<TString> keyStrs;
+    TVector<TVector<TString>> fieldRows;
+    contentStrs.Reserve(count);
+    titleStrs.Reserve(titles ? count : 0);
+    keyStrs.Reserve(keys ? count : 0);
+    for (size_t i = 0; i < count; ++i) {
+        contentStrs.PushBack(TString(contents[i] ? contents[i] : ""));
+        if (titles) {
+            titleStrs.PushBack(TString(titles[i] ? titles[i] : ""));
+        }
+        if (keys) {
+            keyStrs.PushBack(TString(keys[i] ? keys[i] : ""));
+        }
+        if (fields) {
+            fieldRows.PushBack(to_fields(fields + i * field_count, field_count));
+        }
+    }
+    TVector<TDocId> docIds = wrapper->db->AddDocuments(contentStrs, titleStrs, keyStrs, fieldRows, threads);
+    if (out_ids) {
+        for (size_t i = 0; i < docIds.Size(); ++i) {
+            out_ids[i] = wrapper->db->ToExternalId(docIds[i]);
+        }
+    }
+    return docIds.Size();
+}
+
+int search_db_delete_document(SearchDBHandle handle, size_t doc_id) {
+    auto* wrapper = static_cast<SearchDBWrapper*>(handle);
+    TDocId id;
+    if (!to_doc_id(*wrapper->db, doc_id, &id)) return 0;
+    return wrapper->db->DeleteDocument(id) ? 1 : 0;
+}
+
+int search_db_open_durable(SearchDBHandle handle, const char* snapshot_path, const char* wal_path, int sync_policy) {
+    if (!snapshot_path || !wal_path) return 0;
+    auto* wrapper = static_cast<SearchDBWrapper*>(handle);
+    NIndex::TWriteAheadLog::TOptions wal;
+    if (sync_policy == 1) {
+        wal.Sync = NIndex::TWriteAheadLog::ESyncPolicy::Periodic;
+    } else if (sync_policy == 2) {
+        wal.Sync = NIndex::TWriteAheadLog::ESyncPolicy::None;
+    }
+    wrapper->db->SetLogOptions(wal);
+    return wrapper->db->OpenDurable(snapshot_path, wal_path) ? 1 : 0;
+}
+
+int search_db_checkpoint(SearchDBHandle handle) {
+    auto* wrapper = static_cast<SearchDBWrapper*>(handle);
+    return wrapper->db->Checkpoint() ? 1 : 0;
+}
+
+int search_db_checkpoint_async(SearchDBHandle handle, size_t bytes_per_second) {
+    auto* wrapper = static_cast<SearchDBWrapper*>(handle);
+    return wrapper->db->StartCheckpoint(bytes_per_second) ? 1 : 0;
+}
+
+int search_db_snapshot_async(SearchDBHandle handle, const char* path, size_t bytes_per_second) {
+    if (!path) return 0;
+    auto* wrapper = static_cast<SearchDBWrapper*>(handle);
+    return wrapper->db->StartSnapshot(path, bytes_per_second) ? 1 : 0;
+}
+
+void search_db_snapshot_progress(SearchDBHandle handle, SearchDBSnapshotProgress* progress) {
+    if (!progress) return;
+    auto* wrapper = static_cast<SearchDBWrapper*>(handle);
+    NIndex::TSnapshotWriter::TProgress current = wrapper->db->GetSnapshotProgress();
+    progress->state = static_cast<int>(current.State);
+    progress->bytes_written = current.BytesWritten;
+    progress->total_bytes = current.TotalBytes;
+}
+
+int search_db_snapshot_wait(SearchDBHandle handle) {
+    auto* wrapper = static_cast<SearchDBWrapper*>(handle);
+    return wrapper->db->WaitSnapshot() ? 1 : 0;
+}
+
 SearchResultList* search_db_search_tfidf(SearchDBHandle handle, const char* query, size_t top_k) {
     auto* wrapper = static_cast<SearchDBWrapper*>(handle);
     TString queryStr(query ? query : "");
     
-    auto results = wrapper->db->Search(queryStr, top_k);
+    bool ok = true;
+    auto results = wrapper->db->Search(queryStr, top_k, &ok);
+    if (!ok) return nullptr;
     
     SearchResultList* list = static_cast<SearchResultList*>(malloc(sizeof(SearchResultList)));
     list->count = results.Size();
     list->results = static_cast<SearchResult*>(malloc(sizeof(SearchResult) * (results.Size() > 0 ? results.Size() : 1)));
     
     for (size_t i = 0; i < results.Size(); ++i) {
-        list->results[i].doc_id = results[i].DocId;
+        list->results[i].doc_id = wrapper->db->ToExternalId(results[i].DocId);
         list->results[i].score = results[i].Score;
     }
     
     return list;
 }
 
+size_t search_db_count_matches(SearchDBHandle handle, const char* query) {
+    auto* wrapper = static_cast<SearchDBWrapper*>(handle);
+    bool ok = true;
+    size_t count = wrapper->db->CountMatches(TString(query ? query : ""), &ok);
+    return ok ? count : SEARCH_DB_READ_ERROR;
+}
+
 void search_result_list_free(SearchResultList* list) {
     if (list) {
         free(list->results);
@@ -95,14 +417,16 @@ DocIdList* search_db_boolean_query(SearchDBHandle handle, const char* query) {
     auto* wrapper = static_cast<SearchDBWrapper*>(handle);
     TString queryStr(query ? query : "");
     
-    auto docIds = wrapper->db->BooleanQuery(queryStr);
+    bool ok = true;
+    auto docIds = wrapper->db->BooleanQuery(queryStr, &ok);
+    if (!ok) return nullptr;
     
     DocIdList* list = static_cast<DocIdList*>(malloc(sizeof(DocIdList)));
     list->count = docIds.Size();
     list->doc_ids = static_cast<size_t*>(malloc(sizeof(size_t) * (docIds.Size() > 0 ? docIds.Size() : 1)));
     
     for (size_t i = 0; i < docIds.Size(); ++i) {
-        list->doc_ids[i] = docIds[i];
+        list->doc_ids[i] = wrapper->db->ToExternalId(docIds[i]);
     }
     
     return list;
@@ -115,6 +439,115 @@ void doc_id_list_free(DocIdList* list) {
     }
 }
 
+DocumentList* search_db_get_documents(SearchDBHandle handle, const size_t* doc_ids, size_t count) {
+    auto* wrapper = static_cast<SearchDBWrapper*>(handle);
+    TVector<TDocId> ids;
+    TVector<bool> known(count, false);
+    for (size_t i = 0; i < count; ++i) {
+        TDocId id = 0;
+        known[i] = doc_ids && to_doc_id(*wrapper->db, doc_ids[i], &id);
+        ids.PushBack(id);
+    }
+    TVector<TString> documents = wrapper->db->GetDocuments(ids);
+
+    DocumentList* list = static_cast<DocumentList*>(malloc(sizeof(DocumentList)));
+    list->count = count;
+    list->documents = static_cast<char**>(malloc(sizeof(char*) * (count > 0 ? count : 1)));
+    for (size_t i = 0; i < count; ++i) {
+        list->documents[i] = allocate_cstring(known[i] ? documents[i] : TString());
+    }
+    return list;
+}
+
+void document_list_free(DocumentList* list) {
+    if (list) {
+        for (size_t i = 0; i < list->count; ++i) {
+            free(list->documents[i]);
+        }
+        free(list->documents);
+        free(list);
+    }
+}
+
+FetchedResultList* search_db_search_and_fetch(SearchDBHandle handle, const char* query, size_t top_k) {
+    auto* wrapper = static_cast<SearchDBWrapper*>(handle);
+    bool ok = true;
+    auto results = wrapper->db->SearchAndFetch(TString(query ? query : ""), top_k, &ok);
+    return ok ? to_fetched_list(*wrapper->db, results) : nullptr;
+}
+
+FetchedResultList* search_db_fetch_documents(SearchDBHandle handle, const size_t* doc_ids, size_t count) {
+    auto* wrapper = static_cast<SearchDBWrapper*>(handle);
+    TVector<TDocId> ids;
+    for (size_t i = 0; doc_ids && i < count; ++i) {
+        TDocId id;
+        if (to_doc_id(*wrapper->db, doc_ids[i], &id)) {
+            ids.PushBack(id);
+        }
+    }
+    return to_fetched_list(*wrapper->db, wrapper->db->FetchDocuments(ids));
+}
+
+void fetched_result_list_free(FetchedResultList* list) {
+    if (list) {
+        for (size_t i = 0; i < list->count; ++i) {
+            free(list->results[i].document);
+            free(list->results[i].title);
+            for (size_t f = 0; f < list->results[i].field_count; ++f) {
+                free(list->results[i].fields[f]);
+            }
+            free(list->results[i].fields);
+        }
+        free(list->results);
+        free(list);
+    }
+}
+
+size_t search_db_get_passage_count(SearchDBHandle handle) {
+    auto* wrapper = static_cast<SearchDBWrapper*>(handle);
+    return wrapper->db->GetPassageCount();
+}
+
+PassageResultList* search_db_search_passages(SearchDBHandle handle, const char* query, size_t top_k) {
+    auto* wrapper = static_cast<SearchDBWrapper*>(handle);
+    return to_passage_list(*wrapper->db, wrapper->db->SearchPassages(TString(query ? query : ""), top_k));
+}
+
+PassageResultList* search_db_search_by_passage(SearchDBHandle handle, const char* query, size_t top_k) {
+    auto* wrapper = static_cast<SearchDBWrapper*>(handle);
+    return to_passage_list(*wrapper->db, wrapper->db->SearchByPassage(TString(query ? query : ""), top_k));
+}
+
+void passage_result_list_free(PassageResultList* list) {
+    if (list) {
+        for (size_t i = 0; i < list->count; ++i) {
+            free(list->results[i].snippet);
+        }
+        free(list->results);
+        free(list);
+    }
+}
+
+RhymeLineList* search_db_find_rhyming_lines(SearchDBHandle handle, const char* word) {
+    auto* wrapper = static_cast<SearchDBWrapper*>(handle);
+    auto lines = wrapper->db->FindRhymingLines(TString(word ? word : ""));
+    RhymeLineList* list = static_cast<RhymeLineList*>(malloc(sizeof(RhymeLineList)));
+    list->count = lines.Size();
+    list->lines = static_cast<RhymeLine*>(malloc(sizeof(RhymeLine) * (lines.Size() > 0 ? lines.Size() : 1)));
+    for (size_t i = 0; i < lines.Size(); ++i) {
+        list->lines[i].doc_id = wrapper->db->ToExternalId(lines[i].DocId);
+        list->lines[i].line = lines[i].Line;
+    }
+    return list;
+}
+
+void rhyme_line_list_free(RhymeLineList* list) {
+    if (list) {
+        free(list->lines);
+        free(list);
+    }
+}
+
 const char* search_db_compress_text(const char* text) {
     if (!text) return nullptr;
     TString input(text);
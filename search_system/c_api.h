@@ -8,10 +8,73 @@ extern "C" {
 
 /**
  * C API для поисковой системы (для вызова из Python/Go через FFI)
+ *
+ * Id документов на границе всегда size_t, независимо от внутренней ширины TDocId.
+ * Это внешние id (порядковый номер добавления): они не меняются при перенумерации в search_db_seal.
  */
 
 typedef void* SearchDBHandle;
 
+/* Id, который возвращает добавление, если журнал (search_db_open_durable) не зафиксировал запись
+ * или дисковый индекс уже построен */
+#define SEARCH_DB_INVALID_ID ((size_t)-1)
+
+/* Число совпадений из search_db_count_matches, если в дисковом режиме не удалось прочитать постинги */
+#define SEARCH_DB_READ_ERROR ((size_t)-1)
+
+/*
+ * duplicate_policy: 0 — не проверять, 1 — помечать, 2 — пропускать почти-дубликаты
+ * stopword_mode: 0 — индексировать стоп-слова, 1 — выбрасывать, 2 — common-grams
+ * phrase_bigrams: 1 — строить при search_db_seal индекс частых пар термов для фраз в кавычках
+ * scorer: 0 — TF-IDF, 1 — BM25, 2 — квантованные импакты (строятся при search_db_seal/search_db_load)
+ * incremental_snapshots: 1 — snapshot_path долговечного режима — каталог инкрементальных снимков
+ * stored_fields: имена хранимых полей (автор, год и т.п.), stored_field_count штук; может быть NULL.
+ *   Схема записывается в образ: search_db_load берёт её из файла
+ * passage_unit: 0 — без индекса фрагментов, 1 — строки, 2 — строфы (блоки между пустыми строками)
+ * rhyme_index: 1 — индекс рифм по последним словам строк, оператор rhyme:слово в булевых запросах
+ * phonetic_index: 1 — фонетический словарь термов (строится при search_db_seal), оператор sound:слово
+ * disk_index_path: не NULL и не пустой — дисковый режим: постинги строятся в этот файл прогонами
+ *   по disk_build_bytes байт памяти и после search_db_seal читаются через кэш страниц в disk_cache_bytes
+ *   (0 — по умолчанию). Добавления после search_db_seal, образы, снимки и журнал в этом режиме отклоняются
+ */
+typedef struct {
+    int use_stemming;
+    int use_compression;
+    int duplicate_policy;
+    int collapse_duplicates;
+    int stopword_mode;
+    int phrase_bigrams;
+    int scorer;
+    int incremental_snapshots;
+    const char* const* stored_fields;
+    size_t stored_field_count;
+    int passage_unit;
+    int rhyme_index;
+    int phonetic_index;
+    const char* disk_index_path;
+    size_t disk_build_bytes;
+    size_t disk_cache_bytes;
+} SearchDBOptions;
+
+/*
+ * Статический прунинг: mode 0 — term-centric (top_k, epsilon), 1 — document-centric (doc_fraction)
+ */
+typedef struct {
+    int mode;
+    size_t top_k;
+    double epsilon;
+    double doc_fraction;
+} SearchDBPruneOptions;
+
+typedef struct {
+    size_t postings_before;
+    size_t postings_after;
+    size_t terms_before;
+    size_t terms_after;
+    size_t bytes_before;
+    size_t bytes_after;
+} SearchDBPruneReport;
+
 typedef struct {
     size_t doc_id;
     double score;
@@ -27,20 +90,179 @@ typedef struct {
     size_t count;
 } DocIdList;
 
+/* Тексты пачки документов; отсутствующий или удалённый документ — пустая строка */
+typedef struct {
+    char** documents;
+    size_t count;
+} DocumentList;
+
+/* fields — значения хранимых полей по схеме (search_db_get_field_name), field_count штук */
+typedef struct {
+    size_t doc_id;
+    double score;
+    char* document;
+    char* title;
+    char** fields;
+    size_t field_count;
+} FetchedResult;
+
+typedef struct {
+    FetchedResult* results;
+    size_t count;
+} FetchedResultList;
+
+/* Найденный фрагмент: snippet — его текст, строки [first_line, first_line + line_count) с нуля */
+typedef struct {
+    size_t doc_id;
+    size_t passage_id;
+    double score;
+    size_t first_line;
+    size_t line_count;
+    char* snippet;
+} PassageResult;
+
+typedef struct {
+    PassageResult* results;
+    size_t count;
+} PassageResultList;
+
+/* Строка документа (номер с нуля), рифмующаяся с запрошенным словом */
+typedef struct {
+    size_t doc_id;
+    size_t line;
+} RhymeLine;
+
+typedef struct {
+    RhymeLine* lines;
+    size_t count;
+} RhymeLineList;
+
 SearchDBHandle search_db_create(int use_stemming, int use_compression);
+SearchDBHandle search_db_create_with_options(const SearchDBOptions* options);
 void search_db_destroy(SearchDBHandle handle);
 
 size_t search_db_add_document(SearchDBHandle handle, const char* content, const char* title);
 const char* search_db_get_document(SearchDBHandle handle, size_t doc_id);
 const char* search_db_get_title(SearchDBHandle handle, size_t doc_id);
+
+/*
+ * Внешний ключ документа (ObjectId, номер строки и т.п.; без '\0'), хранится в базе вместе с индексом.
+ * find_by_key пишет внешний id в doc_id: 1 — найден, 0 — нет такого ключа или документ удалён.
+ * При повторе ключа находится документ, добавленный последним.
+ */
+size_t search_db_add_document_with_key(SearchDBHandle handle, const char* content, const char* title, const char* key);
+const char* search_db_get_external_key(SearchDBHandle handle, size_t doc_id);
+int search_db_find_by_key(SearchDBHandle handle, const char* key, size_t* doc_id);
+
+/* Схема хранимых полей; имя освобождается search_db_free_string */
+size_t search_db_get_field_count(SearchDBHandle handle);
+const char* search_db_get_field_name(SearchDBHandle handle, size_t index);
+/* fields — field_count значений по порядку схемы (может быть NULL) */
+size_t search_db_add_document_with_fields(SearchDBHandle handle, const char* content, const char* title,
+                                          const char* key, const char* const* fields, size_t field_count);
 size_t search_db_get_document_count(SearchDBHandle handle);
+/* 1 — успех; 0 — в дисковом режиме не удалось записать или открыть файл индекса */
+int search_db_seal(SearchDBHandle handle);
+size_t search_db_get_duplicate_group(SearchDBHandle handle, size_t doc_id);
 
+/* Возвращают 1 при успехе, 0 при ошибке (файл недоступен, битый образ, другие настройки конвейера) */
+int search_db_prune(SearchDBHandle handle, const SearchDBPruneOptions* options, SearchDBPruneReport* report);
+int search_db_save(SearchDBHandle handle, const char* path);
+int search_db_load(SearchDBHandle handle, const char* path);
+/* Инкрементальный снимок в каталог: пишутся только изменившиеся сегменты и манифест */
+int search_db_save_incremental(SearchDBHandle handle, const char* dir);
+int search_db_load_incremental(SearchDBHandle handle, const char* dir);
+
+/*
+ * Файловое хранилище текстов: save_doc_store выносит тексты в файл, open_doc_store переводит
+ * базу на него и освобождает копии в памяти. Пачки текстов читаются асинхронно.
+ * backend: 0 — io_uring, если ядро его даёт, иначе пул потоков; 1 — только io_uring; 2 — пул потоков с pread
+ */
+int search_db_save_doc_store(SearchDBHandle handle, const char* path);
+int search_db_open_doc_store(SearchDBHandle handle, const char* path, int backend);
+
+/* Прогрев памяти индекса после загрузки; threads = 0 — по числу ядер. Возвращает число прочитанных страниц */
+size_t search_db_warmup(SearchDBHandle handle, size_t threads);
+
+/*
+ * Пакетная загрузка count документов (titles может быть NULL); разбор текста идёт в threads потоках
+ * (0 — по числу ядер). Внешние id пишутся в out_ids (если не NULL). Возвращает число добавленных:
+ * 0 при count > 0 — журнал не зафиксировал пакет, ничего не добавлено.
+ */
+size_t search_db_add_documents(SearchDBHandle handle, const char* const* contents, const char* const* titles,
+                               size_t count, size_t threads, size_t* out_ids);
+/* То же с внешними ключами (keys может быть NULL) */
+size_t search_db_add_documents_with_keys(SearchDBHandle handle, const char* const* contents, const char* const* titles,
+                                         const char* const* keys, size_t count, size_t threads, size_t* out_ids);
+/* fields — count строк по field_count значений подряд (может быть NULL) */
+size_t search_db_add_documents_with_fields(SearchDBHandle handle, const char* const* contents, const char* const* titles,
+                                           const char* const* keys, const char* const* fields, size_t field_count,
+                                           size_t count, size_t threads, size_t* out_ids);
+
+/* Удаление документа по внешнему id: 1 — удалён, 0 — нет такого, уже удалён или журнал не зафиксировал удаление */
+int search_db_delete_document(SearchDBHandle handle, size_t doc_id);
+
+/*
+ * Долговечный режим: загрузить снимок snapshot_path (если есть), проиграть журнал wal_path
+ * и журналировать все дальнейшие добавления и удаления.
+ * sync_policy: 0 — fdatasync на каждую фиксацию, 1 — периодически, 2 — не вызывать
+ */
+int search_db_open_durable(SearchDBHandle handle, const char* snapshot_path, const char* wal_path, int sync_policy);
+/* Атомарно записать снимок и обнулить журнал */
+int search_db_checkpoint(SearchDBHandle handle);
+
+/*
+ * Фоновые снимки: образ снимается сразу, на диск пишется в отдельном потоке не быстрее
+ * bytes_per_second (0 — без ограничения). checkpoint_async — в файл снимка долговечного режима
+ * с отрезанием журнала, snapshot_async — в произвольный файл. 0 — запись уже идёт (или нет журнала).
+ * state: 0 — не запускалась, 1 — идёт, 2 — готово, 3 — ошибка, 4 — отменена
+ */
+typedef struct {
+    int state;
+    size_t bytes_written;
+    size_t total_bytes;
+} SearchDBSnapshotProgress;
+
+int search_db_checkpoint_async(SearchDBHandle handle, size_t bytes_per_second);
+int search_db_snapshot_async(SearchDBHandle handle, const char* path, size_t bytes_per_second);
+void search_db_snapshot_progress(SearchDBHandle handle, SearchDBSnapshotProgress* progress);
+/* Дождаться фоновой записи: 1 — снимок на диске */
+int search_db_snapshot_wait(SearchDBHandle handle);
+
+/* Если в дисковом режиме не удалось прочитать постинги, search_db_search_tfidf,
+ * search_db_boolean_query и search_db_search_and_fetch возвращают NULL,
+ * search_db_count_matches — SEARCH_DB_READ_ERROR */
 SearchResultList* search_db_search_tfidf(SearchDBHandle handle, const char* query, size_t top_k);
+size_t search_db_count_matches(SearchDBHandle handle, const char* query);
 void search_result_list_free(SearchResultList* list);
 
 DocIdList* search_db_boolean_query(SearchDBHandle handle, const char* query);
 void doc_id_list_free(DocIdList* list);
 
+/* Тексты count документов одним пакетом чтений */
+DocumentList* search_db_get_documents(SearchDBHandle handle, const size_t* doc_ids, size_t count);
+void document_list_free(DocumentList* list);
+
+/* search_db_search_tfidf вместе с текстами, заголовками и хранимыми полями найденных документов */
+FetchedResultList* search_db_search_and_fetch(SearchDBHandle handle, const char* query, size_t top_k);
+/* Тексты, заголовки и хранимые поля count документов (score = 0); неизвестные id пропускаются */
+FetchedResultList* search_db_fetch_documents(SearchDBHandle handle, const size_t* doc_ids, size_t count);
+void fetched_result_list_free(FetchedResultList* list);
+
+/*
+ * Поиск по индексу фрагментов (passage_unit != 0; иначе пустой список):
+ * search_passages — top_k лучших строк/строф, by_passage — top_k документов
+ * с оценкой и текстом лучшего фрагмента (max-passage)
+ */
+size_t search_db_get_passage_count(SearchDBHandle handle);
+PassageResultList* search_db_search_passages(SearchDBHandle handle, const char* query, size_t top_k);
+PassageResultList* search_db_search_by_passage(SearchDBHandle handle, const char* query, size_t top_k);
+void passage_result_list_free(PassageResultList* list);
+
+/* Все строки с рифмой к word (rhyme_index != 0; иначе пустой список) */
+RhymeLineList* search_db_find_rhyming_lines(SearchDBHandle handle, const char* word);
+void rhyme_line_list_free(RhymeLineList* list);
+
 const char* search_db_compress_text(const char* text);
 const char* search_db_decompress_text(const char* compressed);
 void search_db_free_string(const char* str);
@@ -3,152 +3,2131 @@
 #include <lib/types/string/string.h>
 #include <lib/collections/vector/vector.h>
 #include <lib/collections/unordered_map/unordered_map.h>
+#include <lib/collections/unordered_set/unordered_set.h>
 #include <lib/index/pipeline.h>
+#include <lib/index/doc_reorder.h>
+#include <lib/index/near_duplicates.h>
+#include <lib/index/pruning.h>
+#include <lib/index/phrase_index.h>
+#include <lib/index/index_io.h>
+#include <lib/index/wal.h>
+#include <lib/index/snapshot.h>
+#include <lib/index/async_io.h>
+#include <lib/index/disk_index.h>
+#include <lib/index/key_map.h>
+#include <lib/index/stored_fields.h>
+#include <lib/index/passage_index.h>
+#include <lib/index/rhyme_index.h>
+#include <lib/index/phonetic_index.h>
 #include <lib/lzw/lzw.h>
 
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <thread>
+
 namespace NSearchSystem {
 
 using NTypes::TString;
 using NCollections::TVector;
 using NCollections::TUnorderedMap;
+using NCollections::TUnorderedSet;
+using NCollections::TStringHash;
 
 using NIndex::TDocId;
 using NIndex::TPostingList;
+using NIndex::TPostingOps;
 using NIndex::TTfIdf;
+using NIndex::TStaticPruner;
+using NIndex::TBinaryWriter;
+using NIndex::TBinaryReader;
 
 /**
  * База документов и поисковый интерфейс: добавление документов, булев поиск, TF-IDF ранжирование.
  */
 class TSearchDatabase {
 public:
+    /**
+     * Возвращается добавлением, если журнал не смог зафиксировать запись или дисковый
+     * индекс уже построен (см. TOptions::DiskIndexPath): документ не добавлен.
+     */
+    static constexpr TDocId INVALID_DOC_ID = static_cast<TDocId>(-1);
+
+    /**
+     * Что делать с почти-дубликатами при загрузке:
+     * Keep — не проверять, Flag — индексировать и запомнить группу, Skip — не индексировать повторно.
+     */
+    enum class EDuplicatePolicy {
+        Keep,
+        Flag,
+        Skip
+    };
+
     struct TOptions {
         NIndex::TTextPipeline::TOptions Pipeline;
         bool StoreDocuments = true;
         bool CompressDocuments = true;
         bool StoreTitles = true;
+        bool ReorderOnSeal = true;
+        EDuplicatePolicy Duplicates = EDuplicatePolicy::Keep;
+        NIndex::TNearDuplicateIndex::TOptions DuplicateDetection;
+        bool CollapseDuplicates = false;
+        bool PhraseBigrams = false;
+        NIndex::TBigramIndex::TOptions Bigrams;
+        size_t TermFilterBitsPerKey = NIndex::TBlockedBloomFilter::DEFAULT_BITS_PER_KEY;
+        size_t SketchMinDocFrequency = NIndex::TInvertedIndex::SKETCH_MIN_DOC_FREQUENCY;
+        NIndex::EScorer Scorer = NIndex::EScorer::TfIdf;
+        NIndex::TWriteAheadLog::TOptions Wal;
+        size_t IngestThreads = 0;
+        bool IncrementalSnapshots = false;
+        TVector<TString> StoredFields;
+        NIndex::TPassageIndex::EUnit Passages = NIndex::TPassageIndex::EUnit::None;
+        bool RhymeIndex = false;
+        bool PhoneticIndex = false;
+        /**
+         * Непустой DiskIndexPath — дисковый режим: постинги не держатся в памяти, а строятся
+         * в этот файл прогонами по DiskBuildMemoryBytes (TDiskIndexBuilder) и после Seal
+         * читаются через кэш страниц DiskCache (TBufferPool). Индекс после Seal неизменяем;
+         * перенумерация, прунинг, фонетический словарь, импакты и образы базы (Save,
+         * снимки, журнал) в этом режиме не поддерживаются.
+         */
+        TString DiskIndexPath;
+        size_t DiskBuildMemoryBytes = NIndex::TDiskIndexBuilder::DEFAULT_MEMORY_BYTES;
+        NIndex::TBufferPool::TOptions DiskCache;
+    };
+
+    TSearchDatabase() : TSearchDatabase(TOptions()) {}
+
+    explicit TSearchDatabase(const TOptions& options)
+        : Options_(options)
+        , Engine_(MakeEngineOptions(options))
+        , Lzw_()
+        , Duplicates_(options.DuplicateDetection)
+        , Fields_(options.StoredFields)
+    {
+        Passages_.SetUnit(options.Passages);
+        Rhymes_.SetEnabled(options.RhymeIndex);
+        ResetDiskBuilder();
+    }
+
+    TDocId AddDocument(const TString& content) {
+        return AddDocument(content, TString());
+    }
+
+    TDocId AddDocument(const TString& content, const TString& title) {
+        return AddDocument(content, title, TString());
+    }
+
+    /**
+     * key — внешний ключ документа (см. FindByExternalKey); пустой — без ключа.
+     */
+    TDocId AddDocument(const TString& content, const TString& title, const TString& key) {
+        return AddDocument(content, title, key, TVector<TString>());
+    }
+
+    /**
+     * fields — значения хранимых полей по порядку схемы Options_.StoredFields (см. GetFields).
+     */
+    TDocId AddDocument(const TString& content, const TString& title, const TString& key,
+                       const TVector<TString>& fields) {
+        if (!AcceptsAdds()) return INVALID_DOC_ID;
+        uint64_t lsn = 0;
+        if (!LogAdd(content, title, key, fields, &lsn)) return INVALID_DOC_ID;
+        TPreparedDoc doc = Prepare(content);
+        TDocId docId = AddProcessed(doc.Tokens.Terms.begin(), doc.Tokens.Terms.end(), &content, &title, nullptr, &key, &fields, &doc);
+        MarkApplied(lsn);
+        return docId;
+    }
+
+    template <typename TermIt>
+    TDocId AddDocumentTerms(TermIt first, TermIt last) {
+        if (!AcceptsAdds()) return INVALID_DOC_ID;
+        uint64_t lsn = 0;
+        if (!LogAddTerms(first, last, nullptr, &lsn)) return INVALID_DOC_ID;
+        TDocId docId = AddProcessed(first, last, nullptr, nullptr);
+        MarkApplied(lsn);
+        return docId;
+    }
+
+    template <typename TermIt>
+    TDocId AddDocumentTerms(TermIt first, TermIt last, const TString& content) {
+        if (!AcceptsAdds()) return INVALID_DOC_ID;
+        uint64_t lsn = 0;
+        if (!LogAddTerms(first, last, &content, &lsn)) return INVALID_DOC_ID;
+        TDocId docId = AddProcessed(first, last, &content, nullptr);
+        MarkApplied(lsn);
+        return docId;
+    }
+
+    /**
+     * Пакетная загрузка. Конвейер обработки текста и LZW-сжатие идут параллельно
+     * в threads потоках (0 — Options_.IngestThreads, затем число ядер), вставка в индекс —
+     * последовательно в порядке пакета, поэтому id те же, что при поочерёдных AddDocument.
+     * С открытым журналом весь пакет фиксируется одной групповой записью; если фиксация
+     * не удалась (или дисковый индекс уже построен), пакет не применяется и возвращается пустой вектор.
+     * titles — пустой вектор или по заголовку на документ.
+     */
+    TVector<TDocId> AddDocuments(const TVector<TString>& contents, const TVector<TString>& titles, size_t threads = 0) {
+        return AddDocuments(contents, titles, TVector<TString>(), threads);
+    }
+
+    /**
+     * То же с внешними ключами: keys — пустой вектор или по ключу на документ.
+     */
+    TVector<TDocId> AddDocuments(const TVector<TString>& contents, const TVector<TString>& titles,
+                                 const TVector<TString>& keys, size_t threads = 0) {
+        return AddDocuments(contents, titles, keys, TVector<TVector<TString>>(), threads);
+    }
+
+    /**
+     * То же с хранимыми полями: fields — пустой вектор или по строке значений на документ.
+     */
+    TVector<TDocId> AddDocuments(const TVector<TString>& contents, const TVector<TString>& titles,
+                                 const TVector<TString>& keys, const TVector<TVector<TString>>& fields,
+                                 size_t threads = 0) {
+        if (!AcceptsAdds()) return TVector<TDocId>();
+        uint64_t lsn = 0;
+        if (Wal_.IsOpen()) {
+            const TString none;
+            const TVector<TString> noFields;
+            for (size_t i = 0; i < contents.Size(); ++i) {
+                lsn = Wal_.Append(EncodeAdd(contents[i], i < titles.Size() ? titles[i] : none,
+                                            i < keys.Size() ? keys[i] : none,
+                                            i < fields.Size() ? fields[i] : noFields));
+            }
+            if (!Wal_.Commit(lsn)) return TVector<TDocId>();
+        }
+        TVector<TDocId> docIds = ApplyAdds(contents, titles, keys, fields, threads);
+        MarkApplied(lsn);
+        return docIds;
+    }
+
+    /**
+     * Удаление через битовую маску удалённых (tombstones): постинги не трогаются,
+     * документ перестаёт попадать в выдачу, его текст и заголовок освобождаются.
+     * Статистики ранжирования (df, средняя длина) по-прежнему учитывают удалённые документы.
+     * false — документа нет, он уже удалён или журнал не смог зафиксировать удаление.
+     */
+    bool DeleteDocument(TDocId docId) {
+        if (docId >= GetDocumentCount() || Deleted_.Test(docId)) return false;
+        uint64_t lsn = 0;
+        if (Wal_.IsOpen()) {
+            TBinaryWriter record;
+            record.WriteU8(WAL_DELETE);
+            record.WriteVarint(ToExternalId(docId));
+            lsn = Wal_.Append(record);
+            if (!Wal_.Commit(lsn)) return false;
+        }
+        ApplyDelete(docId);
+        MarkApplied(lsn);
+        return true;
+    }
+
+    bool IsDeleted(TDocId docId) const { return Deleted_.Test(docId); }
+    size_t GetDeletedCount() const { return DeletedCount_; }
+
+    /**
+     * Долговечный режим: загружает последний снимок snapshotPath (если он есть),
+     * проигрывает хвост журнала walPath — записи новее снимка — через пакетную загрузку
+     * и дальше пишет в журнал каждое добавление и удаление до того, как применить его.
+     * Seal() и Prune() не журналируются: после восстановления их вызывают заново.
+     * С IncrementalSnapshots snapshotPath — каталог инкрементальных снимков (см. SaveIncremental).
+     */
+    bool OpenDurable(const char* snapshotPath, const char* walPath) {
+        CloseLog();
+        if (IsDiskMode()) return false;
+        NIndex::TByteBuffer buffer;
+        if (Options_.IncrementalSnapshots) {
+            if (NIndex::TSegmentStore::Exists(NIndex::TSegmentStore::ManifestPath(TString(snapshotPath)))) {
+                if (!LoadIncremental(snapshotPath)) return false;
+            } else {
+                Clear();
+            }
+        } else if (TBinaryReader::LoadFile(snapshotPath, &buffer)) {
+            TBinaryReader reader(buffer);
+            if (!Load(reader)) return false;
+        } else {
+            Clear();
+        }
+
+        TReplayBatch batch;
+        const uint64_t snapshotLsn = AppliedLsn_;
+        bool ok = true;
+        bool opened = Wal_.Open(walPath, Options_.Wal, snapshotLsn,
+            [&](uint64_t lsn, const unsigned char* data, size_t size) {
+                if (!ok || lsn <= snapshotLsn) return;
+                ok = Replay(TBinaryReader(data, size), batch);
+                AppliedLsn_ = lsn;
+            });
+        FlushReplay(batch);
+        if (!opened || !ok) {
+            Wal_.Close();
+            return false;
+        }
+        SnapshotPath_ = TString(snapshotPath);
+        return true;
+    }
+
+    /**
+     * Снимок в долговечном режиме без остановки запросов и загрузки: в текущем потоке образ
+     * собирается из неизменяемых частей (см. CaptureImage), а их сериализация там, где она
+     * не сделана заранее, и запись на диск (временный файл + fsync + rename, не быстрее
+     * bytesPerSecond; 0 — без ограничения) и отрезание покрытой снимком части журнала идут
+     * в фоновом потоке. Падение на любом шаге безопасно: записи, уже вошедшие в снимок,
+     * при открытии пропускаются по LSN. false — долговечный режим не открыт или запись уже идёт.
+     * С IncrementalSnapshots на диск уходят только изменившиеся сегменты и манифест.
+     */
+    bool StartCheckpoint(size_t bytesPerSecond = 0) {
+        if (!Wal_.IsOpen() || Snapshot_.IsRunning() || !Wal_.CommitAll()) return false;
+        if (Options_.IncrementalSnapshots) {
+            TVector<NIndex::TSnapshotWriter::TFile> files;
+            if (!CaptureSegments(SnapshotPath_, &files)) return false;
+            return Snapshot_.Start(std::move(files), MakeSnapshotOptions(bytesPerSecond), &Wal_, AppliedLsn_);
+        }
+        TVector<NIndex::TSnapshotWriter::TFile> files(1);
+        if (!CaptureImage(SnapshotPath_, &files[0])) return false;
+        return Snapshot_.Start(std::move(files), MakeSnapshotOptions(bytesPerSecond), &Wal_, AppliedLsn_);
+    }
+
+    /**
+     * Фоновая запись образа в произвольный файл; журнал не трогается.
+     */
+    bool StartSnapshot(const char* path, size_t bytesPerSecond = 0) {
+        if (IsDiskMode() || Snapshot_.IsRunning()) return false;
+        TVector<NIndex::TSnapshotWriter::TFile> files(1);
+        if (!CaptureImage(TString(path), &files[0])) return false;
+        return Snapshot_.Start(std::move(files), MakeSnapshotOptions(bytesPerSecond));
+    }
+
+    NIndex::TSnapshotWriter::TProgress GetSnapshotProgress() const {
+        return Snapshot_.GetProgress();
+    }
+
+    /**
+     * Дожидается фоновой записи снимка. true — последний снимок записан.
+     */
+    bool WaitSnapshot() {
+        return Snapshot_.Wait();
+    }
+
+    /**
+     * Синхронный вариант StartCheckpoint.
+     */
+    bool Checkpoint() {
+        Snapshot_.Wait();
+        return StartCheckpoint() && Snapshot_.Wait();
+    }
+
+    void CloseLog() {
+        Snapshot_.Wait();
+        Wal_.Close();
+    }
+
+    /**
+     * Политика журнала для следующего OpenDurable.
+     */
+    void SetLogOptions(const NIndex::TWriteAheadLog::TOptions& options) {
+        Options_.Wal = options;
+    }
+
+    bool IsDurable() const { return Wal_.IsOpen() && Wal_.Ok(); }
+
+    const NIndex::TWriteAheadLog& GetLog() const { return Wal_; }
+
+    /**
+     * Ранжирование скорером из Options_.Scorer. Импакт-скорер работает по импактам,
+     * построенным в Seal()/Load()/Prune(); до следующего Seal() после добавления документов
+     * поиск откатывается на TF-IDF.
+     * ok (если задан) получает false, когда в дисковом режиме не удалось прочитать постинги:
+     * результат тогда пуст, а не молча неполон. Так же ok работает во всех запросах ниже.
+     */
+    TVector<TTfIdf::TSearchResult> Search(const TString& query, size_t topK = 10, bool* ok = nullptr) const {
+        if (ok) *ok = true;
+        if (!Options_.CollapseDuplicates || DuplicateGroupOf_.Empty()) {
+            return Rank(query, topK, ok);
+        }
+        size_t fetch = topK * 2 + 1;
+        while (true) {
+            TVector<TTfIdf::TSearchResult> results = Rank(query, fetch, ok);
+            TVector<TTfIdf::TSearchResult> collapsed = CollapseDuplicates(results, topK);
+            if (collapsed.Size() >= topK || results.Size() < fetch) {
+                return collapsed;
+            }
+            fetch *= 2;
+        }
+    }
+
+    /**
+     * Число документов, содержащих хотя бы один терм запроса (коллектор-счётчик, без сортировки).
+     */
+    size_t CountMatches(const TString& query, bool* ok = nullptr) const {
+        if (ok) *ok = true;
+        NIndex::TScoringRequest request = MakeScoringRequest(0);
+        request.Collector = NIndex::ECollector::Count;
+        return Score(Engine_.GetPipeline().Process(query), request, ok).Count;
+    }
+
+    /**
+     * Оставляет по одному (лучшему) результату на группу дубликатов.
+     */
+    TVector<TTfIdf::TSearchResult> CollapseDuplicates(const TVector<TTfIdf::TSearchResult>& results, size_t topK) const {
+        TVector<TTfIdf::TSearchResult> collapsed;
+        TUnorderedSet<size_t> seen;
+        for (size_t i = 0; i < results.Size() && collapsed.Size() < topK; ++i) {
+            size_t group = GetDuplicateGroup(results[i].DocId);
+            if (seen.Contains(group)) continue;
+            seen.Insert(group);
+            collapsed.PushBack(results[i]);
+        }
+        return collapsed;
+    }
+
+    /**
+     * Группа дубликатов документа — внешний id первого документа группы.
+     */
+    size_t GetDuplicateGroup(TDocId docId) const {
+        if (docId < DuplicateGroupOf_.Size()) {
+            return DuplicateGroupOf_[docId];
+        }
+        return ToExternalId(docId);
+    }
+
+    bool IsDuplicate(TDocId docId) const {
+        return GetDuplicateGroup(docId) != ToExternalId(docId);
+    }
+
+    template <typename TermIt>
+    TVector<TTfIdf::TSearchResult> SearchTerms(TermIt first, TermIt last, size_t topK = 10, bool* ok = nullptr) const {
+        if (ok) *ok = true;
+        return Score(ToTerms(first, last), MakeScoringRequest(topK), ok).Hits;
+    }
+
+    TPostingList BooleanAnd(const TVector<TString>& terms, bool* ok = nullptr) const {
+        if (ok) *ok = true;
+        if (IsDiskMode()) {
+            TPostingList docs;
+            if (!DiskIndex_.SearchAnd(Engine_.GetPipeline().NormalizeTerms(terms), &docs)) return ReadFailed(ok);
+            return DropDeleted(std::move(docs));
+        }
+        return DropDeleted(Engine_.BooleanAnd(terms));
+    }
+
+    TPostingList BooleanOr(const TVector<TString>& terms, bool* ok = nullptr) const {
+        if (ok) *ok = true;
+        if (IsDiskMode()) {
+            TPostingList docs;
+            if (!DiskIndex_.SearchOr(Engine_.GetPipeline().NormalizeTerms(terms), &docs)) return ReadFailed(ok);
+            return DropDeleted(std::move(docs));
+        }
+        return DropDeleted(Engine_.BooleanOr(terms));
+    }
+
+    template <typename TermIt>
+    TPostingList BooleanAnd(TermIt first, TermIt last, bool* ok = nullptr) const {
+        if (IsDiskMode()) return BooleanAnd(ToTerms(first, last), ok);
+        if (ok) *ok = true;
+        return DropDeleted(Engine_.BooleanAnd(first, last));
+    }
+
+    template <typename TermIt>
+    TPostingList BooleanOr(TermIt first, TermIt last, bool* ok = nullptr) const {
+        if (IsDiskMode()) return BooleanOr(ToTerms(first, last), ok);
+        if (ok) *ok = true;
+        return DropDeleted(Engine_.BooleanOr(first, last));
+    }
+
+    /**
+     * Булев запрос: термы, AND/OR/NOT, скобки, фразы в кавычках ("the sea"),
+     * rhyme:слово — документы со строкой, рифмующейся со словом (при Options_.RhymeIndex),
+     * и sound:слово — любой терм с тем же фонетическим кодом (при Options_.PhoneticIndex,
+     * словарь — на момент последнего Seal): sound:musick находит и music.
+     */
+    TPostingList BooleanQuery(const TString& query, bool* ok = nullptr) const {
+        if (ok) *ok = true;
+        TVector<TString> tokens = TokenizeBooleanQuery(query);
+        TVector<TString> rpn = ToRpn(tokens);
+        return DropDeleted(EvalRpn(rpn, ok));
+    }
+
+    /**
+     * Документы, где термы фразы идут подряд (после конвейера обработки).
+     * Пары из TBigramIndex сужают кандидатов вместо пересечения длинных списков термов;
+     * фраза из двух слов, пара которой проиндексирована, отвечается прямо постингами пары.
+     * Остальные кандидаты проверяются повторной токенизацией сохранённого текста
+     * (позиции в индексе не хранятся); без хранилища текстов кандидаты не проверяются.
+     */
+    TPostingList PhraseQuery(const TString& phrase, bool* ok = nullptr) const {
+        if (ok) *ok = true;
+        return DropDeleted(MatchPhrase(phrase, ok));
+    }
+
+    size_t GetBigramCount() const { return Bigrams_.Size(); }
+
+    /**
+     * Строка документа, последнее слово которой рифмуется с запрошенным (номер строки с нуля).
+     */
+    struct TRhymeLine {
+        TDocId DocId = 0;
+        uint32_t Line = 0;
+    };
+
+    size_t GetRhymeCount() const { return Rhymes_.Size(); }
+
+    size_t GetPhoneticCodeCount() const { return Phonetic_.Size(); }
+
+    /**
+     * Все строки с рифмой к word по TRhymeIndex, удалённые документы пропускаются.
+     * Без индекса рифм — пусто.
+     */
+    TVector<TRhymeLine> FindRhymingLines(const TString& word) const {
+        TVector<TRhymeLine> lines;
+        TVector<NIndex::TRhymeIndex::TEntry> entries = Rhymes_.FindLines(word);
+        for (size_t i = 0; i < entries.Size(); ++i) {
+            if (DeletedCount_ > 0 && Deleted_.Test(entries[i].Doc)) continue;
+            lines.PushBack(TRhymeLine{entries[i].Doc, entries[i].Line});
+        }
+        return lines;
+    }
+
+    TString GetDocument(TDocId docId) const {
+        if (!Options_.StoreDocuments) {
+            return TString();
+        }
+        if (FindStored(docId)) {
+            return GetDocuments(TVector<TDocId>(1, docId))[0];
+        }
+        if (Options_.CompressDocuments) {
+            auto it = CompressedDocs_.Find(docId);
+            if (it == CompressedDocs_.end()) {
+                return TString();
+            }
+            return Lzw_.Decompress(it.Value());
+        }
+        auto it = RawDocs_.Find(docId);
+        if (it == RawDocs_.end()) {
+            return TString();
+        }
+        return it.Value();
+    }
+
+    TString GetTitle(TDocId docId) const {
+        if (!Options_.StoreTitles) {
+            return TString();
+        }
+        auto it = Titles_.Find(docId);
+        if (it == Titles_.end()) {
+            return TString();
+        }
+        return it.Value();
+    }
+
+    /**
+     * Внешний ключ документа, заданный при добавлении; пустая строка — ключа нет.
+     */
+    TString GetExternalKey(TDocId docId) const {
+        return ExternalKeys_.Get(ToExternalId(docId));
+    }
+
+    /**
+     * Документ по внешнему ключу (при повторе ключа — добавленный последним). Ключ дубликата,
+     * пропущенного по EDuplicatePolicy::Skip, ведёт к оставшемуся документу группы. false — нет
+     * такого ключа или документ удалён. Поиск — по хеш-таблице TExternalKeyMap.
+     */
+    bool FindByExternalKey(const TString& key, TDocId* docId) const {
+        size_t externalId = 0;
+        TDocId found;
+        if (!ExternalKeys_.Find(key, &externalId) || !ToInternalId(externalId, &found) || Deleted_.Test(found)) {
+            return false;
+        }
+        *docId = found;
+        return true;
+    }
+
+    /**
+     * Схема хранимых полей: имена по порядку значений GetFields.
+     */
+    const TVector<TString>& GetFieldNames() const { return Fields_.GetSchema(); }
+
+    /**
+     * Номер поля по имени; GetFieldNames().Size() — такого поля нет.
+     */
+    size_t FindField(const TString& name) const { return Fields_.FindField(name); }
+
+    /**
+     * Хранимые поля документа по схеме (пустые строки — значения нет или документ удалён).
+     */
+    TVector<TString> GetFields(TDocId docId) const {
+        if (Deleted_.Test(docId)) return TVector<TString>(Fields_.GetFieldCount());
+        return Fields_.Get(ToExternalId(docId));
+    }
+
+    TString GetField(TDocId docId, size_t field) const {
+        if (Deleted_.Test(docId)) return TString();
+        return Fields_.Get(ToExternalId(docId), field);
+    }
+
+    /**
+     * Тексты пачки документов, по порядку docIds (пустая строка — текста нет или документ удалён).
+     * Тексты из файлового хранилища (OpenDocStore) читаются одним асинхронным пакетом
+     * и распаковываются по мере завершения чтений, а не по одному GetDocument на документ.
+     */
+    TVector<TString> GetDocuments(const TVector<TDocId>& docIds) const {
+        TVector<TString> documents(docIds.Size());
+        if (!Options_.StoreDocuments) return documents;
+        TVector<NIndex::TAsyncReader::TRange> ranges;
+        TVector<size_t> slotOf;
+        for (size_t i = 0; i < docIds.Size(); ++i) {
+            if (const TDocStoreEntry* entry = FindStored(docIds[i])) {
+                ranges.PushBack(NIndex::TAsyncReader::TRange{entry->Offset, entry->Size});
+                slotOf.PushBack(i);
+            } else {
+                documents[i] = GetDocument(docIds[i]);
+            }
+        }
+        const bool compressed = DocStoreCompressed_;
+        DocStore_.ReadBatch(ranges, [&](size_t index, const unsigned char* data, size_t size) {
+            documents[slotOf[index]] = compressed
+                ? Lzw_.Decompress(data, data + size)
+                : TString(reinterpret_cast<const char*>(data), size);
+        });
+        return documents;
+    }
+
+    struct TFetchedResult {
+        TDocId DocId = 0;
+        double Score = 0;
+        TString Document;
+        TString Title;
+        TVector<TString> Fields;
+    };
+
+    /**
+     * Всё, что нужно для показа документов: тексты (одним пакетом GetDocuments),
+     * заголовки и хранимые поля. Score = 0.
+     */
+    TVector<TFetchedResult> FetchDocuments(const TVector<TDocId>& docIds) const {
+        TVector<TString> documents = GetDocuments(docIds);
+        TVector<TFetchedResult> results(docIds.Size());
+        for (size_t i = 0; i < docIds.Size(); ++i) {
+            results[i].DocId = docIds[i];
+            results[i].Document = std::move(documents[i]);
+            results[i].Title = GetTitle(docIds[i]);
+            results[i].Fields = GetFields(docIds[i]);
+        }
+        return results;
+    }
+
+    /**
+     * Search вместе с FetchDocuments найденных документов.
+     */
+    TVector<TFetchedResult> SearchAndFetch(const TString& query, size_t topK = 10, bool* ok = nullptr) const {
+        TVector<TTfIdf::TSearchResult> hits = Search(query, topK, ok);
+        TVector<TDocId> docIds;
+        docIds.Reserve(hits.Size());
+        for (size_t i = 0; i < hits.Size(); ++i) {
+            docIds.PushBack(hits[i].DocId);
+        }
+        TVector<TFetchedResult> results = FetchDocuments(docIds);
+        for (size_t i = 0; i < hits.Size(); ++i) {
+            results[i].Score = hits[i].Score;
+        }
+        return results;
+    }
+
+    /**
+     * Найденный фрагмент (строка или строфа, см. Options_.Passages): документ, номер
+     * фрагмента, его диапазон в тексте и сам текст — готовый сниппет.
+     */
+    struct TPassageResult {
+        TDocId DocId = 0;
+        TDocId PassageId = 0;
+        double Score = 0;
+        NIndex::TPassageIndex::TSpan Span;
+        TString Text;
+    };
+
+    size_t GetPassageCount() const { return Passages_.Size(); }
+
+    /**
+     * Ранжирование фрагментов как самостоятельных документов: topK лучших строк/строф,
+     * несколько может прийтись на одно стихотворение. Без индекса фрагментов — пусто.
+     */
+    TVector<TPassageResult> SearchPassages(const TString& query, size_t topK = 10) const {
+        if (!Passages_.IsEnabled()) return TVector<TPassageResult>();
+        return ToPassageResults(Passages_.SearchPassages(Engine_.GetPipeline().Process(query), MakeScoringRequest(topK)));
+    }
+
+    /**
+     * Ранжирование документов по лучшему фрагменту (max-passage): одно длинное стихотворение
+     * с единственной подходящей строкой не проигрывает из-за длины. Score — оценка
+     * фрагмента, Text — его текст, поэтому сниппет не ищется повторным проходом по документу.
+     */
+    TVector<TPassageResult> SearchByPassage(const TString& query, size_t topK = 10) const {
+        if (!Passages_.IsEnabled()) return TVector<TPassageResult>();
+        return ToPassageResults(Passages_.SearchDocuments(Engine_.GetPipeline().Process(query), MakeScoringRequest(topK)));
+    }
+
+    /**
+     * Выносит тексты в файловое хранилище path: сохранённые байты текстов (сжатые, если
+     * CompressDocuments) подряд по внешним id, за ними таблица длин и хвост
+     * [u64 смещение таблицы][u32 магия]. Память не освобождается — это делает OpenDocStore.
+     */
+    bool SaveDocStore(const char* path) const {
+        TBinaryWriter writer;
+        writer.WriteU32(DOC_STORE_MAGIC);
+        writer.WriteU8(Options_.CompressDocuments ? 1 : 0);
+        TVector<TStoredDoc> docs;
+        TVector<NIndex::TByteBuffer> buffers;
+        TVector<size_t> lengths;
+        for (size_t segment = 0; segment < GetDocSegmentCount(); ++segment) {
+            if (!CollectStoredDocs(segment, &docs, &buffers)) return false;
+            for (size_t i = 0; i < docs.Size(); ++i) {
+                const bool present = docs[i].Present && docs[i].Compressed == Options_.CompressDocuments;
+                lengths.PushBack(present ? docs[i].Size + 1 : 0);
+                if (present) writer.WriteRaw(docs[i].Data, docs[i].Size);
+            }
+        }
+        const uint64_t tableOffset = writer.GetBuffer().Size();
+        writer.WriteVarint(lengths.Size());
+        for (size_t i = 0; i < lengths.Size(); ++i) {
+            writer.WriteVarint(lengths[i]);
+        }
+        writer.WriteU64(tableOffset);
+        writer.WriteU32(DOC_STORE_MAGIC);
+        // Через временный файл: path может быть открытым сейчас хранилищем.
+        TString tmpPath(path);
+        tmpPath.Append(".tmp");
+        if (!writer.SaveToFile(tmpPath.CStr(), true)) return false;
+        return std::rename(tmpPath.CStr(), path) == 0;
+    }
+
+    /**
+     * Переводит тексты на файловое хранилище path (см. SaveDocStore): в памяти остаётся
+     * только таблица смещений, копии текстов из хранилища освобождаются. Документы,
+     * добавленные после SaveDocStore, продолжают храниться в памяти. Чтения идут через
+     * TAsyncReader (io_uring или пул потоков с pread, см. options).
+     */
+    bool OpenDocStore(const char* path, const NIndex::TAsyncReader::TOptions& options = NIndex::TAsyncReader::TOptions()) {
+        CloseDocStore();
+        if (!DocStore_.Open(path, options)) return false;
+        TVector<TDocStoreEntry> entries;
+        bool compressed = false;
+        if (!ReadDocStoreTable(&entries, &compressed) || compressed != Options_.CompressDocuments) {
+            DocStore_.Close();
+            return false;
+        }
+        for (size_t externalId = 0; externalId < entries.Size(); ++externalId) {
+            const TDocId docId = InternalIdOf_[externalId];
+            if (Deleted_.Test(docId)) {
+                entries[externalId].Present = false;
+            }
+            if (entries[externalId].Present) {
+                RawDocs_.Erase(docId);
+                CompressedDocs_.Erase(docId);
+            }
+        }
+        DocStoreEntries_.Swap(entries);
+        DocStoreCompressed_ = compressed;
+        return true;
+    }
+
+    void CloseDocStore() {
+        DocStore_.Close();
+        DocStoreEntries_.Clear();
+    }
+
+    bool HasDocStore() const { return DocStore_.IsOpen(); }
+
+    size_t GetDocumentCount() const {
+        if (!IsDiskMode()) return Engine_.GetDocumentCount();
+        return DiskBuilder_ ? DiskBuilder_->GetDocumentCount() : DiskIndex_.GetDocumentCount();
+    }
+
+    size_t GetTermCount() const {
+        return IsDiskMode() ? DiskIndex_.GetTermCount() : Engine_.GetTermCount();
+    }
+
+    bool IsDiskMode() const { return !Options_.DiskIndexPath.Empty(); }
+
+    /**
+     * Счётчики кэша страниц дискового индекса (см. TBufferPool::TStats).
+     */
+    NIndex::TBufferPool::TStats GetDiskCacheStats() const { return DiskIndex_.GetCacheStats(); }
+
+    /**
+     * Завершает загрузку корпуса. При ReorderOnSeal документы перенумеровываются так,
+     * чтобы похожие тексты шли подряд; постинги, хранилище текстов и заголовки
+     * переносятся согласованно. Внешний id (порядковый номер добавления) не меняется.
+     * Затем по словарю строится фильтр Блума (TermFilterBitsPerKey = 0 отключает)
+     * и HyperLogLog-скетчи частых термов для оценок планировщика (SketchMinDocFrequency = 0 отключает).
+     * При PhoneticIndex перестраивается фонетический словарь для оператора sound:.
+     * В дисковом режиме Seal только сливает прогоны в файл индекса, открывает его
+     * и строит фонетический словарь по словарю файла; false — файл не удалось записать или открыть.
+     */
+    bool Seal() {
+        InvalidateCore();
+        if (Options_.PhraseBigrams) {
+            Bigrams_.Seal(Options_.Bigrams);
+        }
+        if (IsDiskMode()) return SealDisk();
+        if (Options_.ReorderOnSeal && GetDocumentCount() > 1) {
+            Reorder(NIndex::TDocReorderer::ComputeOrder(Engine_.GetIndex()));
+        }
+        if (Options_.TermFilterBitsPerKey > 0) {
+            Engine_.BuildTermFilter(Options_.TermFilterBitsPerKey);
+        }
+        if (Options_.SketchMinDocFrequency > 0) {
+            Engine_.BuildSketches(Options_.SketchMinDocFrequency);
+        }
+        BuildImpactsIfNeeded();
+        BuildPhoneticIfNeeded();
+        return true;
+    }
+
+    void Reorder(const TVector<TDocId>& newIdOf) {
+        if (IsDiskMode()) return;
+        InvalidateCore();
+        Engine_.Remap(newIdOf);
+        Bigrams_.Remap(newIdOf);
+        Rhymes_.Remap(newIdOf);
+        RemapKeys(RawDocs_, newIdOf);
+        RemapKeys(CompressedDocs_, newIdOf);
+        RemapKeys(Titles_, newIdOf);
+        Permute(DuplicateGroupOf_, newIdOf);
+        if (DeletedCount_ > 0) {
+            NIndex::TDocBitset deleted(Deleted_.Size());
+            for (size_t oldId = 0; oldId < Deleted_.Size(); ++oldId) {
+                if (Deleted_.Test(static_cast<TDocId>(oldId))) {
+                    deleted.Set(newIdOf[oldId]);
+                }
+            }
+            Deleted_ = std::move(deleted);
+        }
+
+        TVector<size_t> externalOf(ExternalIdOf_.Size());
+        for (size_t oldId = 0; oldId < ExternalIdOf_.Size(); ++oldId) {
+            TDocId newId = newIdOf[oldId];
+            externalOf[newId] = ExternalIdOf_[oldId];
+            InternalIdOf_[ExternalIdOf_[oldId]] = newId;
+        }
+        ExternalIdOf_.Swap(externalOf);
+    }
+
+    /**
+     * Статический прунинг запечатанного индекса (см. TStaticPruner).
+     * Хранилище текстов и заголовков не трогается: меняются только постинги.
+     * В дисковом режиме не выполняется (пустой отчёт).
+     */
+    TStaticPruner::TReport Prune(const TStaticPruner::TOptions& options) {
+        if (IsDiskMode()) return TStaticPruner::TReport();
+        InvalidateCore();
+        TStaticPruner::TReport report = Engine_.Prune(options);
+        BuildImpactsIfNeeded();
+        BuildPhoneticIfNeeded();
+        return report;
+    }
+
+    /**
+     * Образ базы целиком: ядро (индекс, отображение id, группы дубликатов, биграммы, фрагменты),
+     * дельты ядра (Save их не пишет, см. CaptureImage), сегменты хранилища текстов и заголовков,
+     * LSN последней применённой записи журнала
+     * и удалённые документы. Загружается в память как есть и сразу готов к поиску. Настройки
+     * конвейера должны совпадать с записанными, иначе запросы нормализовались бы иначе, чем документы.
+     * false — не прочитались тексты из файлового хранилища (образ в writer тогда неполон)
+     * или база в дисковом режиме.
+     */
+    bool Save(TBinaryWriter& writer) const {
+        if (IsDiskMode()) return false;
+        SaveCore(writer);
+        writer.WriteVarint(0);
+        for (size_t segment = 0; segment < GetDocSegmentCount(); ++segment) {
+            if (!SaveDocSegment(writer, segment)) return false;
+        }
+        writer.WriteVarint(AppliedLsn_);
+        SaveDeleted(writer);
+        return true;
+    }
+
+    bool Load(TBinaryReader& reader) {
+        if (IsDiskMode()) return false;
+        Clear();
+        if (!LoadCore(reader)) return Fail();
+        const size_t deltas = reader.ReadCount(8);
+        for (size_t i = 0; i < deltas; ++i) {
+            if (!LoadCoreDelta(reader)) return Fail();
+        }
+        for (size_t segment = 0; segment < GetDocSegmentCount(); ++segment) {
+            if (!LoadDocSegment(reader, segment)) return Fail();
+        }
+        AppliedLsn_ = reader.ReadVarint();
+        if (!LoadDeleted(reader) || !reader.AtEnd()) return Fail();
+        BuildImpactsIfNeeded();
+        return true;
+    }
+
+    bool SaveToFile(const char* path) const {
+        TBinaryWriter writer;
+        return Save(writer) && writer.SaveToFile(path);
+    }
+
+    bool LoadFromFile(const char* path) {
+        NIndex::TByteBuffer buffer;
+        if (!TBinaryReader::LoadFile(path, &buffer)) return false;
+        TBinaryReader reader(buffer);
+        return Load(reader);
+    }
+
+    /**
+     * Инкрементальный снимок в каталог dir (см. TSegmentStore): ядро и сегменты хранилища
+     * по DOC_SEGMENT_SIZE внешних id лежат в файлах, названных хешем содержимого, манифест
+     * перечисляет их и хранит удалённые документы. Пишутся только сегменты, изменившиеся
+     * с прошлого снимка, и манифест, поэтому время записи растёт с дельтой, а не с базой.
+     * Документы, добавленные после снимка ядра, уходят в неизменяемые дельты ядра (свой
+     * словарь и термы по документу), которые при загрузке доливаются в индекс. Seal, Prune
+     * и MAX_CORE_DELTAS дельт подряд переписывают ядро целиком (компакция).
+     */
+    bool SaveIncremental(const char* dir) {
+        Snapshot_.Wait();
+        return StartIncrementalSnapshot(dir) && Snapshot_.Wait();
+    }
+
+    /**
+     * Фоновый вариант SaveIncremental; журнал не трогается.
+     */
+    bool StartIncrementalSnapshot(const char* dir, size_t bytesPerSecond = 0) {
+        if (IsDiskMode() || Snapshot_.IsRunning()) return false;
+        TVector<NIndex::TSnapshotWriter::TFile> files;
+        if (!CaptureSegments(TString(dir), &files)) return false;
+        return Snapshot_.Start(std::move(files), MakeSnapshotOptions(bytesPerSecond));
+    }
+
+    /**
+     * Собирает базу из манифеста каталога dir, сверяя хеш каждого сегмента с его именем.
+     * Запомненные хеши делают следующий SaveIncremental в тот же каталог дельтой.
+     */
+    bool LoadIncremental(const char* dir) {
+        if (IsDiskMode()) return false;
+        Clear();
+        const TString root(dir);
+        NIndex::TByteBuffer manifestBytes;
+        if (!TBinaryReader::LoadFile(NIndex::TSegmentStore::ManifestPath(root).CStr(), &manifestBytes)) return false;
+        TBinaryReader manifest(manifestBytes);
+        uint64_t coreHash = 0;
+        TVector<uint64_t> deltaHashes;
+        TVector<uint64_t> segmentHashes;
+        if (!ReadManifestHead(manifest, &coreHash, &deltaHashes, &segmentHashes)) return false;
+
+        NIndex::TByteBuffer bytes;
+        if (!LoadSegmentFile(root, coreHash, &bytes)) return Fail();
+        TBinaryReader core(bytes);
+        if (!LoadCore(core) || !core.AtEnd()) return Fail();
+        for (size_t i = 0; i < deltaHashes.Size(); ++i) {
+            if (!LoadSegmentFile(root, deltaHashes[i], &bytes)) return Fail();
+            TBinaryReader delta(bytes);
+            if (!LoadCoreDelta(delta) || !delta.AtEnd()) return Fail();
+        }
+        if (segmentHashes.Size() != GetDocSegmentCount()) return Fail();
+        for (size_t segment = 0; segment < segmentHashes.Size(); ++segment) {
+            if (!LoadSegmentFile(root, segmentHashes[segment], &bytes)) return Fail();
+            TBinaryReader reader(bytes);
+            if (!LoadDocSegment(reader, segment) || !reader.AtEnd()) return Fail();
+        }
+        AppliedLsn_ = manifest.ReadVarint();
+        if (!LoadDeleted(manifest) || !manifest.AtEnd()) return Fail();
+
+        CoreHash_ = coreHash;
+        for (size_t i = 0; i < deltaHashes.Size(); ++i) {
+            CoreDeltas_.PushBack(TCoreDeltaRef{nullptr, deltaHashes[i]});
+        }
+        DocSegmentHash_.Swap(segmentHashes);
+        BuildImpactsIfNeeded();
+        return true;
+    }
+
+    /**
+     * Прогрев после загрузки образа: параллельно читает по странице из постингов,
+     * длин документов, фильтра словаря, биграмм и хранилища текстов, чтобы первые
+     * запросы не платили за page fault. Возвращает число прочитанных страниц.
+     */
+    size_t Warmup(size_t threads = 0) const {
+        NCollections::TMemoryWarmer warmer;
+        Engine_.AddWarmupRanges(warmer);
+        Bigrams_.AddWarmupRanges(warmer);
+        Passages_.AddWarmupRanges(warmer);
+        Rhymes_.AddWarmupRanges(warmer);
+        for (auto it = RawDocs_.begin(); it != RawDocs_.end(); ++it) {
+            warmer.AddContainer(it.Value());
+        }
+        for (auto it = CompressedDocs_.begin(); it != CompressedDocs_.end(); ++it) {
+            warmer.AddContainer(it.Value());
+        }
+        return warmer.Run(threads);
+    }
+
+    size_t ToExternalId(TDocId docId) const {
+        return docId < ExternalIdOf_.Size() ? ExternalIdOf_[docId] : static_cast<size_t>(docId);
+    }
+
+    bool ToInternalId(size_t externalId, TDocId* docId) const {
+        if (externalId >= InternalIdOf_.Size()) return false;
+        *docId = InternalIdOf_[externalId];
+        return true;
+    }
+
+    void Clear() {
+        Engine_.Clear();
+        RawDocs_.Clear();
+        CompressedDocs_.Clear();
+        Titles_.Clear();
+        ExternalIdOf_.Clear();
+        InternalIdOf_.Clear();
+        Duplicates_.Clear();
+        DuplicateGroupOf_.Clear();
+        Bigrams_.Clear();
+        Deleted_.Clear();
+        DeletedCount_ = 0;
+        AppliedLsn_ = 0;
+        InvalidateCore();
+        DocSegmentHash_.Clear();
+        DocSegmentImage_.Clear();
+        CloseDocStore();
+        ExternalKeys_.Clear();
+        Fields_.Clear();
+        Passages_.Clear();
+        Rhymes_.Clear();
+        Phonetic_.Clear();
+        DiskIndex_.Close();
+        ResetDiskBuilder();
+    }
+
+    const NIndex::TSearchEngine& GetEngine() const { return Engine_; }
+
+private:
+    static constexpr uint32_t FILE_MAGIC = 0x42445349; // "ISDB"
+    static constexpr uint32_t FILE_VERSION = 11;
+    static constexpr uint32_t MANIFEST_MAGIC = 0x464D5349; // "ISMF"
+    static constexpr uint32_t DELTA_MAGIC = 0x4C445349; // "ISDL"
+    static constexpr size_t MAX_CORE_DELTAS = 16;
+    static constexpr unsigned char DELTA_GROUP = 1;
+    static constexpr unsigned char DELTA_PASSAGES = 2;
+    static constexpr unsigned char DELTA_RHYMES = 4;
+    static constexpr size_t DOC_SEGMENT_SIZE = 4096;
+    static constexpr unsigned char SEGMENT_RAW = 1;
+    static constexpr unsigned char SEGMENT_COMPRESSED = 2;
+    static constexpr unsigned char SEGMENT_TITLE = 4;
+    static constexpr unsigned char SEGMENT_KEY = 8;
+    static constexpr unsigned char SEGMENT_FIELDS = 16;
+    static constexpr unsigned char SEGMENT_ALIASES = 32;
+    static constexpr uint32_t DOC_STORE_MAGIC = 0x53445349; // "ISDS"
+    static constexpr size_t DOC_STORE_HEADER = 5;
+    static constexpr size_t DOC_STORE_FOOTER = 12;
+
+    static constexpr unsigned char WAL_ADD = 1;
+    static constexpr unsigned char WAL_ADD_TERMS = 2;
+    static constexpr unsigned char WAL_DELETE = 3;
+    static constexpr unsigned char WAL_ADD_KEYED = 4;
+    static constexpr unsigned char WAL_ADD_FIELDS = 5;
+    static constexpr size_t REPLAY_BATCH = 4096;
+    static constexpr size_t MIN_DOCS_PER_THREAD = 64;
+    static constexpr size_t PHRASE_FETCH_BATCH = 256;
+
+    /**
+     * Документы, добавленные после последнего снимка ядра (см. CaptureSegments): словарь
+     * дельты и по документу — номера термов в словаре, группа дубликата, разбиение
+     * на фрагменты и рифмы строк. Копится, только пока есть поколение ядра: файл снимка
+     * (CoreHash_) или образ в памяти (CoreImage_).
+     */
+    struct TCoreDelta {
+        TUnorderedMap<TString, size_t, TStringHash> TermIds;
+        TVector<TString> Terms;
+        TBinaryWriter Docs;
+        size_t DocCount = 0;
+
+        void Clear() {
+            TermIds.Clear();
+            Terms.Clear();
+            Docs.TakeBuffer();
+            DocCount = 0;
+        }
+    };
+
+    /**
+     * Замороженная дельта: после FreezeDelta не меняется и делится с потоком записи.
+     */
+    struct TFrozenDelta {
+        size_t FirstId = 0;
+        size_t DocCount = 0;
+        TVector<TString> Terms;
+        NIndex::TByteBuffer Docs;
+    };
+
+    /**
+     * Дельта поколения ядра: объект (нет после LoadIncremental) и хеш файла в каталоге снимков (0 — нет).
+     */
+    struct TCoreDeltaRef {
+        std::shared_ptr<const TFrozenDelta> Delta;
+        uint64_t Hash = 0;
     };
 
-    TSearchDatabase() : TSearchDatabase(TOptions()) {}
+    static void WritePipelineOptions(TBinaryWriter& writer, const NIndex::TTextPipeline::TOptions& options) {
+        writer.WriteU8(options.LowerCase ? 1 : 0);
+        writer.WriteU8(options.UseStemming ? 1 : 0);
+        writer.WriteU8(options.UseLemmatization ? 1 : 0);
+        writer.WriteU8(options.SkipPunctuation ? 1 : 0);
+        writer.WriteU8(options.SkipNumbers ? 1 : 0);
+        writer.WriteVarint(options.MinTokenLength);
+        writer.WriteVarint(options.MaxTokenLength);
+        writer.WriteU8(static_cast<unsigned char>(options.Stopwords));
+    }
+
+    static bool SamePipelineOptions(TBinaryReader& reader, const NIndex::TTextPipeline::TOptions& options) {
+        TBinaryWriter expected;
+        WritePipelineOptions(expected, options);
+        const NIndex::TByteBuffer& bytes = expected.GetBuffer();
+        bool same = true;
+        for (size_t i = 0; i < bytes.Size(); ++i) {
+            same = reader.ReadU8() == bytes[i] && same;
+        }
+        return same && reader.Ok();
+    }
+
+    bool Fail() {
+        Clear();
+        return false;
+    }
+
+    NIndex::TScoringRequest MakeScoringRequest(size_t topK) const {
+        NIndex::TScoringRequest request;
+        request.Scorer = Options_.Scorer;
+        request.TopK = topK;
+        request.Deleted = DeletedCount_ > 0 ? &Deleted_ : nullptr;
+        return request;
+    }
+
+    /**
+     * Образ в формате Save из неизменяемых частей по shared_ptr. Ядро сериализуется здесь,
+     * только если образа текущего поколения ещё нет (после Seal, Prune или MAX_CORE_DELTAS
+     * дельт); добавленное с прошлого снимка замораживается дельтой, которую сериализует поток
+     * записи; образы сегментов хранилища переиспользуются, изменившиеся собираются здесь.
+     * Образы ядра и сегментов остаются в памяти до следующего снимка. false — не прочитались
+     * тексты из файлового хранилища.
+     */
+    bool CaptureImage(const TString& path, NIndex::TSnapshotWriter::TFile* image) {
+        FreezeDelta();
+        bool deltasInMemory = true;
+        for (size_t i = 0; i < CoreDeltas_.Size(); ++i) {
+            deltasInMemory = deltasInMemory && CoreDeltas_[i].Delta;
+        }
+        if (!CoreImage_ || !deltasInMemory || CoreDeltas_.Size() > MAX_CORE_DELTAS) {
+            InvalidateCore();
+            TBinaryWriter core;
+            SaveCore(core);
+            CoreImage_ = std::make_shared<const NIndex::TByteBuffer>(core.TakeBuffer());
+        }
+        while (DocSegmentImage_.Size() < GetDocSegmentCount()) {
+            DocSegmentImage_.PushBack(nullptr);
+        }
+        for (size_t segment = 0; segment < DocSegmentImage_.Size(); ++segment) {
+            if (DocSegmentImage_[segment]) continue;
+            TBinaryWriter writer;
+            if (!SaveDocSegment(writer, segment)) return false;
+            DocSegmentImage_[segment] = std::make_shared<const NIndex::TByteBuffer>(writer.TakeBuffer());
+        }
+
+        image->Path = path;
+        image->Parts.Clear();
+        image->Parts.PushBack(NIndex::TSnapshotWriter::TPart(CoreImage_));
+        TBinaryWriter count;
+        count.WriteVarint(CoreDeltas_.Size());
+        image->Parts.PushBack(NIndex::TSnapshotWriter::TPart(std::make_shared<const NIndex::TByteBuffer>(count.TakeBuffer())));
+        for (size_t i = 0; i < CoreDeltas_.Size(); ++i) {
+            image->Parts.PushBack(NIndex::TSnapshotWriter::TPart(CoreDeltas_[i].Delta,
+                [](const void* source, TBinaryWriter& writer) {
+                    SaveCoreDelta(writer, *static_cast<const TFrozenDelta*>(source));
+                }));
+        }
+        for (size_t segment = 0; segment < DocSegmentImage_.Size(); ++segment) {
+            image->Parts.PushBack(NIndex::TSnapshotWriter::TPart(DocSegmentImage_[segment]));
+        }
+        TBinaryWriter tail;
+        tail.WriteVarint(AppliedLsn_);
+        SaveDeleted(tail);
+        image->Parts.PushBack(NIndex::TSnapshotWriter::TPart(std::make_shared<const NIndex::TByteBuffer>(tail.TakeBuffer())));
+        return true;
+    }
+
+    static NIndex::TSnapshotWriter::TOptions MakeSnapshotOptions(size_t bytesPerSecond) {
+        NIndex::TSnapshotWriter::TOptions options;
+        options.BytesPerSecond = bytesPerSecond;
+        return options;
+    }
+
+    /**
+     * Ядро образа: заголовок, индекс и всё, что зависит от внутренних id.
+     */
+    void SaveCore(TBinaryWriter& writer) const {
+        writer.WriteU32(FILE_MAGIC);
+        writer.WriteU32(FILE_VERSION);
+        WritePipelineOptions(writer, Options_.Pipeline);
+        writer.WriteU8(Options_.StoreDocuments ? 1 : 0);
+        writer.WriteU8(Options_.CompressDocuments ? 1 : 0);
+        writer.WriteU8(Options_.StoreTitles ? 1 : 0);
+        Fields_.SaveSchema(writer);
+
+        Engine_.Save(writer);
+        for (size_t i = 0; i < ExternalIdOf_.Size(); ++i) {
+            writer.WriteVarint(ExternalIdOf_[i]);
+        }
+        Duplicates_.Save(writer);
+        writer.WriteVarint(DuplicateGroupOf_.Size());
+        for (size_t i = 0; i < DuplicateGroupOf_.Size(); ++i) {
+            writer.WriteVarint(DuplicateGroupOf_[i]);
+        }
+        Bigrams_.Save(writer);
+        Passages_.Save(writer);
+        Rhymes_.Save(writer);
+    }
+
+    bool LoadCore(TBinaryReader& reader) {
+        if (reader.ReadU32() != FILE_MAGIC || reader.ReadU32() != FILE_VERSION) return false;
+        if (!SamePipelineOptions(reader, Options_.Pipeline)) return false;
+        Options_.StoreDocuments = reader.ReadU8() != 0;
+        Options_.CompressDocuments = reader.ReadU8() != 0;
+        Options_.StoreTitles = reader.ReadU8() != 0;
+        if (!Fields_.LoadSchema(reader)) return false;
+        Options_.StoredFields = Fields_.GetSchema();
+
+        if (!reader.Ok() || !Engine_.Load(reader)) return false;
+        size_t n = Engine_.GetDocumentCount();
+        ExternalIdOf_.Resize(n);
+        InternalIdOf_.Resize(n);
+        for (size_t docId = 0; docId < n && reader.Ok(); ++docId) {
+            size_t externalId = static_cast<size_t>(reader.ReadVarint());
+            if (externalId >= n) return false;
+            ExternalIdOf_[docId] = externalId;
+            InternalIdOf_[externalId] = static_cast<TDocId>(docId);
+        }
+
+        if (!Duplicates_.Load(reader)) return false;
+        size_t count = reader.ReadCount();
+        if (count != 0 && count != n) return false;
+        for (size_t i = 0; i < count && reader.Ok(); ++i) {
+            DuplicateGroupOf_.PushBack(static_cast<size_t>(reader.ReadVarint()));
+        }
+        if (!Bigrams_.Load(reader, n) || !Passages_.Load(reader, n) || !Rhymes_.Load(reader, n)) return false;
+        Options_.Passages = Passages_.GetUnit();
+        Options_.RhymeIndex = Rhymes_.IsEnabled();
+        BuildPhoneticIfNeeded();
+        return reader.Ok();
+    }
+
+    /**
+     * Дельта ядра: первый внешний id, число документов, словарь дельты, затем документы
+     * в формате RecordDelta. Внутренние id новых документов идут подряд за ядром.
+     * Не трогает базу, поэтому вызывается и из потока записи снимка.
+     */
+    static void SaveCoreDelta(TBinaryWriter& writer, const TFrozenDelta& delta) {
+        writer.WriteU32(DELTA_MAGIC);
+        writer.WriteU32(FILE_VERSION);
+        writer.WriteVarint(delta.FirstId);
+        writer.WriteVarint(delta.DocCount);
+        writer.WriteVarint(delta.Terms.Size());
+        for (size_t i = 0; i < delta.Terms.Size(); ++i) {
+            writer.WriteString(delta.Terms[i]);
+        }
+        writer.WriteRaw(delta.Docs.Data(), delta.Docs.Size());
+    }
+
+    /**
+     * Доливает документы дельты в индекс тем же путём, что и добавление, но без проверки
+     * дубликатов: группа записана, а удаления применяются позже из манифеста.
+     */
+    bool LoadCoreDelta(TBinaryReader& reader) {
+        if (reader.ReadU32() != DELTA_MAGIC || reader.ReadU32() != FILE_VERSION) return false;
+        if (reader.ReadVarint() != InternalIdOf_.Size()) return false;
+        const size_t count = reader.ReadCount(2);
+        TVector<TString> dictionary(reader.ReadCount());
+        for (size_t i = 0; i < dictionary.Size() && reader.Ok(); ++i) {
+            dictionary[i] = reader.ReadString();
+        }
+        const bool groups = Options_.Duplicates != EDuplicatePolicy::Keep;
+        TVector<TString> terms;
+        for (size_t doc = 0; doc < count && reader.Ok(); ++doc) {
+            const size_t externalId = InternalIdOf_.Size();
+            terms.Clear();
+            const size_t termCount = reader.ReadCount();
+            for (size_t i = 0; i < termCount && reader.Ok(); ++i) {
+                const size_t term = static_cast<size_t>(reader.ReadVarint());
+                if (term >= dictionary.Size()) return false;
+                terms.PushBack(dictionary[term]);
+            }
+            const unsigned char flags = reader.ReadU8();
+            TDuplicateCheck duplicate;
+            if (flags & DELTA_GROUP) {
+                duplicate.Group = static_cast<size_t>(reader.ReadVarint());
+                if (duplicate.Group > externalId) return false;
+                duplicate.IsDuplicate = duplicate.Group != externalId;
+            }
+            if (groups != ((flags & DELTA_GROUP) != 0)) return false;
+            if (groups) duplicate.Signature = NIndex::TNearDuplicateIndex::ComputeSignature(terms.begin(), terms.end());
+
+            const TDocId docId = Engine_.AddDocumentTerms(terms.begin(), terms.end());
+            if (Options_.PhraseBigrams) {
+                Bigrams_.AddDocument(docId, terms.begin(), terms.end());
+            }
+            RegisterDoc(docId, duplicate, nullptr, nullptr);
+            if (flags & DELTA_PASSAGES) {
+                if (!Passages_.IsEnabled()) return false;
+                NIndex::TPassageIndex::TTokenized tokens;
+                const size_t spans = reader.ReadCount(5);
+                size_t previousEnd = 0;
+                for (size_t i = 0; i < spans && reader.Ok(); ++i) {
+                    NIndex::TPassageIndex::TSpan span;
+                    span.Begin = static_cast<uint32_t>(reader.ReadVarint());
+                    span.End = span.Begin + static_cast<uint32_t>(reader.ReadVarint());
+                    span.FirstLine = static_cast<uint32_t>(reader.ReadVarint());
+                    span.LineCount = static_cast<uint32_t>(reader.ReadVarint());
+                    const size_t end = static_cast<size_t>(reader.ReadVarint());
+                    if (end < previousEnd || end > terms.Size()) return false;
+                    previousEnd = end;
+                    tokens.Spans.PushBack(span);
+                    tokens.TermEnds.PushBack(end);
+                }
+                tokens.Terms = terms;
+                if (!Passages_.AddDocument(static_cast<TDocId>(externalId), tokens)) return false;
+            }
+            if (flags & DELTA_RHYMES) {
+                if (!Rhymes_.IsEnabled()) return false;
+                TVector<NIndex::TRhymeIndex::TLineRhyme> lines(reader.ReadCount(2));
+                for (size_t i = 0; i < lines.Size() && reader.Ok(); ++i) {
+                    lines[i].Line = static_cast<uint32_t>(reader.ReadVarint());
+                    lines[i].Signature = reader.ReadString();
+                }
+                Rhymes_.AddDocument(docId, lines);
+            }
+        }
+        return reader.Ok();
+    }
+
+    size_t GetDocSegmentCount() const {
+        return (InternalIdOf_.Size() + DOC_SEGMENT_SIZE - 1) / DOC_SEGMENT_SIZE;
+    }
+
+    /**
+     * Сегмент хранилища: тексты, заголовки, внешние ключи с псевдонимами и поля документов с внешними id
+     * [segment * DOC_SEGMENT_SIZE, (segment + 1) * DOC_SEGMENT_SIZE). Ключ — внешний id,
+     * поэтому перенумерация в Seal() сегменты не меняет. false — тексты сегмента
+     * не прочитались из файлового хранилища.
+     */
+    bool SaveDocSegment(TBinaryWriter& writer, size_t segment) const {
+        const size_t begin = segment * DOC_SEGMENT_SIZE;
+        TVector<TStoredDoc> docs;
+        TVector<NIndex::TByteBuffer> buffers;
+        if (!CollectStoredDocs(segment, &docs, &buffers)) return false;
+        TVector<unsigned char> masks(docs.Size(), 0);
+        size_t count = 0;
+        for (size_t i = 0; i < docs.Size(); ++i) {
+            if (docs[i].Present) masks[i] |= docs[i].Compressed ? SEGMENT_COMPRESSED : SEGMENT_RAW;
+            if (Titles_.Contains(InternalIdOf_[begin + i])) masks[i] |= SEGMENT_TITLE;
+            if (!ExternalKeys_.Get(begin + i).Empty()) masks[i] |= SEGMENT_KEY;
+            if (ExternalKeys_.GetAliases(begin + i)) masks[i] |= SEGMENT_ALIASES;
+            size_t rowSize = 0;
+            Fields_.GetRow(begin + i, &rowSize);
+            if (rowSize > 0 && !Deleted_.Test(InternalIdOf_[begin + i])) masks[i] |= SEGMENT_FIELDS;
+            count += masks[i] != 0 ? 1 : 0;
+        }
+        writer.WriteVarint(count);
+        for (size_t i = 0; i < docs.Size(); ++i) {
+            if (masks[i] == 0) continue;
+            writer.WriteVarint(i);
+            writer.WriteU8(masks[i]);
+            if (docs[i].Present) writer.WriteBytes(docs[i].Data, docs[i].Size);
+            if (masks[i] & SEGMENT_TITLE) writer.WriteString(Titles_.Find(InternalIdOf_[begin + i]).Value());
+            if (masks[i] & SEGMENT_KEY) writer.WriteString(ExternalKeys_.Get(begin + i));
+            if (masks[i] & SEGMENT_ALIASES) {
+                const TVector<TString>& aliases = *ExternalKeys_.GetAliases(begin + i);
+                writer.WriteVarint(aliases.Size());
+                for (size_t a = 0; a < aliases.Size(); ++a) {
+                    writer.WriteString(aliases[a]);
+                }
+            }
+            if (masks[i] & SEGMENT_FIELDS) {
+                size_t rowSize = 0;
+                const unsigned char* row = Fields_.GetRow(begin + i, &rowSize);
+                writer.WriteBytes(row, rowSize);
+            }
+        }
+        return true;
+    }
+
+    bool LoadDocSegment(TBinaryReader& reader, size_t segment) {
+        const size_t begin = segment * DOC_SEGMENT_SIZE;
+        const size_t size = InternalIdOf_.Size() - begin < DOC_SEGMENT_SIZE ? InternalIdOf_.Size() - begin : DOC_SEGMENT_SIZE;
+        size_t count = reader.ReadCount(2);
+        for (size_t i = 0; i < count && reader.Ok(); ++i) {
+            size_t offset = static_cast<size_t>(reader.ReadVarint());
+            unsigned char mask = reader.ReadU8();
+            if (offset >= size) return false;
+            const TDocId docId = InternalIdOf_[begin + offset];
+            if (mask & SEGMENT_RAW) RawDocs_.Insert(docId, reader.ReadString());
+            if (mask & SEGMENT_COMPRESSED) CompressedDocs_.Insert(docId, reader.ReadBytes());
+            if (mask & SEGMENT_TITLE) Titles_.Insert(docId, reader.ReadString());
+            if ((mask & SEGMENT_KEY) && !ExternalKeys_.Set(begin + offset, reader.ReadString())) return false;
+            if (mask & SEGMENT_ALIASES) {
+                size_t aliases = reader.ReadCount(1);
+                for (size_t a = 0; a < aliases && reader.Ok(); ++a) {
+                    ExternalKeys_.AddAlias(begin + offset, reader.ReadString());
+                }
+            }
+            if (mask & SEGMENT_FIELDS) {
+                NIndex::TByteBuffer row = reader.ReadBytes();
+                if (!Fields_.SetRow(begin + offset, row.Data(), row.Size())) return false;
+            }
+        }
+        return reader.Ok();
+    }
+
+    struct TDocStoreEntry {
+        uint64_t Offset = 0;
+        size_t Size = 0;
+        bool Present = false;
+    };
+
+    /**
+     * Сохранённые байты текста: указывают в память базы или в buffers CollectStoredDocs.
+     */
+    struct TStoredDoc {
+        const unsigned char* Data = nullptr;
+        size_t Size = 0;
+        bool Compressed = false;
+        bool Present = false;
+    };
+
+    const TDocStoreEntry* FindStored(TDocId docId) const {
+        if (DocStoreEntries_.Empty()) return nullptr;
+        const size_t externalId = ToExternalId(docId);
+        if (externalId >= DocStoreEntries_.Size() || !DocStoreEntries_[externalId].Present) return nullptr;
+        return &DocStoreEntries_[externalId];
+    }
+
+    /**
+     * Тексты сегмента по порядку внешних id, как они хранятся (без распаковки): из памяти
+     * или одним пакетом чтений из файлового хранилища. false — чтение хранилища не удалось.
+     */
+    bool CollectStoredDocs(size_t segment, TVector<TStoredDoc>* docs, TVector<NIndex::TByteBuffer>* buffers) const {
+        const size_t begin = segment * DOC_SEGMENT_SIZE;
+        const size_t end = begin + DOC_SEGMENT_SIZE < InternalIdOf_.Size() ? begin + DOC_SEGMENT_SIZE : InternalIdOf_.Size();
+        docs->Clear();
+        docs->Resize(end - begin);
+        TVector<NIndex::TAsyncReader::TRange> ranges;
+        TVector<size_t> slotOf;
+        for (size_t externalId = begin; externalId < end; ++externalId) {
+            const TDocId docId = InternalIdOf_[externalId];
+            TStoredDoc& doc = (*docs)[externalId - begin];
+            auto raw = RawDocs_.Find(docId);
+            auto compressed = CompressedDocs_.Find(docId);
+            if (raw != RawDocs_.end()) {
+                doc.Data = reinterpret_cast<const unsigned char*>(raw.Value().Data());
+                doc.Size = raw.Value().Size();
+                doc.Present = true;
+            } else if (compressed != CompressedDocs_.end()) {
+                doc.Data = compressed.Value().Data();
+                doc.Size = compressed.Value().Size();
+                doc.Compressed = doc.Present = true;
+            } else if (const TDocStoreEntry* entry = FindStored(docId)) {
+                ranges.PushBack(NIndex::TAsyncReader::TRange{entry->Offset, entry->Size});
+                slotOf.PushBack(externalId - begin);
+            }
+        }
+        buffers->Clear();
+        buffers->Resize(ranges.Size());
+        bool ok = DocStore_.ReadBatch(ranges, [buffers](size_t index, const unsigned char* data, size_t size) {
+            NIndex::TByteBuffer& buffer = (*buffers)[index];
+            buffer.Resize(size);
+            if (size > 0) std::memcpy(buffer.Data(), data, size);
+        });
+        for (size_t i = 0; i < ranges.Size(); ++i) {
+            TStoredDoc& doc = (*docs)[slotOf[i]];
+            doc.Data = (*buffers)[i].Data();
+            doc.Size = (*buffers)[i].Size();
+            doc.Compressed = DocStoreCompressed_;
+            doc.Present = (*buffers)[i].Size() == ranges[i].Size;
+        }
+        return ok;
+    }
+
+    bool ReadDocStoreRange(uint64_t offset, size_t size, NIndex::TByteBuffer* out) const {
+        TVector<NIndex::TAsyncReader::TRange> ranges(1, NIndex::TAsyncReader::TRange{offset, size});
+        out->Clear();
+        return DocStore_.ReadBatch(ranges, [out](size_t, const unsigned char* data, size_t count) {
+            out->Resize(count);
+            if (count > 0) std::memcpy(out->Data(), data, count);
+        }) && out->Size() == size;
+    }
+
+    /**
+     * Заголовок, хвост и таблица длин открытого хранилища; смещения восстанавливаются
+     * накопленной суммой длин. Записей не больше, чем документов в базе.
+     */
+    bool ReadDocStoreTable(TVector<TDocStoreEntry>* entries, bool* compressed) const {
+        const uint64_t fileSize = DocStore_.GetFileSize();
+        if (fileSize < DOC_STORE_HEADER + DOC_STORE_FOOTER) return false;
+        NIndex::TByteBuffer bytes;
+        if (!ReadDocStoreRange(0, DOC_STORE_HEADER, &bytes)) return false;
+        TBinaryReader header(bytes);
+        if (header.ReadU32() != DOC_STORE_MAGIC) return false;
+        *compressed = header.ReadU8() != 0;
+
+        if (!ReadDocStoreRange(fileSize - DOC_STORE_FOOTER, DOC_STORE_FOOTER, &bytes)) return false;
+        TBinaryReader footer(bytes);
+        const uint64_t tableOffset = footer.ReadU64();
+        if (footer.ReadU32() != DOC_STORE_MAGIC || !footer.Ok()) return false;
+        if (tableOffset < DOC_STORE_HEADER || tableOffset > fileSize - DOC_STORE_FOOTER) return false;
+
+        if (!ReadDocStoreRange(tableOffset, static_cast<size_t>(fileSize - DOC_STORE_FOOTER - tableOffset), &bytes)) return false;
+        TBinaryReader table(bytes);
+        const size_t count = table.ReadCount();
+        if (count > InternalIdOf_.Size()) return false;
+        entries->Resize(count);
+        uint64_t offset = DOC_STORE_HEADER;
+        for (size_t i = 0; i < count && table.Ok(); ++i) {
+            const uint64_t length = table.ReadVarint();
+            if (length == 0) continue;
+            TDocStoreEntry& entry = (*entries)[i];
+            entry.Offset = offset;
+            entry.Size = static_cast<size_t>(length - 1);
+            entry.Present = true;
+            offset += entry.Size;
+            if (offset > tableOffset) return false;
+        }
+        return table.AtEnd() && offset == tableOffset;
+    }
+
+    void SaveDeleted(TBinaryWriter& writer) const {
+        writer.WriteVarint(DeletedCount_);
+        TDocId prev = 0;
+        for (size_t docId = 0; docId < Deleted_.Size(); ++docId) {
+            if (Deleted_.Test(static_cast<TDocId>(docId))) {
+                writer.WriteVarint(docId - prev);
+                prev = static_cast<TDocId>(docId);
+            }
+        }
+    }
+
+    bool LoadDeleted(TBinaryReader& reader) {
+        const size_t n = Engine_.GetDocumentCount();
+        size_t count = reader.ReadCount();
+        TDocId docId = 0;
+        for (size_t i = 0; i < count && reader.Ok(); ++i) {
+            docId += static_cast<TDocId>(reader.ReadVarint());
+            if (docId >= n || Deleted_.Test(docId)) return false;
+            Deleted_.Set(docId);
+            Passages_.DeleteParent(static_cast<TDocId>(ToExternalId(docId)));
+        }
+        DeletedCount_ = count;
+        return reader.Ok();
+    }
+
+    void InvalidateCore() {
+        CoreHash_ = 0;
+        CoreImage_.reset();
+        CoreDeltas_.Clear();
+        Delta_.Clear();
+    }
 
-    explicit TSearchDatabase(const TOptions& options)
-        : Options_(options)
-        , Engine_(MakeEngineOptions(options))
-        , Lzw_()
-    {}
+    void InvalidateDocSegment(size_t externalId) {
+        size_t segment = externalId / DOC_SEGMENT_SIZE;
+        if (segment < DocSegmentHash_.Size()) {
+            DocSegmentHash_[segment] = 0;
+        }
+        if (segment < DocSegmentImage_.Size()) {
+            DocSegmentImage_[segment].reset();
+        }
+    }
 
-    TDocId AddDocument(const TString& content) {
-        return AddDocument(content, TString());
+    /**
+     * Переносит накопленные добавления в неизменяемую дельту поколения ядра.
+     */
+    void FreezeDelta() {
+        if (Delta_.DocCount == 0) return;
+        auto frozen = std::make_shared<TFrozenDelta>();
+        frozen->FirstId = InternalIdOf_.Size() - Delta_.DocCount;
+        frozen->DocCount = Delta_.DocCount;
+        frozen->Terms.Swap(Delta_.Terms);
+        frozen->Docs = Delta_.Docs.TakeBuffer();
+        Delta_.Clear();
+        CoreDeltas_.PushBack(TCoreDeltaRef{std::move(frozen), 0});
     }
 
-    TDocId AddDocument(const TString& content, const TString& title) {
-        TVector<TString> terms = Engine_.GetPipeline().Process(content);
-        TDocId docId = Engine_.AddDocumentTerms(terms.begin(), terms.end());
+    /**
+     * Снимает инкрементальный снимок в каталог dir: в files попадают только сегменты,
+     * которых там ещё нет, и последним — манифест. Сегмент с запомненным хешем
+     * не сериализуется вовсе, если его файл на месте. Файлы, на которые не ссылаются
+     * ни новый манифест, ни лежащий на диске, удаляются: старый снимок цел, пока не подменён.
+     * false — сегмент не собрался; тогда на диске ничего не трогается.
+     */
+    bool CaptureSegments(const TString& dir, TVector<NIndex::TSnapshotWriter::TFile>* files) {
+        if (!NIndex::TSegmentStore::EnsureDirectory(dir)) return false;
+        TUnorderedSet<uint64_t> referenced;
+        FreezeDelta();
+        bool deltasAvailable = true;
+        for (size_t i = 0; i < CoreDeltas_.Size(); ++i) {
+            deltasAvailable = deltasAvailable && (CoreDeltas_[i].Delta || SegmentExists(dir, CoreDeltas_[i].Hash));
+        }
+        if (!deltasAvailable || CoreDeltas_.Size() > MAX_CORE_DELTAS || (!CoreImage_ && !SegmentExists(dir, CoreHash_))) {
+            InvalidateCore();
+        }
+        if (CoreImage_ && !SegmentExists(dir, CoreHash_)) {
+            CoreHash_ = NIndex::TSegmentStore::ContentHash(*CoreImage_);
+            files->PushBack(NIndex::TSnapshotWriter::TFile(NIndex::TSegmentStore::SegmentPath(dir, CoreHash_), CoreImage_));
+            referenced.Insert(CoreHash_);
+        } else {
+            CaptureSegment(dir, &CoreHash_, referenced, files, [this](TBinaryWriter& writer) {
+                SaveCore(writer);
+                return true;
+            });
+        }
+        for (size_t i = 0; i < CoreDeltas_.Size(); ++i) {
+            const TFrozenDelta* delta = CoreDeltas_[i].Delta.get();
+            CaptureSegment(dir, &CoreDeltas_[i].Hash, referenced, files, [delta](TBinaryWriter& writer) {
+                SaveCoreDelta(writer, *delta);
+                return true;
+            });
+        }
+        while (DocSegmentHash_.Size() < GetDocSegmentCount()) {
+            DocSegmentHash_.PushBack(0);
+        }
+        for (size_t segment = 0; segment < DocSegmentHash_.Size(); ++segment) {
+            if (!CaptureSegment(dir, &DocSegmentHash_[segment], referenced, files,
+                    [this, segment](TBinaryWriter& writer) { return SaveDocSegment(writer, segment); })) {
+                return false;
+            }
+        }
 
-        if (Options_.StoreDocuments) {
-            StoreDoc(docId, content);
+        TBinaryWriter manifest;
+        manifest.WriteU32(MANIFEST_MAGIC);
+        manifest.WriteU32(FILE_VERSION);
+        manifest.WriteVarint(DOC_SEGMENT_SIZE);
+        manifest.WriteU64(CoreHash_);
+        manifest.WriteVarint(CoreDeltas_.Size());
+        for (size_t i = 0; i < CoreDeltas_.Size(); ++i) {
+            manifest.WriteU64(CoreDeltas_[i].Hash);
         }
-        if (Options_.StoreTitles && !title.Empty()) {
-            Titles_.Insert(docId, title);
+        manifest.WriteVarint(DocSegmentHash_.Size());
+        for (size_t segment = 0; segment < DocSegmentHash_.Size(); ++segment) {
+            manifest.WriteU64(DocSegmentHash_[segment]);
         }
-        return docId;
+        manifest.WriteVarint(AppliedLsn_);
+        SaveDeleted(manifest);
+
+        const TString manifestPath = NIndex::TSegmentStore::ManifestPath(dir);
+        NIndex::TByteBuffer previous;
+        if (TBinaryReader::LoadFile(manifestPath.CStr(), &previous)) {
+            TBinaryReader reader(previous);
+            uint64_t coreHash = 0;
+            TVector<uint64_t> deltaHashes;
+            TVector<uint64_t> segmentHashes;
+            if (ReadManifestHead(reader, &coreHash, &deltaHashes, &segmentHashes)) {
+                referenced.Insert(coreHash);
+                for (size_t i = 0; i < deltaHashes.Size(); ++i) {
+                    referenced.Insert(deltaHashes[i]);
+                }
+                for (size_t i = 0; i < segmentHashes.Size(); ++i) {
+                    referenced.Insert(segmentHashes[i]);
+                }
+            }
+        }
+        NIndex::TSegmentStore::RemoveUnreferenced(dir, referenced);
+        files->PushBack(NIndex::TSnapshotWriter::TFile(
+            manifestPath, std::make_shared<const NIndex::TByteBuffer>(manifest.TakeBuffer())));
+        return true;
     }
 
-    template <typename TermIt>
-    TDocId AddDocumentTerms(TermIt first, TermIt last) {
-        TDocId docId = Engine_.AddDocumentTerms(first, last);
-        return docId;
+    /**
+     * Сериализует сегмент, если файла с хешем *hash ещё нет, и обновляет *hash.
+     * false — save не смог собрать сегмент; *hash тогда сброшен.
+     */
+    template <typename TSaveFn>
+    static bool CaptureSegment(const TString& dir, uint64_t* hash, TUnorderedSet<uint64_t>& referenced,
+                               TVector<NIndex::TSnapshotWriter::TFile>* files, TSaveFn&& save) {
+        if (*hash != 0 && NIndex::TSegmentStore::Exists(NIndex::TSegmentStore::SegmentPath(dir, *hash))) {
+            referenced.Insert(*hash);
+            return true;
+        }
+        TBinaryWriter writer;
+        if (!save(writer)) {
+            *hash = 0;
+            return false;
+        }
+        auto data = std::make_shared<const NIndex::TByteBuffer>(writer.TakeBuffer());
+        *hash = NIndex::TSegmentStore::ContentHash(*data);
+        TString path = NIndex::TSegmentStore::SegmentPath(dir, *hash);
+        if (!referenced.Contains(*hash) && !NIndex::TSegmentStore::Exists(path)) {
+            files->PushBack(NIndex::TSnapshotWriter::TFile(path, std::move(data)));
+        }
+        referenced.Insert(*hash);
+        return true;
     }
 
-    template <typename TermIt>
-    TDocId AddDocumentTerms(TermIt first, TermIt last, const TString& content) {
-        TDocId docId = Engine_.AddDocumentTerms(first, last);
-        if (Options_.StoreDocuments) {
-            StoreDoc(docId, content);
+    static bool ReadManifestHead(TBinaryReader& reader, uint64_t* coreHash, TVector<uint64_t>* deltaHashes,
+                                 TVector<uint64_t>* segmentHashes) {
+        if (reader.ReadU32() != MANIFEST_MAGIC || reader.ReadU32() != FILE_VERSION) return false;
+        if (reader.ReadVarint() != DOC_SEGMENT_SIZE) return false;
+        *coreHash = reader.ReadU64();
+        size_t count = reader.ReadCount(8);
+        for (size_t i = 0; i < count && reader.Ok(); ++i) {
+            deltaHashes->PushBack(reader.ReadU64());
         }
-        return docId;
+        count = reader.ReadCount(8);
+        for (size_t i = 0; i < count && reader.Ok(); ++i) {
+            segmentHashes->PushBack(reader.ReadU64());
+        }
+        return reader.Ok();
     }
 
-    TVector<TTfIdf::TSearchResult> Search(const TString& query, size_t topK = 10) const {
-        return Engine_.Search(query, topK);
+    static bool SegmentExists(const TString& dir, uint64_t hash) {
+        return hash != 0 && NIndex::TSegmentStore::Exists(NIndex::TSegmentStore::SegmentPath(dir, hash));
     }
 
-    template <typename TermIt>
-    TVector<TTfIdf::TSearchResult> SearchTerms(TermIt first, TermIt last, size_t topK = 10) const {
-        return Engine_.SearchTerms(first, last, topK);
+    static bool LoadSegmentFile(const TString& dir, uint64_t hash, NIndex::TByteBuffer* bytes) {
+        return TBinaryReader::LoadFile(NIndex::TSegmentStore::SegmentPath(dir, hash).CStr(), bytes) &&
+               NIndex::TSegmentStore::ContentHash(*bytes) == hash;
     }
 
-    TPostingList BooleanAnd(const TVector<TString>& terms) const {
-        return Engine_.BooleanAnd(terms);
+    TPostingList DropDeleted(TPostingList&& docs) const {
+        if (DeletedCount_ == 0) return std::move(docs);
+        size_t kept = 0;
+        for (size_t i = 0; i < docs.Size(); ++i) {
+            if (!Deleted_.Test(docs[i])) {
+                docs[kept++] = docs[i];
+            }
+        }
+        docs.Resize(kept);
+        return std::move(docs);
     }
 
-    TPostingList BooleanOr(const TVector<TString>& terms) const {
-        return Engine_.BooleanOr(terms);
+    static TBinaryWriter EncodeAdd(const TString& content, const TString& title, const TString& key,
+                                   const TVector<TString>& fields) {
+        TBinaryWriter record;
+        record.WriteU8(!fields.Empty() ? WAL_ADD_FIELDS : !key.Empty() ? WAL_ADD_KEYED : WAL_ADD);
+        record.WriteString(content);
+        record.WriteString(title);
+        if (!key.Empty() || !fields.Empty()) record.WriteString(key);
+        if (!fields.Empty()) {
+            record.WriteVarint(fields.Size());
+            for (size_t i = 0; i < fields.Size(); ++i) {
+                record.WriteString(fields[i]);
+            }
+        }
+        return record;
     }
 
-    template <typename TermIt>
-    TPostingList BooleanAnd(TermIt first, TermIt last) const {
-        return Engine_.BooleanAnd(first, last);
+    /**
+     * Журналирует добавление до его применения; false — запись не легла на диск,
+     * и документ не добавляется (иначе он жил бы только в памяти).
+     */
+    bool LogAdd(const TString& content, const TString& title, const TString& key, const TVector<TString>& fields,
+                uint64_t* lsn) {
+        if (!Wal_.IsOpen()) return true;
+        *lsn = Wal_.Append(EncodeAdd(content, title, key, fields));
+        return Wal_.Commit(*lsn);
     }
 
     template <typename TermIt>
-    TPostingList BooleanOr(TermIt first, TermIt last) const {
-        return Engine_.BooleanOr(first, last);
+    bool LogAddTerms(TermIt first, TermIt last, const TString* content, uint64_t* lsn) {
+        if (!Wal_.IsOpen()) return true;
+        TBinaryWriter record;
+        record.WriteU8(WAL_ADD_TERMS);
+        record.WriteU8(content ? 1 : 0);
+        if (content) record.WriteString(*content);
+        size_t count = 0;
+        for (TermIt it = first; it != last; ++it) ++count;
+        record.WriteVarint(count);
+        for (TermIt it = first; it != last; ++it) {
+            record.WriteString(TString(*it));
+        }
+        *lsn = Wal_.Append(record);
+        return Wal_.Commit(*lsn);
     }
 
-    TPostingList BooleanQuery(const TString& query) const {
-        TVector<TString> tokens = TokenizeBooleanQuery(query);
-        TVector<TString> rpn = ToRpn(tokens);
-        return EvalRpn(rpn);
+    void MarkApplied(uint64_t lsn) {
+        if (lsn > AppliedLsn_) AppliedLsn_ = lsn;
     }
 
-    TString GetDocument(TDocId docId) const {
-        if (!Options_.StoreDocuments) {
-            return TString();
+    struct TReplayBatch {
+        TVector<TString> Contents;
+        TVector<TString> Titles;
+        TVector<TString> Keys;
+        TVector<TVector<TString>> Fields;
+    };
+
+    void FlushReplay(TReplayBatch& batch) {
+        ApplyAdds(batch.Contents, batch.Titles, batch.Keys, batch.Fields, 0);
+        batch.Contents.Clear();
+        batch.Titles.Clear();
+        batch.Keys.Clear();
+        batch.Fields.Clear();
+    }
+
+    /**
+     * Применяет одну запись журнала. Подряд идущие добавления текста копятся в batch
+     * и уходят в ApplyAdds пакетами, чтобы восстановление шло параллельным конвейером.
+     */
+    bool Replay(TBinaryReader reader, TReplayBatch& batch) {
+        unsigned char op = reader.ReadU8();
+        if (op == WAL_ADD || op == WAL_ADD_KEYED || op == WAL_ADD_FIELDS) {
+            batch.Contents.PushBack(reader.ReadString());
+            batch.Titles.PushBack(reader.ReadString());
+            batch.Keys.PushBack(op != WAL_ADD ? reader.ReadString() : TString());
+            batch.Fields.PushBack(TVector<TString>());
+            if (op == WAL_ADD_FIELDS) {
+                size_t count = reader.ReadCount();
+                for (size_t i = 0; i < count && reader.Ok(); ++i) {
+                    batch.Fields.Back().PushBack(reader.ReadString());
+                }
+            }
+            if (batch.Contents.Size() >= REPLAY_BATCH) {
+                FlushReplay(batch);
+            }
+            return reader.Ok() && reader.AtEnd();
         }
-        if (Options_.CompressDocuments) {
-            auto it = CompressedDocs_.Find(docId);
-            if (it == CompressedDocs_.end()) {
-                return TString();
+
+        FlushReplay(batch);
+        if (op == WAL_ADD_TERMS) {
+            bool hasContent = reader.ReadU8() != 0;
+            TString content = hasContent ? reader.ReadString() : TString();
+            size_t count = reader.ReadCount();
+            TVector<TString> terms;
+            terms.Reserve(count);
+            for (size_t i = 0; i < count && reader.Ok(); ++i) {
+                terms.PushBack(reader.ReadString());
             }
-            return Lzw_.Decompress(it.Value());
+            if (!reader.Ok() || !reader.AtEnd()) return false;
+            AddProcessed(terms.begin(), terms.end(), hasContent ? &content : nullptr, nullptr);
+            return true;
         }
-        auto it = RawDocs_.Find(docId);
-        if (it == RawDocs_.end()) {
-            return TString();
+        if (op == WAL_DELETE) {
+            TDocId docId;
+            size_t externalId = static_cast<size_t>(reader.ReadVarint());
+            if (!reader.Ok() || !reader.AtEnd() || !ToInternalId(externalId, &docId)) return false;
+            if (!Deleted_.Test(docId)) ApplyDelete(docId);
+            return true;
         }
-        return it.Value();
+        return false;
     }
 
-    TString GetTitle(TDocId docId) const {
-        if (!Options_.StoreTitles) {
-            return TString();
+    /**
+     * Параллельная часть пакетной загрузки: разбор текста и сжатие. Потоки берут
+     * непрерывные куски пакета, результаты лежат по индексу документа.
+     */
+    TVector<TDocId> ApplyAdds(const TVector<TString>& contents, const TVector<TString>& titles,
+                              const TVector<TString>& keys, const TVector<TVector<TString>>& fields, size_t threads) {
+        const size_t n = contents.Size();
+        TVector<TPreparedDoc> docs(n);
+        const bool compress = Options_.StoreDocuments && Options_.CompressDocuments;
+        TVector<NLzw::TLzw::TBytes> compressed(compress ? n : 0);
+
+        auto prepare = [&](size_t from, size_t to) {
+            for (size_t i = from; i < to; ++i) {
+                docs[i] = Prepare(contents[i]);
+                if (compress) {
+                    compressed[i] = Lzw_.Compress(contents[i]);
+                }
+            }
+        };
+
+        if (threads == 0) threads = Options_.IngestThreads;
+        if (threads == 0) threads = std::thread::hardware_concurrency();
+        if (threads > n / MIN_DOCS_PER_THREAD) threads = n / MIN_DOCS_PER_THREAD;
+        if (threads <= 1) {
+            prepare(0, n);
+        } else {
+            TVector<std::thread> workers;
+            workers.Reserve(threads);
+            for (size_t t = 0; t < threads; ++t) {
+                workers.PushBack(std::thread(prepare, n * t / threads, n * (t + 1) / threads));
+            }
+            for (size_t t = 0; t < workers.Size(); ++t) {
+                workers[t].join();
+            }
         }
-        auto it = Titles_.Find(docId);
-        if (it == Titles_.end()) {
-            return TString();
+
+        TVector<TDocId> docIds;
+        docIds.Reserve(n);
+        const TString none;
+        for (size_t i = 0; i < n; ++i) {
+            const TString& title = i < titles.Size() ? titles[i] : none;
+            const TString& key = i < keys.Size() ? keys[i] : none;
+            docIds.PushBack(AddProcessed(docs[i].Tokens.Terms.begin(), docs[i].Tokens.Terms.end(), &contents[i], &title,
+                compress ? &compressed[i] : nullptr, &key, i < fields.Size() ? &fields[i] : nullptr, &docs[i]));
         }
-        return it.Value();
+        return docIds;
     }
 
-    size_t GetDocumentCount() const { return Engine_.GetDocumentCount(); }
-    size_t GetTermCount() const { return Engine_.GetTermCount(); }
+    void ApplyDelete(TDocId docId) {
+        InvalidateDocSegment(ToExternalId(docId));
+        Deleted_.Set(docId);
+        ++DeletedCount_;
+        RawDocs_.Erase(docId);
+        CompressedDocs_.Erase(docId);
+        Titles_.Erase(docId);
+        const size_t externalId = ToExternalId(docId);
+        Passages_.DeleteParent(static_cast<TDocId>(externalId));
+        if (externalId < DocStoreEntries_.Size()) {
+            DocStoreEntries_[externalId].Present = false;
+        }
+    }
 
-    void Clear() {
-        Engine_.Clear();
-        RawDocs_.Clear();
-        CompressedDocs_.Clear();
-        Titles_.Clear();
+    /**
+     * Ранжирование по индексу в памяти или, в дисковом режиме, по постингам, прочитанным
+     * одним пакетом через TBufferPool. Ошибку чтения отмечает в ok.
+     */
+    NIndex::TScoringResult Score(const TVector<TString>& terms, const NIndex::TScoringRequest& request, bool* ok) const {
+        if (!IsDiskMode()) return Engine_.ScoreTerms(terms, request);
+        NIndex::TScoringResult result;
+        if (!DiskIndex_.Score(terms, request, &result) && ok) *ok = false;
+        return result;
     }
 
-    const NIndex::TSearchEngine& GetEngine() const { return Engine_; }
+    /**
+     * Отмечает в ok, что постинги с диска не прочитаны; запрос тогда отвечает пустым списком.
+     */
+    static TPostingList ReadFailed(bool* ok) {
+        if (ok) *ok = false;
+        return TPostingList();
+    }
+
+    template <typename TermIt>
+    static TVector<TString> ToTerms(TermIt first, TermIt last) {
+        TVector<TString> terms;
+        for (TermIt it = first; it != last; ++it) {
+            terms.PushBack(TString(*it));
+        }
+        return terms;
+    }
+
+    /**
+     * Дисковый индекс после Seal неизменяем: новые документы в него не попадут.
+     */
+    bool AcceptsAdds() const {
+        return !IsDiskMode() || DiskBuilder_;
+    }
+
+    void ResetDiskBuilder() {
+        DiskBuilder_.reset();
+        if (IsDiskMode()) {
+            DiskBuilder_.reset(new NIndex::TDiskIndexBuilder(Options_.DiskIndexPath, Options_.DiskBuildMemoryBytes));
+        }
+    }
+
+    bool SealDisk() {
+        if (!DiskBuilder_) return DiskIndex_.IsOpen();
+        const bool built = DiskBuilder_->Finish();
+        DiskBuilder_.reset();
+        if (!built || !DiskIndex_.Open(Options_.DiskIndexPath.CStr(), Options_.DiskCache)) return false;
+        BuildPhoneticIfNeeded();
+        return true;
+    }
+
+    TVector<TTfIdf::TSearchResult> Rank(const TString& query, size_t topK, bool* ok) const {
+        return Score(Engine_.GetPipeline().Process(query), MakeScoringRequest(topK), ok).Hits;
+    }
+
+    void BuildPhoneticIfNeeded() {
+        if (!Options_.PhoneticIndex) return;
+        if (IsDiskMode()) {
+            Phonetic_.Clear();
+            DiskIndex_.ForEachTerm([&](const TString& term, size_t) { Phonetic_.Add(term); });
+            return;
+        }
+        Phonetic_.Build(Engine_.GetIndex());
+    }
+
+    void BuildImpactsIfNeeded() {
+        if (Options_.Scorer == NIndex::EScorer::Impact) {
+            Engine_.BuildImpacts();
+            if (Passages_.IsEnabled()) Passages_.BuildImpacts();
+        }
+    }
+
+    /**
+     * Разбор документа до вставки в индекс: термы (с индексом фрагментов — заодно границы
+     * строк/строф) и рифменные подписи строк.
+     */
+    struct TPreparedDoc {
+        NIndex::TPassageIndex::TTokenized Tokens;
+        TVector<NIndex::TRhymeIndex::TLineRhyme> Rhymes;
+    };
+
+    TPreparedDoc Prepare(const TString& content) const {
+        TPreparedDoc doc;
+        doc.Tokens = NIndex::TPassageIndex::Tokenize(Engine_.GetPipeline(), content, Options_.Passages);
+        if (Options_.RhymeIndex) {
+            doc.Rhymes = NIndex::TRhymeIndex::Extract(content);
+        }
+        return doc;
+    }
+
+    TVector<TPassageResult> ToPassageResults(const TVector<NIndex::TPassageIndex::THit>& hits) const {
+        TVector<TPassageResult> results(hits.Size());
+        TVector<TDocId> docIds(hits.Size());
+        for (size_t i = 0; i < hits.Size(); ++i) {
+            docIds[i] = InternalIdOf_[hits[i].Parent];
+        }
+        TVector<TString> documents = GetDocuments(docIds);
+        for (size_t i = 0; i < hits.Size(); ++i) {
+            results[i].DocId = docIds[i];
+            results[i].PassageId = hits[i].Passage;
+            results[i].Score = hits[i].Score;
+            results[i].Span = Passages_.GetSpan(hits[i].Passage);
+            results[i].Text = Passages_.GetText(hits[i].Passage, documents[i]);
+        }
+        return results;
+    }
 
-private:
     static NIndex::TSearchEngine::TOptions MakeEngineOptions(const TOptions& options) {
         NIndex::TSearchEngine::TOptions e;
         e.PipelineOptions = options.Pipeline;
         return e;
     }
 
+    struct TDuplicateCheck {
+        NIndex::TNearDuplicateIndex::TSignature Signature = 0;
+        size_t Group = 0;
+        bool IsDuplicate = false;
+    };
+
+    template <typename TermIt>
+    TDocId AddProcessed(TermIt first, TermIt last, const TString* content, const TString* title,
+                        NLzw::TLzw::TBytes* compressed = nullptr, const TString* key = nullptr,
+                        const TVector<TString>* fields = nullptr,
+                        const TPreparedDoc* prepared = nullptr) {
+        TDuplicateCheck duplicate = CheckDuplicate(first, last);
+        if (duplicate.IsDuplicate && Options_.Duplicates == EDuplicatePolicy::Skip &&
+            !Deleted_.Test(InternalIdOf_[duplicate.Group])) {
+            // Ключ пропущенного документа ведёт к оставшемуся.
+            if (key && ExternalKeys_.AddAlias(duplicate.Group, *key)) {
+                InvalidateDocSegment(duplicate.Group);
+            }
+            return InternalIdOf_[duplicate.Group];
+        }
+
+        TDocId docId = DiskBuilder_ ? DiskBuilder_->AddDocument(first, last) : Engine_.AddDocumentTerms(first, last);
+        if (Options_.PhraseBigrams) {
+            Bigrams_.AddDocument(docId, first, last);
+        }
+        if (compressed && Options_.StoreDocuments && Options_.CompressDocuments) {
+            CompressedDocs_.Insert(docId, std::move(*compressed));
+        } else if (content && Options_.StoreDocuments) {
+            StoreDoc(docId, *content);
+        }
+        if (title && Options_.StoreTitles && !title->Empty()) {
+            Titles_.Insert(docId, *title);
+        }
+        RegisterDoc(docId, duplicate, key, fields);
+        if (prepared && Passages_.IsEnabled()) {
+            Passages_.AddDocument(static_cast<TDocId>(ToExternalId(docId)), prepared->Tokens);
+        }
+        if (prepared && Rhymes_.IsEnabled()) {
+            Rhymes_.AddDocument(docId, prepared->Rhymes);
+        }
+        if (CoreHash_ != 0 || CoreImage_) {
+            RecordDelta(first, last, prepared);
+        }
+        return docId;
+    }
+
+    template <typename TermIt>
+    TDuplicateCheck CheckDuplicate(TermIt first, TermIt last) const {
+        TDuplicateCheck check;
+        if (Options_.Duplicates == EDuplicatePolicy::Keep) {
+            return check;
+        }
+        check.Signature = NIndex::TNearDuplicateIndex::ComputeSignature(first, last);
+        check.IsDuplicate = Duplicates_.Find(check.Signature, &check.Group);
+        return check;
+    }
+
+    void RegisterDoc(TDocId docId, const TDuplicateCheck& duplicate, const TString* key,
+                     const TVector<TString>* fields) {
+        size_t externalId = InternalIdOf_.Size();
+        ExternalIdOf_.PushBack(externalId);
+        InternalIdOf_.PushBack(docId);
+        if (key && !key->Empty()) {
+            ExternalKeys_.Set(externalId, *key);
+        }
+        if (fields && !fields->Empty()) {
+            Fields_.Set(externalId, *fields);
+        }
+        InvalidateDocSegment(externalId);
+
+        if (Options_.Duplicates != EDuplicatePolicy::Keep) {
+            size_t group = duplicate.IsDuplicate ? duplicate.Group : externalId;
+            DuplicateGroupOf_.PushBack(group);
+            Duplicates_.Add(duplicate.Signature, group);
+        }
+    }
+
+    template <typename TermIt>
+    void RecordDelta(TermIt first, TermIt last, const TPreparedDoc* prepared) {
+        TBinaryWriter& writer = Delta_.Docs;
+        writer.WriteVarint(static_cast<uint64_t>(std::distance(first, last)));
+        for (TermIt it = first; it != last; ++it) {
+            auto found = Delta_.TermIds.Find(*it);
+            if (found != Delta_.TermIds.end()) {
+                writer.WriteVarint(found.Value());
+                continue;
+            }
+            writer.WriteVarint(Delta_.Terms.Size());
+            Delta_.TermIds.Insert(*it, Delta_.Terms.Size());
+            Delta_.Terms.PushBack(*it);
+        }
+        const bool group = Options_.Duplicates != EDuplicatePolicy::Keep;
+        const bool passages = prepared && Passages_.IsEnabled();
+        const bool rhymes = prepared && Rhymes_.IsEnabled();
+        writer.WriteU8((group ? DELTA_GROUP : 0) | (passages ? DELTA_PASSAGES : 0) | (rhymes ? DELTA_RHYMES : 0));
+        if (group) writer.WriteVarint(DuplicateGroupOf_.Back());
+        if (passages) {
+            const NIndex::TPassageIndex::TTokenized& tokens = prepared->Tokens;
+            writer.WriteVarint(tokens.Spans.Size());
+            for (size_t i = 0; i < tokens.Spans.Size(); ++i) {
+                writer.WriteVarint(tokens.Spans[i].Begin);
+                writer.WriteVarint(tokens.Spans[i].End - tokens.Spans[i].Begin);
+                writer.WriteVarint(tokens.Spans[i].FirstLine);
+                writer.WriteVarint(tokens.Spans[i].LineCount);
+                writer.WriteVarint(tokens.TermEnds[i]);
+            }
+        }
+        if (rhymes) {
+            writer.WriteVarint(prepared->Rhymes.Size());
+            for (size_t i = 0; i < prepared->Rhymes.Size(); ++i) {
+                writer.WriteVarint(prepared->Rhymes[i].Line);
+                writer.WriteString(prepared->Rhymes[i].Signature);
+            }
+        }
+        ++Delta_.DocCount;
+    }
+
+    template <typename T>
+    static void Permute(TVector<T>& values, const TVector<TDocId>& newIdOf) {
+        if (values.Empty()) return;
+        TVector<T> permuted(values.Size());
+        for (size_t oldId = 0; oldId < values.Size(); ++oldId) {
+            permuted[newIdOf[oldId]] = std::move(values[oldId]);
+        }
+        values.Swap(permuted);
+    }
+
+    template <typename V>
+    static void RemapKeys(TUnorderedMap<TDocId, V>& map, const TVector<TDocId>& newIdOf) {
+        TUnorderedMap<TDocId, V> remapped(map.Size() * 2);
+        for (auto it = map.begin(); it != map.end(); ++it) {
+            remapped.Insert(TDocId(newIdOf[it.Key()]), std::move(it.Value()));
+        }
+        map.Swap(remapped);
+    }
+
     void StoreDoc(TDocId docId, const TString& content) {
         if (Options_.CompressDocuments) {
             CompressedDocs_.Insert(docId, Lzw_.Compress(content));
@@ -157,6 +2136,96 @@ private:
         }
     }
 
+    TPostingList MatchPhrase(const TString& phrase, bool* ok) const {
+        TVector<TString> terms = Engine_.GetPipeline().Process(phrase);
+        if (terms.Empty()) return TPostingList();
+        const NIndex::TInvertedIndex& index = Engine_.GetIndex();
+        if (terms.Size() == 1) {
+            if (!IsDiskMode()) return TPostingList(index.GetPostingList(terms[0]));
+            TPostingList docs;
+            return DiskIndex_.GetPostingList(terms[0], &docs) ? docs : ReadFailed(ok);
+        }
+
+        TVector<const TPostingList*> lists;
+        TVector<bool> covered(terms.Size(), false);
+        size_t pairs = 0;
+        for (size_t i = 0; i + 1 < terms.Size(); ++i) {
+            const TPostingList* pair = Bigrams_.Find(terms[i], terms[i + 1]);
+            if (!pair) continue;
+            lists.PushBack(pair);
+            covered[i] = covered[i + 1] = true;
+            ++pairs;
+        }
+        TVector<TString> uncovered;
+        for (size_t i = 0; i < terms.Size(); ++i) {
+            if (!covered[i]) {
+                uncovered.PushBack(terms[i]);
+            }
+        }
+        TVector<NIndex::TTermPostings> fetched;
+        if (IsDiskMode() && !DiskIndex_.FetchTerms(uncovered, &fetched)) return ReadFailed(ok);
+        for (size_t i = 0; i < uncovered.Size(); ++i) {
+            lists.PushBack(IsDiskMode() ? &fetched[i].Docs : &index.GetPostingList(uncovered[i]));
+        }
+
+        TPostingList candidates = IntersectAll(lists);
+        if (terms.Size() == 2 && pairs == 1) return candidates;
+        if (!Options_.StoreDocuments) return candidates;
+
+        TPostingList verified;
+        TVector<TDocId> batch;
+        for (size_t begin = 0; begin < candidates.Size(); begin += PHRASE_FETCH_BATCH) {
+            batch.Clear();
+            for (size_t i = begin; i < candidates.Size() && i < begin + PHRASE_FETCH_BATCH; ++i) {
+                batch.PushBack(candidates[i]);
+            }
+            TVector<TString> documents = GetDocuments(batch);
+            for (size_t i = 0; i < batch.Size(); ++i) {
+                TVector<TString> docTerms = Engine_.GetPipeline().Process(documents[i]);
+                if (ContainsSequence(docTerms, terms)) {
+                    verified.PushBack(batch[i]);
+                }
+            }
+        }
+        return verified;
+    }
+
+    static constexpr char PHRASE_QUOTE = '"';
+    static constexpr const char* RHYME_PREFIX = "rhyme:";
+    static constexpr size_t RHYME_PREFIX_SIZE = 6;
+    static constexpr const char* SOUND_PREFIX = "sound:";
+    static constexpr size_t SOUND_PREFIX_SIZE = 6;
+
+    /**
+     * Пересечение от коротких списков к длинным: промежуточный результат не больше самого короткого.
+     */
+    static TPostingList IntersectAll(TVector<const TPostingList*>& lists) {
+        for (size_t i = 0; i < lists.Size(); ++i) {
+            for (size_t j = i + 1; j < lists.Size(); ++j) {
+                if (lists[j]->Size() < lists[i]->Size()) {
+                    const TPostingList* tmp = lists[i];
+                    lists[i] = lists[j];
+                    lists[j] = tmp;
+                }
+            }
+        }
+        TPostingList result(*lists[0]);
+        for (size_t i = 1; i < lists.Size() && !result.Empty(); ++i) {
+            result = TPostingOps::Intersect(result, *lists[i]);
+        }
+        return result;
+    }
+
+    static bool ContainsSequence(const TVector<TString>& text, const TVector<TString>& phrase) {
+        if (phrase.Size() > text.Size()) return false;
+        for (size_t start = 0; start + phrase.Size() <= text.Size(); ++start) {
+            size_t k = 0;
+            while (k < phrase.Size() && text[start + k] == phrase[k]) ++k;
+            if (k == phrase.Size()) return true;
+        }
+        return false;
+    }
+
     static bool IsWs(char c) {
         return c == ' ' || c == '\t' || c == '\n' || c == '\r';
     }
@@ -185,6 +2254,18 @@ private:
                 tokens.PushBack(TString(1, c));
                 continue;
             }
+            if (c == PHRASE_QUOTE) {
+                if (!cur.Empty()) {
+                    tokens.PushBack(cur);
+                    cur.Clear();
+                }
+                TString phrase(1, PHRASE_QUOTE);
+                for (++i; i < query.Size() && query[i] != PHRASE_QUOTE; ++i) {
+                    phrase.PushBack(query[i]);
+                }
+                tokens.PushBack(phrase);
+                continue;
+            }
             cur.PushBack(c);
         }
         if (!cur.Empty()) {
@@ -193,6 +2274,18 @@ private:
         return tokens;
     }
 
+    static bool IsPhrase(const TString& t) {
+        return !t.Empty() && t[0] == PHRASE_QUOTE;
+    }
+
+    static bool IsRhyme(const TString& t) {
+        return t.Size() > RHYME_PREFIX_SIZE && std::memcmp(t.Data(), RHYME_PREFIX, RHYME_PREFIX_SIZE) == 0;
+    }
+
+    static bool IsSound(const TString& t) {
+        return t.Size() > SOUND_PREFIX_SIZE && std::memcmp(t.Data(), SOUND_PREFIX, SOUND_PREFIX_SIZE) == 0;
+    }
+
     static bool IsOp(const TString& t) {
         return t == "and" || t == "or" || t == "not" || t == "AND" || t == "OR" || t == "NOT";
     }
@@ -245,6 +2338,11 @@ private:
                 continue;
             }
 
+            if (IsPhrase(tok) || IsRhyme(tok) || IsSound(tok)) {
+                out.PushBack(tok);
+                continue;
+            }
+
             out.PushBack(Engine_.GetPipeline().NormalizeTerm(tok));
         }
 
@@ -258,95 +2356,204 @@ private:
         return out;
     }
 
-    static TPostingList Intersect(const TPostingList& a, const TPostingList& b) {
+    TPostingList NotList(const TPostingList& a) const {
         TPostingList r;
+        size_t n = GetDocumentCount();
         size_t i = 0;
-        size_t j = 0;
-        while (i < a.Size() && j < b.Size()) {
-            if (a[i] == b[j]) {
-                r.PushBack(a[i]);
-                ++i;
-                ++j;
-            } else if (a[i] < b[j]) {
+        for (size_t doc = 0; doc < n; ++doc) {
+            if (i < a.Size() && a[i] == doc) {
                 ++i;
             } else {
-                ++j;
+                r.PushBack(static_cast<TDocId>(doc));
             }
         }
         return r;
     }
 
-    static TPostingList Union(const TPostingList& a, const TPostingList& b) {
-        TPostingList r;
-        size_t i = 0;
-        size_t j = 0;
-        while (i < a.Size() && j < b.Size()) {
-            if (a[i] == b[j]) {
-                r.PushBack(a[i]);
-                ++i;
-                ++j;
-            } else if (a[i] < b[j]) {
-                r.PushBack(a[i]);
-                ++i;
+    /**
+     * Операнд RPN-стека. Цепочка OR не вычисляется попарно: списки копятся в операнде
+     * и объединяются одним k-way слиянием, когда результат действительно нужен.
+     * Borrowed указывает на постинги индекса (со скетчами), Owned хранит промежуточные результаты.
+     */
+    struct TRpnOperand {
+        TVector<const NIndex::TTermPostings*> Borrowed;
+        TVector<TPostingList> Owned;
+
+        void Append(TRpnOperand&& other) {
+            for (size_t i = 0; i < other.Borrowed.Size(); ++i) {
+                Borrowed.PushBack(other.Borrowed[i]);
+            }
+            for (size_t i = 0; i < other.Owned.Size(); ++i) {
+                Owned.PushBack(std::move(other.Owned[i]));
+            }
+        }
+
+        size_t ListCount() const { return Borrowed.Size() + Owned.Size(); }
+
+        /**
+         * Оценка размера объединения: скетчи для постингов индекса, длины для промежуточных списков.
+         */
+        size_t EstimateSize(const NIndex::TInvertedIndex& index) const {
+            size_t estimate = 0;
+            if (NIndex::TInvertedIndex::HasSketches(Borrowed)) {
+                estimate = index.EstimateUnion(Borrowed);
             } else {
-                r.PushBack(b[j]);
-                ++j;
+                for (size_t i = 0; i < Borrowed.Size(); ++i) {
+                    estimate += Borrowed[i]->Docs.Size();
+                }
+            }
+            for (size_t i = 0; i < Owned.Size(); ++i) {
+                estimate += Owned[i].Size();
             }
+            return estimate;
         }
-        while (i < a.Size()) {
-            r.PushBack(a[i]);
-            ++i;
+
+        TVector<const TPostingList*> Lists() const {
+            TVector<const TPostingList*> lists;
+            lists.Reserve(ListCount());
+            for (size_t i = 0; i < Borrowed.Size(); ++i) {
+                lists.PushBack(&Borrowed[i]->Docs);
+            }
+            for (size_t i = 0; i < Owned.Size(); ++i) {
+                lists.PushBack(&Owned[i]);
+            }
+            return lists;
         }
-        while (j < b.Size()) {
-            r.PushBack(b[j]);
-            ++j;
+
+        TPostingList Materialize(const NIndex::TInvertedIndex& index) const {
+            if (Owned.Empty() && Borrowed.Size() == 1) {
+                return TPostingList(Borrowed[0]->Docs);
+            }
+            if (Borrowed.Empty() && Owned.Size() == 1) {
+                return Owned[0];
+            }
+            return TPostingOps::UnionMany(Lists(), EstimateSize(index));
         }
-        return r;
+
+        static TRpnOperand FromList(TPostingList&& list) {
+            TRpnOperand op;
+            op.Owned.PushBack(std::move(list));
+            return op;
+        }
+    };
+
+    /**
+     * Во сколько раз оценка OR-цепочки должна превышать второй операнд AND,
+     * чтобы AND раскладывался по членам цепочки: (a OR b) AND c = (a AND c) OR (b AND c).
+     */
+    static constexpr size_t DISTRIBUTE_RATIO = 8;
+
+    /**
+     * AND двух операндов. Если один из них — длинная OR-цепочка, а другой заметно меньше
+     * оценки её объединения, объединение не строится: короткий список галопом
+     * пересекается с каждым членом цепочки, и объединяются уже маленькие результаты.
+     */
+    TPostingList EvalAnd(const TRpnOperand& a, const TRpnOperand& b) const {
+        const NIndex::TInvertedIndex& index = Engine_.GetIndex();
+        size_t estimateA = a.EstimateSize(index);
+        size_t estimateB = b.EstimateSize(index);
+        const TRpnOperand& chain = estimateA >= estimateB ? a : b;
+        const TRpnOperand& other = estimateA >= estimateB ? b : a;
+        size_t chainEstimate = estimateA >= estimateB ? estimateA : estimateB;
+
+        TPostingList filter = other.Materialize(index);
+        if (chain.ListCount() < 2 || filter.Size() * DISTRIBUTE_RATIO > chainEstimate) {
+            return TPostingOps::Intersect(chain.Materialize(index), filter);
+        }
+
+        TVector<const TPostingList*> members = chain.Lists();
+        TVector<TPostingList> parts;
+        parts.Reserve(members.Size());
+        for (size_t i = 0; i < members.Size(); ++i) {
+            parts.PushBack(TPostingOps::Intersect(filter, *members[i]));
+        }
+        TVector<const TPostingList*> partLists;
+        for (size_t i = 0; i < parts.Size(); ++i) {
+            partLists.PushBack(&parts[i]);
+        }
+        return TPostingOps::UnionMany(partLists);
     }
 
-    TPostingList NotList(const TPostingList& a) const {
-        TPostingList r;
-        size_t n = Engine_.GetDocumentCount();
-        size_t i = 0;
-        for (size_t doc = 0; doc < n; ++doc) {
-            if (i < a.Size() && a[i] == doc) {
-                ++i;
-            } else {
-                r.PushBack(doc);
-            }
+    /**
+     * Термы словаря с фонетическим кодом слова из токена sound:слово; nullptr — таких нет.
+     */
+    const TVector<TString>* SoundTerms(const TString& tok) const {
+        TString word(tok.Data() + SOUND_PREFIX_SIZE, tok.Size() - SOUND_PREFIX_SIZE);
+        return Phonetic_.FindTerms(Engine_.GetPipeline().NormalizeTerm(word));
+    }
+
+    /**
+     * Постинги всех термов словаря с фонетическим кодом слова — без копирования:
+     * объединяет их UnionMany при материализации, в AND они раскладываются как OR-цепочка.
+     * В дисковом режиме постинги берутся из пакета fetched начиная с *leaf.
+     */
+    TRpnOperand SoundOperand(const TString& tok, const TVector<NIndex::TTermPostings>& fetched, size_t* leaf) const {
+        TRpnOperand op;
+        const TVector<TString>* terms = SoundTerms(tok);
+        for (size_t i = 0; terms && i < terms->Size(); ++i) {
+            op.Borrowed.PushBack(IsDiskMode() ? &fetched[(*leaf)++] : &Engine_.GetIndex().GetTermPostings((*terms)[i]));
         }
-        return r;
+        return op;
     }
 
-    TPostingList EvalRpn(const TVector<TString>& rpn) const {
-        TVector<TPostingList> st;
+    /**
+     * В дисковом режиме постинги всех термов-листьев (и термов sound:) читаются заранее одним пакетом.
+     */
+    TPostingList EvalRpn(const TVector<TString>& rpn, bool* ok) const {
+        const NIndex::TInvertedIndex& index = Engine_.GetIndex();
+        TVector<NIndex::TTermPostings> fetched;
+        if (IsDiskMode()) {
+            TVector<TString> leaves;
+            for (size_t i = 0; i < rpn.Size(); ++i) {
+                if (IsSound(rpn[i])) {
+                    const TVector<TString>* terms = SoundTerms(rpn[i]);
+                    for (size_t t = 0; terms && t < terms->Size(); ++t) leaves.PushBack((*terms)[t]);
+                } else if (!IsOp(rpn[i]) && !IsPhrase(rpn[i]) && !IsRhyme(rpn[i])) {
+                    leaves.PushBack(rpn[i]);
+                }
+            }
+            if (!DiskIndex_.FetchTerms(leaves, &fetched)) return ReadFailed(ok);
+        }
+        size_t leaf = 0;
+        TVector<TRpnOperand> st;
         for (size_t i = 0; i < rpn.Size(); ++i) {
             const TString& tok = rpn[i];
             if (IsOp(tok)) {
                 if (tok == "not" || tok == "NOT") {
                     if (st.Empty()) return TPostingList();
-                    TPostingList a = st.Back();
-                    st.PopBack();
-                    st.PushBack(NotList(a));
+                    TPostingList a = st.Back().Materialize(index);
+                    st.Back() = TRpnOperand::FromList(NotList(a));
                     continue;
                 }
                 if (st.Size() < 2) return TPostingList();
-                TPostingList b = st.Back();
-                st.PopBack();
-                TPostingList a = st.Back();
+                TRpnOperand b = std::move(st.Back());
                 st.PopBack();
                 if (tok == "and" || tok == "AND") {
-                    st.PushBack(Intersect(a, b));
+                    st.Back() = TRpnOperand::FromList(EvalAnd(st.Back(), b));
                 } else {
-                    st.PushBack(Union(a, b));
+                    st.Back().Append(std::move(b));
                 }
                 continue;
             }
-            const TPostingList& pl = Engine_.GetIndex().GetPostingList(tok);
-            st.PushBack(TPostingList(pl));
+            if (IsPhrase(tok)) {
+                st.PushBack(TRpnOperand::FromList(MatchPhrase(TString(tok.Data() + 1, tok.Size() - 1), ok)));
+                continue;
+            }
+            if (IsRhyme(tok)) {
+                TString word(tok.Data() + RHYME_PREFIX_SIZE, tok.Size() - RHYME_PREFIX_SIZE);
+                st.PushBack(TRpnOperand::FromList(Rhymes_.FindDocuments(word)));
+                continue;
+            }
+            if (IsSound(tok)) {
+                st.PushBack(SoundOperand(tok, fetched, &leaf));
+                continue;
+            }
+            TRpnOperand operand;
+            operand.Borrowed.PushBack(IsDiskMode() ? &fetched[leaf++] : &index.GetTermPostings(tok));
+            st.PushBack(std::move(operand));
         }
-        if (st.Empty()) return TPostingList();
-        return st.Back();
+        if (st.Empty() || (ok && !*ok)) return TPostingList();
+        return st.Back().Materialize(index);
     }
 
 private:
@@ -357,6 +2564,34 @@ private:
     TUnorderedMap<TDocId, TString> RawDocs_;
     TUnorderedMap<TDocId, NLzw::TLzw::TBytes> CompressedDocs_;
     TUnorderedMap<TDocId, TString> Titles_;
+    TVector<size_t> ExternalIdOf_;
+    TVector<TDocId> InternalIdOf_;
+    NIndex::TNearDuplicateIndex Duplicates_;
+    TVector<size_t> DuplicateGroupOf_;
+    NIndex::TBigramIndex Bigrams_;
+    NIndex::TPassageIndex Passages_;
+    NIndex::TRhymeIndex Rhymes_;
+    NIndex::TPhoneticIndex Phonetic_;
+    NIndex::TDiskIndex DiskIndex_;
+    std::unique_ptr<NIndex::TDiskIndexBuilder> DiskBuilder_;
+
+    NIndex::TDocBitset Deleted_;
+    size_t DeletedCount_ = 0;
+    NIndex::TWriteAheadLog Wal_;
+    TString SnapshotPath_;
+    uint64_t AppliedLsn_ = 0;
+    NIndex::TSnapshotWriter Snapshot_;
+    uint64_t CoreHash_ = 0;
+    std::shared_ptr<const NIndex::TByteBuffer> CoreImage_;
+    TVector<TCoreDeltaRef> CoreDeltas_;
+    TCoreDelta Delta_;
+    TVector<uint64_t> DocSegmentHash_;
+    TVector<std::shared_ptr<const NIndex::TByteBuffer>> DocSegmentImage_;
+    mutable NIndex::TAsyncReader DocStore_;
+    TVector<TDocStoreEntry> DocStoreEntries_;
+    bool DocStoreCompressed_ = false;
+    NIndex::TExternalKeyMap ExternalKeys_;
+    NIndex::TStoredFields Fields_;
 };
 
 } // namespace NSearchSystem
@@ -2,7 +2,17 @@
 
 #include <gtest/gtest.h>
 
+#include <cstdio>
+#include <string>
+
+#include <csignal>
+#include <dirent.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 using NSearchSystem::TSearchDatabase;
+using NSearchSystem::TStaticPruner;
 using NTypes::TString;
 using NCollections::TVector;
 
@@ -51,6 +61,22 @@ TEST(TSearchDatabase, BooleanQueryOrNot) {
     EXPECT_EQ(r[1], 1);
 }
 
+TEST(TSearchDatabase, BooleanQueryOrChain) {
+    TSearchDatabase db;
+    db.AddDocument(TString("red apple"));
+    db.AddDocument(TString("green apple"));
+    db.AddDocument(TString("red banana"));
+    db.AddDocument(TString("yellow lemon"));
+    db.AddDocument(TString("blue sky"));
+
+    auto r = db.BooleanQuery(TString("lemon OR sky OR banana OR (green AND apple)"));
+    ASSERT_EQ(r.Size(), 4);
+    EXPECT_EQ(r[0], 1);
+    EXPECT_EQ(r[1], 2);
+    EXPECT_EQ(r[2], 3);
+    EXPECT_EQ(r[3], 4);
+}
+
 TEST(TSearchDatabase, AddDocumentTermsIterator) {
     TSearchDatabase db;
     TVector<TString> terms;
@@ -61,3 +87,1113 @@ TEST(TSearchDatabase, AddDocumentTermsIterator) {
 }
 
 
+
+TEST(TSearchDatabase, SealReordersConsistently) {
+    TSearchDatabase db;
+    db.AddDocument(TString("ocean wave salt shore"), TString("a"));
+    db.AddDocument(TString("forest pine moss fern"), TString("b"));
+    db.AddDocument(TString("ocean wave salt tide"), TString("c"));
+    db.AddDocument(TString("forest pine moss oak"), TString("d"));
+
+    db.Seal();
+
+    for (size_t external = 0; external < 4; ++external) {
+        NIndex::TDocId internal = 0;
+        ASSERT_TRUE(db.ToInternalId(external, &internal));
+        EXPECT_EQ(db.ToExternalId(internal), external);
+    }
+
+    NIndex::TDocId a = 0, b = 0, c = 0, d = 0;
+    ASSERT_TRUE(db.ToInternalId(0, &a));
+    ASSERT_TRUE(db.ToInternalId(1, &b));
+    ASSERT_TRUE(db.ToInternalId(2, &c));
+    ASSERT_TRUE(db.ToInternalId(3, &d));
+    EXPECT_EQ(db.GetTitle(a), TString("a"));
+    EXPECT_EQ(db.GetDocument(c), TString("ocean wave salt tide"));
+    EXPECT_EQ(db.GetTitle(d), TString("d"));
+
+    auto ocean = db.BooleanQuery(TString("ocean"));
+    ASSERT_EQ(ocean.Size(), 2);
+    EXPECT_EQ(ocean[1], ocean[0] + 1);
+
+    auto tide = db.BooleanQuery(TString("tide"));
+    ASSERT_EQ(tide.Size(), 1);
+    EXPECT_EQ(tide[0], c);
+
+    auto added = db.AddDocument(TString("ocean breeze"));
+    EXPECT_EQ(db.ToExternalId(added), 4u);
+    EXPECT_EQ(db.BooleanQuery(TString("ocean")).Size(), 3);
+}
+
+TEST(TSearchDatabase, NearDuplicatesFlagged) {
+    TSearchDatabase::TOptions opts;
+    opts.Duplicates = TSearchDatabase::EDuplicatePolicy::Flag;
+    opts.CollapseDuplicates = true;
+    TSearchDatabase db(opts);
+
+    auto original = db.AddDocument(TString(
+        "shall i compare thee to a summers day thou art more lovely and more temperate "
+        "rough winds do shake the darling buds of may and summers lease hath all too short a date"));
+    auto reprint = db.AddDocument(TString(
+        "shall i compare thee to a summers day thou art more lovely and more temperate "
+        "rough winds do shake the darling buds of may and summers lease hath all too short a date!"));
+    auto other = db.AddDocument(TString("the raven quoth nevermore once upon a midnight dreary"));
+
+    EXPECT_EQ(db.GetDocumentCount(), 3);
+    EXPECT_FALSE(db.IsDuplicate(original));
+    EXPECT_TRUE(db.IsDuplicate(reprint));
+    EXPECT_EQ(db.GetDuplicateGroup(reprint), db.ToExternalId(original));
+    EXPECT_FALSE(db.IsDuplicate(other));
+
+    auto r = db.Search(TString("summers day"), 10);
+    ASSERT_EQ(r.Size(), 1);
+}
+
+TEST(TSearchDatabase, NearDuplicatesSkipped) {
+    TSearchDatabase::TOptions opts;
+    opts.Duplicates = TSearchDatabase::EDuplicatePolicy::Skip;
+    TSearchDatabase db(opts);
+
+    auto first = db.AddDocument(TString("because i could not stop for death he kindly stopped for me"));
+    auto second = db.AddDocument(TString("Because I could not stop for Death, he kindly stopped for me."));
+
+    EXPECT_EQ(first, second);
+    EXPECT_EQ(db.GetDocumentCount(), 1);
+}
+
+TEST(TSearchDatabase, SkippedDuplicateKeyMapsToSurvivor) {
+    TSearchDatabase::TOptions opts;
+    opts.Duplicates = TSearchDatabase::EDuplicatePolicy::Skip;
+    TSearchDatabase db(opts);
+
+    auto kept = db.AddDocument(TString("hope is the thing with feathers that perches in the soul"), TString(), TString("row-1"));
+    auto skipped = db.AddDocument(TString("Hope is the thing with feathers, that perches in the soul."), TString(), TString("row-2"));
+    ASSERT_EQ(kept, skipped);
+    EXPECT_EQ(db.GetExternalKey(kept), TString("row-1"));
+    NIndex::TDocId found;
+    ASSERT_TRUE(db.FindByExternalKey(TString("row-2"), &found));
+    EXPECT_EQ(found, kept);
+
+    std::string path = ::testing::TempDir() + "skipped_key.idx";
+    ASSERT_TRUE(db.SaveToFile(path.c_str()));
+    TSearchDatabase loaded(opts);
+    ASSERT_TRUE(loaded.LoadFromFile(path.c_str()));
+    ASSERT_TRUE(loaded.FindByExternalKey(TString("row-2"), &found));
+    EXPECT_EQ(found, kept);
+    EXPECT_EQ(loaded.GetExternalKey(kept), TString("row-1"));
+    std::remove(path.c_str());
+}
+
+TEST(TSearchDatabase, PrunedImageServesFromFile) {
+    TSearchDatabase db;
+    db.AddDocument(TString("the sea the sea the restless sea"), TString("sea"));
+    db.AddDocument(TString("moon over quiet water and the sea"), TString("moon"));
+    db.AddDocument(TString("forest pine moss fern"), TString("forest"));
+    db.Seal();
+
+    TStaticPruner::TOptions options;
+    options.TopK = 1;
+    options.Epsilon = 1.0;
+    TStaticPruner::TReport report = db.Prune(options);
+    EXPECT_LT(report.PostingsAfter, report.PostingsBefore);
+
+    std::string path = ::testing::TempDir() + "pruned_image.idx";
+    ASSERT_TRUE(db.SaveToFile(path.c_str()));
+
+    TSearchDatabase loaded;
+    ASSERT_TRUE(loaded.LoadFromFile(path.c_str()));
+    EXPECT_EQ(loaded.GetDocumentCount(), 3u);
+
+    auto expected = db.Search(TString("sea"), 10);
+    auto actual = loaded.Search(TString("sea"), 10);
+    ASSERT_EQ(actual.Size(), expected.Size());
+    for (size_t i = 0; i < actual.Size(); ++i) {
+        EXPECT_EQ(loaded.ToExternalId(actual[i].DocId), db.ToExternalId(expected[i].DocId));
+        EXPECT_DOUBLE_EQ(actual[i].Score, expected[i].Score);
+    }
+
+    NIndex::TDocId forest = 0;
+    ASSERT_TRUE(loaded.ToInternalId(2, &forest));
+    EXPECT_EQ(loaded.GetTitle(forest), TString("forest"));
+    EXPECT_EQ(loaded.GetDocument(forest), TString("forest pine moss fern"));
+
+    TSearchDatabase::TOptions otherPipeline;
+    otherPipeline.Pipeline.UseStemming = false;
+    TSearchDatabase mismatched(otherPipeline);
+    EXPECT_FALSE(mismatched.LoadFromFile(path.c_str()));
+    std::remove(path.c_str());
+
+    size_t pages = loaded.Warmup(2);
+    EXPECT_GT(pages, 0u);
+    EXPECT_EQ(loaded.Search(TString("sea"), 10).Size(), expected.Size());
+}
+
+TEST(TSearchDatabase, PhraseQueryVerifiesAdjacency) {
+    TSearchDatabase db;
+    auto near = db.AddDocument(TString("roll on thou deep and dark blue ocean roll"));
+    auto apart = db.AddDocument(TString("the ocean is blue and the sky is dark"));
+
+    auto phrase = db.BooleanQuery(TString("\"blue ocean\""));
+    ASSERT_EQ(phrase.Size(), 1);
+    EXPECT_EQ(phrase[0], near);
+
+    auto both = db.BooleanQuery(TString("blue AND ocean"));
+    EXPECT_EQ(both.Size(), 2);
+
+    auto negated = db.BooleanQuery(TString("ocean AND NOT \"dark blue\""));
+    ASSERT_EQ(negated.Size(), 1);
+    EXPECT_EQ(negated[0], apart);
+}
+
+TEST(TSearchDatabase, PhraseBigramsSelectedAtSeal) {
+    TSearchDatabase::TOptions opts;
+    opts.PhraseBigrams = true;
+    opts.Bigrams.MinPairDocuments = 3;
+    opts.Bigrams.MinLogLikelihood = 1.0;
+    TSearchDatabase db(opts);
+
+    db.AddDocument(TString("my love is like a red red rose"));
+    db.AddDocument(TString("o my love my love is far away"));
+    db.AddDocument(TString("farewell my love the sea is wide"));
+    db.AddDocument(TString("love my country and the quiet sea"));
+    db.AddDocument(TString("the wind over the sea my heart"));
+    db.Seal();
+
+    EXPECT_GT(db.GetBigramCount(), 0u);
+
+    auto love = db.PhraseQuery(TString("my love"));
+    EXPECT_EQ(love.Size(), 3);
+    for (size_t i = 0; i + 1 < love.Size(); ++i) {
+        EXPECT_LT(love[i], love[i + 1]);
+    }
+
+    auto longer = db.PhraseQuery(TString("my love is"));
+    EXPECT_EQ(longer.Size(), 2);
+
+    auto added = db.AddDocument(TString("sing my love a song"));
+    EXPECT_EQ(db.PhraseQuery(TString("my love")).Size(), 4);
+    EXPECT_EQ(db.PhraseQuery(TString("my love")).Back(), added);
+}
+
+TEST(TSearchDatabase, AndDistributesOverLongOrChain) {
+    TSearchDatabase::TOptions opts;
+    opts.SketchMinDocFrequency = 10;
+    TSearchDatabase db(opts);
+    for (size_t i = 0; i < 200; ++i) {
+        TString text(i % 2 == 0 ? "river stone" : "mountain stone");
+        if (i % 50 == 0) text.Append(" lantern");
+        db.AddDocument(text);
+    }
+    db.Seal();
+
+    auto planned = db.BooleanQuery(TString("(river OR mountain OR stone) AND lantern"));
+    auto direct = db.BooleanQuery(TString("lantern"));
+    EXPECT_EQ(planned, direct);
+    EXPECT_EQ(planned.Size(), 4);
+
+    auto reversed = db.BooleanQuery(TString("lantern AND (river OR mountain)"));
+    EXPECT_EQ(reversed, direct);
+}
+
+TEST(TSearchDatabase, ScorerOptionAndCountMatches) {
+    const char* docs[] = {"river stone", "river river mountain", "mountain pass", "quiet lake"};
+    TSearchDatabase::TOptions bm25Opts;
+    bm25Opts.Scorer = NIndex::EScorer::Bm25;
+    TSearchDatabase::TOptions impactOpts;
+    impactOpts.Scorer = NIndex::EScorer::Impact;
+    TSearchDatabase tfidf, bm25(bm25Opts), impact(impactOpts);
+    for (const char* doc : docs) {
+        tfidf.AddDocument(TString(doc));
+        bm25.AddDocument(TString(doc));
+        impact.AddDocument(TString(doc));
+    }
+    tfidf.Seal();
+    bm25.Seal();
+    impact.Seal();
+
+    EXPECT_EQ(tfidf.CountMatches(TString("river mountain")), 3);
+    EXPECT_EQ(bm25.CountMatches(TString("river mountain")), 3);
+    EXPECT_EQ(tfidf.CountMatches(TString("absent")), 0);
+
+    auto a = tfidf.Search(TString("river"), 10);
+    auto b = bm25.Search(TString("river"), 10);
+    auto c = impact.Search(TString("river"), 10);
+    ASSERT_EQ(a.Size(), 2);
+    ASSERT_EQ(b.Size(), 2);
+    ASSERT_EQ(c.Size(), 2);
+    EXPECT_EQ(tfidf.ToExternalId(a[0].DocId), 1);
+    EXPECT_EQ(bm25.ToExternalId(b[0].DocId), 1);
+    EXPECT_EQ(impact.ToExternalId(c[0].DocId), 1);
+    EXPECT_NE(a[0].Score, b[0].Score);
+}
+
+TEST(TSearchDatabase, DeletedDocumentsLeaveResults) {
+    TSearchDatabase db;
+    db.AddDocument(TString("river stone"), TString("a"));
+    db.AddDocument(TString("river mountain"), TString("b"));
+    db.AddDocument(TString("mountain pass"), TString("c"));
+    db.Seal();
+
+    NIndex::TDocId river = 0;
+    ASSERT_TRUE(db.ToInternalId(1, &river));
+    EXPECT_TRUE(db.DeleteDocument(river));
+    EXPECT_FALSE(db.DeleteDocument(river));
+    EXPECT_EQ(db.GetDeletedCount(), 1u);
+
+    auto hits = db.Search(TString("river mountain"), 10);
+    ASSERT_EQ(hits.Size(), 2u);
+    for (size_t i = 0; i < hits.Size(); ++i) {
+        EXPECT_NE(hits[i].DocId, river);
+    }
+    EXPECT_EQ(db.CountMatches(TString("river")), 1u);
+    EXPECT_EQ(db.BooleanQuery(TString("river OR mountain")).Size(), 2u);
+    EXPECT_EQ(db.BooleanQuery(TString("NOT stone")).Size(), 1u);
+    EXPECT_EQ(db.PhraseQuery(TString("river mountain")).Size(), 0u);
+    EXPECT_EQ(db.GetDocument(river), TString());
+
+    std::string path = ::testing::TempDir() + "deleted_image.idx";
+    ASSERT_TRUE(db.SaveToFile(path.c_str()));
+    TSearchDatabase loaded;
+    ASSERT_TRUE(loaded.LoadFromFile(path.c_str()));
+    std::remove(path.c_str());
+    EXPECT_TRUE(loaded.IsDeleted(river));
+    EXPECT_EQ(loaded.Search(TString("river"), 10).Size(), 1u);
+}
+
+TEST(TSearchDatabase, ParallelBatchMatchesSequentialAdds) {
+    TVector<TString> contents;
+    TVector<TString> titles;
+    for (size_t i = 0; i < 300; ++i) {
+        std::string text = "doc " + std::to_string(i % 17) + " running river" + (i % 3 == 0 ? " stones" : " mountains");
+        contents.PushBack(TString(text.c_str()));
+        titles.PushBack(TString(std::to_string(i).c_str()));
+    }
+
+    TSearchDatabase sequential;
+    for (size_t i = 0; i < contents.Size(); ++i) {
+        sequential.AddDocument(contents[i], titles[i]);
+    }
+    TSearchDatabase batched;
+    TVector<NIndex::TDocId> ids = batched.AddDocuments(contents, titles, 4);
+    ASSERT_EQ(ids.Size(), contents.Size());
+
+    EXPECT_EQ(batched.GetTermCount(), sequential.GetTermCount());
+    EXPECT_EQ(batched.GetDocument(ids[42]), contents[42]);
+    EXPECT_EQ(batched.GetTitle(ids[42]), titles[42]);
+    auto a = sequential.Search(TString("stones river"), 20);
+    auto b = batched.Search(TString("stones river"), 20);
+    ASSERT_EQ(a.Size(), b.Size());
+    for (size_t i = 0; i < a.Size(); ++i) {
+        EXPECT_EQ(a[i].DocId, b[i].DocId);
+        EXPECT_DOUBLE_EQ(a[i].Score, b[i].Score);
+    }
+}
+
+TEST(TSearchDatabase, DurableOpenReplaysLogOverSnapshot) {
+    std::string snapshot = ::testing::TempDir() + "durable.idx";
+    std::string wal = ::testing::TempDir() + "durable.wal";
+    std::remove(snapshot.c_str());
+    std::remove(wal.c_str());
+
+    {
+        TSearchDatabase db;
+        ASSERT_TRUE(db.OpenDurable(snapshot.c_str(), wal.c_str()));
+        db.AddDocument(TString("the quiet river"), TString("r"));
+        db.AddDocument(TString("stone bridge over the river"));
+        const char* terms[] = {"lantern", "harbor"};
+        db.AddDocumentTerms(terms, terms + 2);
+        NIndex::TDocId bridge = 0;
+        ASSERT_TRUE(db.ToInternalId(1, &bridge));
+        db.DeleteDocument(bridge);
+        EXPECT_TRUE(db.IsDurable());
+    }
+
+    {
+        TSearchDatabase db;
+        ASSERT_TRUE(db.OpenDurable(snapshot.c_str(), wal.c_str()));
+        EXPECT_EQ(db.GetDocumentCount(), 3u);
+        EXPECT_EQ(db.GetDeletedCount(), 1u);
+        EXPECT_EQ(db.Search(TString("river"), 10).Size(), 1u);
+        EXPECT_EQ(db.BooleanQuery(TString("lantern")).Size(), 1u);
+        NIndex::TDocId first = 0;
+        ASSERT_TRUE(db.ToInternalId(0, &first));
+        EXPECT_EQ(db.GetTitle(first), TString("r"));
+
+        ASSERT_TRUE(db.Checkpoint());
+        TVector<TString> batch;
+        batch.PushBack(TString("river delta"));
+        batch.PushBack(TString("mountain river"));
+        db.AddDocuments(batch, TVector<TString>());
+    }
+
+    {
+        TSearchDatabase db;
+        ASSERT_TRUE(db.OpenDurable(snapshot.c_str(), wal.c_str()));
+        EXPECT_EQ(db.GetDocumentCount(), 5u);
+        EXPECT_EQ(db.Search(TString("river"), 10).Size(), 3u);
+        EXPECT_EQ(db.GetLog().GetStats().Records, 0u);
+        db.Seal();
+        EXPECT_EQ(db.Search(TString("river"), 10).Size(), 3u);
+        ASSERT_TRUE(db.Checkpoint());
+    }
+
+    {
+        TSearchDatabase db;
+        ASSERT_TRUE(db.OpenDurable(snapshot.c_str(), wal.c_str()));
+        EXPECT_EQ(db.GetDocumentCount(), 5u);
+        EXPECT_EQ(db.GetDeletedCount(), 1u);
+        EXPECT_EQ(db.Search(TString("river"), 10).Size(), 3u);
+    }
+    std::remove(snapshot.c_str());
+    std::remove(wal.c_str());
+}
+
+TEST(TSearchDatabase, FailedLogWriteRejectsMutation) {
+    std::string snapshot = ::testing::TempDir() + "walfail.idx";
+    std::string wal = ::testing::TempDir() + "walfail.wal";
+    std::remove(snapshot.c_str());
+    std::remove(wal.c_str());
+
+    TSearchDatabase db;
+    ASSERT_TRUE(db.OpenDurable(snapshot.c_str(), wal.c_str()));
+    NIndex::TDocId river = db.AddDocument(TString("the quiet river"));
+    ASSERT_NE(river, TSearchDatabase::INVALID_DOC_ID);
+
+    struct stat st;
+    ASSERT_EQ(::stat(wal.c_str(), &st), 0);
+    struct rlimit saved;
+    ASSERT_EQ(::getrlimit(RLIMIT_FSIZE, &saved), 0);
+    struct rlimit limited = saved;
+    limited.rlim_cur = static_cast<rlim_t>(st.st_size);
+    auto previous = std::signal(SIGXFSZ, SIG_IGN);
+    ASSERT_EQ(::setrlimit(RLIMIT_FSIZE, &limited), 0);
+
+    EXPECT_EQ(db.AddDocument(TString("a stone bridge")), TSearchDatabase::INVALID_DOC_ID);
+    TVector<TString> batch;
+    batch.PushBack(TString("river delta"));
+    EXPECT_TRUE(db.AddDocuments(batch, TVector<TString>()).Empty());
+    EXPECT_FALSE(db.DeleteDocument(river));
+
+    ::setrlimit(RLIMIT_FSIZE, &saved);
+    std::signal(SIGXFSZ, previous);
+    EXPECT_FALSE(db.GetLog().Ok());
+    EXPECT_EQ(db.GetDocumentCount(), 1u);
+    EXPECT_EQ(db.AddDocument(TString("still failing")), TSearchDatabase::INVALID_DOC_ID);
+    EXPECT_FALSE(db.IsDeleted(river));
+    EXPECT_EQ(db.Search(TString("river"), 10).Size(), 1u);
+    db.CloseLog();
+
+    TSearchDatabase reopened;
+    ASSERT_TRUE(reopened.OpenDurable(snapshot.c_str(), wal.c_str()));
+    EXPECT_EQ(reopened.GetDocumentCount(), 1u);
+    std::remove(snapshot.c_str());
+    std::remove(wal.c_str());
+}
+
+static size_t CountSegmentFiles(const std::string& dir) {
+    size_t count = 0;
+    if (DIR* handle = ::opendir(dir.c_str())) {
+        while (struct dirent* entry = ::readdir(handle)) {
+            std::string name = entry->d_name;
+            count += name.size() > 4 && name.compare(name.size() - 4, 4, ".seg") == 0 ? 1 : 0;
+        }
+        ::closedir(handle);
+    }
+    return count;
+}
+
+static void RemoveSnapshotDirectory(const std::string& dir) {
+    NIndex::TSegmentStore::RemoveUnreferenced(TString(dir.c_str()), NCollections::TUnorderedSet<uint64_t>());
+    std::remove((dir + "/manifest").c_str());
+    ::rmdir(dir.c_str());
+}
+
+TEST(TSearchDatabase, IncrementalSnapshotWritesOnlyChangedSegments) {
+    std::string dir = ::testing::TempDir() + "incremental";
+    RemoveSnapshotDirectory(dir);
+
+    TSearchDatabase db;
+    TVector<TString> contents;
+    TVector<TString> titles;
+    for (size_t i = 0; i < 3 * 4096 + 100; ++i) {
+        std::string text = "record " + std::to_string(i) + " describes harbor cargo manifest number " +
+                           std::to_string(i * 7919) + " shipped along the northern coast";
+        contents.PushBack(TString(text.c_str()));
+        titles.PushBack(TString(("title " + std::to_string(i)).c_str()));
+    }
+    db.AddDocuments(contents, titles);
+
+    ASSERT_TRUE(db.SaveIncremental(dir.c_str()));
+    const size_t full = db.GetSnapshotProgress().TotalBytes;
+    EXPECT_EQ(CountSegmentFiles(dir), 5u);
+
+    ASSERT_TRUE(db.SaveIncremental(dir.c_str()));
+    EXPECT_LT(db.GetSnapshotProgress().TotalBytes, 200u);
+    EXPECT_EQ(CountSegmentFiles(dir), 5u);
+
+    ASSERT_TRUE(db.DeleteDocument(10));
+    ASSERT_TRUE(db.SaveIncremental(dir.c_str()));
+    EXPECT_LT(db.GetSnapshotProgress().TotalBytes, full / 3);
+    EXPECT_EQ(CountSegmentFiles(dir), 6u);
+
+    db.AddDocument(TString("lighthouse keeper"), TString("keeper"));
+    db.Seal();
+    ASSERT_TRUE(db.SaveIncremental(dir.c_str()));
+    EXPECT_LT(db.GetSnapshotProgress().TotalBytes, full);
+    EXPECT_EQ(CountSegmentFiles(dir), 7u);
+
+    TSearchDatabase loaded;
+    ASSERT_TRUE(loaded.LoadIncremental(dir.c_str()));
+    ASSERT_EQ(loaded.GetDocumentCount(), db.GetDocumentCount());
+    EXPECT_EQ(loaded.GetDeletedCount(), 1u);
+    for (size_t externalId : {size_t(0), size_t(11), size_t(4096), size_t(3 * 4096 + 99), size_t(3 * 4096 + 100)}) {
+        NIndex::TDocId expected;
+        NIndex::TDocId actual;
+        ASSERT_TRUE(db.ToInternalId(externalId, &expected));
+        ASSERT_TRUE(loaded.ToInternalId(externalId, &actual));
+        EXPECT_EQ(loaded.GetDocument(actual), db.GetDocument(expected));
+        EXPECT_EQ(loaded.GetTitle(actual), db.GetTitle(expected));
+    }
+    NIndex::TDocId deleted;
+    ASSERT_TRUE(loaded.ToInternalId(10, &deleted));
+    EXPECT_TRUE(loaded.IsDeleted(deleted));
+    EXPECT_EQ(loaded.Search(TString("harbor"), 20000).Size(), 3 * 4096 + 99u);
+    EXPECT_EQ(loaded.Search(TString("lighthouse"), 10).Size(), 1u);
+
+    ASSERT_TRUE(loaded.SaveIncremental(dir.c_str()));
+    EXPECT_LT(loaded.GetSnapshotProgress().TotalBytes, 200u);
+    RemoveSnapshotDirectory(dir);
+}
+
+TEST(TSearchDatabase, IncrementalSnapshotWritesAddsAsCoreDeltas) {
+    std::string dir = ::testing::TempDir() + "incremental_delta";
+    RemoveSnapshotDirectory(dir);
+
+    TSearchDatabase::TOptions options;
+    options.Duplicates = TSearchDatabase::EDuplicatePolicy::Flag;
+    options.PhraseBigrams = true;
+    options.Passages = NIndex::TPassageIndex::EUnit::Line;
+    options.RhymeIndex = true;
+    TSearchDatabase db(options);
+    TVector<TString> contents;
+    TVector<TString> titles;
+    for (size_t i = 0; i < 2 * 4096; ++i) {
+        std::string text = "ballad " + std::to_string(i) + " of the river light\nsung by boatmen " +
+                           std::to_string(i * 13) + " in the night";
+        contents.PushBack(TString(text.c_str()));
+        titles.PushBack(TString());
+    }
+    db.AddDocuments(contents, titles);
+    db.Seal();
+    ASSERT_TRUE(db.SaveIncremental(dir.c_str()));
+    const size_t full = db.GetSnapshotProgress().TotalBytes;
+
+    db.AddDocument(TString("the lamp burns low\nupon the quiet snow"));
+    db.AddDocument(TString("The lamp burns low, upon the quiet snow!"));
+    ASSERT_TRUE(db.SaveIncremental(dir.c_str()));
+    EXPECT_LT(db.GetSnapshotProgress().TotalBytes, full / 20);
+    db.AddDocument(TString("a lantern swings\nabove the frozen springs"));
+    ASSERT_TRUE(db.SaveIncremental(dir.c_str()));
+    EXPECT_LT(db.GetSnapshotProgress().TotalBytes, full / 20);
+
+    TSearchDatabase loaded(options);
+    ASSERT_TRUE(loaded.LoadIncremental(dir.c_str()));
+    ASSERT_EQ(loaded.GetDocumentCount(), db.GetDocumentCount());
+    for (const char* query : {"lamp", "lantern", "river night", "quiet snow"}) {
+        auto expected = db.Search(TString(query), 5);
+        auto actual = loaded.Search(TString(query), 5);
+        ASSERT_EQ(actual.Size(), expected.Size());
+        for (size_t i = 0; i < actual.Size(); ++i) {
+            EXPECT_EQ(loaded.ToExternalId(actual[i].DocId), db.ToExternalId(expected[i].DocId));
+        }
+    }
+    EXPECT_EQ(loaded.PhraseQuery(TString("quiet snow")).Size(), 2u);
+    EXPECT_EQ(loaded.BooleanQuery(TString("rhyme:springs")).Size(), 1u);
+    auto passages = loaded.SearchPassages(TString("frozen"), 1);
+    ASSERT_EQ(passages.Size(), 1u);
+    EXPECT_EQ(passages[0].Text, TString("above the frozen springs"));
+    NIndex::TDocId flagged;
+    ASSERT_TRUE(loaded.ToInternalId(2 * 4096 + 1, &flagged));
+    EXPECT_TRUE(loaded.IsDuplicate(flagged));
+
+    ASSERT_TRUE(loaded.SaveIncremental(dir.c_str()));
+    EXPECT_LT(loaded.GetSnapshotProgress().TotalBytes, 300u);
+    size_t compactions = 0;
+    for (size_t i = 0; i < 16; ++i) {
+        loaded.AddDocument(TString(("winter verse " + std::to_string(i)).c_str()));
+        ASSERT_TRUE(loaded.SaveIncremental(dir.c_str()));
+        compactions += loaded.GetSnapshotProgress().TotalBytes > full / 4 ? 1 : 0;
+    }
+    EXPECT_EQ(compactions, 1u);
+    TSearchDatabase compacted(options);
+    ASSERT_TRUE(compacted.LoadIncremental(dir.c_str()));
+    EXPECT_EQ(compacted.GetDocumentCount(), 2 * 4096 + 3 + 16u);
+    EXPECT_EQ(compacted.Search(TString("winter"), 20).Size(), 16u);
+    RemoveSnapshotDirectory(dir);
+}
+
+TEST(TSearchDatabase, DurableIncrementalCheckpoint) {
+    std::string dir = ::testing::TempDir() + "incremental_durable";
+    std::string wal = ::testing::TempDir() + "incremental_durable.wal";
+    RemoveSnapshotDirectory(dir);
+    std::remove(wal.c_str());
+
+    TSearchDatabase::TOptions options;
+    options.IncrementalSnapshots = true;
+    {
+        TSearchDatabase db(options);
+        ASSERT_TRUE(db.OpenDurable(dir.c_str(), wal.c_str()));
+        for (size_t i = 0; i < 20; ++i) {
+            db.AddDocument(TString("harbor lights over the water"));
+        }
+        ASSERT_TRUE(db.Checkpoint());
+        db.AddDocument(TString("lighthouse keeper"));
+        db.CloseLog();
+    }
+
+    TSearchDatabase recovered(options);
+    ASSERT_TRUE(recovered.OpenDurable(dir.c_str(), wal.c_str()));
+    EXPECT_EQ(recovered.GetDocumentCount(), 21u);
+    EXPECT_EQ(recovered.Search(TString("lighthouse"), 10).Size(), 1u);
+    ASSERT_TRUE(recovered.Checkpoint());
+    recovered.CloseLog();
+
+    TSearchDatabase loaded;
+    ASSERT_TRUE(loaded.LoadIncremental(dir.c_str()));
+    EXPECT_EQ(loaded.GetDocumentCount(), 21u);
+    RemoveSnapshotDirectory(dir);
+    std::remove(wal.c_str());
+}
+
+TEST(TSearchDatabase, BackgroundCheckpointKeepsServing) {
+    std::string snapshot = ::testing::TempDir() + "background.idx";
+    std::string wal = ::testing::TempDir() + "background.wal";
+    std::remove(snapshot.c_str());
+    std::remove(wal.c_str());
+
+    {
+        TSearchDatabase db;
+        ASSERT_TRUE(db.OpenDurable(snapshot.c_str(), wal.c_str()));
+        for (size_t i = 0; i < 50; ++i) {
+            db.AddDocument(TString("harbor lights over the water"));
+        }
+        ASSERT_TRUE(db.StartCheckpoint(16 * 1024));
+        EXPECT_FALSE(db.StartCheckpoint());
+        EXPECT_EQ(db.GetSnapshotProgress().State, NIndex::TSnapshotWriter::EState::Running);
+
+        db.AddDocument(TString("lighthouse keeper"));
+        EXPECT_EQ(db.Search(TString("harbor"), 100).Size(), 50u);
+        EXPECT_EQ(db.Search(TString("lighthouse"), 10).Size(), 1u);
+
+        ASSERT_TRUE(db.WaitSnapshot());
+        NIndex::TSnapshotWriter::TProgress progress = db.GetSnapshotProgress();
+        EXPECT_EQ(progress.State, NIndex::TSnapshotWriter::EState::Done);
+        EXPECT_EQ(progress.BytesWritten, progress.TotalBytes);
+        EXPECT_EQ(progress.Lsn, 50u);
+    }
+
+    TSearchDatabase fromSnapshot;
+    ASSERT_TRUE(fromSnapshot.LoadFromFile(snapshot.c_str()));
+    EXPECT_EQ(fromSnapshot.GetDocumentCount(), 50u);
+
+    TSearchDatabase recovered;
+    ASSERT_TRUE(recovered.OpenDurable(snapshot.c_str(), wal.c_str()));
+    EXPECT_EQ(recovered.GetDocumentCount(), 51u);
+    EXPECT_EQ(recovered.Search(TString("lighthouse"), 10).Size(), 1u);
+    recovered.CloseLog();
+    std::remove(snapshot.c_str());
+    std::remove(wal.c_str());
+}
+
+TEST(TSearchDatabase, BackgroundSnapshotReusesSegmentImages) {
+    std::string path = ::testing::TempDir() + "segment_images.idx";
+    TSearchDatabase db;
+    TVector<TString> contents;
+    TVector<TString> titles;
+    for (size_t i = 0; i < 2 * 4096; ++i) {
+        contents.PushBack(TString(("tide table " + std::to_string(i) + " for the outer harbor").c_str()));
+        titles.PushBack(TString(("table " + std::to_string(i)).c_str()));
+    }
+    db.AddDocuments(contents, titles);
+    db.Seal();
+    ASSERT_TRUE(db.StartSnapshot(path.c_str()));
+    ASSERT_TRUE(db.WaitSnapshot());
+
+    db.AddDocument(TString("fog horn at the breakwater"), TString("fog"));
+    db.AddDocument(TString("fog over the breakwater lamps"), TString("lamps"));
+    ASSERT_TRUE(db.StartSnapshot(path.c_str(), 64 * 1024));
+    // Изменения после захвата не попадают в образ, который ещё пишется.
+    db.AddDocument(TString("fog bell never rings"), TString("bell"));
+    ASSERT_TRUE(db.DeleteDocument(0));
+    ASSERT_TRUE(db.WaitSnapshot());
+    NIndex::TSnapshotWriter::TProgress progress = db.GetSnapshotProgress();
+    EXPECT_EQ(progress.BytesWritten, progress.TotalBytes);
+    struct stat st;
+    ASSERT_EQ(::stat(path.c_str(), &st), 0);
+    EXPECT_EQ(static_cast<size_t>(st.st_size), progress.TotalBytes);
+
+    TSearchDatabase loaded;
+    ASSERT_TRUE(loaded.LoadFromFile(path.c_str()));
+    EXPECT_EQ(loaded.GetDocumentCount(), 2 * 4096 + 2u);
+    EXPECT_EQ(loaded.GetDeletedCount(), 0u);
+    EXPECT_EQ(loaded.Search(TString("fog"), 10).Size(), 2u);
+    EXPECT_EQ(loaded.PhraseQuery(TString("the breakwater")).Size(), 2u);
+    NIndex::TDocId docId;
+    ASSERT_TRUE(loaded.ToInternalId(2 * 4096 + 1, &docId));
+    EXPECT_EQ(loaded.GetTitle(docId), TString("lamps"));
+
+    ASSERT_TRUE(db.StartSnapshot(path.c_str()));
+    ASSERT_TRUE(db.WaitSnapshot());
+    ASSERT_TRUE(loaded.LoadFromFile(path.c_str()));
+    EXPECT_EQ(loaded.GetDocumentCount(), 2 * 4096 + 3u);
+    EXPECT_EQ(loaded.GetDeletedCount(), 1u);
+    EXPECT_EQ(loaded.Search(TString("fog"), 10).Size(), 3u);
+    std::remove(path.c_str());
+}
+
+TEST(TSearchDatabase, DiskModeServesSearchThroughBufferPool) {
+    std::string path = ::testing::TempDir() + "disk_mode.idx";
+    TSearchDatabase::TOptions diskOptions;
+    diskOptions.DiskIndexPath = TString(path.c_str());
+    diskOptions.DiskBuildMemoryBytes = 8192;
+    diskOptions.DiskCache.PageSize = 1024;
+    diskOptions.DiskCache.CapacityBytes = 16 * 1024;
+    TSearchDatabase disk(diskOptions);
+    TSearchDatabase::TOptions memoryOptions;
+    memoryOptions.ReorderOnSeal = false;
+    TSearchDatabase memory(memoryOptions);
+
+    const char* words[] = {"harbor", "lantern", "tide", "anchor", "gull", "storm", "rope", "keel"};
+    TVector<TString> contents;
+    TVector<TString> titles;
+    for (size_t i = 0; i < 1500; ++i) {
+        std::string text = std::string(words[i % 8]) + " " + words[(i / 8) % 8] + " " + words[(i * 7) % 8];
+        if (i % 5 == 0) text += " the old lighthouse";
+        contents.PushBack(TString(text.c_str()));
+        titles.PushBack(TString(("log " + std::to_string(i)).c_str()));
+    }
+    EXPECT_EQ(disk.AddDocuments(contents, titles).Size(), contents.Size());
+    memory.AddDocuments(contents, titles);
+    EXPECT_EQ(disk.GetDocumentCount(), memory.GetDocumentCount());
+    ASSERT_TRUE(disk.Seal());
+    ASSERT_TRUE(memory.Seal());
+    EXPECT_EQ(disk.GetTermCount(), memory.GetTermCount());
+
+    const char* queries[] = {"harbor storm", "lighthouse", "keel rope gull", "absent"};
+    for (const char* query : queries) {
+        auto expected = memory.Search(TString(query), 20);
+        auto actual = disk.Search(TString(query), 20);
+        ASSERT_EQ(actual.Size(), expected.Size());
+        for (size_t i = 0; i < expected.Size(); ++i) {
+            EXPECT_EQ(actual[i].DocId, expected[i].DocId);
+            EXPECT_DOUBLE_EQ(actual[i].Score, expected[i].Score);
+        }
+        EXPECT_EQ(disk.CountMatches(TString(query)), memory.CountMatches(TString(query)));
+    }
+    EXPECT_TRUE(disk.BooleanQuery(TString("(harbor OR tide) AND NOT storm")) ==
+                memory.BooleanQuery(TString("(harbor OR tide) AND NOT storm")));
+    EXPECT_TRUE(disk.PhraseQuery(TString("old lighthouse")) == memory.PhraseQuery(TString("old lighthouse")));
+    EXPECT_EQ(disk.PhraseQuery(TString("old lighthouse")).Size(), 300u);
+    EXPECT_GT(disk.GetDiskCacheStats().Misses, 0u);
+    EXPECT_EQ(disk.GetTitle(7), TString("log 7"));
+
+    ASSERT_TRUE(disk.DeleteDocument(0));
+    EXPECT_EQ(disk.BooleanQuery(TString("lighthouse")).Size(), 299u);
+    EXPECT_EQ(disk.AddDocument(TString("late harbor")), TSearchDatabase::INVALID_DOC_ID);
+    EXPECT_TRUE(disk.AddDocuments(contents, titles).Empty());
+    EXPECT_FALSE(disk.SaveToFile((path + ".image").c_str()));
+    std::remove(path.c_str());
+}
+
+TEST(TSearchDatabase, DiskModeReportsReadErrors) {
+    std::string path = ::testing::TempDir() + "disk_mode_errors.idx";
+    TSearchDatabase::TOptions options;
+    options.DiskIndexPath = TString(path.c_str());
+    TSearchDatabase db(options);
+    for (size_t i = 0; i < 200; ++i) {
+        db.AddDocument(TString(i % 2 ? "harbor lantern at dusk" : "storm over the harbor"));
+    }
+    ASSERT_TRUE(db.Seal());
+    bool ok = false;
+    EXPECT_EQ(db.CountMatches(TString("absent"), &ok), 0u);
+    EXPECT_TRUE(ok);
+
+    ASSERT_EQ(::truncate(path.c_str(), 16), 0);
+    EXPECT_TRUE(db.Search(TString("lantern"), 5, &ok).Empty());
+    EXPECT_FALSE(ok);
+    EXPECT_EQ(db.CountMatches(TString("storm"), &ok), 0u);
+    EXPECT_FALSE(ok);
+    EXPECT_TRUE(db.BooleanQuery(TString("storm AND NOT lantern"), &ok).Empty());
+    EXPECT_FALSE(ok);
+    EXPECT_TRUE(db.PhraseQuery(TString("harbor lantern"), &ok).Empty());
+    EXPECT_FALSE(ok);
+    EXPECT_TRUE(db.BooleanOr(TVector<TString>(1, TString("dusk")), &ok).Empty());
+    EXPECT_FALSE(ok);
+    EXPECT_TRUE(db.SearchAndFetch(TString("dusk"), 5, &ok).Empty());
+    EXPECT_FALSE(ok);
+    db.BooleanQuery(TString("absent"), &ok);
+    EXPECT_TRUE(ok);
+    std::remove(path.c_str());
+}
+
+TEST(TSearchDatabase, DocStoreServesBatchFetches) {
+    std::string storePath = ::testing::TempDir() + "doc_store.bin";
+    std::string imagePath = ::testing::TempDir() + "doc_store_image.bin";
+    TSearchDatabase reference;
+    TSearchDatabase db;
+    for (size_t i = 0; i < 300; ++i) {
+        std::string text = "note " + std::to_string(i) + " about river ferry schedule " + std::to_string(i * 31);
+        if (i % 3 == 0) text += " with night crossing";
+        reference.AddDocument(TString(text.c_str()), TString(("ferry " + std::to_string(i)).c_str()));
+        db.AddDocument(TString(text.c_str()), TString(("ferry " + std::to_string(i)).c_str()));
+    }
+    db.Seal();
+    reference.Seal();
+
+    ASSERT_TRUE(db.SaveDocStore(storePath.c_str()));
+    ASSERT_TRUE(db.OpenDocStore(storePath.c_str()));
+    EXPECT_TRUE(db.HasDocStore());
+    NIndex::TDocId late = db.AddDocument(TString("river ferry added after the store"), TString("late"));
+
+    TVector<NIndex::TDocId> docIds;
+    for (size_t externalId = 0; externalId < 300; externalId += 7) {
+        NIndex::TDocId docId;
+        ASSERT_TRUE(db.ToInternalId(externalId, &docId));
+        docIds.PushBack(docId);
+    }
+    docIds.PushBack(late);
+    TVector<TString> documents = db.GetDocuments(docIds);
+    ASSERT_EQ(documents.Size(), docIds.Size());
+    for (size_t i = 0; i + 1 < docIds.Size(); ++i) {
+        EXPECT_EQ(documents[i], reference.GetDocument(docIds[i]));
+        EXPECT_EQ(db.GetDocument(docIds[i]), documents[i]);
+    }
+    EXPECT_EQ(documents.Back(), TString("river ferry added after the store"));
+
+    auto fetched = db.SearchAndFetch(TString("night crossing"), 5);
+    ASSERT_EQ(fetched.Size(), 5u);
+    for (size_t i = 0; i < fetched.Size(); ++i) {
+        EXPECT_EQ(fetched[i].Document, reference.GetDocument(fetched[i].DocId));
+        EXPECT_EQ(fetched[i].Title, reference.GetTitle(fetched[i].DocId));
+    }
+    EXPECT_EQ(db.PhraseQuery(TString("night crossing")).Size(), 100u);
+
+    NIndex::TDocId deleted;
+    ASSERT_TRUE(db.ToInternalId(21, &deleted));
+    ASSERT_TRUE(db.DeleteDocument(deleted));
+    EXPECT_TRUE(db.GetDocument(deleted).Empty());
+
+    ASSERT_TRUE(db.SaveToFile(imagePath.c_str()));
+    TSearchDatabase loaded;
+    ASSERT_TRUE(loaded.LoadFromFile(imagePath.c_str()));
+    EXPECT_FALSE(loaded.HasDocStore());
+    for (size_t i = 0; i < docIds.Size(); ++i) {
+        EXPECT_EQ(loaded.GetDocument(docIds[i]), db.GetDocument(docIds[i]));
+    }
+
+    ASSERT_TRUE(db.SaveDocStore(storePath.c_str()));
+    ASSERT_TRUE(db.OpenDocStore(storePath.c_str()));
+    EXPECT_EQ(db.GetDocument(late), TString("river ferry added after the store"));
+    EXPECT_TRUE(db.GetDocument(deleted).Empty());
+
+    TSearchDatabase::TOptions rawOptions;
+    rawOptions.CompressDocuments = false;
+    TSearchDatabase raw(rawOptions);
+    raw.AddDocument(TString("plain stored text"));
+    EXPECT_FALSE(raw.OpenDocStore(storePath.c_str()));
+    std::remove(storePath.c_str());
+    std::remove(imagePath.c_str());
+}
+
+TEST(TSearchDatabase, UnreadableDocStoreAbortsSave) {
+    std::string storePath = ::testing::TempDir() + "torn_store.bin";
+    std::string imagePath = ::testing::TempDir() + "torn_store_image.bin";
+    std::string dir = ::testing::TempDir() + "torn_store_segments";
+    std::remove(imagePath.c_str());
+    TSearchDatabase db;
+    for (size_t i = 0; i < 40; ++i) {
+        db.AddDocument(TString(("harbour lantern " + std::to_string(i)).c_str()));
+    }
+    ASSERT_TRUE(db.SaveDocStore(storePath.c_str()));
+    ASSERT_TRUE(db.OpenDocStore(storePath.c_str()));
+    ASSERT_EQ(::truncate(storePath.c_str(), 8), 0);
+
+    EXPECT_FALSE(db.SaveToFile(imagePath.c_str()));
+    struct stat st;
+    EXPECT_NE(::stat(imagePath.c_str(), &st), 0);
+    EXPECT_FALSE(db.SaveIncremental(dir.c_str()));
+    TSearchDatabase loaded;
+    EXPECT_FALSE(loaded.LoadIncremental(dir.c_str()));
+    std::remove(storePath.c_str());
+}
+
+TEST(TSearchDatabase, ExternalKeysSurviveLogAndSnapshot) {
+    std::string snapshot = ::testing::TempDir() + "keys.idx";
+    std::string wal = ::testing::TempDir() + "keys.wal";
+    std::remove(snapshot.c_str());
+    std::remove(wal.c_str());
+
+    {
+        TSearchDatabase db;
+        ASSERT_TRUE(db.OpenDurable(snapshot.c_str(), wal.c_str()));
+        db.AddDocument(TString("winter road"), TString(), TString("65f0c1a2b3c4d5e6f7a8b9c0"));
+        db.AddDocument(TString("unkeyed verse"));
+        TVector<TString> contents;
+        TVector<TString> keys;
+        contents.PushBack(TString("spring rain"));
+        keys.PushBack(TString("line-17"));
+        contents.PushBack(TString("autumn leaves"));
+        keys.PushBack(TString("line-18"));
+        db.AddDocuments(contents, TVector<TString>(), keys);
+        ASSERT_TRUE(db.Checkpoint());
+        db.AddDocument(TString("summer heat"), TString(), TString("line-19"));
+    }
+
+    TSearchDatabase db;
+    ASSERT_TRUE(db.OpenDurable(snapshot.c_str(), wal.c_str()));
+    db.Seal();
+    NIndex::TDocId docId;
+    ASSERT_TRUE(db.FindByExternalKey(TString("65f0c1a2b3c4d5e6f7a8b9c0"), &docId));
+    EXPECT_EQ(db.GetDocument(docId), TString("winter road"));
+    EXPECT_EQ(db.ToExternalId(docId), 0u);
+    ASSERT_TRUE(db.FindByExternalKey(TString("line-18"), &docId));
+    EXPECT_EQ(db.GetDocument(docId), TString("autumn leaves"));
+    EXPECT_EQ(db.GetExternalKey(docId), TString("line-18"));
+    ASSERT_TRUE(db.FindByExternalKey(TString("line-19"), &docId));
+    EXPECT_EQ(db.GetDocument(docId), TString("summer heat"));
+    EXPECT_FALSE(db.FindByExternalKey(TString("line-1"), &docId));
+    EXPECT_FALSE(db.FindByExternalKey(TString(), &docId));
+
+    ASSERT_TRUE(db.ToInternalId(1, &docId));
+    EXPECT_TRUE(db.GetExternalKey(docId).Empty());
+
+    ASSERT_TRUE(db.FindByExternalKey(TString("line-17"), &docId));
+    ASSERT_TRUE(db.DeleteDocument(docId));
+    EXPECT_FALSE(db.FindByExternalKey(TString("line-17"), &docId));
+    db.AddDocument(TString("spring rain again"), TString(), TString("line-17"));
+    ASSERT_TRUE(db.FindByExternalKey(TString("line-17"), &docId));
+    EXPECT_EQ(db.GetDocument(docId), TString("spring rain again"));
+
+    ASSERT_TRUE(db.SaveToFile(snapshot.c_str()));
+    TSearchDatabase loaded;
+    ASSERT_TRUE(loaded.LoadFromFile(snapshot.c_str()));
+    ASSERT_TRUE(loaded.FindByExternalKey(TString("line-17"), &docId));
+    EXPECT_EQ(loaded.GetDocument(docId), TString("spring rain again"));
+    ASSERT_TRUE(loaded.FindByExternalKey(TString("65f0c1a2b3c4d5e6f7a8b9c0"), &docId));
+    EXPECT_EQ(loaded.GetDocument(docId), TString("winter road"));
+    std::remove(snapshot.c_str());
+    std::remove(wal.c_str());
+}
+
+TEST(TSearchDatabase, StoredFieldsServedWithHits) {
+    std::string snapshot = ::testing::TempDir() + "fields.idx";
+    std::string wal = ::testing::TempDir() + "fields.wal";
+    std::remove(snapshot.c_str());
+    std::remove(wal.c_str());
+
+    TSearchDatabase::TOptions options;
+    options.StoredFields.PushBack(TString("author"));
+    options.StoredFields.PushBack(TString("year"));
+    auto row = [](const char* author, const char* year) {
+        TVector<TString> values;
+        values.PushBack(TString(author));
+        values.PushBack(TString(year));
+        return values;
+    };
+
+    {
+        TSearchDatabase db(options);
+        ASSERT_TRUE(db.OpenDurable(snapshot.c_str(), wal.c_str()));
+        db.AddDocument(TString("frost and sun a wondrous winter day"), TString("Winter Morning"), TString(),
+                       row("Pushkin", "1829"));
+        TVector<TString> contents;
+        TVector<TVector<TString>> fields;
+        contents.PushBack(TString("night street lamp pharmacy"));
+        fields.PushBack(row("Blok", "1912"));
+        contents.PushBack(TString("untitled winter sketch"));
+        fields.PushBack(TVector<TString>());
+        db.AddDocuments(contents, TVector<TString>(), TVector<TString>(), fields);
+    }
+
+    TSearchDatabase db(options);
+    ASSERT_TRUE(db.OpenDurable(snapshot.c_str(), wal.c_str()));
+    ASSERT_EQ(db.GetFieldNames().Size(), 2u);
+    EXPECT_EQ(db.FindField(TString("year")), 1u);
+
+    auto hits = db.SearchAndFetch(TString("winter"), 10);
+    ASSERT_EQ(hits.Size(), 2u);
+    for (size_t i = 0; i < hits.Size(); ++i) {
+        ASSERT_EQ(hits[i].Fields.Size(), 2u);
+        if (hits[i].Title == TString("Winter Morning")) {
+            EXPECT_EQ(hits[i].Fields[0], TString("Pushkin"));
+            EXPECT_EQ(hits[i].Fields[1], TString("1829"));
+        } else {
+            EXPECT_TRUE(hits[i].Fields[0].Empty());
+            EXPECT_EQ(hits[i].Document, TString("untitled winter sketch"));
+        }
+    }
+
+    NIndex::TDocId blok;
+    ASSERT_TRUE(db.ToInternalId(1, &blok));
+    TVector<TSearchDatabase::TFetchedResult> fetched = db.FetchDocuments(TVector<NIndex::TDocId>(1, blok));
+    ASSERT_EQ(fetched.Size(), 1u);
+    EXPECT_EQ(fetched[0].Document, TString("night street lamp pharmacy"));
+    EXPECT_EQ(fetched[0].Fields[0], TString("Blok"));
+
+    db.Seal();
+    ASSERT_TRUE(db.Checkpoint());
+    NIndex::TDocId pushkin;
+    ASSERT_TRUE(db.ToInternalId(0, &pushkin));
+    ASSERT_TRUE(db.DeleteDocument(pushkin));
+    EXPECT_TRUE(db.GetField(pushkin, 0).Empty());
+
+    TSearchDatabase plain;
+    ASSERT_TRUE(db.SaveToFile(snapshot.c_str()));
+    ASSERT_TRUE(plain.LoadFromFile(snapshot.c_str()));
+    ASSERT_EQ(plain.GetFieldNames().Size(), 2u);
+    ASSERT_TRUE(plain.ToInternalId(1, &blok));
+    EXPECT_EQ(plain.GetField(blok, plain.FindField(TString("year"))), TString("1912"));
+    ASSERT_TRUE(plain.ToInternalId(0, &pushkin));
+    EXPECT_TRUE(plain.GetField(pushkin, 0).Empty());
+    std::remove(snapshot.c_str());
+    std::remove(wal.c_str());
+}
+
+TEST(TSearchDatabase, PassageSearchReturnsBestStanza) {
+    std::string snapshot = ::testing::TempDir() + "passages.idx";
+    std::string wal = ::testing::TempDir() + "passages.wal";
+    std::remove(snapshot.c_str());
+    std::remove(wal.c_str());
+
+    TSearchDatabase::TOptions options;
+    options.Passages = NIndex::TPassageIndex::EUnit::Stanza;
+    TString longPoem;
+    for (size_t i = 0; i < 20; ++i) {
+        longPoem += TString("grey fields and empty roads\nthe wind across the plain\n\n");
+    }
+    longPoem += TString("a silver moon above the sea\nthe silver moon again");
+
+    {
+        TSearchDatabase db(options);
+        ASSERT_TRUE(db.OpenDurable(snapshot.c_str(), wal.c_str()));
+        db.AddDocument(longPoem);
+        TVector<TString> contents;
+        contents.PushBack(TString("the moon is bright\n\nthe sea is calm tonight"));
+        contents.PushBack(TString("silver rain on the window\nno moon tonight"));
+        db.AddDocuments(contents, TVector<TString>());
+    }
+
+    TSearchDatabase db(options);
+    ASSERT_TRUE(db.OpenDurable(snapshot.c_str(), wal.c_str()));
+    EXPECT_EQ(db.GetPassageCount(), 24u);
+
+    auto hits = db.SearchByPassage(TString("silver moon"), 10);
+    ASSERT_EQ(hits.Size(), 3u);
+    EXPECT_EQ(db.ToExternalId(hits[0].DocId), 0u);
+    EXPECT_EQ(hits[0].Text, TString("a silver moon above the sea\nthe silver moon again"));
+    EXPECT_EQ(hits[0].Span.FirstLine, 60u);
+    EXPECT_EQ(hits[0].Span.LineCount, 2u);
+    EXPECT_EQ(db.SearchPassages(TString("moon"), 10).Size(), 3u);
+
+    db.Seal();
+    ASSERT_TRUE(db.DeleteDocument(hits[0].DocId));
+    TSearchDatabase plain;
+    ASSERT_TRUE(db.SaveToFile(snapshot.c_str()));
+    ASSERT_TRUE(plain.LoadFromFile(snapshot.c_str()));
+    hits = plain.SearchByPassage(TString("silver moon"), 10);
+    ASSERT_EQ(hits.Size(), 2u);
+    EXPECT_EQ(plain.ToExternalId(hits[0].DocId), 2u);
+    EXPECT_EQ(hits[0].Text, TString("silver rain on the window\nno moon tonight"));
+    EXPECT_TRUE(TSearchDatabase().SearchByPassage(TString("moon")).Empty());
+    std::remove(snapshot.c_str());
+    std::remove(wal.c_str());
+}
+
+TEST(TSearchDatabase, RhymeOperatorInBooleanQuery) {
+    std::string path = ::testing::TempDir() + "rhymes.idx";
+    TSearchDatabase::TOptions options;
+    options.RhymeIndex = true;
+    TSearchDatabase db(options);
+    TVector<TString> contents;
+    for (size_t i = 0; i < 200; ++i) {
+        contents.PushBack(i % 2 == 0 ? TString("the moon above\nall through the night") : TString("grey fields\nand empty roads"));
+    }
+    contents.PushBack(TString("a candle burning bright\nthe moon is gone"));
+    db.AddDocuments(contents, TVector<TString>(), 4);
+    db.AddDocument(TString("no moon, no light,\nonly my love"));
+
+    EXPECT_EQ(db.BooleanQuery(TString("rhyme:white")).Size(), 102u);
+    auto both = db.BooleanQuery(TString("rhyme:white AND NOT rhyme:glove AND moon"));
+    ASSERT_EQ(both.Size(), 1u);
+    EXPECT_EQ(db.ToExternalId(both[0]), 200u);
+    EXPECT_TRUE(db.BooleanQuery(TString("rhyme:orange")).Empty());
+
+    db.Seal();
+    auto lines = db.FindRhymingLines(TString("glove"));
+    ASSERT_EQ(lines.Size(), 101u);
+    NIndex::TDocId last = 0;
+    ASSERT_TRUE(db.ToInternalId(201, &last));
+    ASSERT_TRUE(db.DeleteDocument(last));
+    ASSERT_TRUE(db.SaveToFile(path.c_str()));
+
+    TSearchDatabase loaded;
+    ASSERT_TRUE(loaded.LoadFromFile(path.c_str()));
+    EXPECT_EQ(loaded.GetRhymeCount(), db.GetRhymeCount());
+    lines = loaded.FindRhymingLines(TString("glove"));
+    ASSERT_EQ(lines.Size(), 100u);
+    EXPECT_EQ(lines[0].Line, 0u);
+    EXPECT_EQ(loaded.BooleanQuery(TString("(rhyme:kite OR rhyme:sun) AND candle")).Size(), 1u);
+    EXPECT_TRUE(TSearchDatabase().BooleanQuery(TString("rhyme:night")).Empty());
+    std::remove(path.c_str());
+}
+
+TEST(TSearchDatabase, SoundOperatorMatchesArchaicSpellings) {
+    std::string path = ::testing::TempDir() + "phonetic.idx";
+    TSearchDatabase::TOptions options;
+    options.PhoneticIndex = true;
+    TSearchDatabase db(options);
+    db.AddDocument(TString("musick hath charms to soothe"));
+    db.AddDocument(TString("the music of the night"));
+    db.AddDocument(TString("shew me the way"));
+    db.AddDocument(TString("magic lanterns"));
+    EXPECT_TRUE(db.BooleanQuery(TString("sound:music")).Empty());
+
+    db.Seal();
+    EXPECT_GT(db.GetPhoneticCodeCount(), 0u);
+    EXPECT_EQ(db.BooleanQuery(TString("sound:music")).Size(), 2u);
+    auto night = db.BooleanQuery(TString("sound:musick AND night"));
+    ASSERT_EQ(night.Size(), 1u);
+    EXPECT_EQ(db.ToExternalId(night[0]), 1u);
+    EXPECT_EQ(db.BooleanQuery(TString("sound:show OR lanterns")).Size(), 2u);
+    EXPECT_TRUE(db.BooleanQuery(TString("sound:zebra")).Empty());
+    ASSERT_TRUE(db.SaveToFile(path.c_str()));
+
+    TSearchDatabase loaded(options);
+    ASSERT_TRUE(loaded.LoadFromFile(path.c_str()));
+    EXPECT_EQ(loaded.GetPhoneticCodeCount(), db.GetPhoneticCodeCount());
+    EXPECT_EQ(loaded.BooleanQuery(TString("sound:musique AND NOT night")).Size(), 1u);
+    EXPECT_TRUE(TSearchDatabase().BooleanQuery(TString("sound:music")).Empty());
+    std::remove(path.c_str());
+}
+
+TEST(TSearchDatabase, SoundOperatorWorksInDiskMode) {
+    std::string path = ::testing::TempDir() + "phonetic_disk.idx";
+    TSearchDatabase::TOptions options;
+    options.PhoneticIndex = true;
+    options.DiskIndexPath = TString(path.c_str());
+    TSearchDatabase db(options);
+    db.AddDocument(TString("musick hath charms to soothe"));
+    db.AddDocument(TString("the music of the night"));
+    db.AddDocument(TString("shew me the way"));
+    db.AddDocument(TString("magic lanterns"));
+    ASSERT_TRUE(db.Seal());
+
+    EXPECT_GT(db.GetPhoneticCodeCount(), 0u);
+    EXPECT_EQ(db.BooleanQuery(TString("sound:music")).Size(), 2u);
+    auto night = db.BooleanQuery(TString("sound:musick AND night"));
+    ASSERT_EQ(night.Size(), 1u);
+    EXPECT_EQ(db.ToExternalId(night[0]), 1u);
+    EXPECT_EQ(db.BooleanQuery(TString("lanterns OR sound:show AND way")).Size(), 2u);
+    EXPECT_TRUE(db.BooleanQuery(TString("sound:zebra")).Empty());
+    std::remove(path.c_str());
+}
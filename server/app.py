@@ -8,7 +8,8 @@ import pandas as pd
 import plotly.graph_objects as go
 from typing import List, Optional, Dict
 from dataclasses import dataclass
-from pymongo import MongoClient, UpdateOne, ASCENDING
+from bson import ObjectId
+from pymongo import MongoClient, ASCENDING
 
 
 logging.basicConfig(
@@ -22,7 +23,7 @@ logging.basicConfig(
 
 
 try:
-    from search_bridge import SearchEngine, SearchResult
+    from search_bridge import SearchEngine, SearchResult, PASSAGES_STANZA
     SEARCH_ENGINE_AVAILABLE = True
 except Exception as e:
     SEARCH_ENGINE_AVAILABLE = False
@@ -39,6 +40,10 @@ except Exception as e:
     print(f"Warning: Evaluation module not available: {e}")
 
 
+# Поля, которые движок хранит рядом с документом и отдаёт вместе с результатами
+STORED_FIELDS = ("author", "year")
+
+
 @dataclass
 class DisplayResult:
     """Результат поиска для отображения."""
@@ -57,6 +62,7 @@ class SearchApp:
         self.mongo_uri = os.getenv("MONGO_URI", "mongodb://mongodb:27017")
         self.db_name = os.getenv("DB_NAME", "poetry_search")
         self.lib_path = os.getenv("LIB_PATH", None)
+        self.index_path = os.getenv("INDEX_PATH", None)
         self.progress_callback = progress_callback
         self.logger = logging.getLogger(__name__)
         self._doc_cache: Dict[int, dict] = {}
@@ -87,10 +93,24 @@ class SearchApp:
         """Инициализация C++ поисковой системы."""
         if SEARCH_ENGINE_AVAILABLE:
             try:
-                self.search_engine = SearchEngine(lib_path=self.lib_path)
+                self.search_engine = SearchEngine(
+                    lib_path=self.lib_path,
+                    stored_fields=list(STORED_FIELDS),
+                    passage_unit=PASSAGES_STANZA,
+                    rhyme_index=True,
+                    phonetic_index=True,
+                )
                 self.engine_available = True
                 self.logger.info("C++ search engine initialized")
                 
+                if self.index_path and os.path.exists(self.index_path):
+                    if self.search_engine.load(self.index_path):
+                        self.logger.info(f"Index image loaded from {self.index_path}")
+                        pages = self.search_engine.warmup()
+                        self.logger.info(f"Index warmed up: {pages} pages")
+                    else:
+                        self.logger.error(f"Cannot load index image {self.index_path}")
+                
                 if self.mongo_available and self.search_engine.get_document_count() == 0:
                     self._load_index_from_mongo()
             except Exception as e:
@@ -102,47 +122,42 @@ class SearchApp:
             self.engine_available = False
     
     def _load_index_from_mongo(self, limit: int = 50000):
-        """Загружает документы из MongoDB в C++ индекс."""
+        """Загружает документы из MongoDB в C++ индекс; _id документа хранится в индексе как внешний ключ."""
         if self.collection is None or not self.search_engine:
             return
         
-        self.collection.update_many({}, {"$unset": {"cpp_doc_id": ""}})
-        
         self.logger.info(f"Starting to index documents (limit: {limit})...")
         
-        cursor = self.collection.find().sort("_id", 1).limit(limit)
+        cursor = self.collection.find({}, {"text": 1, "title": 1, **{f: 1 for f in STORED_FIELDS}}).sort("_id", 1).limit(limit)
         
         total = min(limit, self.collection.count_documents({}))
         
         batch_size = 500
-        bulk_operations = []
+        contents, titles, keys, fields = [], [], [], []
         
         for idx, doc in enumerate(cursor, 1):
             content = doc.get("text", "")
-            title = doc.get("title", "")
             
             if content:
-                cpp_id = self.search_engine.add_document(content, title)
+                contents.append(content)
+                titles.append(doc.get("title", ""))
+                keys.append(str(doc["_id"]))
+                fields.append({f: doc.get(f, "") for f in STORED_FIELDS})
                 
-                bulk_operations.append(
-                    UpdateOne(
-                        {"_id": doc["_id"]},
-                        {"$set": {"cpp_doc_id": cpp_id}}
-                    )
-                )
-                
-                if len(bulk_operations) >= batch_size:
-                    self.collection.bulk_write(bulk_operations, ordered=False)
-                    bulk_operations = []
-                
-                if idx % 1000 == 0:
-                    progress = idx / total
-                    self.logger.info(f"Indexed {idx}/{total} documents ({progress*100:.1f}%)")
-                    if self.progress_callback:
-                        self.progress_callback(progress, f"Индексировано {idx}/{total} документов")
+                if len(contents) >= batch_size:
+                    self.search_engine.add_documents(contents, titles, keys=keys, fields=fields)
+                    contents, titles, keys, fields = [], [], [], []
+            
+            if idx % 1000 == 0:
+                progress = idx / total
+                self.logger.info(f"Indexed {idx}/{total} documents ({progress*100:.1f}%)")
+                if self.progress_callback:
+                    self.progress_callback(progress, f"Индексировано {idx}/{total} документов")
+        
+        if contents:
+            self.search_engine.add_documents(contents, titles, keys=keys, fields=fields)
         
-        if bulk_operations:
-            self.collection.bulk_write(bulk_operations, ordered=False)
+        self.search_engine.seal()
         
         indexed_count = self.search_engine.get_document_count()
         self.logger.info(f"Indexing complete! Total indexed: {indexed_count}")
@@ -150,7 +165,20 @@ class SearchApp:
             self.progress_callback(1.0, f"Готово! Индексировано {indexed_count} документов")
     
     def _get_docs_batch(self, cpp_ids: List[int]) -> Dict[int, dict]:
-        """Получает документы из MongoDB пакетом по C++ ID."""
+        """Документы для показа: текст, заголовок и хранимые поля отдаёт C++ движок одним вызовом.
+        MongoDB нужна только образам индекса, собранным без хранимых полей."""
+        if not cpp_ids:
+            return {}
+        if self.search_engine and set(STORED_FIELDS) <= set(self.search_engine.field_names()):
+            result = {}
+            for fetched in self.search_engine.fetch_documents(cpp_ids):
+                doc = {"title": fetched.title, "text": fetched.document, **fetched.fields}
+                result[fetched.doc_id] = {k: v for k, v in doc.items() if v}
+            return result
+        return self._get_mongo_docs_batch(cpp_ids)
+    
+    def _get_mongo_docs_batch(self, cpp_ids: List[int]) -> Dict[int, dict]:
+        """Получает документы из MongoDB пакетом по первичному ключу, который хранит C++ индекс."""
         if self.collection is None or not cpp_ids:
             return {}
         
@@ -160,16 +188,30 @@ class SearchApp:
         result = {cpp_id: self._doc_cache[cpp_id] for cpp_id in cached_ids}
         
         if missing_ids:
-            docs = self.collection.find(
-                {"cpp_doc_id": {"$in": list(missing_ids)}},
-                {"cpp_doc_id": 1, "title": 1, "text": 1, "author": 1, "year": 1}
-            )
+            projection = {"cpp_doc_id": 1, "title": 1, "text": 1, "author": 1, "year": 1}
+            cpp_id_by_key = {}
+            legacy_ids = []
+            for cpp_id in missing_ids:
+                key = self.search_engine.get_external_key(cpp_id)
+                if key:
+                    cpp_id_by_key[ObjectId(key) if ObjectId.is_valid(key) else key] = cpp_id
+                else:
+                    legacy_ids.append(cpp_id)
+            
+            if cpp_id_by_key:
+                for doc in self.collection.find({"_id": {"$in": list(cpp_id_by_key)}}, projection):
+                    cpp_id = cpp_id_by_key.get(doc["_id"])
+                    if cpp_id is not None:
+                        self._doc_cache[cpp_id] = doc
+                        result[cpp_id] = doc
             
-            for doc in docs:
-                cpp_id = doc.get("cpp_doc_id")
-                if cpp_id is not None:
-                    self._doc_cache[cpp_id] = doc
-                    result[cpp_id] = doc
+            # Образы индекса без внешних ключей: документы помечены cpp_doc_id.
+            if legacy_ids:
+                for doc in self.collection.find({"cpp_doc_id": {"$in": legacy_ids}}, projection):
+                    cpp_id = doc.get("cpp_doc_id")
+                    if cpp_id is not None:
+                        self._doc_cache[cpp_id] = doc
+                        result[cpp_id] = doc
         
         return result
     
@@ -197,6 +239,27 @@ class SearchApp:
         
         return results
     
+    def search_stanzas(self, query: str, top_k: int = 10) -> List[DisplayResult]:
+        """Поиск по строфам: документ оценивается лучшей строфой, она же — сниппет."""
+        results = []
+        
+        if self.engine_available and self.search_engine:
+            passages = self.search_engine.search_by_passage(query, top_k)
+            docs_map = self._get_docs_batch([p.doc_id for p in passages])
+            
+            for p in passages:
+                doc = docs_map.get(p.doc_id, {})
+                results.append(DisplayResult(
+                    doc_id=p.doc_id,
+                    score=p.score,
+                    title=doc.get("title", "Без названия"),
+                    text=f"[строки {p.first_line + 1}-{p.first_line + p.line_count}]\n{p.snippet}",
+                    author=doc.get("author", "Неизвестен"),
+                    year=doc.get("year", ""),
+                ))
+        
+        return results
+    
     def search_boolean(self, query: str, top_k: int = 10) -> List[DisplayResult]:
         """Булев поиск с TF-IDF ранжированием."""
         self.logger.info(f"Boolean search: query='{query}', top_k={top_k}")
@@ -283,27 +346,19 @@ class SearchApp:
 
     
     def _extract_query_terms(self, query: str) -> List[str]:
-        """Извлекает термины запроса, исключая операторы AND/OR/NOT и скобки."""
+        """Извлекает термины запроса, исключая операторы AND/OR/NOT, rhyme:/sound: и скобки."""
         operators = {'and', 'or', 'not', '(', ')'}
         
         tokens = query.lower().replace('(', ' ( ').replace(')', ' ) ').split()
         
-        terms = [t for t in tokens if t not in operators and t.strip()]
+        terms = [t for t in tokens if t not in operators and not t.startswith(('rhyme:', 'sound:')) and t.strip()]
         
         self.logger.debug(f"Extracted query terms: {terms} from query: '{query}'")
         return terms
     
     def _get_doc_by_cpp_id(self, cpp_id: int) -> Optional[dict]:
         """Получает документ из MongoDB по C++ ID."""
-        if cpp_id in self._doc_cache:
-            return self._doc_cache[cpp_id]
-        
-        if self.collection is not None:
-            doc = self.collection.find_one({"cpp_doc_id": cpp_id})
-            if doc:
-                self._doc_cache[cpp_id] = doc
-            return doc
-        return None
+        return self._get_docs_batch([cpp_id]).get(cpp_id)
     
     def get_stats(self) -> dict:
         """Статистика системы."""
@@ -328,7 +383,7 @@ def render_search_tab(app: SearchApp):
     """Вкладка поиска."""
     search_mode = st.radio(
         "Режим поиска:",
-        ["TF-IDF (релевантность)", "Булев (AND/OR/NOT)"],
+        ["TF-IDF (релевантность)", "По строфам", "Булев (AND/OR/NOT)"],
         horizontal=True,
         key="search_mode_radio"
     )
@@ -348,6 +403,8 @@ def render_search_tab(app: SearchApp):
             with st.spinner("Поиск..."):
                 if "TF-IDF" in search_mode:
                     results = app.search_tfidf(query, top_k)
+                elif "строфам" in search_mode:
+                    results = app.search_stanzas(query, top_k)
                 else:
                     results = app.search_boolean(query, top_k)
             
@@ -767,7 +824,7 @@ def main():
         st.markdown("""
         **Возможности:**
         - TF-IDF ранжирование
-        - Булев поиск (AND, OR, NOT)
+        - Булев поиск (AND, OR, NOT, rhyme:слово, sound:слово)
         - LZW-сжатие документов
         - Porter Stemmer
         - Метрики качества (P, DCG, NDCG, ERR)
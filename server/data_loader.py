@@ -5,6 +5,7 @@ import json
 import os
 from typing import Iterator, Dict, Any, Optional
 from dataclasses import dataclass
+from bson import ObjectId
 from pymongo import MongoClient
 from pymongo.collection import Collection
 
@@ -124,11 +125,7 @@ class DataLoader:
             title = doc.get("title", "")
             
             if content:
-                cpp_doc_id = self.search_engine.add_document(content, title)
-                self.collection.update_one(
-                    {"_id": doc["_id"]},
-                    {"$set": {"cpp_doc_id": cpp_doc_id}}
-                )
+                self.search_engine.add_document(content, title, key=str(doc["_id"]))
                 total += 1
                 
                 if total % 1000 == 0:
@@ -138,8 +135,11 @@ class DataLoader:
         return total
     
     def get_mongo_doc_by_cpp_id(self, cpp_doc_id: int) -> Optional[Dict[str, Any]]:
-        """Получает документ из MongoDB по C++ ID."""
-        return self.collection.find_one({"cpp_doc_id": cpp_doc_id})
+        """Получает документ из MongoDB по C++ ID через внешний ключ (_id), хранящийся в индексе."""
+        key = self.search_engine.get_external_key(cpp_doc_id) if self.search_engine else ""
+        if not key:
+            return self.collection.find_one({"cpp_doc_id": cpp_doc_id})
+        return self.collection.find_one({"_id": ObjectId(key) if ObjectId.is_valid(key) else key})
     
     def close(self):
         """Закрывает соединение с MongoDB."""
@@ -0,0 +1,137 @@
+"""
+Статический прунинг индекса для реплик с малым объёмом памяти.
+
+Берёт запечатанный индекс (файл search_db_save или индексацию из MongoDB),
+выбрасывает постинги с пренебрежимым вкладом в top-K, сохраняет компактный образ
+и оценивает потерю качества: NDCG@k выдачи урезанного индекса по синтетическим
+запросам, размеченным выдачей полного индекса.
+
+Использование:
+    python prune_index.py --input full.idx --output pruned.idx --mode term --epsilon 0.5
+    python prune_index.py --from-mongo --output pruned.idx --mode document --doc-fraction 0.4
+"""
+import os
+import sys
+import json
+import argparse
+import tempfile
+from typing import Dict, List
+
+from search_bridge import SearchEngine, PRUNE_TERM_CENTRIC, PRUNE_DOCUMENT_CENTRIC
+from evaluation import SearchEvaluator, TestQuery, generate_k_values
+from metrics import dcg_at_k
+
+
+def judged_ndcg(engine: SearchEngine, queries: List[TestQuery], top_k: int) -> Dict[int, float]:
+    """
+    NDCG@k относительно разметки полного индекса.
+
+    Идеальная выдача строится по оценкам из разметки, а не по найденным документам,
+    поэтому релевантный документ, выпавший из выдачи после прунинга, снижает метрику.
+    """
+    k_values = generate_k_values(top_k)
+    totals = {k: 0.0 for k in k_values}
+    counted = 0
+    for test_query in queries:
+        ideal = sorted(test_query.doc_relevance.values(), reverse=True)
+        if not ideal or ideal[0] == 0:
+            continue
+        results = engine.search_tfidf(test_query.query, top_k=top_k)
+        relevance = [test_query.doc_relevance.get(r.doc_id, 0) for r in results]
+        for k in k_values:
+            idcg = dcg_at_k(ideal, k)
+            totals[k] += dcg_at_k(relevance, k) / idcg if idcg > 0 else 0.0
+        counted += 1
+    return {k: (total / counted if counted else 0.0) for k, total in totals.items()}
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Static index pruning with NDCG report")
+    parser.add_argument("--input", help="Образ полного индекса (search_db_save)")
+    parser.add_argument("--from-mongo", action="store_true",
+                        help="Построить полный индекс из MongoDB")
+    parser.add_argument("--mongo-uri", default=os.getenv("MONGO_URI", "mongodb://mongodb:27017"))
+    parser.add_argument("--limit", type=int, default=50000)
+    parser.add_argument("--output", required=True, help="Куда сохранить урезанный образ")
+    parser.add_argument("--lib-path", default=os.getenv("LIB_PATH"))
+    parser.add_argument("--mode", choices=["term", "document"], default="term")
+    parser.add_argument("--top-k", type=int, default=10,
+                        help="K, для которого сохраняется top-K (term-centric) и считается NDCG")
+    parser.add_argument("--epsilon", type=float, default=0.5,
+                        help="Доля K-го импакта терма, ниже которой постинг выбрасывается")
+    parser.add_argument("--doc-fraction", type=float, default=0.5,
+                        help="Доля самых весомых термов документа, которая остаётся")
+    parser.add_argument("--queries", type=int, default=100, help="Число синтетических запросов")
+    parser.add_argument("--format", choices=["text", "json"], default="text")
+    args = parser.parse_args()
+
+    if not args.input and not args.from_mongo:
+        parser.error("нужен --input или --from-mongo")
+
+    full = SearchEngine(lib_path=args.lib_path)
+    full_path = args.input
+    temp_path = None
+    if args.input:
+        if not full.load(args.input):
+            print(f"Не удалось загрузить {args.input}", file=sys.stderr)
+            sys.exit(1)
+    else:
+        from data_loader import DataLoader
+        loader = DataLoader(mongo_uri=args.mongo_uri)
+        loader.search_engine = full
+        try:
+            loader.index_from_mongo(limit=args.limit)
+        finally:
+            loader.close()
+        full.seal()
+        fd, temp_path = tempfile.mkstemp(suffix=".idx")
+        os.close(fd)
+        full.save(temp_path)
+        full_path = temp_path
+
+    try:
+        pruned = SearchEngine(lib_path=args.lib_path)
+        if not pruned.load(full_path):
+            print("Не удалось перечитать полный образ", file=sys.stderr)
+            sys.exit(1)
+    finally:
+        if temp_path:
+            os.remove(temp_path)
+
+    mode = PRUNE_TERM_CENTRIC if args.mode == "term" else PRUNE_DOCUMENT_CENTRIC
+    report = pruned.prune(mode, args.top_k, args.epsilon, args.doc_fraction)
+    if not pruned.save(args.output):
+        print(f"Не удалось сохранить {args.output}", file=sys.stderr)
+        sys.exit(1)
+
+    queries = SearchEvaluator(full).generate_synthetic_queries(args.queries, top_k=args.top_k)
+    ndcg_full = judged_ndcg(full, queries, args.top_k)
+    ndcg_pruned = judged_ndcg(pruned, queries, args.top_k)
+
+    summary = {
+        "mode": args.mode,
+        "file_bytes": os.path.getsize(args.output),
+        **report,
+        "queries": len(queries),
+        "ndcg_full": ndcg_full,
+        "ndcg_pruned": ndcg_pruned,
+        "ndcg_delta": {k: ndcg_pruned[k] - ndcg_full[k] for k in ndcg_full},
+    }
+
+    if args.format == "json":
+        print(json.dumps(summary, ensure_ascii=False, indent=2))
+        return
+
+    ratio = report["postings_after"] / report["postings_before"] if report["postings_before"] else 1.0
+    print(f"Режим: {args.mode}")
+    print(f"Постинги: {report['postings_before']} -> {report['postings_after']} ({ratio:.1%})")
+    print(f"Термы: {report['terms_before']} -> {report['terms_after']}")
+    print(f"Индекс, байт: {report['bytes_before']} -> {report['bytes_after']}")
+    print(f"Файл {args.output}: {summary['file_bytes']} байт")
+    print(f"Запросов: {len(queries)}")
+    for k in ndcg_full:
+        print(f"NDCG@{k}: {ndcg_full[k]:.4f} -> {ndcg_pruned[k]:.4f} ({summary['ndcg_delta'][k]:+.4f})")
+
+
+if __name__ == "__main__":
+    main()
@@ -3,8 +3,8 @@ Python обёртка над C++ поисковой системой через
 """
 import ctypes
 import os
-from dataclasses import dataclass
-from typing import List, Optional
+from dataclasses import dataclass, field
+from typing import Dict, List, Optional, Tuple
 
 
 @dataclass
@@ -13,6 +13,25 @@ class SearchResult:
     score: float
 
 
+@dataclass
+class FetchedResult:
+    doc_id: int
+    score: float
+    document: str
+    title: str
+    fields: Dict[str, str] = field(default_factory=dict)
+
+
+@dataclass
+class PassageResult:
+    doc_id: int
+    passage_id: int
+    score: float
+    first_line: int
+    line_count: int
+    snippet: str
+
+
 class SearchResultStruct(ctypes.Structure):
     _fields_ = [
         ("doc_id", ctypes.c_size_t),
@@ -34,6 +53,149 @@ class DocIdListStruct(ctypes.Structure):
     ]
 
 
+class DocumentListStruct(ctypes.Structure):
+    _fields_ = [
+        ("documents", ctypes.POINTER(ctypes.c_char_p)),
+        ("count", ctypes.c_size_t),
+    ]
+
+
+class FetchedResultStruct(ctypes.Structure):
+    _fields_ = [
+        ("doc_id", ctypes.c_size_t),
+        ("score", ctypes.c_double),
+        ("document", ctypes.c_char_p),
+        ("title", ctypes.c_char_p),
+        ("fields", ctypes.POINTER(ctypes.c_char_p)),
+        ("field_count", ctypes.c_size_t),
+    ]
+
+
+class FetchedResultListStruct(ctypes.Structure):
+    _fields_ = [
+        ("results", ctypes.POINTER(FetchedResultStruct)),
+        ("count", ctypes.c_size_t),
+    ]
+
+
+class PassageResultStruct(ctypes.Structure):
+    _fields_ = [
+        ("doc_id", ctypes.c_size_t),
+        ("passage_id", ctypes.c_size_t),
+        ("score", ctypes.c_double),
+        ("first_line", ctypes.c_size_t),
+        ("line_count", ctypes.c_size_t),
+        ("snippet", ctypes.c_char_p),
+    ]
+
+
+class PassageResultListStruct(ctypes.Structure):
+    _fields_ = [
+        ("results", ctypes.POINTER(PassageResultStruct)),
+        ("count", ctypes.c_size_t),
+    ]
+
+
+class RhymeLineStruct(ctypes.Structure):
+    _fields_ = [
+        ("doc_id", ctypes.c_size_t),
+        ("line", ctypes.c_size_t),
+    ]
+
+
+class RhymeLineListStruct(ctypes.Structure):
+    _fields_ = [
+        ("lines", ctypes.POINTER(RhymeLineStruct)),
+        ("count", ctypes.c_size_t),
+    ]
+
+
+class SearchDBOptionsStruct(ctypes.Structure):
+    _fields_ = [
+        ("use_stemming", ctypes.c_int),
+        ("use_compression", ctypes.c_int),
+        ("duplicate_policy", ctypes.c_int),
+        ("collapse_duplicates", ctypes.c_int),
+        ("stopword_mode", ctypes.c_int),
+        ("phrase_bigrams", ctypes.c_int),
+        ("scorer", ctypes.c_int),
+        ("incremental_snapshots", ctypes.c_int),
+        ("stored_fields", ctypes.POINTER(ctypes.c_char_p)),
+        ("stored_field_count", ctypes.c_size_t),
+        ("passage_unit", ctypes.c_int),
+        ("rhyme_index", ctypes.c_int),
+        ("phonetic_index", ctypes.c_int),
+        ("disk_index_path", ctypes.c_char_p),
+        ("disk_build_bytes", ctypes.c_size_t),
+        ("disk_cache_bytes", ctypes.c_size_t),
+    ]
+
+
+class SearchDBPruneOptionsStruct(ctypes.Structure):
+    _fields_ = [
+        ("mode", ctypes.c_int),
+        ("top_k", ctypes.c_size_t),
+        ("epsilon", ctypes.c_double),
+        ("doc_fraction", ctypes.c_double),
+    ]
+
+
+class SearchDBPruneReportStruct(ctypes.Structure):
+    _fields_ = [
+        ("postings_before", ctypes.c_size_t),
+        ("postings_after", ctypes.c_size_t),
+        ("terms_before", ctypes.c_size_t),
+        ("terms_after", ctypes.c_size_t),
+        ("bytes_before", ctypes.c_size_t),
+        ("bytes_after", ctypes.c_size_t),
+    ]
+
+
+class SearchDBSnapshotProgressStruct(ctypes.Structure):
+    _fields_ = [
+        ("state", ctypes.c_int),
+        ("bytes_written", ctypes.c_size_t),
+        ("total_bytes", ctypes.c_size_t),
+    ]
+
+
+DUPLICATES_KEEP = 0
+DUPLICATES_FLAG = 1
+DUPLICATES_SKIP = 2
+
+STOPWORDS_KEEP = 0
+STOPWORDS_REMOVE = 1
+STOPWORDS_COMMON_GRAMS = 2
+
+PRUNE_TERM_CENTRIC = 0
+PRUNE_DOCUMENT_CENTRIC = 1
+
+SCORER_TFIDF = 0
+SCORER_BM25 = 1
+SCORER_IMPACT = 2
+
+INVALID_DOC_ID = ctypes.c_size_t(-1).value
+READ_ERROR = ctypes.c_size_t(-1).value
+
+PASSAGES_NONE = 0
+PASSAGES_LINE = 1
+PASSAGES_STANZA = 2
+
+WAL_SYNC_EVERY_COMMIT = 0
+WAL_SYNC_PERIODIC = 1
+WAL_SYNC_NONE = 2
+
+SNAPSHOT_IDLE = 0
+SNAPSHOT_RUNNING = 1
+SNAPSHOT_DONE = 2
+SNAPSHOT_FAILED = 3
+SNAPSHOT_CANCELLED = 4
+
+DOC_STORE_AUTO = 0
+DOC_STORE_IO_URING = 1
+DOC_STORE_THREAD_POOL = 2
+
+
 class SearchEngine:
     """Обёртка над C++ TSearchDatabase."""
 
@@ -42,16 +204,46 @@ class SearchEngine:
         lib_path: Optional[str] = None,
         use_stemming: bool = True,
         use_compression: bool = True,
+        duplicate_policy: int = DUPLICATES_KEEP,
+        collapse_duplicates: bool = False,
+        stopword_mode: int = STOPWORDS_KEEP,
+        phrase_bigrams: bool = False,
+        scorer: int = SCORER_TFIDF,
+        incremental_snapshots: bool = False,
+        stored_fields: Optional[List[str]] = None,
+        passage_unit: int = PASSAGES_NONE,
+        rhyme_index: bool = False,
+        phonetic_index: bool = False,
+        disk_index_path: Optional[str] = None,
+        disk_build_bytes: int = 0,
+        disk_cache_bytes: int = 0,
     ):
         if lib_path is None:
             lib_path = self._find_library()
 
         self._lib = ctypes.CDLL(lib_path)
         self._setup_functions()
-        self._handle = self._lib.search_db_create(
-            ctypes.c_int(1 if use_stemming else 0),
-            ctypes.c_int(1 if use_compression else 0),
+        options = SearchDBOptionsStruct(
+            1 if use_stemming else 0,
+            1 if use_compression else 0,
+            duplicate_policy,
+            1 if collapse_duplicates else 0,
+            stopword_mode,
+            1 if phrase_bigrams else 0,
+            scorer,
+            1 if incremental_snapshots else 0,
         )
+        stored_fields = stored_fields or []
+        field_array = (ctypes.c_char_p * len(stored_fields))(*[f.encode("utf-8") for f in stored_fields])
+        options.stored_fields = field_array
+        options.stored_field_count = len(stored_fields)
+        options.passage_unit = passage_unit
+        options.rhyme_index = 1 if rhyme_index else 0
+        options.phonetic_index = 1 if phonetic_index else 0
+        options.disk_index_path = disk_index_path.encode("utf-8") if disk_index_path else None
+        options.disk_build_bytes = disk_build_bytes
+        options.disk_cache_bytes = disk_cache_bytes
+        self._handle = self._lib.search_db_create_with_options(ctypes.byref(options))
 
     def _find_library(self) -> str:
         """Ищет скомпилированную библиотеку."""
@@ -86,6 +278,11 @@ class SearchEngine:
         self._lib.search_db_create.argtypes = [ctypes.c_int, ctypes.c_int]
         self._lib.search_db_create.restype = ctypes.c_void_p
 
+        self._lib.search_db_create_with_options.argtypes = [
+            ctypes.POINTER(SearchDBOptionsStruct)
+        ]
+        self._lib.search_db_create_with_options.restype = ctypes.c_void_p
+
         self._lib.search_db_destroy.argtypes = [ctypes.c_void_p]
         self._lib.search_db_destroy.restype = None
 
@@ -96,6 +293,40 @@ class SearchEngine:
         ]
         self._lib.search_db_add_document.restype = ctypes.c_size_t
 
+        self._lib.search_db_add_document_with_key.argtypes = [
+            ctypes.c_void_p,
+            ctypes.c_char_p,
+            ctypes.c_char_p,
+            ctypes.c_char_p,
+        ]
+        self._lib.search_db_add_document_with_key.restype = ctypes.c_size_t
+
+        self._lib.search_db_get_external_key.argtypes = [ctypes.c_void_p, ctypes.c_size_t]
+        self._lib.search_db_get_external_key.restype = ctypes.c_void_p
+
+        self._lib.search_db_find_by_key.argtypes = [
+            ctypes.c_void_p,
+            ctypes.c_char_p,
+            ctypes.POINTER(ctypes.c_size_t),
+        ]
+        self._lib.search_db_find_by_key.restype = ctypes.c_int
+
+        self._lib.search_db_get_field_count.argtypes = [ctypes.c_void_p]
+        self._lib.search_db_get_field_count.restype = ctypes.c_size_t
+
+        self._lib.search_db_get_field_name.argtypes = [ctypes.c_void_p, ctypes.c_size_t]
+        self._lib.search_db_get_field_name.restype = ctypes.c_void_p
+
+        self._lib.search_db_add_document_with_fields.argtypes = [
+            ctypes.c_void_p,
+            ctypes.c_char_p,
+            ctypes.c_char_p,
+            ctypes.c_char_p,
+            ctypes.POINTER(ctypes.c_char_p),
+            ctypes.c_size_t,
+        ]
+        self._lib.search_db_add_document_with_fields.restype = ctypes.c_size_t
+
         self._lib.search_db_get_document.argtypes = [ctypes.c_void_p, ctypes.c_size_t]
         self._lib.search_db_get_document.restype = ctypes.c_char_p
 
@@ -105,6 +336,110 @@ class SearchEngine:
         self._lib.search_db_get_document_count.argtypes = [ctypes.c_void_p]
         self._lib.search_db_get_document_count.restype = ctypes.c_size_t
 
+        self._lib.search_db_count_matches.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+        self._lib.search_db_count_matches.restype = ctypes.c_size_t
+
+        self._lib.search_db_seal.argtypes = [ctypes.c_void_p]
+        self._lib.search_db_seal.restype = ctypes.c_int
+
+        self._lib.search_db_get_duplicate_group.argtypes = [ctypes.c_void_p, ctypes.c_size_t]
+        self._lib.search_db_get_duplicate_group.restype = ctypes.c_size_t
+
+        self._lib.search_db_prune.argtypes = [
+            ctypes.c_void_p,
+            ctypes.POINTER(SearchDBPruneOptionsStruct),
+            ctypes.POINTER(SearchDBPruneReportStruct),
+        ]
+        self._lib.search_db_prune.restype = ctypes.c_int
+
+        self._lib.search_db_save.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+        self._lib.search_db_save.restype = ctypes.c_int
+
+        self._lib.search_db_load.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+        self._lib.search_db_load.restype = ctypes.c_int
+
+        self._lib.search_db_save_incremental.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+        self._lib.search_db_save_incremental.restype = ctypes.c_int
+
+        self._lib.search_db_load_incremental.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+        self._lib.search_db_load_incremental.restype = ctypes.c_int
+
+        self._lib.search_db_save_doc_store.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+        self._lib.search_db_save_doc_store.restype = ctypes.c_int
+
+        self._lib.search_db_open_doc_store.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_int]
+        self._lib.search_db_open_doc_store.restype = ctypes.c_int
+
+        self._lib.search_db_warmup.argtypes = [ctypes.c_void_p, ctypes.c_size_t]
+        self._lib.search_db_warmup.restype = ctypes.c_size_t
+
+        self._lib.search_db_add_documents.argtypes = [
+            ctypes.c_void_p,
+            ctypes.POINTER(ctypes.c_char_p),
+            ctypes.POINTER(ctypes.c_char_p),
+            ctypes.c_size_t,
+            ctypes.c_size_t,
+            ctypes.POINTER(ctypes.c_size_t),
+        ]
+        self._lib.search_db_add_documents.restype = ctypes.c_size_t
+
+        self._lib.search_db_add_documents_with_keys.argtypes = [
+            ctypes.c_void_p,
+            ctypes.POINTER(ctypes.c_char_p),
+            ctypes.POINTER(ctypes.c_char_p),
+            ctypes.POINTER(ctypes.c_char_p),
+            ctypes.c_size_t,
+            ctypes.c_size_t,
+            ctypes.POINTER(ctypes.c_size_t),
+        ]
+        self._lib.search_db_add_documents_with_keys.restype = ctypes.c_size_t
+
+        self._lib.search_db_add_documents_with_fields.argtypes = [
+            ctypes.c_void_p,
+            ctypes.POINTER(ctypes.c_char_p),
+            ctypes.POINTER(ctypes.c_char_p),
+            ctypes.POINTER(ctypes.c_char_p),
+            ctypes.POINTER(ctypes.c_char_p),
+            ctypes.c_size_t,
+            ctypes.c_size_t,
+            ctypes.c_size_t,
+            ctypes.POINTER(ctypes.c_size_t),
+        ]
+        self._lib.search_db_add_documents_with_fields.restype = ctypes.c_size_t
+
+        self._lib.search_db_delete_document.argtypes = [ctypes.c_void_p, ctypes.c_size_t]
+        self._lib.search_db_delete_document.restype = ctypes.c_int
+
+        self._lib.search_db_open_durable.argtypes = [
+            ctypes.c_void_p,
+            ctypes.c_char_p,
+            ctypes.c_char_p,
+            ctypes.c_int,
+        ]
+        self._lib.search_db_open_durable.restype = ctypes.c_int
+
+        self._lib.search_db_checkpoint.argtypes = [ctypes.c_void_p]
+        self._lib.search_db_checkpoint.restype = ctypes.c_int
+
+        self._lib.search_db_checkpoint_async.argtypes = [ctypes.c_void_p, ctypes.c_size_t]
+        self._lib.search_db_checkpoint_async.restype = ctypes.c_int
+
+        self._lib.search_db_snapshot_async.argtypes = [
+            ctypes.c_void_p,
+            ctypes.c_char_p,
+            ctypes.c_size_t,
+        ]
+        self._lib.search_db_snapshot_async.restype = ctypes.c_int
+
+        self._lib.search_db_snapshot_progress.argtypes = [
+            ctypes.c_void_p,
+            ctypes.POINTER(SearchDBSnapshotProgressStruct),
+        ]
+        self._lib.search_db_snapshot_progress.restype = None
+
+        self._lib.search_db_snapshot_wait.argtypes = [ctypes.c_void_p]
+        self._lib.search_db_snapshot_wait.restype = ctypes.c_int
+
         self._lib.search_db_search_tfidf.argtypes = [
             ctypes.c_void_p,
             ctypes.c_char_p,
@@ -123,6 +458,49 @@ class SearchEngine:
         self._lib.doc_id_list_free.argtypes = [ctypes.POINTER(DocIdListStruct)]
         self._lib.doc_id_list_free.restype = None
 
+        self._lib.search_db_get_documents.argtypes = [
+            ctypes.c_void_p,
+            ctypes.POINTER(ctypes.c_size_t),
+            ctypes.c_size_t,
+        ]
+        self._lib.search_db_get_documents.restype = ctypes.POINTER(DocumentListStruct)
+
+        self._lib.document_list_free.argtypes = [ctypes.POINTER(DocumentListStruct)]
+        self._lib.document_list_free.restype = None
+
+        self._lib.search_db_search_and_fetch.argtypes = [
+            ctypes.c_void_p,
+            ctypes.c_char_p,
+            ctypes.c_size_t,
+        ]
+        self._lib.search_db_search_and_fetch.restype = ctypes.POINTER(FetchedResultListStruct)
+
+        self._lib.search_db_fetch_documents.argtypes = [
+            ctypes.c_void_p,
+            ctypes.POINTER(ctypes.c_size_t),
+            ctypes.c_size_t,
+        ]
+        self._lib.search_db_fetch_documents.restype = ctypes.POINTER(FetchedResultListStruct)
+
+        self._lib.fetched_result_list_free.argtypes = [ctypes.POINTER(FetchedResultListStruct)]
+        self._lib.fetched_result_list_free.restype = None
+
+        self._lib.search_db_get_passage_count.argtypes = [ctypes.c_void_p]
+        self._lib.search_db_get_passage_count.restype = ctypes.c_size_t
+
+        for name in ("search_db_search_passages", "search_db_search_by_passage"):
+            getattr(self._lib, name).argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_size_t]
+            getattr(self._lib, name).restype = ctypes.POINTER(PassageResultListStruct)
+
+        self._lib.passage_result_list_free.argtypes = [ctypes.POINTER(PassageResultListStruct)]
+        self._lib.passage_result_list_free.restype = None
+
+        self._lib.search_db_find_rhyming_lines.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+        self._lib.search_db_find_rhyming_lines.restype = ctypes.POINTER(RhymeLineListStruct)
+
+        self._lib.rhyme_line_list_free.argtypes = [ctypes.POINTER(RhymeLineListStruct)]
+        self._lib.rhyme_line_list_free.restype = None
+
         self._lib.search_db_free_string.argtypes = [ctypes.c_char_p]
         self._lib.search_db_free_string.restype = None
 
@@ -130,13 +508,139 @@ class SearchEngine:
         if hasattr(self, "_handle") and self._handle:
             self._lib.search_db_destroy(self._handle)
 
-    def add_document(self, content: str, title: str = "") -> int:
-        """Добавить документ в индекс."""
-        return self._lib.search_db_add_document(
+    def add_document(
+        self,
+        content: str,
+        title: str = "",
+        key: Optional[str] = None,
+        fields: Optional[Dict[str, str]] = None,
+    ) -> int:
+        """Добавить документ в индекс; key — внешний ключ (например, ObjectId), fields — хранимые поля.
+
+        OSError — журнал долговечного режима не зафиксировал запись, документ не добавлен.
+        """
+        values = self._field_row(fields)
+        doc_id = self._lib.search_db_add_document_with_fields(
             self._handle,
             content.encode("utf-8"),
             title.encode("utf-8") if title else None,
+            key.encode("utf-8") if key else None,
+            (ctypes.c_char_p * len(values))(*values),
+            len(values),
         )
+        if doc_id == INVALID_DOC_ID:
+            raise OSError("write-ahead log commit failed")
+        return doc_id
+
+    def field_names(self) -> List[str]:
+        """Схема хранимых полей."""
+        names = []
+        for i in range(self._lib.search_db_get_field_count(self._handle)):
+            result = self._lib.search_db_get_field_name(self._handle, ctypes.c_size_t(i))
+            names.append(ctypes.string_at(result).decode("utf-8"))
+            self._lib.search_db_free_string(ctypes.cast(result, ctypes.c_char_p))
+        return names
+
+    def _field_row(self, fields: Optional[Dict[str, str]]) -> List[bytes]:
+        if not fields:
+            return []
+        return [str(fields.get(name, "") or "").encode("utf-8") for name in self.field_names()]
+
+    def add_documents(
+        self,
+        contents: List[str],
+        titles: Optional[List[str]] = None,
+        threads: int = 0,
+        keys: Optional[List[str]] = None,
+        fields: Optional[List[Dict[str, str]]] = None,
+    ) -> List[int]:
+        """Пакетно добавить документы (разбор текста параллельно). Возвращает их ID.
+
+        OSError — журнал долговечного режима не зафиксировал пакет, ничего не добавлено.
+        """
+        count = len(contents)
+        content_array = (ctypes.c_char_p * count)(*[c.encode("utf-8") for c in contents])
+        title_array = None
+        if titles is not None:
+            title_array = (ctypes.c_char_p * count)(*[t.encode("utf-8") for t in titles])
+        key_array = None
+        if keys is not None:
+            key_array = (ctypes.c_char_p * count)(*[k.encode("utf-8") for k in keys])
+        field_array = None
+        field_count = 0
+        if fields is not None:
+            names = self.field_names()
+            field_count = len(names)
+            flat = [str(row.get(name, "") or "").encode("utf-8") for row in fields for name in names]
+            field_array = (ctypes.c_char_p * len(flat))(*flat)
+        ids = (ctypes.c_size_t * count)()
+        added = self._lib.search_db_add_documents_with_fields(
+            self._handle, content_array, title_array, key_array, field_array, field_count, count, threads, ids
+        )
+        if count > 0 and added == 0:
+            raise OSError("write-ahead log commit failed")
+        return list(ids[:added])
+
+    def get_external_key(self, doc_id: int) -> str:
+        """Внешний ключ документа; пустая строка — ключа нет."""
+        result = self._lib.search_db_get_external_key(self._handle, ctypes.c_size_t(doc_id))
+        if result:
+            text = ctypes.string_at(result).decode("utf-8")
+            self._lib.search_db_free_string(ctypes.cast(result, ctypes.c_char_p))
+            return text
+        return ""
+
+    def find_by_key(self, key: str) -> Optional[int]:
+        """ID документа по внешнему ключу или None."""
+        doc_id = ctypes.c_size_t()
+        if self._lib.search_db_find_by_key(self._handle, key.encode("utf-8"), ctypes.byref(doc_id)):
+            return doc_id.value
+        return None
+
+    def delete_document(self, doc_id: int) -> bool:
+        """Удалить документ из выдачи."""
+        return self._lib.search_db_delete_document(self._handle, ctypes.c_size_t(doc_id)) != 0
+
+    def open_durable(
+        self, snapshot_path: str, wal_path: str, sync_policy: int = WAL_SYNC_EVERY_COMMIT
+    ) -> bool:
+        """Загрузить снимок, проиграть журнал и журналировать дальнейшие изменения."""
+        return (
+            self._lib.search_db_open_durable(
+                self._handle,
+                snapshot_path.encode("utf-8"),
+                wal_path.encode("utf-8"),
+                sync_policy,
+            )
+            != 0
+        )
+
+    def checkpoint(self) -> bool:
+        """Записать снимок и обнулить журнал."""
+        return self._lib.search_db_checkpoint(self._handle) != 0
+
+    def checkpoint_async(self, bytes_per_second: int = 0) -> bool:
+        """Начать фоновую запись снимка долговечного режима."""
+        return self._lib.search_db_checkpoint_async(self._handle, bytes_per_second) != 0
+
+    def snapshot_async(self, path: str, bytes_per_second: int = 0) -> bool:
+        """Начать фоновую запись образа базы в файл."""
+        return (
+            self._lib.search_db_snapshot_async(
+                self._handle, path.encode("utf-8"), bytes_per_second
+            )
+            != 0
+        )
+
+    def snapshot_progress(self) -> Dict[str, int]:
+        """Состояние фоновой записи снимка (state — одна из констант SNAPSHOT_*)."""
+        progress = SearchDBSnapshotProgressStruct()
+        self._lib.search_db_snapshot_progress(self._handle, ctypes.byref(progress))
+        return {name: getattr(progress, name) for name, _ in SearchDBSnapshotProgressStruct._fields_}
+
+    def snapshot_wait(self) -> bool:
+        """Дождаться фоновой записи снимка."""
+        return self._lib.search_db_snapshot_wait(self._handle) != 0
 
     def get_document(self, doc_id: int) -> str:
         """Получить содержимое документа по ID."""
@@ -147,6 +651,20 @@ class SearchEngine:
             return text
         return ""
 
+    def get_documents(self, doc_ids: List[int]) -> List[str]:
+        """Тексты нескольких документов одним пакетом чтений."""
+        ids = (ctypes.c_size_t * len(doc_ids))(*doc_ids)
+        result_list = self._lib.search_db_get_documents(self._handle, ids, ctypes.c_size_t(len(doc_ids)))
+
+        documents = []
+        if result_list and result_list.contents:
+            for i in range(result_list.contents.count):
+                raw = result_list.contents.documents[i]
+                documents.append(raw.decode("utf-8") if raw else "")
+            self._lib.document_list_free(result_list)
+
+        return documents
+
     def get_title(self, doc_id: int) -> str:
         """Получить заголовок документа по ID."""
         result = self._lib.search_db_get_title(self._handle, ctypes.c_size_t(doc_id))
@@ -160,13 +678,78 @@ class SearchEngine:
         """Получить количество документов в индексе."""
         return self._lib.search_db_get_document_count(self._handle)
 
+    def count_matches(self, query: str) -> int:
+        """Число документов, содержащих хотя бы один терм запроса.
+
+        OSError — в дисковом режиме не удалось прочитать постинги.
+        """
+        count = self._lib.search_db_count_matches(self._handle, query.encode("utf-8"))
+        if count == READ_ERROR:
+            raise OSError("disk index read failed")
+        return count
+
+    def seal(self) -> bool:
+        """Завершить загрузку: перенумеровать документы для компактности индекса.
+
+        Внешние ID, выданные add_document, остаются прежними. В дисковом режиме
+        (disk_index_path) строит файл индекса; False — его не удалось записать.
+        """
+        return bool(self._lib.search_db_seal(self._handle))
+
+    def get_duplicate_group(self, doc_id: int) -> int:
+        """ID группы почти-дубликатов (ID первого документа группы)."""
+        return self._lib.search_db_get_duplicate_group(self._handle, ctypes.c_size_t(doc_id))
+
+    def prune(
+        self,
+        mode: int = PRUNE_TERM_CENTRIC,
+        top_k: int = 10,
+        epsilon: float = 0.5,
+        doc_fraction: float = 0.5,
+    ) -> Dict[str, int]:
+        """Статический прунинг постингов. Возвращает размеры индекса до и после."""
+        options = SearchDBPruneOptionsStruct(mode, top_k, epsilon, doc_fraction)
+        report = SearchDBPruneReportStruct()
+        self._lib.search_db_prune(self._handle, ctypes.byref(options), ctypes.byref(report))
+        return {name: getattr(report, name) for name, _ in SearchDBPruneReportStruct._fields_}
+
+    def save(self, path: str) -> bool:
+        """Сохранить образ базы (индекс, тексты, заголовки) в файл."""
+        return self._lib.search_db_save(self._handle, path.encode("utf-8")) != 0
+
+    def load(self, path: str) -> bool:
+        """Загрузить образ базы из файла, созданного save()."""
+        return self._lib.search_db_load(self._handle, path.encode("utf-8")) != 0
+
+    def save_incremental(self, directory: str) -> bool:
+        """Записать в каталог только изменившиеся с прошлого снимка сегменты и манифест."""
+        return self._lib.search_db_save_incremental(self._handle, directory.encode("utf-8")) != 0
+
+    def load_incremental(self, directory: str) -> bool:
+        """Собрать базу из манифеста каталога, созданного save_incremental()."""
+        return self._lib.search_db_load_incremental(self._handle, directory.encode("utf-8")) != 0
+
+    def save_doc_store(self, path: str) -> bool:
+        """Вынести тексты документов в файловое хранилище."""
+        return self._lib.search_db_save_doc_store(self._handle, path.encode("utf-8")) != 0
+
+    def open_doc_store(self, path: str, backend: int = DOC_STORE_AUTO) -> bool:
+        """Перевести базу на файловое хранилище текстов, созданное save_doc_store()."""
+        return self._lib.search_db_open_doc_store(self._handle, path.encode("utf-8"), backend) != 0
+
+    def warmup(self, threads: int = 0) -> int:
+        """Прогреть память индекса (префолт страниц). Возвращает число прочитанных страниц."""
+        return self._lib.search_db_warmup(self._handle, ctypes.c_size_t(threads))
+
     def search_tfidf(self, query: str, top_k: int = 10) -> List[SearchResult]:
-        """TF-IDF поиск."""
+        """TF-IDF поиск. OSError — в дисковом режиме не удалось прочитать постинги."""
         result_list = self._lib.search_db_search_tfidf(
             self._handle,
             query.encode("utf-8"),
             ctypes.c_size_t(top_k),
         )
+        if not result_list:
+            raise OSError("disk index read failed")
 
         results = []
         if result_list and result_list.contents:
@@ -177,12 +760,99 @@ class SearchEngine:
 
         return results
 
+    def search_and_fetch(self, query: str, top_k: int = 10) -> List[FetchedResult]:
+        """Поиск вместе с текстами и заголовками найденных документов.
+
+        OSError — в дисковом режиме не удалось прочитать постинги.
+        """
+        result_list = self._lib.search_db_search_and_fetch(
+            self._handle,
+            query.encode("utf-8"),
+            ctypes.c_size_t(top_k),
+        )
+        if not result_list:
+            raise OSError("disk index read failed")
+
+        return self._take_fetched(result_list)
+
+    def fetch_documents(self, doc_ids: List[int]) -> List[FetchedResult]:
+        """Тексты, заголовки и хранимые поля документов без обращения к внешней БД."""
+        ids = (ctypes.c_size_t * len(doc_ids))(*doc_ids)
+        result_list = self._lib.search_db_fetch_documents(self._handle, ids, ctypes.c_size_t(len(doc_ids)))
+        return self._take_fetched(result_list)
+
+    def passage_count(self) -> int:
+        """Число проиндексированных фрагментов (строк или строф)."""
+        return self._lib.search_db_get_passage_count(self._handle)
+
+    def search_passages(self, query: str, top_k: int = 10) -> List[PassageResult]:
+        """Лучшие строки/строфы как самостоятельные результаты."""
+        result_list = self._lib.search_db_search_passages(self._handle, query.encode("utf-8"), ctypes.c_size_t(top_k))
+        return self._take_passages(result_list)
+
+    def search_by_passage(self, query: str, top_k: int = 10) -> List[PassageResult]:
+        """Документы по оценке лучшего фрагмента; snippet — текст этого фрагмента."""
+        result_list = self._lib.search_db_search_by_passage(self._handle, query.encode("utf-8"), ctypes.c_size_t(top_k))
+        return self._take_passages(result_list)
+
+    def _take_passages(self, result_list) -> List[PassageResult]:
+        results = []
+        if result_list and result_list.contents:
+            for i in range(result_list.contents.count):
+                r = result_list.contents.results[i]
+                results.append(PassageResult(
+                    doc_id=r.doc_id,
+                    passage_id=r.passage_id,
+                    score=r.score,
+                    first_line=r.first_line,
+                    line_count=r.line_count,
+                    snippet=r.snippet.decode("utf-8") if r.snippet else "",
+                ))
+            self._lib.passage_result_list_free(result_list)
+
+        return results
+
+    def find_rhyming_lines(self, word: str) -> List[Tuple[int, int]]:
+        """Пары (doc_id, номер строки с нуля) для строк, рифмующихся со словом."""
+        result_list = self._lib.search_db_find_rhyming_lines(self._handle, word.encode("utf-8"))
+        lines = []
+        if result_list and result_list.contents:
+            for i in range(result_list.contents.count):
+                r = result_list.contents.lines[i]
+                lines.append((r.doc_id, r.line))
+            self._lib.rhyme_line_list_free(result_list)
+
+        return lines
+
+    def _take_fetched(self, result_list) -> List[FetchedResult]:
+        results = []
+        if result_list and result_list.contents:
+            names = self.field_names()
+            for i in range(result_list.contents.count):
+                r = result_list.contents.results[i]
+                values = [r.fields[f].decode("utf-8") if r.fields[f] else "" for f in range(r.field_count)]
+                results.append(FetchedResult(
+                    doc_id=r.doc_id,
+                    score=r.score,
+                    document=r.document.decode("utf-8") if r.document else "",
+                    title=r.title.decode("utf-8") if r.title else "",
+                    fields=dict(zip(names, values)),
+                ))
+            self._lib.fetched_result_list_free(result_list)
+
+        return results
+
     def boolean_query(self, query: str) -> List[int]:
-        """Булев поиск (AND, OR, NOT, скобки)."""
+        """Булев поиск (AND, OR, NOT, скобки, фразы в кавычках, rhyme:слово, sound:слово).
+
+        OSError — в дисковом режиме не удалось прочитать постинги.
+        """
         result_list = self._lib.search_db_boolean_query(
             self._handle,
             query.encode("utf-8"),
         )
+        if not result_list:
+            raise OSError("disk index read failed")
 
         doc_ids = []
         if result_list and result_list.contents: